@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>  // For INFINITY
+#include <ctype.h>
 
 #ifndef LUA_TCDATA
 #define LUA_TCDATA 10 /* LuaJIT specific */
@@ -26,6 +27,12 @@ static inline int lua_absindex(lua_State *L, int idx) {
 #define LUA_OK 0
 #endif
 
+#if defined(LUA_VERSION_NUM) && LUA_VERSION_NUM >= 502
+#define clay_rawlen(L, i) lua_rawlen(L, i)
+#else
+#define clay_rawlen(L, i) lua_objlen(L, i)
+#endif
+
 
 // global arena pointer so we can free it later
 static void* g_ClayArenaMem = NULL;
@@ -106,11 +113,714 @@ static inline void clay_set_ptr_from_lua(lua_State *L, int value_index, void **f
     *field = clay_tag_from_ref(ref);
 }
 
+// Read an {r=, g=, b=, a=} table field into *out; leaves *out unchanged if the field is absent.
+static void clay_opt_color_field(lua_State *L, int tbl, const char *name, Clay_Color *out) {
+    lua_getfield(L, tbl, name);
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, "r"); out->r = (float)luaL_optnumber(L, -1, 0);   lua_pop(L, 1);
+        lua_getfield(L, -1, "g"); out->g = (float)luaL_optnumber(L, -1, 0);   lua_pop(L, 1);
+        lua_getfield(L, -1, "b"); out->b = (float)luaL_optnumber(L, -1, 0);   lua_pop(L, 1);
+        lua_getfield(L, -1, "a"); out->a = (float)luaL_optnumber(L, -1, 255); lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+static float clay_opt_number_field(lua_State *L, int tbl, const char *name, float def) {
+    lua_getfield(L, tbl, name);
+    float v = lua_isnumber(L, -1) ? (float)lua_tonumber(L, -1) : def;
+    lua_pop(L, 1);
+    return v;
+}
+
+// tbl.name = { [k] = {r, g, b [, a]}, ... } fills out[k] for 1 <= k < count; returns a bitmask of the entries set.
+static uint32_t clay_opt_palette_field(lua_State *L, int tbl, const char *name, Clay_Color *out, int count) {
+    uint32_t set = 0;
+    lua_getfield(L, tbl, name);
+    if (lua_istable(L, -1)) {
+        int t = lua_gettop(L);
+        for (int k = 1; k < count; ++k) {
+            lua_rawgeti(L, t, k);
+            if (lua_istable(L, -1)) {
+                int c = lua_gettop(L);
+                float ch[4];
+                for (int i = 0; i < 4; ++i) {
+                    lua_rawgeti(L, c, i + 1);
+                    ch[i] = (float)luaL_optnumber(L, -1, i == 3 ? 255 : 0);
+                    lua_pop(L, 1);
+                }
+                out[k] = (Clay_Color){ ch[0], ch[1], ch[2], ch[3] };
+                if (k < 32) set |= 1u << k;
+            }
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    return set;
+}
+
+// Clay's internal scroll state for a clip container, as of the last layout; NULL if unknown.
+// Unlike Clay_GetScrollContainerData this is safe to call while the next frame is being declared.
+static Clay__ScrollContainerDataInternal* clay_scroll_data_find(uint32_t id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx) return NULL;
+    for (int32_t i = 0; i < ctx->scrollContainerDatas.length; ++i) {
+        Clay__ScrollContainerDataInternal *d = Clay__ScrollContainerDataInternalArray_Get(&ctx->scrollContainerDatas, i);
+        if (d->elementId == id) return d;
+    }
+    return NULL;
+}
+
+// Frame counter, bumped by clay.beginLayout(). Used to age binding-side caches.
+static uint32_t g_FrameIndex = 0;
+
+// Binding clock in seconds: set by clay.beginLayout(now), or advanced by the dt passed to
+// clay.updateScrollContainers() when beginLayout gets no time. Drives animations.
+static double g_Now = 0;
+static double g_PendingDt = 0;
+// Non-zero while clay.measureSubtree() declares into its scratch context. Those
+// declarations must not register anything for the main frame's post-layout passes.
+static int g_MeasureDepth = 0;
+// Earliest clock time at which something declared this frame changes by itself (a caret
+// blink); INFINITY when nothing is scheduled. Reset by clay.beginLayout().
+static double g_NextWake = INFINITY;
+
+// FNV-1a over raw bytes; used to key caches on string contents.
+static inline uint32_t clay_hash_bytes(const char *data, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t clay_hash_u32(uint32_t h, uint32_t v) {
+    h ^= v + 0x9e3779b9u + (h << 6) + (h >> 2);
+    return h;
+}
+
+// ---- uint32 -> int32 open addressing map (key 0 is reserved as "empty"; Clay never hands out id 0) ----
+typedef struct {
+    uint32_t *keys;
+    int32_t *values;
+    int32_t capacity;   // power of two, 0 when unallocated
+    int32_t count;
+} ClayU32Map;
+
+static void clay_u32map_free(ClayU32Map *m) {
+    free(m->keys);
+    free(m->values);
+    *m = (ClayU32Map){0};
+}
+
+static void clay_u32map_clear(ClayU32Map *m) {
+    if (m->keys) memset(m->keys, 0, sizeof(uint32_t) * (size_t)m->capacity);
+    m->count = 0;
+}
+
+static int32_t clay_u32map_get(const ClayU32Map *m, uint32_t key) {
+    if (!m->capacity || key == 0) return -1;
+    uint32_t mask = (uint32_t)m->capacity - 1;
+    for (uint32_t i = (key * 2654435761u) & mask; ; i = (i + 1) & mask) {
+        if (m->keys[i] == key) return m->values[i];
+        if (m->keys[i] == 0) return -1;
+    }
+}
+
+static void clay_u32map_put(ClayU32Map *m, uint32_t key, int32_t value);
+
+static void clay_u32map_grow(ClayU32Map *m) {
+    ClayU32Map old = *m;
+    int32_t cap = old.capacity ? old.capacity * 2 : 64;
+    m->keys = (uint32_t*)calloc((size_t)cap, sizeof(uint32_t));
+    m->values = (int32_t*)malloc(sizeof(int32_t) * (size_t)cap);
+    m->capacity = cap;
+    m->count = 0;
+    for (int32_t i = 0; i < old.capacity; ++i) {
+        if (old.keys[i]) clay_u32map_put(m, old.keys[i], old.values[i]);
+    }
+    free(old.keys);
+    free(old.values);
+}
+
+static void clay_u32map_put(ClayU32Map *m, uint32_t key, int32_t value) {
+    if (key == 0) return;
+    if ((m->count + 1) * 4 >= m->capacity * 3) clay_u32map_grow(m);
+    uint32_t mask = (uint32_t)m->capacity - 1;
+    for (uint32_t i = (key * 2654435761u) & mask; ; i = (i + 1) & mask) {
+        if (m->keys[i] == key) { m->values[i] = value; return; }
+        if (m->keys[i] == 0) {
+            m->keys[i] = key;
+            m->values[i] = value;
+            m->count++;
+            return;
+        }
+    }
+}
+
+// ---- Growable arrays ----
+// Grow *array to hold `need` elements of `size` bytes; returns 0 when out of memory.
+static int clay_array_reserve(void **array, int32_t *capacity, int32_t need, size_t size) {
+    if (need <= *capacity) return 1;
+    int32_t cap = *capacity ? *capacity : 16;
+    while (cap < need) {
+        if (cap > INT32_MAX / 2) return 0;
+        cap *= 2;
+    }
+    void *grown = realloc(*array, size * (size_t)cap);
+    if (!grown) return 0;
+    *array = grown;
+    *capacity = cap;
+    return 1;
+}
+
+// ---- Frame anchors: userdata read back while this frame's commands are rendered ----
+// Kept reachable from a registry table until the next clay.beginLayout() starts a new one.
+static int g_FrameAnchorRef = LUA_NOREF;
+static int32_t g_FrameAnchorCount = 0;
+
+static void clay_frame_anchor(lua_State *L, int idx) {
+    idx = lua_absindex(L, idx);
+    if (g_FrameAnchorCount == 0) {
+        luaL_unref(L, LUA_REGISTRYINDEX, g_FrameAnchorRef);
+        lua_newtable(L);
+        g_FrameAnchorRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_FrameAnchorRef);
+    lua_pushvalue(L, idx);
+    lua_rawseti(L, -2, ++g_FrameAnchorCount);
+    lua_pop(L, 1);
+}
+
+// ---- Per-frame arena: binding-owned memory referenced by this frame's render commands ----
+// Reset by clay.beginLayout(); chunks are never moved, so pointers stay valid for the frame.
+typedef struct ClayFrameChunk {
+    struct ClayFrameChunk *next;
+    size_t used;
+    size_t capacity;
+    size_t reserved;    // pads the header so the data that follows it stays 16-byte aligned
+} ClayFrameChunk;
+
+#define CLAY_FRAME_CHUNK_DATA(c) ((char*)((c) + 1))
+
+static ClayFrameChunk *g_FrameChunks = NULL;
+
+static void* clay_frame_alloc(size_t size) {
+    size = (size + 15u) & ~(size_t)15u;
+    ClayFrameChunk *c = g_FrameChunks;
+    if (!c || c->capacity - c->used < size) {
+        size_t cap = size > 65536u ? size : 65536u;
+        ClayFrameChunk *nc = (ClayFrameChunk*)malloc(sizeof(ClayFrameChunk) + cap);
+        if (!nc) return NULL;
+        nc->next = c;
+        nc->used = 0;
+        nc->capacity = cap;
+        g_FrameChunks = c = nc;
+    }
+    void *p = CLAY_FRAME_CHUNK_DATA(c) + c->used;
+    c->used += size;
+    return p;
+}
+
+static Clay_String clay_frame_string(const char *chars, int32_t length) {
+    char *dst = (char*)clay_frame_alloc((size_t)length + 1);
+    if (!dst) return (Clay_String){0};
+    memcpy(dst, chars, (size_t)length);
+    dst[length] = '\0';
+    return (Clay_String){ .isStaticallyAllocated = false, .length = length, .chars = dst };
+}
+
+// Keep the most recent chunk (it is the largest after growth), free the rest.
+static void clay_frame_reset(void) {
+    g_FrameAnchorCount = 0;
+    ClayFrameChunk *c = g_FrameChunks;
+    if (!c) return;
+    ClayFrameChunk *rest = c->next;
+    while (rest) {
+        ClayFrameChunk *n = rest->next;
+        free(rest);
+        rest = n;
+    }
+    c->next = NULL;
+    c->used = 0;
+}
+
+// ---- UTF-8 ----
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLAY_LUA_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CLAY_LUA_NEON 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static inline int clay_ctz32(uint32_t v) { unsigned long i; _BitScanForward(&i, v); return (int)i; }
+#else
+static inline int clay_ctz32(uint32_t v) { return __builtin_ctz(v); }
+#endif
+
+// Decode one codepoint at *i and advance past it. Malformed input yields U+FFFD and advances one byte.
+static inline uint32_t clay_utf8_next(const char *s, int32_t len, int32_t *i) {
+    const uint8_t *p = (const uint8_t*)s + *i;
+    int32_t left = len - *i;
+    uint32_t c = p[0];
+    if (c < 0x80) { *i += 1; return c; }
+    if ((c & 0xE0) == 0xC0 && left >= 2 && (p[1] & 0xC0) == 0x80) {
+        *i += 2;
+        return ((c & 0x1F) << 6) | (p[1] & 0x3F);
+    }
+    if ((c & 0xF0) == 0xE0 && left >= 3 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+        *i += 3;
+        return ((c & 0x0F) << 12) | ((uint32_t)(p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+    }
+    if ((c & 0xF8) == 0xF0 && left >= 4 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+        *i += 4;
+        return ((c & 0x07) << 18) | ((uint32_t)(p[1] & 0x3F) << 12) | ((uint32_t)(p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+    }
+    *i += 1;
+    return 0xFFFD;
+}
+
+// Length of the leading run of ASCII bytes in [s, s+len), 16 bytes at a time where SIMD is available.
+static inline int32_t clay_ascii_run(const char *s, int32_t len) {
+    int32_t i = 0;
+#if defined(CLAY_LUA_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(const void*)(s + i)));
+        if (mask) return i + clay_ctz32((uint32_t)mask);
+    }
+#elif defined(CLAY_LUA_NEON)
+    for (; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(vld1q_u8((const uint8_t*)s + i)) >= 0x80) break;
+    }
+#endif
+    while (i < len && (uint8_t)s[i] < 0x80) i++;
+    return i;
+}
+
+// Step back to the start of the codepoint containing byte offset i.
+static inline int32_t clay_utf8_floor(const char *s, int32_t i) {
+    while (i > 0 && ((uint8_t)s[i] & 0xC0) == 0x80) i--;
+    return i;
+}
+
+// -----------------------------------------------------------------------------
+// Native font metrics
+//
+// clay.setFontMetrics(fontId, { size=, lineHeight=, default=, advances={[codepoint]=w} })
+// registers per-glyph advances captured at `size`. Text using a registered fontId is
+// measured in C (scaled to fontSize), without calling the Lua measure function.
+//
+// clay.setFontFallback(fontId, { fallbackId, ... }) gives a font an ordered fallback
+// chain: each codepoint is measured with the first font in the chain that has it.
+// -----------------------------------------------------------------------------
+
+#define CLAY_FONT_FALLBACK_MAX 8
+
+typedef struct {
+    int registered;
+    float size;             // pixel size the advances were captured at
+    float lineHeight;       // line height at `size`
+    float defaultAdvance;   // advance for codepoints without an entry
+    float ascii[128];
+    uint32_t *codepoints;   // sorted non-ASCII codepoints
+    float *advances;
+    int32_t extraCount;
+    uint32_t asciiCoverage[4];  // bit per ASCII codepoint that has an advance entry
+    uint32_t *ranges;           // sorted [first, last] pairs covered with defaultAdvance
+    int32_t rangeCount;
+    int coversAll;              // no advances/ranges given: the font claims every codepoint
+    int coversPrintableAscii;   // 0x20..0x7E all covered (fast path skips segmentation)
+    uint16_t fallback[CLAY_FONT_FALLBACK_MAX];
+    int32_t fallbackCount;
+} ClayFontMetrics;
+
+static ClayFontMetrics *g_FontMetrics = NULL;
+static int32_t g_FontMetricsCount = 0;
+
+static inline ClayFontMetrics* clay_font_metrics(uint16_t fontId) {
+    if (fontId >= g_FontMetricsCount) return NULL;
+    ClayFontMetrics *fm = &g_FontMetrics[fontId];
+    return fm->registered ? fm : NULL;
+}
+
+static inline int32_t clay_font_glyph_index(const ClayFontMetrics *fm, uint32_t cp) {
+    int32_t lo = 0, hi = fm->extraCount - 1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) >> 1;
+        uint32_t v = fm->codepoints[mid];
+        if (v == cp) return mid;
+        if (v < cp) lo = mid + 1; else hi = mid - 1;
+    }
+    return -1;
+}
+
+static inline float clay_font_advance(const ClayFontMetrics *fm, uint32_t cp) {
+    if (cp < 128) return fm->ascii[cp];
+    int32_t idx = clay_font_glyph_index(fm, cp);
+    return idx >= 0 ? fm->advances[idx] : fm->defaultAdvance;
+}
+
+static int clay_font_has(const ClayFontMetrics *fm, uint32_t cp) {
+    if (fm->coversAll) return 1;
+    if (cp < 128) return (int)((fm->asciiCoverage[cp >> 5] >> (cp & 31)) & 1u);
+    if (clay_font_glyph_index(fm, cp) >= 0) return 1;
+    int32_t lo = 0, hi = fm->rangeCount - 1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) >> 1;
+        if (cp < fm->ranges[mid * 2]) hi = mid - 1;
+        else if (cp > fm->ranges[mid * 2 + 1]) lo = mid + 1;
+        else return 1;
+    }
+    return 0;
+}
+
+// First font in fm's chain (fm itself, then its fallbacks) that has cp; fm when none does.
+static const ClayFontMetrics* clay_font_resolve(const ClayFontMetrics *fm, uint32_t cp) {
+    if (fm->fallbackCount == 0 || clay_font_has(fm, cp)) return fm;
+    for (int32_t k = 0; k < fm->fallbackCount; ++k) {
+        const ClayFontMetrics *f = clay_font_metrics(fm->fallback[k]);
+        if (f && clay_font_has(f, cp)) return f;
+    }
+    return fm;
+}
+
+// Advance of cp at fontSize, taken from whichever font in the chain renders it.
+static inline float clay_font_scaled_advance(const ClayFontMetrics *fm, uint32_t cp, float fontSize) {
+    const ClayFontMetrics *f = clay_font_resolve(fm, cp);
+    return clay_font_advance(f, cp) * (f->size > 0 ? fontSize / f->size : 1.0f);
+}
+
+// Sum of advances of [chars, chars+length) in a single font, scaled to fontSize.
+static float clay_font_run_width(const ClayFontMetrics *fm, const char *chars, int32_t length, float fontSize, int32_t *glyphs) {
+    float width = 0;
+    for (int32_t i = 0; i < length; ) {
+        int32_t run = clay_ascii_run(chars + i, length - i);
+        for (int32_t k = 0; k < run; ++k) width += fm->ascii[(uint8_t)chars[i + k]];
+        *glyphs += run;
+        i += run;
+        if (i < length) {
+            width += clay_font_advance(fm, clay_utf8_next(chars, length, &i));
+            (*glyphs)++;
+        }
+    }
+    return width * (fm->size > 0 ? fontSize / fm->size : 1.0f);
+}
+
+// ---- Font run segmentation cache ----
+// Strings are split into runs of one resolved font. Segmentations are cached per
+// (content hash, fontId) and dropped after they go unused for a while.
+
+#define CLAY_TEXT_RUNS_MAX_IDLE_FRAMES 120u
+
+typedef struct {
+    int32_t start;
+    int32_t length;
+    uint16_t fontId;
+} ClayTextRun;
+
+typedef struct {
+    uint32_t key;
+    uint32_t lastFrame;
+    int32_t textLength;
+    uint16_t fontId;
+    char *text;         // copy of the segmented string, compared on lookup
+    ClayTextRun *runs;
+    int32_t runCount;
+} ClayTextRunsEntry;
+
+static ClayTextRunsEntry *g_TextRuns = NULL;
+static int32_t g_TextRunsCount = 0;
+static int32_t g_TextRunsCapacity = 0;
+static ClayU32Map g_TextRunsIndex = {0};
+
+static void clay_text_runs_clear(void) {
+    for (int32_t i = 0; i < g_TextRunsCount; ++i) {
+        free(g_TextRuns[i].text);
+        free(g_TextRuns[i].runs);
+    }
+    free(g_TextRuns);
+    g_TextRuns = NULL;
+    g_TextRunsCount = g_TextRunsCapacity = 0;
+    clay_u32map_free(&g_TextRunsIndex);
+}
+
+static void clay_text_runs_sweep(void) {
+    int32_t kept = 0;
+    for (int32_t i = 0; i < g_TextRunsCount; ++i) {
+        ClayTextRunsEntry *e = &g_TextRuns[i];
+        if (g_FrameIndex - e->lastFrame > CLAY_TEXT_RUNS_MAX_IDLE_FRAMES) {
+            free(e->text);
+            free(e->runs);
+            continue;
+        }
+        if (kept != i) g_TextRuns[kept] = *e;
+        kept++;
+    }
+    if (kept == g_TextRunsCount) return;
+    g_TextRunsCount = kept;
+    clay_u32map_clear(&g_TextRunsIndex);
+    for (int32_t i = 0; i < g_TextRunsCount; ++i) clay_u32map_put(&g_TextRunsIndex, g_TextRuns[i].key, i);
+}
+
+static int clay_text_runs_build(ClayTextRunsEntry *e, const ClayFontMetrics *fm, const char *chars, int32_t length) {
+    int32_t cap = 0;
+    e->runCount = 0;
+    for (int32_t i = 0; i < length; ) {
+        int32_t start = i;
+        const ClayFontMetrics *f = clay_font_resolve(fm, clay_utf8_next(chars, length, &i));
+        uint16_t fontId = (uint16_t)(f - g_FontMetrics);
+        if (e->runCount > 0 && e->runs[e->runCount - 1].fontId == fontId) {
+            e->runs[e->runCount - 1].length = i - e->runs[e->runCount - 1].start;
+            continue;
+        }
+        if (e->runCount == cap) {
+            cap = cap ? cap * 2 : 4;
+            ClayTextRun *grown = (ClayTextRun*)realloc(e->runs, sizeof(ClayTextRun) * (size_t)cap);
+            if (!grown) return 0;
+            e->runs = grown;
+        }
+        e->runs[e->runCount++] = (ClayTextRun){ start, i - start, fontId };
+    }
+    return 1;
+}
+
+// Cached runs for a string in fontId (which must have registered metrics), or NULL on OOM.
+static ClayTextRunsEntry* clay_text_runs(uint16_t fontId, const char *chars, int32_t length) {
+    uint32_t key = clay_hash_u32(clay_hash_bytes(chars, (size_t)length, 0), fontId);
+    if (key == 0) key = 1;
+    int32_t idx = clay_u32map_get(&g_TextRunsIndex, key);
+    if (idx >= 0 && g_TextRuns[idx].textLength == length && g_TextRuns[idx].fontId == fontId &&
+        (length == 0 || memcmp(g_TextRuns[idx].text, chars, (size_t)length) == 0)) {
+        g_TextRuns[idx].lastFrame = g_FrameIndex;
+        return &g_TextRuns[idx];
+    }
+
+    ClayTextRunsEntry *e;
+    if (idx >= 0) {
+        e = &g_TextRuns[idx];       // hash collision: rebuild in place
+    } else {
+        if (g_TextRunsCount == g_TextRunsCapacity) {
+            int32_t cap = g_TextRunsCapacity ? g_TextRunsCapacity * 2 : 64;
+            ClayTextRunsEntry *grown = (ClayTextRunsEntry*)realloc(g_TextRuns, sizeof(ClayTextRunsEntry) * (size_t)cap);
+            if (!grown) return NULL;
+            g_TextRuns = grown;
+            g_TextRunsCapacity = cap;
+        }
+        e = &g_TextRuns[g_TextRunsCount];
+        *e = (ClayTextRunsEntry){0};
+        clay_u32map_put(&g_TextRunsIndex, key, g_TextRunsCount);
+        g_TextRunsCount++;
+    }
+    char *copy = (char*)realloc(e->text, (size_t)length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, chars, (size_t)length);
+    e->text = copy;
+    e->key = key;
+    e->textLength = length;
+    e->fontId = fontId;
+    e->lastFrame = g_FrameIndex;
+    if (!clay_text_runs_build(e, &g_FontMetrics[fontId], chars, length)) { e->textLength = -1; return NULL; }
+    return e;
+}
+
+static Clay_Dimensions clay_native_measure(const ClayFontMetrics *fm, const char *chars, int32_t length, const Clay_TextElementConfig *cfg) {
+    float fontSize = (float)cfg->fontSize;
+    float scale = fm->size > 0 ? fontSize / fm->size : 1.0f;
+    float width = 0;
+    int32_t glyphs = 0;
+    ClayTextRunsEntry *runs = NULL;
+    if (fm->fallbackCount > 0 && !(fm->coversPrintableAscii && clay_ascii_run(chars, length) == length)) {
+        runs = clay_text_runs(cfg->fontId, chars, length);
+    }
+    if (runs) {
+        for (int32_t r = 0; r < runs->runCount; ++r) {
+            const ClayTextRun *run = &runs->runs[r];
+            width += clay_font_run_width(&g_FontMetrics[run->fontId], chars + run->start, run->length, fontSize, &glyphs);
+        }
+    } else {
+        width = clay_font_run_width(fm, chars, length, fontSize, &glyphs);
+    }
+    if (glyphs > 1) width += (float)cfg->letterSpacing * (float)(glyphs - 1);
+    return (Clay_Dimensions){ width, (fm->lineHeight > 0 ? fm->lineHeight : fm->size) * scale };
+}
+
+// Drops the glyph data; the fallback chain belongs to the fontId and is kept.
+static void clay_font_metrics_free(ClayFontMetrics *fm) {
+    free(fm->codepoints);
+    free(fm->advances);
+    free(fm->ranges);
+    ClayFontMetrics cleared = {0};
+    memcpy(cleared.fallback, fm->fallback, sizeof(fm->fallback));
+    cleared.fallbackCount = fm->fallbackCount;
+    *fm = cleared;
+}
+
+static int clay_font_metrics_grow(int fontId) {
+    if (fontId < g_FontMetricsCount) return 1;
+    int32_t count = fontId + 1;
+    ClayFontMetrics *grown = (ClayFontMetrics*)realloc(g_FontMetrics, sizeof(ClayFontMetrics) * (size_t)count);
+    if (!grown) return 0;
+    memset(grown + g_FontMetricsCount, 0, sizeof(ClayFontMetrics) * (size_t)(count - g_FontMetricsCount));
+    g_FontMetrics = grown;
+    g_FontMetricsCount = count;
+    return 1;
+}
+
+static int clay_cmp_u32_pairs(const void *a, const void *b) {
+    uint32_t x = ((const uint32_t*)a)[0], y = ((const uint32_t*)b)[0];
+    return x < y ? -1 : x > y;
+}
+
+static void clay_paragraph_cache_clear(void);
+static void clay_markdown_relayout(void);
+
+static int l_Clay_SetFontMetrics(lua_State *L) {
+    int fontId = (int)luaL_checkinteger(L, 1);
+    luaL_argcheck(L, fontId >= 0 && fontId <= UINT16_MAX, 1, "fontId out of range");
+
+    if (!clay_font_metrics_grow(fontId)) return luaL_error(L, "setFontMetrics: out of memory");
+    ClayFontMetrics *fm = &g_FontMetrics[fontId];
+    clay_font_metrics_free(fm);
+
+    if (!lua_isnil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "size");       fm->size = (float)luaL_checknumber(L, -1);              lua_pop(L, 1);
+        lua_getfield(L, 2, "lineHeight"); fm->lineHeight = (float)luaL_optnumber(L, -1, 0.0);    lua_pop(L, 1);
+        lua_getfield(L, 2, "default");    fm->defaultAdvance = (float)luaL_optnumber(L, -1, fm->size * 0.5); lua_pop(L, 1);
+        for (int c = 0; c < 128; ++c) fm->ascii[c] = fm->defaultAdvance;
+
+        // Collect non-ASCII entries as (codepoint, float bits) pairs, then sort for binary search.
+        int32_t cap = 0, n = 0;
+        uint32_t *pairs = NULL;
+        lua_getfield(L, 2, "advances");
+        if (lua_istable(L, -1)) {
+            lua_pushnil(L);
+            while (lua_next(L, -2)) {
+                if (lua_type(L, -2) == LUA_TNUMBER && lua_isnumber(L, -1)) {
+                    lua_Integer cp = lua_tointeger(L, -2);
+                    float adv = (float)lua_tonumber(L, -1);
+                    if (cp >= 0 && cp < 128) {
+                        fm->ascii[cp] = adv;
+                        fm->asciiCoverage[cp >> 5] |= 1u << (cp & 31);
+                    } else if (cp >= 128 && cp <= 0x10FFFF) {
+                        if (n == cap) {
+                            cap = cap ? cap * 2 : 256;
+                            uint32_t *grown = (uint32_t*)realloc(pairs, sizeof(uint32_t) * 2 * (size_t)cap);
+                            if (!grown) { free(pairs); return luaL_error(L, "setFontMetrics: out of memory"); }
+                            pairs = grown;
+                        }
+                        pairs[n * 2] = (uint32_t)cp;
+                        memcpy(&pairs[n * 2 + 1], &adv, sizeof(float));
+                        n++;
+                    }
+                }
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+
+        if (n > 0) {
+            qsort(pairs, (size_t)n, sizeof(uint32_t) * 2, clay_cmp_u32_pairs);
+            fm->codepoints = (uint32_t*)malloc(sizeof(uint32_t) * (size_t)n);
+            fm->advances = (float*)malloc(sizeof(float) * (size_t)n);
+            if (!fm->codepoints || !fm->advances) {
+                free(pairs);
+                clay_font_metrics_free(fm);
+                return luaL_error(L, "setFontMetrics: out of memory");
+            }
+            for (int32_t k = 0; k < n; ++k) {
+                fm->codepoints[k] = pairs[k * 2];
+                memcpy(&fm->advances[k], &pairs[k * 2 + 1], sizeof(float));
+            }
+            fm->extraCount = n;
+        }
+        free(pairs);
+
+        // ranges = { {first, last}, ... }: codepoints the font has at its default advance.
+        lua_getfield(L, 2, "ranges");
+        if (lua_istable(L, -1)) {
+            int32_t count = (int32_t)clay_rawlen(L, -1);
+            if (count > 0) {
+                fm->ranges = (uint32_t*)malloc(sizeof(uint32_t) * 2 * (size_t)count);
+                if (!fm->ranges) { clay_font_metrics_free(fm); return luaL_error(L, "setFontMetrics: out of memory"); }
+                for (int32_t k = 0; k < count; ++k) {
+                    lua_rawgeti(L, -1, k + 1);
+                    luaL_argcheck(L, lua_istable(L, -1), 2, "ranges entries must be {first, last}");
+                    lua_rawgeti(L, -1, 1);
+                    lua_rawgeti(L, -2, 2);
+                    uint32_t first = (uint32_t)luaL_checkinteger(L, -2);
+                    uint32_t last = (uint32_t)luaL_optinteger(L, -1, (lua_Integer)first);
+                    lua_pop(L, 3);
+                    fm->ranges[k * 2] = first < last ? first : last;
+                    fm->ranges[k * 2 + 1] = first < last ? last : first;
+                    for (uint32_t c = fm->ranges[k * 2]; c < 128 && c <= fm->ranges[k * 2 + 1]; ++c) {
+                        fm->asciiCoverage[c >> 5] |= 1u << (c & 31);
+                    }
+                }
+                qsort(fm->ranges, (size_t)count, sizeof(uint32_t) * 2, clay_cmp_u32_pairs);
+                fm->rangeCount = count;
+            }
+        }
+        lua_pop(L, 1);
+
+        fm->coversAll = fm->rangeCount == 0 && fm->extraCount == 0 &&
+                        !(fm->asciiCoverage[0] | fm->asciiCoverage[1] | fm->asciiCoverage[2] | fm->asciiCoverage[3]);
+        fm->coversPrintableAscii = 1;
+        for (uint32_t c = 0x20; c < 0x7F; ++c) {
+            if (!clay_font_has(fm, c)) { fm->coversPrintableAscii = 0; break; }
+        }
+        fm->registered = 1;
+    }
+
+    // Cached measurements for this font are stale now. Call outside of a layout pass.
+    if (Clay_GetCurrentContext()) Clay_ResetMeasureTextCache();
+    clay_paragraph_cache_clear();
+    clay_text_runs_clear();
+    clay_markdown_relayout();
+    return 0;
+}
+
+// clay.setFontFallback(fontId, { fallbackId, ... } | nil)
+static int l_Clay_SetFontFallback(lua_State *L) {
+    int fontId = (int)luaL_checkinteger(L, 1);
+    luaL_argcheck(L, fontId >= 0 && fontId <= UINT16_MAX, 1, "fontId out of range");
+    if (!clay_font_metrics_grow(fontId)) return luaL_error(L, "setFontFallback: out of memory");
+
+    ClayFontMetrics *fm = &g_FontMetrics[fontId];
+    fm->fallbackCount = 0;
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        int32_t count = (int32_t)clay_rawlen(L, 2);
+        luaL_argcheck(L, count <= CLAY_FONT_FALLBACK_MAX, 2, "too many fallback fonts");
+        for (int32_t k = 0; k < count; ++k) {
+            lua_rawgeti(L, 2, k + 1);
+            lua_Integer id = luaL_checkinteger(L, -1);
+            lua_pop(L, 1);
+            luaL_argcheck(L, id >= 0 && id <= UINT16_MAX && id != fontId, 2, "invalid fallback fontId");
+            fm->fallback[fm->fallbackCount++] = (uint16_t)id;
+        }
+    }
+
+    if (Clay_GetCurrentContext()) Clay_ResetMeasureTextCache();
+    clay_paragraph_cache_clear();
+    clay_text_runs_clear();
+    clay_markdown_relayout();
+    return 0;
+}
+
 // ---- Measure bridge (safe, no baseChars arithmetic, no Clay calls inside) ----
 static lua_State *g_LuaState = NULL;
 static int g_MeasureTextRef = LUA_NOREF;
 
 static Clay_Dimensions Bridge_MeasureTextFunction(Clay_StringSlice s, Clay_TextElementConfig* cfg, void* userdata) {
+    ClayFontMetrics *fm = cfg ? clay_font_metrics(cfg->fontId) : NULL;
+    if (fm) {
+        return clay_native_measure(fm, s.chars, s.length, cfg);
+    }
+
     if (g_MeasureTextRef == LUA_NOREF) {
         // Clay_TextElementConfig contains members such as fontId, fontSize, letterSpacing etc
         // Note: Clay_String->chars is not guaranteed to be null terminated
@@ -194,106 +904,737 @@ static int l_Clay_SetMeasureTextFunction(lua_State *L) {
 
     Clay_SetMeasureTextFunction(Bridge_MeasureTextFunction, NULL);
 
+    // Cached wrapping was measured with the previous function.
+    clay_paragraph_cache_clear();
+    clay_markdown_relayout();
+
     return 0;
 }
 
-static void readSizingAxisFromLua(lua_State *L, int index, Clay_SizingAxis *out) {
-    lua_getfield(L, index, "type");
-    out->type = (Clay__SizingType)luaL_checkinteger(L, -1);
-    lua_pop(L, 1);
+// -----------------------------------------------------------------------------
+// Paragraph layout cache
+//
+// Text emitted through :paragraph(id) is wrapped here, once, against the width
+// the paragraph element had in the previous frame. The resulting lines are joined
+// with '\n' and kept per element id, then re-emitted as one text element until the
+// content, the style or the available width changes. Every line fits the element,
+// so Clay only splits at the newlines: unchanged paragraphs skip both the measure
+// callback and Clay's word wrapping, and cost one element however many lines they have.
+// -----------------------------------------------------------------------------
 
-    switch (out->type) {
-        case CLAY__SIZING_TYPE_FIXED:
-        case CLAY__SIZING_TYPE_FIT:
-        case CLAY__SIZING_TYPE_GROW: {
-            lua_getfield(L, index, "minMax");
-            if (lua_istable(L, -1)) {
-                lua_getfield(L, -1, "min");
-                out->size.minMax.min = (float)luaL_optnumber(L, -1, 0.0);
-                lua_pop(L, 1);
-                lua_getfield(L, -1, "max");
-                out->size.minMax.max = (float)luaL_optnumber(L, -1, INFINITY);
-                lua_pop(L, 1);
-            } else {
-                out->size.minMax.min = 0.0f;
-                out->size.minMax.max = INFINITY;
-            }
-            lua_pop(L, 1);
-            break;
-        }
+#define CLAY_PARAGRAPH_MAX_IDLE_FRAMES 120u
 
-        case CLAY__SIZING_TYPE_PERCENT: {
-            lua_getfield(L, index, "percent");
-            out->size.percent = (float)luaL_optnumber(L, -1, 100.0);
-            lua_pop(L, 1);
-            break;
-        }
+typedef struct {
+    int32_t start;      // byte offset into entry->text
+    int32_t length;
+} ClayParagraphLine;
 
+typedef struct {
+    uint32_t id;
+    uint32_t contentHash;
+    uint32_t styleHash;
+    float width;        // width the lines were wrapped for, <= 0 when not wrapped yet
+    uint32_t lastFrame;
+    char *text;
+    int32_t textLength;
+    ClayParagraphLine *lines;
+    int32_t lineCount;
+    int32_t lineCapacity;
+    char *joined;       // the lines separated by '\n', as emitted
+    int32_t joinedLength;
+    int32_t joinedCapacity;
+} ClayParagraphEntry;
+
+static ClayParagraphEntry *g_Paragraphs = NULL;
+static int32_t g_ParagraphCount = 0;
+static int32_t g_ParagraphCapacity = 0;
+static ClayU32Map g_ParagraphIndex = {0};
+// Text command ids of the second and later lines of paragraphs whose userData is a
+// registry ref; the ref is cleared from them after layout. Reset by beginLayout.
+static ClayU32Map g_ParagraphRefLines = {0};
+
+static void clay_paragraph_entry_free(ClayParagraphEntry *e) {
+    free(e->text);
+    free(e->lines);
+    free(e->joined);
+    *e = (ClayParagraphEntry){0};
+}
+
+static int g_ParagraphClearPending = 0;
+
+static void clay_paragraph_cache_free(void) {
+    for (int32_t i = 0; i < g_ParagraphCount; ++i) clay_paragraph_entry_free(&g_Paragraphs[i]);
+    g_ParagraphCount = 0;
+    g_ParagraphClearPending = 0;
+    clay_u32map_clear(&g_ParagraphIndex);
+    clay_u32map_clear(&g_ParagraphRefLines);
+}
+
+// Text commands of the current frame still point into the cached strings, so the entries
+// are only freed by the next beginLayout. Until then they are re-wrapped if emitted again.
+static void clay_paragraph_cache_clear(void) {
+    for (int32_t i = 0; i < g_ParagraphCount; ++i) g_Paragraphs[i].width = 0.0f;
+    g_ParagraphClearPending = 1;
+}
+
+// Drop entries whose paragraph has not been declared for a while (called from beginLayout).
+static void clay_paragraph_cache_sweep(void) {
+    if (g_ParagraphClearPending) { clay_paragraph_cache_free(); return; }
+    clay_u32map_clear(&g_ParagraphRefLines);
+    int32_t kept = 0;
+    for (int32_t i = 0; i < g_ParagraphCount; ++i) {
+        ClayParagraphEntry *e = &g_Paragraphs[i];
+        if (g_FrameIndex - e->lastFrame > CLAY_PARAGRAPH_MAX_IDLE_FRAMES) {
+            clay_paragraph_entry_free(e);
+            continue;
+        }
+        if (kept != i) g_Paragraphs[kept] = *e;
+        kept++;
+    }
+    if (kept == g_ParagraphCount) return;
+    g_ParagraphCount = kept;
+    clay_u32map_clear(&g_ParagraphIndex);
+    for (int32_t i = 0; i < g_ParagraphCount; ++i) clay_u32map_put(&g_ParagraphIndex, g_Paragraphs[i].id, i);
+}
+
+static ClayParagraphEntry* clay_paragraph_get(uint32_t id) {
+    int32_t idx = clay_u32map_get(&g_ParagraphIndex, id);
+    if (idx >= 0) return &g_Paragraphs[idx];
+
+    if (g_ParagraphCount == g_ParagraphCapacity) {
+        int32_t cap = g_ParagraphCapacity ? g_ParagraphCapacity * 2 : 32;
+        ClayParagraphEntry *grown = (ClayParagraphEntry*)realloc(g_Paragraphs, sizeof(ClayParagraphEntry) * (size_t)cap);
+        if (!grown) return NULL;
+        g_Paragraphs = grown;
+        g_ParagraphCapacity = cap;
+    }
+    ClayParagraphEntry *e = &g_Paragraphs[g_ParagraphCount];
+    *e = (ClayParagraphEntry){0};
+    e->id = id;
+    clay_u32map_put(&g_ParagraphIndex, id, g_ParagraphCount);
+    g_ParagraphCount++;
+    return e;
+}
+
+static uint32_t clay_text_style_hash(const Clay_TextElementConfig *cfg) {
+    uint32_t h = clay_hash_u32(0, cfg->fontId);
+    h = clay_hash_u32(h, cfg->fontSize);
+    h = clay_hash_u32(h, cfg->letterSpacing);
+    h = clay_hash_u32(h, cfg->lineHeight);
+    return clay_hash_u32(h, (uint32_t)cfg->wrapMode);
+}
+
+static void clay_paragraph_push_line(ClayParagraphEntry *e, int32_t start, int32_t length) {
+    if (e->lineCount == e->lineCapacity) {
+        int32_t cap = e->lineCapacity ? e->lineCapacity * 2 : 8;
+        ClayParagraphLine *grown = (ClayParagraphLine*)realloc(e->lines, sizeof(ClayParagraphLine) * (size_t)cap);
+        if (!grown) return;
+        e->lines = grown;
+        e->lineCapacity = cap;
+    }
+    e->lines[e->lineCount++] = (ClayParagraphLine){ start, length };
+}
+
+static float clay_measure_slice(const char *chars, int32_t length, Clay_TextElementConfig *cfg) {
+    Clay_StringSlice s = { .length = length, .chars = chars, .baseChars = chars };
+    return Bridge_MeasureTextFunction(s, cfg, NULL).width;
+}
+
+// Height of one unwrapped row of text in this style.
+static float clay_text_row_height(Clay_TextElementConfig *cfg) {
+    if (cfg->lineHeight > 0) return (float)cfg->lineHeight;
+    ClayFontMetrics *fm = clay_font_metrics(cfg->fontId);
+    if (fm) return clay_native_measure(fm, " ", 1, cfg).height;
+    Clay_Dimensions d = Bridge_MeasureTextFunction((Clay_StringSlice){ .length = 1, .chars = " ", .baseChars = " " }, cfg, NULL);
+    return d.height > 0 ? d.height : (float)cfg->fontSize;
+}
+
+// Line break classes for the native wrapper (a small subset of UAX #14).
+enum {
+    CLAY_BREAK_IDEOGRAPHIC = 1,     // CJK: break allowed before and after
+    CLAY_BREAK_CLOSE = 2,           // closing punctuation / small kana: no break before
+    CLAY_BREAK_OPEN = 4,            // opening punctuation: no break after
+};
+
+static int clay_break_class(uint32_t cp) {
+    if (cp < 0x80) {
+        switch (cp) {
+            case '.': case ',': case ';': case ':': case '!': case '?': case ')': case ']': case '}': case '%':
+                return CLAY_BREAK_CLOSE;
+            case '(': case '[': case '{':
+                return CLAY_BREAK_OPEN;
+            default:
+                return 0;
+        }
+    }
+    switch (cp) {
+        case 0x3001: case 0x3002: case 0x3009: case 0x300B: case 0x300D: case 0x300F: case 0x3011:
+        case 0x3015: case 0x3017: case 0x3019: case 0x301F: case 0x30FC: case 0x3005: case 0x309D:
+        case 0x309E: case 0x30FD: case 0x30FE: case 0xFF01: case 0xFF09: case 0xFF0C: case 0xFF0E:
+        case 0xFF1A: case 0xFF1B: case 0xFF1F: case 0xFF3D: case 0xFF5D:
+        case 0x3041: case 0x3043: case 0x3045: case 0x3047: case 0x3049: case 0x3063: case 0x3083:
+        case 0x3085: case 0x3087: case 0x308E: case 0x30A1: case 0x30A3: case 0x30A5: case 0x30A7:
+        case 0x30A9: case 0x30C3: case 0x30E3: case 0x30E5: case 0x30E7: case 0x30EE: case 0x30F5:
+        case 0x30F6:
+            return CLAY_BREAK_IDEOGRAPHIC | CLAY_BREAK_CLOSE;
+        case 0x3008: case 0x300A: case 0x300C: case 0x300E: case 0x3010: case 0x3014: case 0x3016:
+        case 0x3018: case 0x301D: case 0xFF08: case 0xFF3B: case 0xFF5B:
+            return CLAY_BREAK_IDEOGRAPHIC | CLAY_BREAK_OPEN;
         default:
             break;
     }
+    if ((cp >= 0x2E80 && cp <= 0x9FFF) ||      // radicals, CJK punctuation, kana, ideographs
+        (cp >= 0xAC00 && cp <= 0xD7AF) ||      // Hangul syllables
+        (cp >= 0xF900 && cp <= 0xFAFF) ||      // compatibility ideographs
+        (cp >= 0xFF00 && cp <= 0xFF60) ||      // fullwidth forms
+        (cp >= 0x20000 && cp <= 0x3FFFF)) {    // supplementary ideographic planes
+        return CLAY_BREAK_IDEOGRAPHIC;
+    }
+    return 0;
 }
 
-static void clay_read_element_declaration(lua_State *L, int tbl_index, Clay_ElementDeclaration *decl) {
-    // make index stable
-    int i = lua_absindex(L, tbl_index);
+static inline int clay_can_break_between(int prevClass, int nextClass) {
+    if (nextClass & CLAY_BREAK_CLOSE) return 0;
+    if (prevClass & CLAY_BREAK_OPEN) return 0;
+    return ((prevClass | nextClass) & CLAY_BREAK_IDEOGRAPHIC) != 0;
+}
 
-    // initialize defaults
-    *decl = (Clay_ElementDeclaration){0};
-    decl->layout = CLAY_LAYOUT_DEFAULT;
+// Greedy wrap following Clay's CLAY_TEXT_WRAP_WORDS rules (break at spaces, force at '\n',
+// trailing spaces don't count, over-long units get a line of their own), plus break
+// opportunities between CJK ideographs. Each codepoint is decoded once; with native font
+// metrics its advance is accumulated during that same pass instead of measuring units.
+static void clay_paragraph_wrap(ClayParagraphEntry *e, Clay_TextElementConfig *cfg, float maxWidth) {
+    e->lineCount = 0;
+    const char *txt = e->text;
+    int32_t len = e->textLength;
 
-    // ---------------- layout ----------------
-    lua_getfield(L, i, "layout");
-    if (lua_istable(L, -1)) {
-        // layoutDirection
-        lua_getfield(L, -1, "layoutDirection");
-        if (lua_isnumber(L, -1)) decl->layout.layoutDirection = (int)lua_tointeger(L, -1);
-        lua_pop(L, 1);
+    if (cfg->wrapMode == CLAY_TEXT_WRAP_NONE) {
+        clay_paragraph_push_line(e, 0, len);
+        return;
+    }
 
-        // childGap
-        lua_getfield(L, -1, "childGap");
-        if (lua_isnumber(L, -1)) decl->layout.childGap = (float)lua_tonumber(L, -1);
-        lua_pop(L, 1);
+    ClayFontMetrics *fm = clay_font_metrics(cfg->fontId);
+    float fontSize = (float)cfg->fontSize;
+    float letterSpacing = (float)cfg->letterSpacing;
+    float spaceWidth = fm ? clay_font_scaled_advance(fm, ' ', fontSize) : clay_measure_slice(" ", 1, cfg);
+    int32_t lineStart = 0, lineEnd = 0;     // [lineStart, lineEnd) is committed content
+    float lineWidth = 0;
+    int32_t i = 0;
+
+    while (i <= len) {
+        if (i == len || txt[i] == '\n') {
+            clay_paragraph_push_line(e, lineStart, lineEnd - lineStart);
+            lineStart = lineEnd = i + 1;
+            lineWidth = 0;
+            i++;
+            continue;
+        }
+        if (txt[i] == ' ') { i++; continue; }
 
-        // childAlignment
-        lua_getfield(L, -1, "childAlignment");
-        if (lua_istable(L, -1)) {
-            lua_getfield(L, -1, "x");
-            if (lua_isnumber(L, -1)) decl->layout.childAlignment.x = (Clay_LayoutAlignmentX)lua_tointeger(L, -1);
-            lua_pop(L, 1);
+        if (cfg->wrapMode == CLAY_TEXT_WRAP_NEWLINES) {
+            while (i < len && txt[i] != ' ' && txt[i] != '\n') i++;
+            lineEnd = i;
+            continue;
+        }
 
-            lua_getfield(L, -1, "y");
-            if (lua_isnumber(L, -1)) decl->layout.childAlignment.y = (Clay_LayoutAlignmentY)lua_tointeger(L, -1);
-            lua_pop(L, 1);
+        // Scan one unbreakable unit: a word, or a single ideograph with any glued punctuation.
+        int32_t unitStart = i;
+        float unitWidth = 0;
+        uint32_t cp = (uint8_t)txt[i] < 0x80 ? (uint8_t)txt[i++] : clay_utf8_next(txt, len, &i);
+        int cls = clay_break_class(cp);
+        if (fm) unitWidth = clay_font_scaled_advance(fm, cp, fontSize);
+        while (i < len && txt[i] != ' ' && txt[i] != '\n') {
+            int32_t j = i;
+            uint32_t next = (uint8_t)txt[j] < 0x80 ? (uint8_t)txt[j++] : clay_utf8_next(txt, len, &j);
+            int nextCls = clay_break_class(next);
+            if (clay_can_break_between(cls, nextCls)) break;
+            if (fm) unitWidth += letterSpacing + clay_font_scaled_advance(fm, next, fontSize);
+            cls = nextCls;
+            i = j;
+        }
+        if (!fm) unitWidth = clay_measure_slice(txt + unitStart, i - unitStart, cfg);
+
+        if (lineEnd == lineStart) {
+            // first unit on the line (leading spaces are dropped, as Clay does after a wrap)
+            lineStart = unitStart;
+            lineEnd = i;
+            lineWidth = unitWidth;
+            continue;
         }
-        lua_pop(L, 1);
 
-        // padding
-        lua_getfield(L, -1, "padding");
-        if (lua_istable(L, -1)) {
-            lua_getfield(L, -1, "left");   decl->layout.padding.left   = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
-            lua_getfield(L, -1, "right");  decl->layout.padding.right  = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
-            lua_getfield(L, -1, "top");    decl->layout.padding.top    = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
-            lua_getfield(L, -1, "bottom"); decl->layout.padding.bottom = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
+        int32_t spaces = unitStart - lineEnd;
+        float gap = spaceWidth * (float)spaces + letterSpacing * (float)(spaces + 1);
+        if (lineWidth + gap + unitWidth > maxWidth) {
+            clay_paragraph_push_line(e, lineStart, lineEnd - lineStart);
+            lineStart = unitStart;
+            lineWidth = unitWidth;
+        } else {
+            lineWidth += gap + unitWidth;
         }
-        lua_pop(L, 1);
+        lineEnd = i;
+    }
+}
 
-        // sizing
-        lua_getfield(L, -1, "sizing");
-        if (lua_istable(L, -1)) {
-            // width
-            lua_getfield(L, -1, "width");
-            if (lua_istable(L, -1)) {
-                readSizingAxisFromLua(L, lua_gettop(L), &decl->layout.sizing.width);
-            } else if (lua_isnumber(L, -1)) {
-                float w = (float)lua_tonumber(L, -1);
-                decl->layout.sizing.width.type = CLAY__SIZING_TYPE_FIXED;
-                decl->layout.sizing.width.size.minMax.min = w;
-                decl->layout.sizing.width.size.minMax.max = w;
-            }
-            lua_pop(L, 1);
-            // height
-            lua_getfield(L, -1, "height");
+// Join the wrapped lines into e->joined; 0 when out of memory.
+static int clay_paragraph_join(ClayParagraphEntry *e) {
+    int64_t need = e->lineCount;
+    for (int32_t i = 0; i < e->lineCount; ++i) need += e->lines[i].length;
+    if (need > INT32_MAX || !clay_array_reserve((void**)&e->joined, &e->joinedCapacity, (int32_t)need, 1)) return 0;
+    int32_t n = 0;
+    for (int32_t i = 0; i < e->lineCount; ++i) {
+        if (i > 0) e->joined[n++] = '\n';
+        memcpy(e->joined + n, e->text + e->lines[i].start, (size_t)e->lines[i].length);
+        n += e->lines[i].length;
+    }
+    e->joinedLength = n;
+    return 1;
+}
+
+// Post-layout: a registry ref can only be consumed once, so leave it on the first line only.
+static void clay_paragraph_apply(Clay_RenderCommandArray *arr) {
+    if (g_ParagraphRefLines.count == 0) return;
+    for (int32_t i = 0; i < arr->length; ++i) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        if (cmd->commandType == CLAY_RENDER_COMMAND_TYPE_TEXT && clay_u32map_get(&g_ParagraphRefLines, cmd->id) >= 0) {
+            cmd->userData = NULL;
+        }
+    }
+}
+
+// Emit text as a cached paragraph element. Called in place of CLAY_TEXT by the text builder.
+static void clay_paragraph_emit(Clay_ElementId eid, Clay_String text, const Clay_TextElementConfig *style) {
+    Clay_ElementData prev = Clay_GetElementData(eid);
+    float width = prev.found ? prev.boundingBox.width : 0.0f;
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.childAlignment.x = style->textAlignment == CLAY_TEXT_ALIGN_CENTER ? CLAY_ALIGN_X_CENTER
+                                 : style->textAlignment == CLAY_TEXT_ALIGN_RIGHT ? CLAY_ALIGN_X_RIGHT
+                                 : CLAY_ALIGN_X_LEFT;
+
+    Clay__OpenElementWithId(eid);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    ClayParagraphEntry *e = clay_paragraph_get(eid.id);
+    Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+    *cfg = *style;
+
+    if (!e || width <= 0.0f) {
+        // Width unknown until this element has been laid out once: let Clay wrap this frame.
+        if (e) { e->lastFrame = g_FrameIndex; e->width = 0.0f; }
+        CLAY_TEXT(text, cfg);
+        Clay__CloseElement();
+        return;
+    }
+
+    uint32_t contentHash = clay_hash_bytes(text.chars, (size_t)text.length, 0);
+    uint32_t styleHash = clay_text_style_hash(style);
+    e->lastFrame = g_FrameIndex;
+
+    // The hash only picks the candidate; the stored text is compared so a collision re-wraps.
+    int sameText = e->textLength == text.length && e->contentHash == contentHash &&
+                   (text.length == 0 || memcmp(e->text, text.chars, (size_t)text.length) == 0);
+    if (e->width != width || !sameText || e->styleHash != styleHash) {
+        if (!sameText) {
+            char *copy = (char*)realloc(e->text, (size_t)text.length + 1);
+            if (!copy) { CLAY_TEXT(text, cfg); Clay__CloseElement(); return; }
+            memcpy(copy, text.chars, (size_t)text.length);
+            copy[text.length] = '\0';
+            e->text = copy;
+            e->textLength = text.length;
+        }
+        e->contentHash = contentHash;
+        e->styleHash = styleHash;
+        e->width = width;
+        clay_paragraph_wrap(e, cfg, width);
+        if (!clay_paragraph_join(e)) {
+            e->width = 0.0f;
+            CLAY_TEXT(text, cfg);
+            Clay__CloseElement();
+            return;
+        }
+    }
+    if (e->lineCount == 0) {
+        Clay__CloseElement();
+        return;
+    }
+
+    // Every line fits the cached width, so Clay breaks only at the newlines. The wrap mode
+    // is left as-is so lines can still compress if the parent shrinks; the new width is
+    // picked up (and re-wrapped here) on the next frame.
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    CLAY_TEXT(((Clay_String){ .isStaticallyAllocated = false, .length = e->joinedLength, .chars = e->joined }), cfg);
+    // A line may be a single unbreakable CJK run; don't let its width pin the paragraph
+    // open when the parent shrinks (the narrower width is re-wrapped next frame).
+    Clay_LayoutElement *te = Clay_LayoutElementArray_Get(&ctx->layoutElements, ctx->layoutElements.length - 1);
+    te->minDimensions.width = 0;
+    if (clay_is_ref_tag(cfg->userData) && !g_MeasureDepth) {
+        for (int32_t i = 1; i < e->lineCount; ++i) clay_u32map_put(&g_ParagraphRefLines, Clay__HashNumber((uint32_t)i, te->id).id, 1);
+    }
+    Clay__CloseElement();
+}
+
+static int l_Clay_ClearParagraphCache(lua_State *L) {
+    (void)L;
+    clay_paragraph_cache_clear();
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Ellipsis truncation
+//
+// Text emitted with :ellipsis(maxLines[, mode]) is wrapped in a box that fits the wrapped
+// text up to maxLines lines and which may shrink below the text's longest word. After
+// layout, the text's render commands are cut to maxLines and the last kept line is
+// shortened with "…" to the box's final width. Widths come from the native font
+// metrics when registered (otherwise the measure function is bisected).
+// -----------------------------------------------------------------------------
+
+enum { CLAY_ELLIPSIS_END = 0, CLAY_ELLIPSIS_MIDDLE = 1, CLAY_ELLIPSIS_START = 2 };
+
+static const char CLAY_ELLIPSIS_UTF8[] = "\xE2\x80\xA6";
+
+typedef struct {
+    const char *chars;      // the text element's string; matched against stringContents.baseChars
+    int32_t length;
+    uint32_t boxId;
+    uint16_t maxLines;
+    uint8_t mode;
+    uint8_t alignment;
+} ClayEllipsisEntry;
+
+static ClayEllipsisEntry *g_Ellipsis = NULL;
+static int32_t g_EllipsisCount = 0;
+static int32_t g_EllipsisCapacity = 0;
+
+static void clay_ellipsis_emit(Clay_String text, const Clay_TextElementConfig *style, uint16_t maxLines, uint8_t mode) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+    Clay_LayoutElement *box = Clay__GetOpenLayoutElement();
+
+    Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+    *cfg = *style;
+    cfg->wrapMode = CLAY_TEXT_WRAP_WORDS;   // only word-wrapped text is compressible in Clay
+    CLAY_TEXT(text, cfg);
+
+    // Let the text shrink below its longest word. The box fits the text once it is wrapped,
+    // but never grows past maxLines lines.
+    Clay_LayoutElement *te = Clay_LayoutElementArray_Get(&ctx->layoutElements, ctx->layoutElements.length - 1);
+    te->minDimensions.width = 0;
+    if (box->layoutConfig && box->layoutConfig != &CLAY_LAYOUT_DEFAULT) {
+        float h = te->dimensions.height * (float)maxLines;
+        box->layoutConfig->sizing.height.type = CLAY__SIZING_TYPE_FIT;
+        box->layoutConfig->sizing.height.size.minMax.min = 0;
+        box->layoutConfig->sizing.height.size.minMax.max = h;
+    }
+
+    if (g_MeasureDepth) {
+        Clay__CloseElement();
+        return;
+    }
+    if (g_EllipsisCount == g_EllipsisCapacity) {
+        int32_t cap = g_EllipsisCapacity ? g_EllipsisCapacity * 2 : 64;
+        ClayEllipsisEntry *grown = (ClayEllipsisEntry*)realloc(g_Ellipsis, sizeof(ClayEllipsisEntry) * (size_t)cap);
+        if (grown) { g_Ellipsis = grown; g_EllipsisCapacity = cap; }
+    }
+    if (g_EllipsisCount < g_EllipsisCapacity) {
+        g_Ellipsis[g_EllipsisCount++] = (ClayEllipsisEntry){
+            .chars = text.chars, .length = text.length, .boxId = box->id,
+            .maxLines = maxLines, .mode = mode, .alignment = (uint8_t)style->textAlignment,
+        };
+    }
+    Clay__CloseElement();
+}
+
+// Byte length of the longest prefix of [s, s+len) that fits maxWidth.
+static int32_t clay_fit_prefix(const char *s, int32_t len, Clay_TextElementConfig *cfg, float maxWidth) {
+    if (maxWidth <= 0) return 0;
+    ClayFontMetrics *fm = clay_font_metrics(cfg->fontId);
+    if (fm) {
+        float w = 0;
+        int32_t i = 0, fit = 0;
+        while (i < len) {
+            w += clay_font_scaled_advance(fm, clay_utf8_next(s, len, &i), (float)cfg->fontSize);
+            if (w > maxWidth) break;
+            fit = i;
+            w += (float)cfg->letterSpacing;
+        }
+        return fit;
+    }
+    int32_t lo = 0, hi = len;     // lo always fits, answer in [lo, hi]
+    while (lo < hi) {
+        int32_t mid = clay_utf8_floor(s, lo + (hi - lo + 1) / 2);
+        if (mid <= lo) {
+            mid = lo;
+            clay_utf8_next(s, len, &mid);
+            if (mid > hi) break;
+        }
+        if (clay_measure_slice(s, mid, cfg) <= maxWidth) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Start offset of the shortest suffix of [s, s+len) that still fits maxWidth.
+static int32_t clay_fit_suffix(const char *s, int32_t len, Clay_TextElementConfig *cfg, float maxWidth) {
+    if (maxWidth <= 0) return len;
+    ClayFontMetrics *fm = clay_font_metrics(cfg->fontId);
+    if (fm) {
+        float w = 0;
+        int32_t start = len;
+        while (start > 0) {
+            int32_t prev = clay_utf8_floor(s, start - 1), j = prev;
+            w += clay_font_scaled_advance(fm, clay_utf8_next(s, len, &j), (float)cfg->fontSize);
+            if (w > maxWidth) break;
+            start = prev;
+            w += (float)cfg->letterSpacing;
+        }
+        return start;
+    }
+    int32_t lo = 0, hi = len;     // answer in [lo, hi]
+    while (lo < hi) {
+        int32_t mid = clay_utf8_floor(s, (lo + hi) / 2);
+        if (mid <= lo) mid = lo;
+        if (clay_measure_slice(s + mid, len - mid, cfg) <= maxWidth) hi = mid;
+        else {
+            int32_t j = mid;
+            clay_utf8_next(s, len, &j);
+            lo = j;
+        }
+    }
+    return hi;
+}
+
+// Build the truncated text for one line. `line` runs from the last kept line to the end of
+// the element's text, so END keeps as much of it as fits rather than just the wrapped words.
+static Clay_String clay_ellipsize(const char *line, int32_t lineLen, const char *full, int32_t fullLen,
+                                  Clay_TextElementConfig *cfg, float maxWidth, uint8_t mode) {
+    float ellW = clay_measure_slice(CLAY_ELLIPSIS_UTF8, 3, cfg) + (float)cfg->letterSpacing;
+    float avail = maxWidth - ellW;
+    int32_t headLen = 0, tailStart = fullLen;
+
+    if (mode == CLAY_ELLIPSIS_START) {
+        tailStart = (int32_t)(line - full) + clay_fit_suffix(line, lineLen, cfg, avail);
+    } else if (mode == CLAY_ELLIPSIS_MIDDLE) {
+        headLen = clay_fit_prefix(line, lineLen, cfg, avail * 0.5f);
+        float headW = headLen > 0 ? clay_measure_slice(line, headLen, cfg) + (float)cfg->letterSpacing : 0.0f;
+        int32_t lineOff = (int32_t)(line - full);
+        int32_t from = lineOff + headLen;
+        tailStart = from + clay_fit_suffix(full + from, fullLen - from, cfg, avail - headW);
+    } else {
+        headLen = clay_fit_prefix(line, lineLen, cfg, avail);
+    }
+
+    int32_t tailLen = fullLen - tailStart;
+    char *dst = (char*)clay_frame_alloc((size_t)(headLen + 3 + tailLen));
+    if (!dst) return (Clay_String){0};
+    memcpy(dst, line, (size_t)headLen);
+    memcpy(dst + headLen, CLAY_ELLIPSIS_UTF8, 3);
+    memcpy(dst + headLen + 3, full + tailStart, (size_t)tailLen);
+    return (Clay_String){ .length = headLen + 3 + tailLen, .chars = dst };
+}
+
+static int clay_cmp_ellipsis(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)((const ClayEllipsisEntry*)a)->chars;
+    uintptr_t y = (uintptr_t)((const ClayEllipsisEntry*)b)->chars;
+    return x < y ? -1 : x > y;
+}
+
+static ClayEllipsisEntry* clay_ellipsis_find(const char *chars) {
+    int32_t lo = 0, hi = g_EllipsisCount - 1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) >> 1;
+        uintptr_t v = (uintptr_t)g_Ellipsis[mid].chars;
+        if (v == (uintptr_t)chars) return &g_Ellipsis[mid];
+        if (v < (uintptr_t)chars) lo = mid + 1; else hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Post-layout: truncate the text commands of ellipsis elements. Dropped lines become NONE
+// and are compacted out of the array.
+static void clay_ellipsis_apply(Clay_RenderCommandArray *arr) {
+    if (g_EllipsisCount == 0) return;
+    qsort(g_Ellipsis, (size_t)g_EllipsisCount, sizeof(ClayEllipsisEntry), clay_cmp_ellipsis);
+
+    int dropped = 0;
+    for (int32_t i = 0; i < arr->length; ) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        ClayEllipsisEntry *e = cmd->commandType == CLAY_RENDER_COMMAND_TYPE_TEXT
+            ? clay_ellipsis_find(cmd->renderData.text.stringContents.baseChars) : NULL;
+        if (!e) { i++; continue; }
+
+        int32_t first = i;
+        while (i < arr->length && arr->internalArray[i].commandType == CLAY_RENDER_COMMAND_TYPE_TEXT &&
+               arr->internalArray[i].renderData.text.stringContents.baseChars == e->chars) {
+            i++;
+        }
+
+        // Line count and line numbers come from the layout: culling may have left out some
+        // of the lines' commands. Line k's command id is derived from the text element's.
+        Clay_LayoutElementHashMapItem *item = Clay__GetHashMapItem(e->boxId);
+        Clay_BoundingBox box = item->boundingBox;
+        Clay_LayoutElement *te = NULL;
+        if (item->layoutElement && item->layoutElement->childrenOrTextContent.children.length > 0) {
+            Clay_Context *ctx = Clay_GetCurrentContext();
+            te = Clay_LayoutElementArray_Get(&ctx->layoutElements, item->layoutElement->childrenOrTextContent.children.elements[0]);
+        }
+        int32_t lines = te ? te->childrenOrTextContent.textElementData->wrappedLines.length : i - first;
+        int32_t keep = lines < e->maxLines ? lines : e->maxLines;
+
+        int32_t line = 0;
+        for (int32_t j = first; j < i; ++j) {
+            Clay_RenderCommand *c = &arr->internalArray[j];
+            if (te) {
+                while (line < lines && Clay__HashNumber((uint32_t)line, te->id).id != c->id) line++;
+            }
+            int32_t k = te ? line++ : j - first;
+            if (k >= keep) {
+                c->commandType = CLAY_RENDER_COMMAND_TYPE_NONE;
+                dropped = 1;
+                continue;
+            }
+            int last = (k == keep - 1);
+            if (!(last && lines > keep) && c->boundingBox.width <= box.width + 0.5f) continue;
+
+            Clay_TextRenderData *td = &c->renderData.text;
+            Clay_TextElementConfig cfg = {
+                .fontId = td->fontId, .fontSize = td->fontSize,
+                .letterSpacing = td->letterSpacing, .lineHeight = td->lineHeight,
+            };
+            const char *line = td->stringContents.chars;
+            int32_t lineLen = last ? (int32_t)(e->chars + e->length - line) : td->stringContents.length;
+            Clay_String out = clay_ellipsize(line, lineLen, e->chars, last ? e->length : (int32_t)(line - e->chars) + lineLen,
+                                             &cfg, box.width, last ? e->mode : CLAY_ELLIPSIS_END);
+            if (!out.chars) continue;
+
+            float w = clay_measure_slice(out.chars, out.length, &cfg);
+            td->stringContents.chars = out.chars;
+            td->stringContents.length = out.length;
+            c->boundingBox.width = w;
+            if (e->alignment == CLAY_TEXT_ALIGN_CENTER) c->boundingBox.x = box.x + (box.width - w) * 0.5f;
+            else if (e->alignment == CLAY_TEXT_ALIGN_RIGHT) c->boundingBox.x = box.x + box.width - w;
+            else c->boundingBox.x = box.x;
+        }
+    }
+
+    if (dropped) {
+        int32_t w = 0;
+        for (int32_t r = 0; r < arr->length; ++r) {
+            if (arr->internalArray[r].commandType == CLAY_RENDER_COMMAND_TYPE_NONE) continue;
+            if (w != r) arr->internalArray[w] = arr->internalArray[r];
+            w++;
+        }
+        // The array is Clay's own command buffer: keep its length in step for other readers.
+        Clay_Context *ctx = Clay_GetCurrentContext();
+        if (ctx && ctx->renderCommands.internalArray == arr->internalArray) ctx->renderCommands.length = w;
+        arr->length = w;
+    }
+    g_EllipsisCount = 0;
+}
+
+static void readSizingAxisFromLua(lua_State *L, int index, Clay_SizingAxis *out) {
+    lua_getfield(L, index, "type");
+    out->type = (Clay__SizingType)luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+
+    switch (out->type) {
+        case CLAY__SIZING_TYPE_FIXED:
+        case CLAY__SIZING_TYPE_FIT:
+        case CLAY__SIZING_TYPE_GROW: {
+            lua_getfield(L, index, "minMax");
+            if (lua_istable(L, -1)) {
+                lua_getfield(L, -1, "min");
+                out->size.minMax.min = (float)luaL_optnumber(L, -1, 0.0);
+                lua_pop(L, 1);
+                lua_getfield(L, -1, "max");
+                out->size.minMax.max = (float)luaL_optnumber(L, -1, INFINITY);
+                lua_pop(L, 1);
+            } else {
+                out->size.minMax.min = 0.0f;
+                out->size.minMax.max = INFINITY;
+            }
+            lua_pop(L, 1);
+            break;
+        }
+
+        case CLAY__SIZING_TYPE_PERCENT: {
+            lua_getfield(L, index, "percent");
+            out->size.percent = (float)luaL_optnumber(L, -1, 100.0);
+            lua_pop(L, 1);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void clay_read_element_declaration(lua_State *L, int tbl_index, Clay_ElementDeclaration *decl) {
+    // make index stable
+    int i = lua_absindex(L, tbl_index);
+
+    // initialize defaults
+    *decl = (Clay_ElementDeclaration){0};
+    decl->layout = CLAY_LAYOUT_DEFAULT;
+
+    // ---------------- layout ----------------
+    lua_getfield(L, i, "layout");
+    if (lua_istable(L, -1)) {
+        // layoutDirection
+        lua_getfield(L, -1, "layoutDirection");
+        if (lua_isnumber(L, -1)) decl->layout.layoutDirection = (int)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+
+        // childGap
+        lua_getfield(L, -1, "childGap");
+        if (lua_isnumber(L, -1)) decl->layout.childGap = (float)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+
+        // childAlignment
+        lua_getfield(L, -1, "childAlignment");
+        if (lua_istable(L, -1)) {
+            lua_getfield(L, -1, "x");
+            if (lua_isnumber(L, -1)) decl->layout.childAlignment.x = (Clay_LayoutAlignmentX)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+
+            lua_getfield(L, -1, "y");
+            if (lua_isnumber(L, -1)) decl->layout.childAlignment.y = (Clay_LayoutAlignmentY)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+
+        // padding
+        lua_getfield(L, -1, "padding");
+        if (lua_istable(L, -1)) {
+            lua_getfield(L, -1, "left");   decl->layout.padding.left   = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
+            lua_getfield(L, -1, "right");  decl->layout.padding.right  = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
+            lua_getfield(L, -1, "top");    decl->layout.padding.top    = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
+            lua_getfield(L, -1, "bottom"); decl->layout.padding.bottom = (float)luaL_optnumber(L, -1, 0.0); lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+
+        // sizing
+        lua_getfield(L, -1, "sizing");
+        if (lua_istable(L, -1)) {
+            // width
+            lua_getfield(L, -1, "width");
+            if (lua_istable(L, -1)) {
+                readSizingAxisFromLua(L, lua_gettop(L), &decl->layout.sizing.width);
+            } else if (lua_isnumber(L, -1)) {
+                float w = (float)lua_tonumber(L, -1);
+                decl->layout.sizing.width.type = CLAY__SIZING_TYPE_FIXED;
+                decl->layout.sizing.width.size.minMax.min = w;
+                decl->layout.sizing.width.size.minMax.max = w;
+            }
+            lua_pop(L, 1);
+            // height
+            lua_getfield(L, -1, "height");
             if (lua_istable(L, -1)) {
                 readSizingAxisFromLua(L, lua_gettop(L), &decl->layout.sizing.height);
             } else if (lua_isnumber(L, -1)) {
@@ -510,67 +1851,783 @@ static Clay_ElementId clay_check_element_id(lua_State *L, int idx)
 }
 
 // -----------------------------------------------------------------------------
-// Fluent builders API (no table churn)
+// Image sources and nine-slice images
+//
+// Post-layout passes can give IMAGE commands a source rectangle inside their image;
+// cmd:imageSource() reads it back. The table is parallel to the final command array,
+// so it is built by the last pass that rebuilds the array.
+//
+// An element built with :nineSlice(l, t, r, b, imageW, imageH [, scale]) has its IMAGE
+// command replaced after layout by up to nine IMAGE commands. The corners keep their
+// size, the edges stretch along one axis, and the center stretches along both.
 // -----------------------------------------------------------------------------
 
 typedef struct {
-    Clay_ElementDeclaration decl;
-    int active;                 // element is currently open
-    int configured;             // decl has been applied to Clay
-    int clipOffsetExplicit;     // childOffset was explicitly set
-} LuaClayElementBuilder;
+    float x, y, w, h;           // source rectangle in image pixels
+    uint8_t hasRect;
+    int32_t *refSlices;         // slices sharing imageData's ref and not read yet; the last read releases it
+} ClayImageSource;
 
 typedef struct {
-    Clay_String text;
-    Clay_TextElementConfig cfg;
-    int active;
-} LuaClayTextBuilder;
+    uint32_t elementId;
+    float insets[4];            // left, top, right, bottom in image pixels
+    float imageWidth, imageHeight;
+    float scale;                // screen pixels per image pixel at the edges
+} ClayNineSlice;
+
+static Clay_RenderCommand *g_ImageSourceCommands = NULL;   // array the table is parallel to
+static ClayImageSource *g_ImageSources = NULL;             // frame arena
+static int32_t g_ImageSourceCount = 0;
+static ClayNineSlice *g_NineSlices = NULL;
+static int32_t g_NineSliceCount = 0;
+static int32_t g_NineSliceCapacity = 0;
+static ClayU32Map g_NineSliceIndex = {0};
+
+static ClayImageSource* clay_image_source(const Clay_RenderCommand *cmd) {
+    if (!g_ImageSources || cmd < g_ImageSourceCommands || cmd >= g_ImageSourceCommands + g_ImageSourceCount) return NULL;
+    return &g_ImageSources[cmd - g_ImageSourceCommands];
+}
+
+static void clay_nine_slice_frame_reset(void) {
+    g_NineSliceCount = 0;
+    clay_u32map_clear(&g_NineSliceIndex);
+    g_ImageSources = NULL;
+    g_ImageSourceCommands = NULL;
+    g_ImageSourceCount = 0;
+}
+
+static void clay_nine_slice_add(const ClayNineSlice *s) {
+    if (!clay_array_reserve((void**)&g_NineSlices, &g_NineSliceCapacity, g_NineSliceCount + 1, sizeof(ClayNineSlice))) return;
+    clay_u32map_put(&g_NineSliceIndex, s->elementId, g_NineSliceCount);
+    g_NineSlices[g_NineSliceCount++] = *s;
+}
+
+static void clay_nine_slice_clear(void) {
+    free(g_NineSlices);
+    g_NineSlices = NULL;
+    g_NineSliceCount = g_NineSliceCapacity = 0;
+    clay_u32map_free(&g_NineSliceIndex);
+}
+
+// Split [0, size) on screen and [0, imageSize) in the image at the two insets. Insets that
+// don't fit on screen shrink proportionally.
+static void clay_nine_slice_axis(float size, float imageSize, float lo, float hi, float scale, float dst[4], float src[4]) {
+    float a = lo * scale, b = hi * scale;
+    if (a + b > size && a + b > 0) {
+        float f = size / (a + b);
+        a *= f;
+        b *= f;
+    }
+    dst[0] = 0; dst[1] = a; dst[2] = size - b; dst[3] = size;
+    src[0] = 0; src[1] = lo; src[2] = imageSize - hi; src[3] = imageSize;
+}
 
-static void text_builder_emit(LuaClayTextBuilder *t) {
-    if (!t || !t->active) return;
-    Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
-    *cfg = t->cfg;
-    CLAY_TEXT(t->text, cfg);
+static void clay_nine_slice_apply(Clay_RenderCommandArray *arr) {
+    if (g_NineSliceCount == 0) return;
+    int64_t extra = 0;
+    for (int32_t i = 0; i < arr->length; ++i) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        if (cmd->commandType == CLAY_RENDER_COMMAND_TYPE_IMAGE && clay_u32map_get(&g_NineSliceIndex, cmd->id) >= 0) extra += 8;
+    }
+    if (extra == 0 || arr->length + extra > INT32_MAX) return;
+    int32_t total = arr->length + (int32_t)extra;
+    Clay_RenderCommand *out = (Clay_RenderCommand*)clay_frame_alloc(sizeof(Clay_RenderCommand) * (size_t)total);
+    ClayImageSource *sources = (ClayImageSource*)clay_frame_alloc(sizeof(ClayImageSource) * (size_t)total);
+    if (!out || !sources) return;
+    memset(sources, 0, sizeof(ClayImageSource) * (size_t)total);
+
+    int32_t k = 0;
+    for (int32_t i = 0; i < arr->length; ++i) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        int32_t idx = cmd->commandType == CLAY_RENDER_COMMAND_TYPE_IMAGE ? clay_u32map_get(&g_NineSliceIndex, cmd->id) : -1;
+        if (idx < 0) {
+            out[k++] = *cmd;
+            continue;
+        }
+        const ClayNineSlice *s = &g_NineSlices[idx];
+        Clay_BoundingBox box = cmd->boundingBox;
+        float dx[4], sx[4], dy[4], sy[4];
+        clay_nine_slice_axis(box.width, s->imageWidth, s->insets[0], s->insets[2], s->scale, dx, sx);
+        clay_nine_slice_axis(box.height, s->imageHeight, s->insets[1], s->insets[3], s->scale, dy, sy);
+        int32_t first = k;
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                float w = dx[c + 1] - dx[c], h = dy[r + 1] - dy[r];
+                if (w <= 0 || h <= 0 || sx[c + 1] <= sx[c] || sy[r + 1] <= sy[r]) continue;
+                Clay_RenderCommand slice = *cmd;
+                slice.boundingBox = (Clay_BoundingBox){ box.x + dx[c], box.y + dy[r], w, h };
+                slice.renderData.image.cornerRadius = (Clay_CornerRadius){0};
+                sources[k] = (ClayImageSource){ sx[c], sy[r], sx[c + 1] - sx[c], sy[r + 1] - sy[r], 1, NULL };
+                out[k++] = slice;
+            }
+        }
+        if (k == first) {
+            out[k++] = *cmd;                            // degenerate: keep the plain image
+        } else if (k - first > 1 && clay_is_ref_tag(cmd->renderData.image.imageData)) {
+            // The slices share one ref; whichever is read last releases it.
+            int32_t *pending = (int32_t*)clay_frame_alloc(sizeof(int32_t));
+            if (pending) {
+                *pending = k - first;
+                for (int32_t j = first; j < k; ++j) sources[j].refSlices = pending;
+            } else {
+                k = first;                              // can't share the ref: keep the plain image
+                sources[k] = (ClayImageSource){0};
+                out[k++] = *cmd;
+            }
+        }
+    }
+    arr->internalArray = out;
+    arr->length = k;
+    arr->capacity = total;
+    g_ImageSourceCommands = out;
+    g_ImageSources = sources;
+    g_ImageSourceCount = k;
+}
 
-    // Detach tagged refs; Clay now owns them until the command is consumed.
-    t->cfg.userData = NULL;
-    t->active = 0;
- }
+// -----------------------------------------------------------------------------
+// Inline custom payloads
+//
+// :payload(tag, ...) gives a custom element a type tag and up to eight numbers in frame
+// arena memory, instead of a registry ref per element per frame. The CUSTOM command's
+// customData points at the ClayCustomPayload, so FFI renderers can read it directly, and
+// cmd:payload() unpacks it for Lua.
+// -----------------------------------------------------------------------------
 
-static LuaClayElementBuilder* check_elem_builder(lua_State *L, int idx) {
-    return (LuaClayElementBuilder*)luaL_checkudata(L, idx, "ClayElementBuilder");
+#define CLAY_PAYLOAD_MAX 8
+
+typedef struct {
+    uint32_t tag;
+    int32_t count;
+    double values[CLAY_PAYLOAD_MAX];
+} ClayCustomPayload;
+
+static ClayCustomPayload **g_Payloads = NULL;
+static int32_t g_PayloadCount = 0;
+static int32_t g_PayloadCapacity = 0;
+static ClayU32Map g_PayloadIndex = {0};
+
+static void clay_payload_add(uint32_t elementId, ClayCustomPayload *p) {
+    if (!clay_array_reserve((void**)&g_Payloads, &g_PayloadCapacity, g_PayloadCount + 1, sizeof(ClayCustomPayload*))) return;
+    clay_u32map_put(&g_PayloadIndex, elementId, g_PayloadCount);
+    g_Payloads[g_PayloadCount++] = p;
 }
 
-static LuaClayTextBuilder* check_text_builder(lua_State *L, int idx) {
-    return (LuaClayTextBuilder*)luaL_checkudata(L, idx, "ClayTextBuilder");
+static ClayCustomPayload* clay_payload_of_command(const Clay_RenderCommand *cmd) {
+    if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_CUSTOM) return NULL;
+    int32_t idx = clay_u32map_get(&g_PayloadIndex, cmd->id);
+    return idx >= 0 && cmd->renderData.custom.customData == g_Payloads[idx] ? g_Payloads[idx] : NULL;
 }
 
-static void elem_builder_ensure_open(lua_State *L, LuaClayElementBuilder *b) {
-    if (!b || !b->active) luaL_error(L, "element builder is not active (already closed?)");
+static void clay_payload_frame_reset(void) {
+    g_PayloadCount = 0;
+    clay_u32map_clear(&g_PayloadIndex);
 }
 
-static void elem_builder_detach_ptrs(LuaClayElementBuilder *b) {
-    // After we configure into Clay, ownership of tagged registry refs transfers to Clay's render commands.
-    // Detach so __gc won't accidentally unref them.
-    b->decl.userData = NULL;
-    b->decl.image.imageData = NULL;
-    b->decl.custom.customData = NULL;
+static void clay_payload_clear(void) {
+    free(g_Payloads);
+    g_Payloads = NULL;
+    g_PayloadCount = g_PayloadCapacity = 0;
+    clay_u32map_free(&g_PayloadIndex);
 }
 
-static void elem_builder_configure_if_needed(lua_State *L, LuaClayElementBuilder *b) {
-    (void)L;
-    if (b->configured) return;
+// -----------------------------------------------------------------------------
+// Native custom handlers
+//
+// Hosts can attach a C function to a payload tag with clay.setCustomHandler(tag, fn [, user]),
+// where fn and user are lightuserdata (from an FFI cast or a host C module), or by calling
+// clay_lua_set_custom_handler directly when linked statically. The render command
+// iterator calls the handler in command order and skips the command, so it never
+// reaches Lua.
+// -----------------------------------------------------------------------------
 
-    // Default clip offset behavior (match existing table reader): if clipping and offset omitted, default to scroll offset.
-    if ((b->decl.clip.horizontal || b->decl.clip.vertical) && !b->clipOffsetExplicit) {
-        b->decl.clip.childOffset = Clay_GetScrollOffset();
+typedef void (*ClayLuaCustomHandler)(void *user, const Clay_RenderCommand *command,
+                                     uint32_t tag, const double *values, int32_t count);
+
+typedef struct {
+    uint32_t tag;
+    ClayLuaCustomHandler fn;
+    void *user;
+} ClayCustomHandlerEntry;
+
+static ClayCustomHandlerEntry *g_CustomHandlers = NULL;
+static int32_t g_CustomHandlerCount = 0;
+static int32_t g_CustomHandlerCapacity = 0;
+
+// Installs (fn != NULL) or removes (fn == NULL) the handler for tag; returns 0 when out of memory.
+int clay_lua_set_custom_handler(uint32_t tag, ClayLuaCustomHandler fn, void *user) {
+    for (int32_t i = 0; i < g_CustomHandlerCount; ++i) {
+        if (g_CustomHandlers[i].tag != tag) continue;
+        if (fn) {
+            g_CustomHandlers[i].fn = fn;
+            g_CustomHandlers[i].user = user;
+        } else {
+            g_CustomHandlers[i] = g_CustomHandlers[--g_CustomHandlerCount];
+        }
+        return 1;
     }
+    if (!fn) return 1;
+    if (!clay_array_reserve((void**)&g_CustomHandlers, &g_CustomHandlerCapacity, g_CustomHandlerCount + 1, sizeof(ClayCustomHandlerEntry))) return 0;
+    g_CustomHandlers[g_CustomHandlerCount++] = (ClayCustomHandlerEntry){ tag, fn, user };
+    return 1;
+}
 
-    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, b->decl));
-    b->configured = 1;
+// Runs the native handler for a payload command; returns 1 if the command was consumed.
+static int clay_custom_dispatch(const Clay_RenderCommand *cmd) {
+    const ClayCustomPayload *p = clay_payload_of_command(cmd);
+    if (!p) return 0;
+    for (int32_t i = 0; i < g_CustomHandlerCount; ++i) {
+        if (g_CustomHandlers[i].tag == p->tag) {
+            g_CustomHandlers[i].fn(g_CustomHandlers[i].user, cmd, p->tag, p->values, p->count);
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    // IMPORTANT: detach tagged refs so builder doesn't unref them.
-    elem_builder_detach_ptrs(b);
+// clay.setCustomHandler(tag, fn|nil [, user])
+static int l_Clay_SetCustomHandler(lua_State *L) {
+    lua_Integer tag = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, tag >= 0 && (uint64_t)tag <= UINT32_MAX, 1, "tag out of range");
+    luaL_argcheck(L, lua_isnoneornil(L, 2) || lua_islightuserdata(L, 2), 2, "expected a lightuserdata function pointer or nil");
+    luaL_argcheck(L, lua_isnoneornil(L, 3) || lua_islightuserdata(L, 3), 3, "expected lightuserdata");
+    // Function and data pointers share a representation on every platform Lua runs on.
+    ClayLuaCustomHandler fn = NULL;
+    void *raw = lua_touserdata(L, 2);
+    memcpy(&fn, &raw, sizeof(fn) < sizeof(raw) ? sizeof(fn) : sizeof(raw));
+    if (!clay_lua_set_custom_handler((uint32_t)tag, fn, lua_touserdata(L, 3))) {
+        return luaL_error(L, "setCustomHandler: out of memory");
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Property animation
+//
+// :animate(prop, target, duration [, easing]) on a builder declares where a property
+// should be. When the target changes, the binding eases from the current value to the
+// new one over `duration` seconds of the binding clock. State lives in C, keyed by element
+// id, and is applied to the declaration when the element is configured. A new element
+// starts at its target. clay.isAnimating() reports whether the last layout had a
+// transition in flight.
+// -----------------------------------------------------------------------------
+
+enum {
+    CLAY_ANIM_BACKGROUND_COLOR,
+    CLAY_ANIM_BORDER_COLOR,
+    CLAY_ANIM_WIDTH,
+    CLAY_ANIM_HEIGHT,
+    CLAY_ANIM_OFFSET,
+    CLAY_ANIM_CORNER_RADIUS,
+    CLAY_ANIM_PROP_COUNT
+};
+
+enum { CLAY_EASE_LINEAR, CLAY_EASE_IN, CLAY_EASE_OUT, CLAY_EASE_IN_OUT };
+
+#define CLAY_ANIM_MAX_IDLE_FRAMES 60u
+
+static const char *const g_AnimPropNames[] = {
+    "backgroundColor", "borderColor", "width", "height", "offset", "cornerRadius", NULL
+};
+
+// What a builder asked for this frame.
+typedef struct {
+    uint8_t mask;
+    uint8_t easing[CLAY_ANIM_PROP_COUNT];
+    float duration[CLAY_ANIM_PROP_COUNT];
+    float target[CLAY_ANIM_PROP_COUNT][4];
+} ClayAnimRequest;
+
+typedef struct {
+    float from[4], to[4], value[4];
+    double start;
+    float duration;
+    uint8_t easing;
+    uint8_t running;
+} ClayAnimTrack;
+
+typedef struct {
+    uint32_t elementId;
+    uint32_t lastFrame;
+    uint8_t mask;               // tracks that hold a value
+    ClayAnimTrack tracks[CLAY_ANIM_PROP_COUNT];
+} ClayAnimState;
+
+static ClayAnimState *g_Anims = NULL;
+static int32_t g_AnimCount = 0;
+static int32_t g_AnimCapacity = 0;
+static ClayU32Map g_AnimIndex = {0};
+static int g_AnimRunning = 0;          // a track was mid-transition during this layout
+
+static float clay_ease(uint8_t easing, float t) {
+    switch (easing) {
+        case CLAY_EASE_IN: return t * t * t;
+        case CLAY_EASE_OUT: { float u = 1.0f - t; return 1.0f - u * u * u; }
+        case CLAY_EASE_IN_OUT:
+            if (t < 0.5f) return 4.0f * t * t * t;
+            { float u = -2.0f * t + 2.0f; return 1.0f - u * u * u * 0.5f; }
+        default: return t;
+    }
+}
+
+// Drop states whose element wasn't declared for a while, then re-index.
+static void clay_anim_sweep(void) {
+    g_AnimRunning = 0;
+    int32_t kept = 0;
+    for (int32_t i = 0; i < g_AnimCount; ++i) {
+        if (g_FrameIndex - g_Anims[i].lastFrame > CLAY_ANIM_MAX_IDLE_FRAMES) continue;
+        if (kept != i) g_Anims[kept] = g_Anims[i];
+        kept++;
+    }
+    if (kept == g_AnimCount) return;
+    g_AnimCount = kept;
+    clay_u32map_clear(&g_AnimIndex);
+    for (int32_t i = 0; i < g_AnimCount; ++i) clay_u32map_put(&g_AnimIndex, g_Anims[i].elementId, i);
+}
+
+static void clay_anim_clear(void) {
+    free(g_Anims);
+    g_Anims = NULL;
+    g_AnimCount = g_AnimCapacity = 0;
+    clay_u32map_free(&g_AnimIndex);
+    g_AnimRunning = 0;
+}
+
+static void clay_anim_write(Clay_ElementDeclaration *decl, int prop, const float v[4]) {
+    switch (prop) {
+        case CLAY_ANIM_BACKGROUND_COLOR: decl->backgroundColor = (Clay_Color){ v[0], v[1], v[2], v[3] }; break;
+        case CLAY_ANIM_BORDER_COLOR: decl->border.color = (Clay_Color){ v[0], v[1], v[2], v[3] }; break;
+        case CLAY_ANIM_WIDTH:
+            decl->layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { v[0], v[0] } }, .type = CLAY__SIZING_TYPE_FIXED };
+            break;
+        case CLAY_ANIM_HEIGHT:
+            decl->layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { v[0], v[0] } }, .type = CLAY__SIZING_TYPE_FIXED };
+            break;
+        case CLAY_ANIM_OFFSET: decl->floating.offset = (Clay_Vector2){ v[0], v[1] }; break;
+        case CLAY_ANIM_CORNER_RADIUS: decl->cornerRadius = (Clay_CornerRadius){ v[0], v[1], v[2], v[3] }; break;
+    }
+}
+
+// Advance the element's tracks to the binding clock and write the values into decl.
+static void clay_anim_apply(uint32_t elementId, const ClayAnimRequest *req, Clay_ElementDeclaration *decl) {
+    int32_t idx = clay_u32map_get(&g_AnimIndex, elementId);
+    if (idx < 0) {
+        if (!clay_array_reserve((void**)&g_Anims, &g_AnimCapacity, g_AnimCount + 1, sizeof(ClayAnimState))) return;
+        idx = g_AnimCount++;
+        memset(&g_Anims[idx], 0, sizeof(ClayAnimState));
+        g_Anims[idx].elementId = elementId;
+        clay_u32map_put(&g_AnimIndex, elementId, idx);
+    }
+    ClayAnimState *st = &g_Anims[idx];
+    st->lastFrame = g_FrameIndex;
+    for (int p = 0; p < CLAY_ANIM_PROP_COUNT; ++p) {
+        if (!(req->mask & (1u << p))) continue;
+        ClayAnimTrack *tr = &st->tracks[p];
+        const float *target = req->target[p];
+        if (!(st->mask & (1u << p))) {
+            memcpy(tr->value, target, sizeof(tr->value));
+            memcpy(tr->to, target, sizeof(tr->to));
+            tr->running = 0;
+            st->mask |= (uint8_t)(1u << p);
+        } else if (memcmp(tr->to, target, sizeof(tr->to)) != 0) {
+            memcpy(tr->from, tr->value, sizeof(tr->from));
+            memcpy(tr->to, target, sizeof(tr->to));
+            tr->start = g_Now;
+            tr->duration = req->duration[p];
+            tr->easing = req->easing[p];
+            tr->running = 1;
+        }
+        if (tr->running) {
+            float t = tr->duration > 0 ? (float)((g_Now - tr->start) / tr->duration) : 1.0f;
+            if (t >= 1.0f) {
+                memcpy(tr->value, tr->to, sizeof(tr->value));
+                tr->running = 0;
+            } else {
+                float e = clay_ease(tr->easing, t < 0 ? 0 : t);
+                for (int k = 0; k < 4; ++k) tr->value[k] = tr->from[k] + (tr->to[k] - tr->from[k]) * e;
+                g_AnimRunning = 1;
+            }
+        }
+        clay_anim_write(decl, p, tr->value);
+    }
+}
+
+// Read a target value: colors {r,g,b[,a]} or { r=, g=, b=, a= }; offset {x, y} or { x=, y= };
+// cornerRadius a number or { topLeft, topRight, bottomLeft, bottomRight }; sizes a number.
+static void clay_anim_check_target(lua_State *L, int idx, int prop, float out[4]) {
+    static const char *const colorKeys[] = { "r", "g", "b", "a" };
+    static const char *const offsetKeys[] = { "x", "y" };
+    memset(out, 0, sizeof(float) * 4);
+    if (prop == CLAY_ANIM_WIDTH || prop == CLAY_ANIM_HEIGHT) {
+        out[0] = (float)luaL_checknumber(L, idx);
+        return;
+    }
+    if (prop == CLAY_ANIM_CORNER_RADIUS && lua_type(L, idx) == LUA_TNUMBER) {
+        out[0] = out[1] = out[2] = out[3] = (float)lua_tonumber(L, idx);
+        return;
+    }
+    luaL_checktype(L, idx, LUA_TTABLE);
+    int color = prop == CLAY_ANIM_BACKGROUND_COLOR || prop == CLAY_ANIM_BORDER_COLOR;
+    const char *const *keys = color ? colorKeys : prop == CLAY_ANIM_OFFSET ? offsetKeys : NULL;
+    int n = prop == CLAY_ANIM_OFFSET ? 2 : 4;
+    for (int k = 0; k < n; ++k) {
+        lua_rawgeti(L, idx, k + 1);
+        if (lua_isnil(L, -1) && keys) {
+            lua_pop(L, 1);
+            lua_getfield(L, idx, keys[k]);
+        }
+        out[k] = (float)luaL_optnumber(L, -1, color && k == 3 ? 255.0 : 0.0);
+        lua_pop(L, 1);
+    }
+}
+
+static int l_Clay_IsAnimating(lua_State *L) {
+    lua_pushboolean(L, g_AnimRunning);
+    return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Bounds tracking (FLIP)
+//
+// Elements built with :trackBounds([duration [, easing]]) have their bounding box recorded
+// after every layout. clay.boundsDelta(id) returns the change since the previous layout.
+// With a duration, a move or resize is also animated. After layout, the element's render
+// commands are drawn from where it was, easing toward where it is now. Its own commands
+// are scaled as well as moved; its descendants are only moved. Positions are compared
+// relative to the content origin of the nearest clipping ancestor, so scrolling alone
+// doesn't start a transition. The layout itself and hit testing keep using the final bounds.
+// -----------------------------------------------------------------------------
+
+#define CLAY_FLIP_MAX_IDLE_FRAMES 60u
+
+typedef struct {
+    uint32_t elementId;
+    uint32_t lastFrame;         // frame the element was last declared
+    uint8_t hasBox;
+    uint8_t easing;
+    float duration;
+    Clay_BoundingBox previous, current;
+    Clay_Vector2 origin;        // content origin of the nearest clip ancestor, for `current`
+    Clay_Vector2 layoutOrigin;  // the same for this layout, from clay_flip_origins()
+    float from[4];              // x, y, w, h offset from `current` when the transition started
+    double start;
+    uint8_t running;
+} ClayFlipState;
+
+// Correction applied to the render commands of one element this frame.
+typedef struct {
+    float dx, dy;               // translation, including tracked ancestors'
+    float sx, sy;               // scale about `origin`; 1 for descendants
+    Clay_Vector2 origin;
+} ClayFlipOffset;
+
+static ClayFlipState *g_Flips = NULL;
+static int32_t g_FlipCount = 0;
+static int32_t g_FlipCapacity = 0;
+static ClayU32Map g_FlipIndex = {0};
+static ClayFlipOffset *g_FlipOffsets = NULL;    // by command id, through g_FlipOffsetIndex
+static int32_t g_FlipOffsetCount = 0;
+static int32_t g_FlipOffsetCapacity = 0;
+static ClayU32Map g_FlipOffsetIndex = {0};
+static int32_t *g_FlipStack = NULL;
+static int32_t g_FlipStackCapacity = 0;
+
+typedef struct {
+    int32_t element;
+    Clay_Vector2 origin;
+} ClayFlipNode;
+
+static ClayFlipNode *g_FlipNodes = NULL;
+static int32_t g_FlipNodeCapacity = 0;
+
+static void clay_flip_track(uint32_t elementId, float duration, uint8_t easing) {
+    int32_t idx = clay_u32map_get(&g_FlipIndex, elementId);
+    if (idx < 0) {
+        if (!clay_array_reserve((void**)&g_Flips, &g_FlipCapacity, g_FlipCount + 1, sizeof(ClayFlipState))) return;
+        idx = g_FlipCount++;
+        memset(&g_Flips[idx], 0, sizeof(ClayFlipState));
+        g_Flips[idx].elementId = elementId;
+        clay_u32map_put(&g_FlipIndex, elementId, idx);
+    }
+    g_Flips[idx].lastFrame = g_FrameIndex;
+    g_Flips[idx].duration = duration;
+    g_Flips[idx].easing = easing;
+}
+
+static void clay_flip_sweep(void) {
+    int32_t kept = 0;
+    for (int32_t i = 0; i < g_FlipCount; ++i) {
+        if (g_FrameIndex - g_Flips[i].lastFrame > CLAY_FLIP_MAX_IDLE_FRAMES) continue;
+        if (kept != i) g_Flips[kept] = g_Flips[i];
+        kept++;
+    }
+    if (kept == g_FlipCount) return;
+    g_FlipCount = kept;
+    clay_u32map_clear(&g_FlipIndex);
+    for (int32_t i = 0; i < g_FlipCount; ++i) clay_u32map_put(&g_FlipIndex, g_Flips[i].elementId, i);
+}
+
+static void clay_flip_clear(void) {
+    free(g_Flips);
+    free(g_FlipOffsets);
+    free(g_FlipStack);
+    free(g_FlipNodes);
+    g_Flips = NULL;
+    g_FlipOffsets = NULL;
+    g_FlipStack = NULL;
+    g_FlipNodes = NULL;
+    g_FlipCount = g_FlipCapacity = 0;
+    g_FlipOffsetCount = g_FlipOffsetCapacity = 0;
+    g_FlipStackCapacity = g_FlipNodeCapacity = 0;
+    clay_u32map_free(&g_FlipIndex);
+    clay_u32map_free(&g_FlipOffsetIndex);
+}
+
+static ClayFlipOffset* clay_flip_offset_for(uint32_t id) {
+    int32_t idx = clay_u32map_get(&g_FlipOffsetIndex, id);
+    if (idx >= 0) return &g_FlipOffsets[idx];
+    if (!clay_array_reserve((void**)&g_FlipOffsets, &g_FlipOffsetCapacity, g_FlipOffsetCount + 1, sizeof(ClayFlipOffset))) return NULL;
+    clay_u32map_put(&g_FlipOffsetIndex, id, g_FlipOffsetCount);
+    g_FlipOffsets[g_FlipOffsetCount] = (ClayFlipOffset){ 0, 0, 1, 1, {0, 0} };
+    return &g_FlipOffsets[g_FlipOffsetCount++];
+}
+
+// The content origin of a clipping element: its box moved by its child offset (the scroll
+// position, for scroll containers).
+static Clay_Vector2 clay_flip_content_origin(Clay_LayoutElement *el, Clay_BoundingBox box) {
+    Clay_ClipElementConfig *clip = Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_CLIP).clipElementConfig;
+    return (Clay_Vector2){ box.x + clip->childOffset.x, box.y + clip->childOffset.y };
+}
+
+// Store in each tracked element's state the content origin of its nearest clip ancestor.
+static void clay_flip_origins(Clay_Context *ctx) {
+    for (int32_t r = 0; r < ctx->layoutElementTreeRoots.length; ++r) {
+        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&ctx->layoutElementTreeRoots, r);
+        int32_t top = 0;
+        if (!clay_array_reserve((void**)&g_FlipNodes, &g_FlipNodeCapacity, 1, sizeof(ClayFlipNode))) return;
+        ClayFlipNode node = { root->layoutElementIndex, { 0, 0 } };
+        if (root->clipElementId) {
+            Clay_LayoutElementHashMapItem *clip = Clay__GetHashMapItem(root->clipElementId);
+            if (clip && clip->layoutElement) node.origin = clay_flip_content_origin(clip->layoutElement, clip->boundingBox);
+        }
+        g_FlipNodes[top++] = node;
+        while (top > 0) {
+            node = g_FlipNodes[--top];
+            Clay_LayoutElement *el = Clay_LayoutElementArray_Get(&ctx->layoutElements, node.element);
+            if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) continue;
+            int32_t idx = clay_u32map_get(&g_FlipIndex, el->id);
+            if (idx >= 0) g_Flips[idx].layoutOrigin = node.origin;
+            if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_CLIP)) {
+                node.origin = clay_flip_content_origin(el, Clay__GetHashMapItem(el->id)->boundingBox);
+            }
+            Clay__LayoutElementChildren ch = el->childrenOrTextContent.children;
+            if (!clay_array_reserve((void**)&g_FlipNodes, &g_FlipNodeCapacity, top + ch.length, sizeof(ClayFlipNode))) return;
+            for (int32_t k = 0; k < ch.length; ++k) {
+                node.element = ch.elements[k];
+                g_FlipNodes[top++] = node;
+            }
+        }
+    }
+}
+
+static void clay_canvas_flip_offset(uint32_t elementId, float dx, float dy);
+static void clay_chart_flip_offset(Clay_RenderCommand *cmd, const ClayFlipOffset *o);
+
+// Move the element's subtree by (dx, dy). Text elements draw one command per wrapped line,
+// each with its own id; canvas items are spliced in with ids of their own.
+static void clay_flip_offset_subtree(Clay_Context *ctx, Clay_LayoutElement *root, float dx, float dy) {
+    int32_t top = 0;
+    if (!clay_array_reserve((void**)&g_FlipStack, &g_FlipStackCapacity, 1, sizeof(int32_t))) return;
+    g_FlipStack[top++] = (int32_t)(root - ctx->layoutElements.internalArray);
+    while (top > 0) {
+        Clay_LayoutElement *el = Clay_LayoutElementArray_Get(&ctx->layoutElements, g_FlipStack[--top]);
+        ClayFlipOffset *o = clay_flip_offset_for(el->id);
+        if (o) { o->dx += dx; o->dy += dy; }
+        clay_canvas_flip_offset(el->id, dx, dy);
+        if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+            int32_t lines = el->childrenOrTextContent.textElementData->wrappedLines.length;
+            for (int32_t k = 0; k < lines; ++k) {
+                o = clay_flip_offset_for(Clay__HashNumber((uint32_t)k, el->id).id);
+                if (o) { o->dx += dx; o->dy += dy; }
+            }
+            continue;
+        }
+        Clay__LayoutElementChildren ch = el->childrenOrTextContent.children;
+        if (!clay_array_reserve((void**)&g_FlipStack, &g_FlipStackCapacity, top + ch.length, sizeof(int32_t))) return;
+        for (int32_t k = 0; k < ch.length; ++k) g_FlipStack[top++] = ch.elements[k];
+    }
+}
+
+// Record this layout's bounds, advance transitions, and shift the affected commands.
+static void clay_flip_apply(Clay_RenderCommandArray *arr) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (g_FlipCount == 0 || !ctx) return;
+    g_FlipOffsetCount = 0;
+    clay_u32map_clear(&g_FlipOffsetIndex);
+    clay_flip_origins(ctx);
+    for (int32_t i = 0; i < g_FlipCount; ++i) {
+        ClayFlipState *f = &g_Flips[i];
+        if (f->lastFrame != g_FrameIndex) continue;
+        Clay_LayoutElementHashMapItem *item = Clay__GetHashMapItem(f->elementId);
+        if (!item || !item->layoutElement || item->elementId.id != f->elementId) continue;
+        Clay_BoundingBox box = item->boundingBox;
+        float off[4] = {0, 0, 0, 0};
+        if (f->running) {
+            float t = f->duration > 0 ? (float)((g_Now - f->start) / f->duration) : 1.0f;
+            float k = t >= 1.0f ? 0.0f : 1.0f - clay_ease(f->easing, t < 0 ? 0 : t);
+            for (int c = 0; c < 4; ++c) off[c] = f->from[c] * k;
+        }
+        Clay_Vector2 previousOrigin = f->hasBox ? f->origin : f->layoutOrigin;
+        f->previous = f->hasBox ? f->current : box;
+        f->current = box;
+        f->origin = f->layoutOrigin;
+        // Positions within the scrolled content; a scroll moves both box and origin.
+        float px = f->previous.x - previousOrigin.x, py = f->previous.y - previousOrigin.y;
+        float cx = box.x - f->origin.x, cy = box.y - f->origin.y;
+        if (!f->hasBox) {
+            f->hasBox = 1;
+        } else if (f->duration > 0 && (px != cx || py != cy ||
+                   f->previous.width != box.width || f->previous.height != box.height)) {
+            // Start from where the element is drawn right now, mid-transition or not.
+            f->from[0] = px + off[0] - cx;
+            f->from[1] = py + off[1] - cy;
+            f->from[2] = f->previous.width + off[2] - box.width;
+            f->from[3] = f->previous.height + off[3] - box.height;
+            f->start = g_Now;
+            f->running = 1;
+            memcpy(off, f->from, sizeof(off));
+        }
+        if (off[0] == 0 && off[1] == 0 && off[2] == 0 && off[3] == 0) {
+            f->running = 0;
+            continue;
+        }
+        g_AnimRunning = 1;
+        clay_flip_offset_subtree(ctx, item->layoutElement, off[0], off[1]);
+        ClayFlipOffset *o = clay_flip_offset_for(f->elementId);
+        if (o) {
+            o->origin = (Clay_Vector2){ box.x, box.y };
+            o->sx = box.width > 0 ? (box.width + off[2]) / box.width : 1.0f;
+            o->sy = box.height > 0 ? (box.height + off[3]) / box.height : 1.0f;
+        }
+    }
+    if (g_FlipOffsetCount == 0) return;
+    for (int32_t i = 0; i < arr->length; ++i) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        int32_t idx = clay_u32map_get(&g_FlipOffsetIndex, cmd->id);
+        if (idx < 0) continue;
+        const ClayFlipOffset *o = &g_FlipOffsets[idx];
+        Clay_BoundingBox *b = &cmd->boundingBox;
+        b->x = o->origin.x + (b->x - o->origin.x) * o->sx + o->dx;
+        b->y = o->origin.y + (b->y - o->origin.y) * o->sy + o->dy;
+        b->width *= o->sx;
+        b->height *= o->sy;
+        clay_chart_flip_offset(cmd, o);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Fluent builders API (no table churn)
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    Clay_ElementDeclaration decl;
+    int active;                 // element is currently open
+    int configured;             // decl has been applied to Clay
+    int clipOffsetExplicit;     // childOffset was explicitly set
+    int hasNineSlice;
+    ClayNineSlice nineSlice;
+    ClayCustomPayload *payload;     // frame arena; registered once the element id is known
+    ClayAnimRequest anim;
+    int trackBounds;
+    float flipDuration;
+    uint8_t flipEasing;
+    int gestureTarget;
+    int focusable;
+} LuaClayElementBuilder;
+
+typedef struct {
+    Clay_String text;
+    Clay_TextElementConfig cfg;
+    int active;
+    Clay_ElementId paragraphId;     // non-zero: emit through the paragraph cache
+    int paragraphAuto;              // :paragraph() without an id: derive it when emitted
+    uint16_t ellipsisLines;         // non-zero: truncate to this many lines after layout
+    uint8_t ellipsisMode;
+} LuaClayTextBuilder;
+
+static void text_builder_emit(LuaClayTextBuilder *t) {
+    if (!t || !t->active) return;
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (t->paragraphAuto && ctx && ctx->openLayoutElementStack.length > 0) {
+        // The id the text element itself would get: its slot under the open parent.
+        Clay_LayoutElement *parent = Clay__GetOpenLayoutElement();
+        uint32_t offset = (uint32_t)(parent->childrenOrTextContent.children.length + parent->floatingChildrenCount);
+        t->paragraphId = Clay__HashNumber(offset, parent->id);
+    }
+    if (t->paragraphId.id) {
+        clay_paragraph_emit(t->paragraphId, t->text, &t->cfg);
+    } else if (t->ellipsisLines) {
+        clay_ellipsis_emit(t->text, &t->cfg, t->ellipsisLines, t->ellipsisMode);
+    } else {
+        Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+        *cfg = t->cfg;
+        CLAY_TEXT(t->text, cfg);
+    }
+
+    // Detach tagged refs; Clay now owns them until the command is consumed.
+    t->cfg.userData = NULL;
+    t->active = 0;
+ }
+
+static LuaClayElementBuilder* check_elem_builder(lua_State *L, int idx) {
+    return (LuaClayElementBuilder*)luaL_checkudata(L, idx, "ClayElementBuilder");
+}
+
+static LuaClayTextBuilder* check_text_builder(lua_State *L, int idx) {
+    return (LuaClayTextBuilder*)luaL_checkudata(L, idx, "ClayTextBuilder");
+}
+
+static void elem_builder_ensure_open(lua_State *L, LuaClayElementBuilder *b) {
+    if (!b || !b->active) luaL_error(L, "element builder is not active (already closed?)");
+}
+
+static void elem_builder_detach_ptrs(LuaClayElementBuilder *b) {
+    // After we configure into Clay, ownership of tagged registry refs transfers to Clay's render commands.
+    // Detach so __gc won't accidentally unref them.
+    b->decl.userData = NULL;
+    b->decl.image.imageData = NULL;
+    b->decl.custom.customData = NULL;
+}
+
+static void clay_gesture_register(uint32_t elementId);
+static void clay_focus_register(uint32_t elementId);
+
+static void elem_builder_configure_if_needed(lua_State *L, LuaClayElementBuilder *b) {
+    (void)L;
+    if (b->configured) return;
+
+    // Default clip offset behavior (match existing table reader): if clipping and offset omitted, default to scroll offset.
+    if ((b->decl.clip.horizontal || b->decl.clip.vertical) && !b->clipOffsetExplicit) {
+        b->decl.clip.childOffset = Clay_GetScrollOffset();
+    }
+
+    if (b->anim.mask) clay_anim_apply(Clay__GetOpenLayoutElement()->id, &b->anim, &b->decl);
+
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, b->decl));
+    b->configured = 1;
+    if (!g_MeasureDepth) {
+        uint32_t id = Clay__GetOpenLayoutElement()->id;
+        if (b->hasNineSlice) {
+            b->nineSlice.elementId = id;
+            clay_nine_slice_add(&b->nineSlice);
+        }
+        if (b->trackBounds) clay_flip_track(id, b->flipDuration, b->flipEasing);
+        if (b->gestureTarget) clay_gesture_register(id);
+        if (b->focusable) clay_focus_register(id);
+        if (b->payload && b->decl.custom.customData == b->payload) clay_payload_add(id, b->payload);
+    }
+
+    // IMPORTANT: detach tagged refs so builder doesn't unref them.
+    elem_builder_detach_ptrs(b);
 }
 
 // --- clay.element(...) ---
@@ -580,7 +2637,7 @@ static Clay_ElementId clay_element_id_from_args(lua_State *L, int arg1) {
         return clay_check_element_id(L, arg1);
     }
     if (t == LUA_TSTRING) {
-        Clay_String s = Clay_BorrowLuaString(L, 1);
+        Clay_String s = Clay_BorrowLuaString(L, arg1);
         uint32_t index = (uint32_t)luaL_optinteger(L, arg1 + 1, 0);
         bool isLocal = lua_toboolean(L, arg1 + 2);
 
@@ -847,6 +2904,27 @@ static int l_Elem_imageData(lua_State *L) {
     return 1;
 }
 
+// :nineSlice(left, top, right, bottom, imageWidth, imageHeight [, scale])
+// Insets are in image pixels; scale maps them to screen pixels (default 1).
+static int l_Elem_nineSlice(lua_State *L) {
+    LuaClayElementBuilder *b = check_elem_builder(L, 1);
+    elem_builder_ensure_open(L, b);
+    ClayNineSlice *s = &b->nineSlice;
+    for (int i = 0; i < 4; ++i) {
+        s->insets[i] = (float)luaL_checknumber(L, 2 + i);
+        luaL_argcheck(L, s->insets[i] >= 0, 2 + i, "inset must not be negative");
+    }
+    s->imageWidth = (float)luaL_checknumber(L, 6);
+    s->imageHeight = (float)luaL_checknumber(L, 7);
+    luaL_argcheck(L, s->insets[0] + s->insets[2] <= s->imageWidth, 6, "left + right insets exceed the image width");
+    luaL_argcheck(L, s->insets[1] + s->insets[3] <= s->imageHeight, 7, "top + bottom insets exceed the image height");
+    s->scale = (float)luaL_optnumber(L, 8, 1);
+    luaL_argcheck(L, s->scale > 0, 8, "scale must be positive");
+    b->hasNineSlice = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
 static int l_Elem_customData(lua_State *L) {
     LuaClayElementBuilder *b = check_elem_builder(L, 1);
     elem_builder_ensure_open(L, b);
@@ -855,6 +2933,75 @@ static int l_Elem_customData(lua_State *L) {
     return 1;
 }
 
+// :animate(prop, target, duration [, easing = clay.EASE_OUT])
+static int l_Elem_animate(lua_State *L) {
+    LuaClayElementBuilder *b = check_elem_builder(L, 1);
+    elem_builder_ensure_open(L, b);
+    int prop = luaL_checkoption(L, 2, NULL, g_AnimPropNames);
+    float duration = (float)luaL_checknumber(L, 4);
+    lua_Integer easing = luaL_optinteger(L, 5, CLAY_EASE_OUT);
+    luaL_argcheck(L, easing >= CLAY_EASE_LINEAR && easing <= CLAY_EASE_IN_OUT, 5, "unknown easing");
+    clay_anim_check_target(L, 3, prop, b->anim.target[prop]);
+    b->anim.duration[prop] = duration > 0 ? duration : 0;
+    b->anim.easing[prop] = (uint8_t)easing;
+    b->anim.mask |= (uint8_t)(1u << prop);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// :trackBounds([duration = 0 [, easing = clay.EASE_OUT]])
+static int l_Elem_trackBounds(lua_State *L) {
+    LuaClayElementBuilder *b = check_elem_builder(L, 1);
+    elem_builder_ensure_open(L, b);
+    float duration = (float)luaL_optnumber(L, 2, 0);
+    lua_Integer easing = luaL_optinteger(L, 3, CLAY_EASE_OUT);
+    luaL_argcheck(L, easing >= CLAY_EASE_LINEAR && easing <= CLAY_EASE_IN_OUT, 3, "unknown easing");
+    b->trackBounds = 1;
+    b->flipDuration = duration > 0 ? duration : 0;
+    b->flipEasing = (uint8_t)easing;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// :gestures()   (gesture events from presses on this element are reported with its id)
+static int l_Elem_gestures(lua_State *L) {
+    LuaClayElementBuilder *b = check_elem_builder(L, 1);
+    elem_builder_ensure_open(L, b);
+    b->gestureTarget = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// :focusable()   (a candidate for clay.focusNext)
+static int l_Elem_focusable(lua_State *L) {
+    LuaClayElementBuilder *b = check_elem_builder(L, 1);
+    elem_builder_ensure_open(L, b);
+    b->focusable = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// :payload(tag, v1, ..., vN)   (N <= 8; replaces customData)
+static int l_Elem_payload(lua_State *L) {
+    LuaClayElementBuilder *b = check_elem_builder(L, 1);
+    elem_builder_ensure_open(L, b);
+    lua_Integer tag = luaL_checkinteger(L, 2);
+    int count = lua_gettop(L) - 2;
+    luaL_argcheck(L, tag >= 0 && (uint64_t)tag <= UINT32_MAX, 2, "tag out of range");
+    luaL_argcheck(L, count <= CLAY_PAYLOAD_MAX, CLAY_PAYLOAD_MAX + 3, "at most 8 payload values");
+    ClayCustomPayload *p = (ClayCustomPayload*)clay_frame_alloc(sizeof(ClayCustomPayload));
+    if (!p) return luaL_error(L, "payload: out of memory");
+    memset(p, 0, sizeof(*p));
+    p->tag = (uint32_t)tag;
+    p->count = count;
+    for (int i = 0; i < count; ++i) p->values[i] = (double)luaL_checknumber(L, 3 + i);
+    clay_unref_tagged(L, &b->decl.custom.customData);
+    b->decl.custom.customData = p;
+    b->payload = p;
+    lua_settop(L, 1);
+    return 1;
+}
+
 static int l_Elem_userData(lua_State *L) {
     LuaClayElementBuilder *b = check_elem_builder(L, 1);
     elem_builder_ensure_open(L, b);
@@ -1044,159 +3191,7292 @@ static int l_Clay_TextBuilder_New(lua_State *L) {
         return 0;
     }
 
-    return 1;
+    return 1;
+}
+
+static void text_builder_detach_ptrs(LuaClayTextBuilder *t) {
+    t->cfg.userData = NULL;
+}
+
+static int l_Text_userData(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    clay_set_ptr_from_lua(L, 2, &t->cfg.userData);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_textColor(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.textColor.r = (float)luaL_checknumber(L, 2);
+    t->cfg.textColor.g = (float)luaL_checknumber(L, 3);
+    t->cfg.textColor.b = (float)luaL_checknumber(L, 4);
+    t->cfg.textColor.a = (float)luaL_optnumber(L, 5, 255.0);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_fontId(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.fontId = (uint16_t)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_fontSize(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.fontSize = (uint16_t)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_letterSpacing(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.letterSpacing = (uint16_t)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_lineHeight(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.lineHeight = (uint16_t)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_wrapMode(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.wrapMode = (Clay_TextElementConfigWrapMode)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_textAlignment(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    t->cfg.textAlignment = (Clay_TextAlignment)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// :paragraph([name[, index[, isLocal]]]) | :paragraph(idTable)
+// Emits the text inside an element with this id and caches its wrapped lines across frames.
+// Without arguments the id is derived from the parent and child position, like clay.autoId().
+static int l_Text_paragraph(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    if (lua_isnoneornil(L, 2)) {
+        t->paragraphAuto = 1;
+        t->paragraphId = (Clay_ElementId){0};
+    } else {
+        t->paragraphAuto = 0;
+        t->paragraphId = clay_element_id_from_args(L, 2);
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+// :ellipsis(maxLines[, mode]) -- mode: clay.ELLIPSIS_END (default), ELLIPSIS_MIDDLE, ELLIPSIS_START
+static int l_Text_ellipsis(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
+    lua_Integer lines = luaL_optinteger(L, 2, 1);
+    luaL_argcheck(L, lines >= 0 && lines <= UINT16_MAX, 2, "maxLines out of range");
+    t->ellipsisLines = (uint16_t)lines;
+    t->ellipsisMode = (uint8_t)luaL_optinteger(L, 3, CLAY_ELLIPSIS_END);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Text_close(lua_State *L) {
+    LuaClayTextBuilder *t = check_text_builder(L, 1);
+    if (!t->active) return 0;
+
+    text_builder_emit(t);
+    return 0;
+}
+
+// Alias for older name (some people prefer :done())
+static int l_Text_done(lua_State *L) {
+    return l_Text_close(L);
+}
+
+static int l_Text_gc(lua_State *L) {
+    LuaClayTextBuilder *t = (LuaClayTextBuilder*)luaL_testudata(L, 1, "ClayTextBuilder");
+    if (!t) return 0;
+    if (t->active) {
+        // Builder never done -> prevent leaking tagged ref
+        clay_unref_tagged(L, &t->cfg.userData);
+        t->active = 0;
+    }
+    return 0;
+}
+
+static void Clay_CreateElementBuilderMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayElementBuilder")) {
+        lua_pushcfunction(L, l_Elem_layoutDirection); lua_setfield(L, -2, "layoutDirection");
+        lua_pushcfunction(L, l_Elem_childGap); lua_setfield(L, -2, "childGap");
+        lua_pushcfunction(L, l_Elem_childAlignment); lua_setfield(L, -2, "childAlignment");
+        lua_pushcfunction(L, l_Elem_padding); lua_setfield(L, -2, "padding");
+        lua_pushcfunction(L, l_Elem_width); lua_setfield(L, -2, "width");
+        lua_pushcfunction(L, l_Elem_height); lua_setfield(L, -2, "height");
+        lua_pushcfunction(L, l_Elem_backgroundColor); lua_setfield(L, -2, "backgroundColor");
+        lua_pushcfunction(L, l_Elem_cornerRadius); lua_setfield(L, -2, "cornerRadius");
+        lua_pushcfunction(L, l_Elem_borderColor); lua_setfield(L, -2, "borderColor");
+        lua_pushcfunction(L, l_Elem_borderWidth); lua_setfield(L, -2, "borderWidth");
+        lua_pushcfunction(L, l_Elem_clip); lua_setfield(L, -2, "clip");
+        lua_pushcfunction(L, l_Elem_clipHorizontal); lua_setfield(L, -2, "clipHorizontal");
+        lua_pushcfunction(L, l_Elem_clipVertical); lua_setfield(L, -2, "clipVertical");
+        lua_pushcfunction(L, l_Elem_childOffset); lua_setfield(L, -2, "childOffset");
+        lua_pushcfunction(L, l_Elem_aspectRatio); lua_setfield(L, -2, "aspectRatio");
+        lua_pushcfunction(L, l_Elem_imageData); lua_setfield(L, -2, "imageData");
+        lua_pushcfunction(L, l_Elem_nineSlice); lua_setfield(L, -2, "nineSlice");
+        lua_pushcfunction(L, l_Elem_customData); lua_setfield(L, -2, "customData");
+        lua_pushcfunction(L, l_Elem_payload); lua_setfield(L, -2, "payload");
+        lua_pushcfunction(L, l_Elem_animate); lua_setfield(L, -2, "animate");
+        lua_pushcfunction(L, l_Elem_trackBounds); lua_setfield(L, -2, "trackBounds");
+        lua_pushcfunction(L, l_Elem_gestures); lua_setfield(L, -2, "gestures");
+        lua_pushcfunction(L, l_Elem_focusable); lua_setfield(L, -2, "focusable");
+        lua_pushcfunction(L, l_Elem_userData); lua_setfield(L, -2, "userData");
+
+        lua_pushcfunction(L, l_Elem_attachTo); lua_setfield(L, -2, "attachTo");
+        lua_pushcfunction(L, l_Elem_attachPoints); lua_setfield(L, -2, "attachPoints");
+        lua_pushcfunction(L, l_Elem_offset); lua_setfield(L, -2, "offset");
+        lua_pushcfunction(L, l_Elem_expand); lua_setfield(L, -2, "expand");
+        lua_pushcfunction(L, l_Elem_parentId); lua_setfield(L, -2, "parentId");
+        lua_pushcfunction(L, l_Elem_zIndex); lua_setfield(L, -2, "zIndex");
+        lua_pushcfunction(L, l_Elem_pointerCaptureMode); lua_setfield(L, -2, "pointerCaptureMode");
+        lua_pushcfunction(L, l_Elem_clipTo); lua_setfield(L, -2, "clipTo");
+
+        lua_pushcfunction(L, l_Elem_children); lua_setfield(L, -2, "children");
+        lua_pushcfunction(L, l_Elem_close); lua_setfield(L, -2, "close");
+
+        lua_pushcfunction(L, l_Elem_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+static void Clay_CreateTextBuilderMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayTextBuilder")) {
+        lua_pushcfunction(L, l_Text_userData); lua_setfield(L, -2, "userData");
+        lua_pushcfunction(L, l_Text_textColor); lua_setfield(L, -2, "textColor");
+        lua_pushcfunction(L, l_Text_fontId); lua_setfield(L, -2, "fontId");
+        lua_pushcfunction(L, l_Text_fontSize); lua_setfield(L, -2, "fontSize");
+        lua_pushcfunction(L, l_Text_letterSpacing); lua_setfield(L, -2, "letterSpacing");
+        lua_pushcfunction(L, l_Text_lineHeight); lua_setfield(L, -2, "lineHeight");
+        lua_pushcfunction(L, l_Text_wrapMode); lua_setfield(L, -2, "wrapMode");
+        lua_pushcfunction(L, l_Text_textAlignment); lua_setfield(L, -2, "textAlignment");
+        lua_pushcfunction(L, l_Text_paragraph); lua_setfield(L, -2, "paragraph");
+        lua_pushcfunction(L, l_Text_ellipsis); lua_setfield(L, -2, "ellipsis");
+        lua_pushcfunction(L, l_Text_close); lua_setfield(L, -2, "close");
+        lua_pushcfunction(L, l_Text_done); lua_setfield(L, -2, "done");
+        lua_pushcfunction(L, l_Text_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Data grid
+//
+// clay.dataGrid() keeps cell values in C, one buffer per column, filled from Lua in
+// bulk. grid:emit(id) declares only the rows and columns inside the visible window
+// (taken from the previous frame's scroll position and viewport), with spacers for the
+// rest, and formats numbers natively into the frame arena.
+// -----------------------------------------------------------------------------
+
+enum { CLAY_GRID_NUMBER = 0, CLAY_GRID_STRING = 1 };
+
+#define CLAY_GRID_FORMAT_MAX 24
+
+typedef struct {
+    int type;
+    float width;                // > 0: fixed; 0: measured from the title and all cells
+    float measuredWidth;
+    int widthDirty;             // title, style or row count changed: measure every cell again
+    float titleWidth;
+    float cellWidth;            // widest cell, without padding
+    int32_t widestRow;          // row holding cellWidth, -1: none
+    int32_t dirtyFirst;         // rows [dirtyFirst, dirtyEnd) were written since the last layout
+    int32_t dirtyEnd;
+    Clay_LayoutAlignmentX align;
+    char format[CLAY_GRID_FORMAT_MAX];  // number cells: printf format with one floating conversion
+    char *title;
+    int32_t titleLength;
+    double *numbers;            // CLAY_GRID_NUMBER
+    uint32_t *offsets;          // CLAY_GRID_STRING: cell bytes live at pool + offsets[row]
+    int32_t *lengths;
+    char *pool;
+    size_t poolUsed;
+    size_t poolCapacity;
+    size_t poolLive;            // bytes still referenced by a cell
+} ClayGridColumn;
+
+typedef struct {
+    ClayGridColumn *columns;
+    int32_t columnCount;
+    float *columnX;             // columnCount + 1 prefix offsets, refreshed on emit
+    int32_t rowCount;
+    int32_t rowCapacity;
+    int32_t *order;             // display row -> data row
+    int32_t sortColumn;         // -1: data order
+    int sortDescending;
+    int sortDirty;
+    int32_t selectedRow;        // data row, -1: none
+    float rowHeight;
+    float headerHeight;
+    uint16_t cellPadding;
+    Clay_TextElementConfig text;
+    Clay_TextElementConfig headerText;
+    Clay_Color headerColor;
+    Clay_Color rowColor;
+    Clay_Color altRowColor;
+    Clay_Color selectedColor;
+    Clay_ElementId id;          // last emitted id, for hitTest()
+} ClayDataGrid;
+
+static void clay_grid_column_free(ClayGridColumn *c) {
+    free(c->title);
+    free(c->numbers);
+    free(c->offsets);
+    free(c->lengths);
+    free(c->pool);
+    *c = (ClayGridColumn){0};
+}
+
+static void clay_grid_free(ClayDataGrid *g) {
+    for (int32_t c = 0; c < g->columnCount; ++c) clay_grid_column_free(&g->columns[c]);
+    free(g->columns);
+    free(g->columnX);
+    free(g->order);
+    g->columns = NULL;
+    g->columnX = NULL;
+    g->order = NULL;
+    g->columnCount = g->rowCount = g->rowCapacity = 0;
+}
+
+static int clay_grid_column_reserve(ClayGridColumn *c, int32_t oldCap, int32_t cap) {
+    if (c->type == CLAY_GRID_NUMBER) {
+        double *n = (double*)realloc(c->numbers, sizeof(double) * (size_t)cap);
+        if (!n) return 0;
+        memset(n + oldCap, 0, sizeof(double) * (size_t)(cap - oldCap));
+        c->numbers = n;
+    } else {
+        uint32_t *o = (uint32_t*)realloc(c->offsets, sizeof(uint32_t) * (size_t)cap);
+        if (!o) return 0;
+        c->offsets = o;
+        int32_t *l = (int32_t*)realloc(c->lengths, sizeof(int32_t) * (size_t)cap);
+        if (!l) return 0;
+        c->lengths = l;
+        memset(o + oldCap, 0, sizeof(uint32_t) * (size_t)(cap - oldCap));
+        memset(l + oldCap, 0, sizeof(int32_t) * (size_t)(cap - oldCap));
+    }
+    return 1;
+}
+
+// Every buffer is allocated at the new capacity before any column is touched,
+// so a failure leaves all columns at the recorded rowCapacity.
+static int clay_grid_reserve_rows(ClayDataGrid *g, int32_t rows) {
+    if (rows <= g->rowCapacity) return 1;
+    int32_t oldCap = g->rowCapacity;
+    int32_t cap = oldCap ? oldCap : 64;
+    while (cap < rows) cap *= 2;
+
+    // fresh[0] is the order array, then two slots per column:
+    // numbers, or offsets + lengths.
+    int32_t slots = 1 + g->columnCount * 2;
+    void **fresh = (void**)calloc((size_t)slots, sizeof(void*));
+    if (!fresh) return 0;
+    int ok = (fresh[0] = malloc(sizeof(int32_t) * (size_t)cap)) != NULL;
+    for (int32_t c = 0; ok && c < g->columnCount; ++c) {
+        if (g->columns[c].type == CLAY_GRID_NUMBER) {
+            ok = (fresh[1 + c * 2] = calloc((size_t)cap, sizeof(double))) != NULL;
+        } else {
+            ok = (fresh[1 + c * 2] = calloc((size_t)cap, sizeof(uint32_t))) != NULL
+              && (fresh[2 + c * 2] = calloc((size_t)cap, sizeof(int32_t))) != NULL;
+        }
+    }
+    if (!ok) {
+        for (int32_t i = 0; i < slots; ++i) free(fresh[i]);
+        free(fresh);
+        return 0;
+    }
+
+    if (g->order) memcpy(fresh[0], g->order, sizeof(int32_t) * (size_t)oldCap);
+    free(g->order);
+    g->order = (int32_t*)fresh[0];
+    for (int32_t c = 0; c < g->columnCount; ++c) {
+        ClayGridColumn *col = &g->columns[c];
+        if (col->type == CLAY_GRID_NUMBER) {
+            if (col->numbers) memcpy(fresh[1 + c * 2], col->numbers, sizeof(double) * (size_t)oldCap);
+            free(col->numbers);
+            col->numbers = (double*)fresh[1 + c * 2];
+        } else {
+            if (col->offsets) memcpy(fresh[1 + c * 2], col->offsets, sizeof(uint32_t) * (size_t)oldCap);
+            if (col->lengths) memcpy(fresh[2 + c * 2], col->lengths, sizeof(int32_t) * (size_t)oldCap);
+            free(col->offsets);
+            free(col->lengths);
+            col->offsets = (uint32_t*)fresh[1 + c * 2];
+            col->lengths = (int32_t*)fresh[2 + c * 2];
+        }
+    }
+    free(fresh);
+    g->rowCapacity = cap;
+    return 1;
+}
+
+static void clay_grid_dirty_rows(ClayGridColumn *col, int32_t first, int32_t end) {
+    if (col->dirtyFirst >= col->dirtyEnd) {
+        col->dirtyFirst = first;
+        col->dirtyEnd = end;
+        return;
+    }
+    if (first < col->dirtyFirst) col->dirtyFirst = first;
+    if (end > col->dirtyEnd) col->dirtyEnd = end;
+}
+
+static void clay_grid_set_row_count(ClayDataGrid *g, int32_t rows) {
+    for (int32_t c = 0; c < g->columnCount; ++c) {
+        ClayGridColumn *col = &g->columns[c];
+        // cells past the end are cleared so a later grow starts empty
+        for (int32_t r = rows; r < g->rowCount; ++r) {
+            if (col->type == CLAY_GRID_NUMBER) {
+                col->numbers[r] = 0;
+            } else {
+                col->poolLive -= (size_t)col->lengths[r];
+                col->lengths[r] = 0;
+            }
+        }
+        if (rows < g->rowCount) {
+            if (col->widestRow >= rows) col->widthDirty = 1;
+            if (col->dirtyEnd > rows) col->dirtyEnd = rows;
+        } else if (col->type == CLAY_GRID_NUMBER) {
+            clay_grid_dirty_rows(col, g->rowCount, rows);   // new number cells read 0, which has text
+        }
+    }
+    g->rowCount = rows;
+    g->sortDirty = 1;
+    if (g->selectedRow >= rows) g->selectedRow = -1;
+}
+
+// Rewrite the pool with only the live cells once more than half of it is garbage.
+static void clay_grid_pool_compact(ClayGridColumn *c, int32_t rowCount) {
+    if (c->poolUsed < 4096 || c->poolLive * 2 > c->poolUsed) return;
+    size_t cap = c->poolLive + 1024;
+    char *pool = (char*)malloc(cap);
+    if (!pool) return;
+    size_t used = 0;
+    for (int32_t r = 0; r < rowCount; ++r) {
+        memcpy(pool + used, c->pool + c->offsets[r], (size_t)c->lengths[r]);
+        c->offsets[r] = (uint32_t)used;
+        used += (size_t)c->lengths[r];
+    }
+    free(c->pool);
+    c->pool = pool;
+    c->poolUsed = used;
+    c->poolCapacity = cap;
+}
+
+static int clay_grid_set_string(ClayGridColumn *c, int32_t row, const char *chars, size_t len) {
+    int32_t old = c->lengths[row];
+    if ((size_t)old >= len) {
+        memcpy(c->pool + c->offsets[row], chars, len);    // shrink in place
+    } else {
+        if (c->poolUsed + len > UINT32_MAX) return 0;
+        if (c->poolUsed + len > c->poolCapacity) {
+            size_t cap = c->poolCapacity ? c->poolCapacity : 4096;
+            while (cap < c->poolUsed + len) cap *= 2;
+            char *pool = (char*)realloc(c->pool, cap);
+            if (!pool) return 0;
+            c->pool = pool;
+            c->poolCapacity = cap;
+        }
+        memcpy(c->pool + c->poolUsed, chars, len);
+        c->offsets[row] = (uint32_t)c->poolUsed;
+        c->poolUsed += len;
+    }
+    c->poolLive += len - (size_t)old;
+    c->lengths[row] = (int32_t)len;
+    return 1;
+}
+
+// Accept flags, width and precision followed by one of f F e E g G a A; "%%" is literal.
+static int clay_grid_format_valid(const char *fmt) {
+    int conversions = 0;
+    for (const char *p = fmt; *p; ++p) {
+        if (*p != '%') continue;
+        if (p[1] == '%') { p++; continue; }
+        p++;
+        while (*p && strchr("-+ #0", *p)) p++;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == '.') { p++; while (*p >= '0' && *p <= '9') p++; }
+        if (!*p || !strchr("fFeEgGaA", *p)) return 0;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+// Cell text for a data row; number cells are formatted into buf.
+static const char* clay_grid_cell(const ClayGridColumn *c, int32_t row, char *buf, size_t cap, int32_t *length) {
+    if (c->type == CLAY_GRID_STRING) {
+        *length = c->lengths[row];
+        return c->pool ? c->pool + c->offsets[row] : "";
+    }
+    int n = snprintf(buf, cap, c->format, c->numbers[row]);
+    *length = n < 0 ? 0 : (n >= (int)cap ? (int32_t)cap - 1 : n);
+    return buf;
+}
+
+static const ClayGridColumn *g_GridSortColumn = NULL;
+static int g_GridSortSign = 1;
+
+static int clay_grid_cmp_rows(const void *a, const void *b) {
+    int32_t ra = *(const int32_t*)a, rb = *(const int32_t*)b;
+    const ClayGridColumn *c = g_GridSortColumn;
+    int r;
+    if (c->type == CLAY_GRID_NUMBER) {
+        double x = c->numbers[ra], y = c->numbers[rb];
+        // NaN sorts after every number in both directions, so the order stays strict
+        int nx = x != x, ny = y != y;
+        if (nx != ny) return nx - ny;
+        r = nx ? 0 : (x > y) - (x < y);
+    } else {
+        int32_t la = c->lengths[ra], lb = c->lengths[rb];
+        r = la && lb ? memcmp(c->pool + c->offsets[ra], c->pool + c->offsets[rb], (size_t)(la < lb ? la : lb)) : 0;
+        if (r == 0) r = (la > lb) - (la < lb);
+    }
+    if (r == 0) return (ra > rb) - (ra < rb);   // keep equal rows in data order
+    return r * g_GridSortSign;
+}
+
+static void clay_grid_sort_if_needed(ClayDataGrid *g) {
+    if (!g->sortDirty) return;
+    g->sortDirty = 0;
+    for (int32_t r = 0; r < g->rowCount; ++r) g->order[r] = r;
+    if (g->sortColumn < 0 || g->sortColumn >= g->columnCount || g->rowCount < 2) return;
+    g_GridSortColumn = &g->columns[g->sortColumn];
+    g_GridSortSign = g->sortDescending ? -1 : 1;
+    qsort(g->order, (size_t)g->rowCount, sizeof(int32_t), clay_grid_cmp_rows);
+    g_GridSortColumn = NULL;
+}
+
+// Width of the widest cell in rows [first, end); *row is set to its row, -1 when the range is empty.
+static float clay_grid_widest_cell(ClayDataGrid *g, const ClayGridColumn *col, int32_t first, int32_t end, int32_t *row) {
+    char buf[64];
+    float w = 0;
+    *row = -1;
+    for (int32_t r = first; r < end; ++r) {
+        int32_t len;
+        const char *s = clay_grid_cell(col, r, buf, sizeof(buf), &len);
+        float cw = len > 0 ? clay_measure_slice(s, len, &g->text) : 0;
+        if (*row < 0 || cw > w) { w = cw; *row = r; }
+    }
+    return w;
+}
+
+static void clay_grid_layout_columns(ClayDataGrid *g) {
+    float x = 0;
+    for (int32_t c = 0; c < g->columnCount; ++c) {
+        ClayGridColumn *col = &g->columns[c];
+        g->columnX[c] = x;
+        if (col->width > 0) { x += col->width; continue; }
+        // Measured columns fit the widest cell. Only rows written since the last layout are
+        // measured, unless one of them held the widest cell and got narrower.
+        if (!col->widthDirty && col->dirtyFirst < col->dirtyEnd) {
+            int32_t widest;
+            float w = clay_grid_widest_cell(g, col, col->dirtyFirst, col->dirtyEnd, &widest);
+            if (w >= col->cellWidth) {
+                col->cellWidth = w;
+                col->widestRow = widest;
+            } else if (col->widestRow >= col->dirtyFirst && col->widestRow < col->dirtyEnd) {
+                col->widthDirty = 1;
+            }
+        }
+        if (col->widthDirty) {
+            col->cellWidth = clay_grid_widest_cell(g, col, 0, g->rowCount, &col->widestRow);
+            col->titleWidth = col->titleLength > 0 ? clay_measure_slice(col->title, col->titleLength, &g->headerText) : 0;
+        }
+        col->widthDirty = 0;
+        col->dirtyFirst = col->dirtyEnd = 0;
+        col->measuredWidth = (col->titleWidth > col->cellWidth ? col->titleWidth : col->cellWidth) + 2.0f * (float)g->cellPadding;
+        x += col->measuredWidth;
+    }
+    g->columnX[g->columnCount] = x;
+}
+
+static ClayDataGrid* check_data_grid(lua_State *L, int idx) {
+    return (ClayDataGrid*)luaL_checkudata(L, idx, "ClayDataGrid");
+}
+
+static ClayGridColumn* check_grid_column(lua_State *L, ClayDataGrid *g, int idx) {
+    lua_Integer c = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, c >= 1 && c <= g->columnCount, idx, "column out of range");
+    return &g->columns[c - 1];
+}
+
+// Rows [first, first + count) of col were written.
+static void clay_grid_mark_dirty(ClayDataGrid *g, ClayGridColumn *col, int32_t first, int32_t count) {
+    clay_grid_dirty_rows(col, first, first + count);
+    if (g->sortColumn >= 0 && &g->columns[g->sortColumn] == col) g->sortDirty = 1;
+}
+
+// clay.dataGrid() -> grid
+static int l_Clay_DataGrid_New(lua_State *L) {
+    ClayDataGrid *g = (ClayDataGrid*)lua_newuserdata(L, sizeof(ClayDataGrid));
+    memset(g, 0, sizeof(*g));
+    g->sortColumn = -1;
+    g->selectedRow = -1;
+    g->rowHeight = 24;
+    g->headerHeight = 28;
+    g->cellPadding = 6;
+    g->text = (Clay_TextElementConfig){ .textColor = {255,255,255,255}, .fontId = 1, .fontSize = 16,
+                                        .wrapMode = CLAY_TEXT_WRAP_NONE };
+    g->headerText = g->text;
+    g->headerColor = (Clay_Color){40,40,40,255};
+    g->rowColor = (Clay_Color){0,0,0,0};
+    g->altRowColor = (Clay_Color){255,255,255,12};
+    g->selectedColor = (Clay_Color){60,110,200,255};
+    luaL_setmetatable(L, "ClayDataGrid");
+    return 1;
+}
+
+// grid:setColumns({ {title=, type=clay.GRID_NUMBER|GRID_STRING, width=, format=, align=}, ... })
+// Replaces all columns; the row count is kept and the new columns start empty.
+static int l_Grid_setColumns(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int32_t count = (int32_t)clay_rawlen(L, 2);
+
+    ClayGridColumn *cols = (ClayGridColumn*)calloc((size_t)(count > 0 ? count : 1), sizeof(ClayGridColumn));
+    float *colX = (float*)malloc(sizeof(float) * (size_t)(count + 1));
+    if (!cols || !colX) { free(cols); free(colX); return luaL_error(L, "setColumns: out of memory"); }
+
+    for (int32_t c = 0; c < count; ++c) {
+        ClayGridColumn *col = &cols[c];
+        lua_rawgeti(L, 2, c + 1);
+        if (!lua_istable(L, -1)) {
+            free(cols); free(colX);
+            return luaL_error(L, "setColumns: column %d must be a table", (int)(c + 1));
+        }
+        int t = lua_gettop(L);
+        lua_getfield(L, t, "type");
+        col->type = lua_isnumber(L, -1) && lua_tointeger(L, -1) == CLAY_GRID_STRING ? CLAY_GRID_STRING : CLAY_GRID_NUMBER;
+        lua_pop(L, 1);
+        col->width = clay_opt_number_field(L, t, "width", 0.0f);
+        col->widthDirty = 1;
+        col->align = (Clay_LayoutAlignmentX)(int)clay_opt_number_field(L, t, "align",
+                         (float)(col->type == CLAY_GRID_NUMBER ? CLAY_ALIGN_X_RIGHT : CLAY_ALIGN_X_LEFT));
+
+        lua_getfield(L, t, "format");
+        const char *fmt = lua_isstring(L, -1) ? lua_tostring(L, -1) : "%.2f";
+        if (strlen(fmt) >= CLAY_GRID_FORMAT_MAX || !clay_grid_format_valid(fmt)) {
+            for (int32_t k = 0; k <= c; ++k) clay_grid_column_free(&cols[k]);
+            free(cols); free(colX);
+            return luaL_error(L, "setColumns: column %d format must have one %%f/%%e/%%g/%%a conversion", (int)(c + 1));
+        }
+        strcpy(col->format, fmt);
+        lua_pop(L, 1);
+
+        lua_getfield(L, t, "title");
+        size_t tlen = 0;
+        const char *title = lua_isstring(L, -1) ? lua_tolstring(L, -1, &tlen) : NULL;
+        if (title && tlen > 0) {
+            col->title = (char*)malloc(tlen);
+            if (col->title) { memcpy(col->title, title, tlen); col->titleLength = (int32_t)tlen; }
+        }
+        lua_pop(L, 2);
+
+        if (g->rowCapacity > 0 && !clay_grid_column_reserve(col, 0, g->rowCapacity)) {
+            for (int32_t k = 0; k <= c; ++k) clay_grid_column_free(&cols[k]);
+            free(cols); free(colX);
+            return luaL_error(L, "setColumns: out of memory");
+        }
+    }
+
+    for (int32_t c = 0; c < g->columnCount; ++c) clay_grid_column_free(&g->columns[c]);
+    free(g->columns);
+    free(g->columnX);
+    g->columns = cols;
+    g->columnX = colX;
+    g->columnCount = count;
+    g->sortColumn = -1;
+    g->sortDirty = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// grid:setRowCount(n)
+static int l_Grid_setRowCount(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    lua_Integer n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0 && n <= INT32_MAX / 2, 2, "row count out of range");
+    if (!clay_grid_reserve_rows(g, (int32_t)n)) return luaL_error(L, "setRowCount: out of memory");
+    clay_grid_set_row_count(g, (int32_t)n);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Grid_rowCount(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    lua_pushinteger(L, g->rowCount);
+    return 1;
+}
+
+// Reserve rows for a bulk write of `count` values starting at firstRow (0-based).
+static void clay_grid_prepare_write(lua_State *L, ClayDataGrid *g, int32_t firstRow, int32_t count) {
+    int64_t end = (int64_t)firstRow + count;
+    if (end > INT32_MAX / 2) luaL_error(L, "data grid: row out of range");
+    if (end > g->rowCount) {
+        if (!clay_grid_reserve_rows(g, (int32_t)end)) luaL_error(L, "data grid: out of memory");
+        clay_grid_set_row_count(g, (int32_t)end);
+    }
+}
+
+// grid:setNumbers(col, { values... } [, firstRow = 1])
+static int l_Grid_setNumbers(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    ClayGridColumn *col = check_grid_column(L, g, 2);
+    luaL_argcheck(L, col->type == CLAY_GRID_NUMBER, 2, "not a number column");
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_Integer first = luaL_optinteger(L, 4, 1);
+    size_t len = clay_rawlen(L, 3);
+    luaL_argcheck(L, first >= 1 && first <= INT32_MAX, 4, "row out of range");
+    luaL_argcheck(L, (uint64_t)(first - 1) + len <= INT32_MAX, 3, "too many rows");
+    int32_t row0 = (int32_t)(first - 1);
+    int32_t count = (int32_t)len;
+    clay_grid_prepare_write(L, g, row0, count);
+
+    double *dst = col->numbers + row0;
+    for (int32_t i = 0; i < count; ++i) {
+        lua_rawgeti(L, 3, i + 1);
+        dst[i] = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+    clay_grid_mark_dirty(g, col, row0, count);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// grid:setStrings(col, { values... } [, firstRow = 1])
+static int l_Grid_setStrings(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    ClayGridColumn *col = check_grid_column(L, g, 2);
+    luaL_argcheck(L, col->type == CLAY_GRID_STRING, 2, "not a string column");
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_Integer first = luaL_optinteger(L, 4, 1);
+    size_t rows = clay_rawlen(L, 3);
+    luaL_argcheck(L, first >= 1 && first <= INT32_MAX, 4, "row out of range");
+    luaL_argcheck(L, (uint64_t)(first - 1) + rows <= INT32_MAX, 3, "too many rows");
+    int32_t row0 = (int32_t)(first - 1);
+    int32_t count = (int32_t)rows;
+    clay_grid_prepare_write(L, g, row0, count);
+
+    for (int32_t i = 0; i < count; ++i) {
+        lua_rawgeti(L, 3, i + 1);
+        size_t len = 0;
+        const char *s = lua_tolstring(L, -1, &len);
+        if (!clay_grid_set_string(col, row0 + i, s ? s : "", s ? len : 0)) {
+            return luaL_error(L, "setStrings: out of memory");
+        }
+        lua_pop(L, 1);
+    }
+    clay_grid_pool_compact(col, g->rowCount);
+    clay_grid_mark_dirty(g, col, row0, count);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// grid:set(row, col, value)
+static int l_Grid_set(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    lua_Integer row = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, row >= 1 && row <= INT32_MAX, 2, "row out of range");
+    ClayGridColumn *col = check_grid_column(L, g, 3);
+    int32_t row0 = (int32_t)(row - 1);
+    clay_grid_prepare_write(L, g, row0, 1);
+
+    if (col->type == CLAY_GRID_NUMBER) {
+        col->numbers[row0] = luaL_checknumber(L, 4);
+    } else {
+        size_t len = 0;
+        const char *s = luaL_checklstring(L, 4, &len);
+        if (!clay_grid_set_string(col, row0, s, len)) return luaL_error(L, "set: out of memory");
+        clay_grid_pool_compact(col, g->rowCount);
+    }
+    clay_grid_mark_dirty(g, col, row0, 1);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// grid:get(row, col) -> number | string
+static int l_Grid_get(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    lua_Integer row = luaL_checkinteger(L, 2);
+    ClayGridColumn *col = check_grid_column(L, g, 3);
+    if (row < 1 || row > g->rowCount) return 0;
+    if (col->type == CLAY_GRID_NUMBER) {
+        lua_pushnumber(L, col->numbers[row - 1]);
+    } else {
+        lua_pushlstring(L, col->pool ? col->pool + col->offsets[row - 1] : "", (size_t)col->lengths[row - 1]);
+    }
+    return 1;
+}
+
+// grid:sort(col [, descending]) | grid:sort(nil)
+static int l_Grid_sort(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        g->sortColumn = -1;
+    } else {
+        check_grid_column(L, g, 2);
+        g->sortColumn = (int32_t)lua_tointeger(L, 2) - 1;
+        g->sortDescending = lua_toboolean(L, 3);
+    }
+    g->sortDirty = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// grid:rowAt(displayRow) -> dataRow (after sorting)
+static int l_Grid_rowAt(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    lua_Integer r = luaL_checkinteger(L, 2);
+    if (r < 1 || r > g->rowCount) return 0;
+    clay_grid_sort_if_needed(g);
+    lua_pushinteger(L, g->order[r - 1] + 1);
+    return 1;
+}
+
+// grid:select(dataRow | nil)
+static int l_Grid_select(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    lua_Integer r = luaL_optinteger(L, 2, 0);
+    g->selectedRow = r >= 1 && r <= g->rowCount ? (int32_t)r - 1 : -1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static void clay_grid_read_text_style(lua_State *L, int tbl, const char *name, Clay_TextElementConfig *cfg) {
+    lua_getfield(L, tbl, name);
+    if (lua_istable(L, -1)) {
+        int t = lua_gettop(L);
+        cfg->fontId = (uint16_t)clay_opt_number_field(L, t, "fontId", cfg->fontId);
+        cfg->fontSize = (uint16_t)clay_opt_number_field(L, t, "fontSize", cfg->fontSize);
+        cfg->letterSpacing = (uint16_t)clay_opt_number_field(L, t, "letterSpacing", cfg->letterSpacing);
+        cfg->lineHeight = (uint16_t)clay_opt_number_field(L, t, "lineHeight", cfg->lineHeight);
+        clay_opt_color_field(L, t, "textColor", &cfg->textColor);
+    }
+    lua_pop(L, 1);
+}
+
+// grid:setStyle({ rowHeight=, headerHeight=, cellPadding=, text={...}, headerText={...},
+//                 headerColor=, rowColor=, altRowColor=, selectedColor= })
+static int l_Grid_setStyle(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    g->rowHeight = clay_opt_number_field(L, 2, "rowHeight", g->rowHeight);
+    g->headerHeight = clay_opt_number_field(L, 2, "headerHeight", g->headerHeight);
+    g->cellPadding = (uint16_t)clay_opt_number_field(L, 2, "cellPadding", g->cellPadding);
+    luaL_argcheck(L, g->rowHeight > 0 && g->headerHeight >= 0, 2, "row heights must be positive");
+    clay_grid_read_text_style(L, 2, "text", &g->text);
+    clay_grid_read_text_style(L, 2, "headerText", &g->headerText);
+    clay_opt_color_field(L, 2, "headerColor", &g->headerColor);
+    clay_opt_color_field(L, 2, "rowColor", &g->rowColor);
+    clay_opt_color_field(L, 2, "altRowColor", &g->altRowColor);
+    clay_opt_color_field(L, 2, "selectedColor", &g->selectedColor);
+    for (int32_t c = 0; c < g->columnCount; ++c) g->columns[c].widthDirty = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static void clay_grid_open_box(float width, float height, Clay_Color bg) {
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { width, width } }, .type = CLAY__SIZING_TYPE_FIXED };
+    decl.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { height, height } }, .type = CLAY__SIZING_TYPE_FIXED };
+    decl.backgroundColor = bg;
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+}
+
+// One header or body row: a spacer for the columns left of the window, then cells c0..c1-1.
+static void clay_grid_emit_row(ClayDataGrid *g, int32_t dataRow, int32_t c0, int32_t c1, float height,
+                               Clay_Color bg, Clay_TextElementConfig *cfg) {
+    Clay_ElementDeclaration row = (Clay_ElementDeclaration){0};
+    row.layout = CLAY_LAYOUT_DEFAULT;
+    row.layout.layoutDirection = CLAY_LEFT_TO_RIGHT;
+    float totalW = g->columnX[g->columnCount];
+    row.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { totalW, totalW } }, .type = CLAY__SIZING_TYPE_FIXED };
+    row.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { height, height } }, .type = CLAY__SIZING_TYPE_FIXED };
+    row.backgroundColor = bg;
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, row));
+
+    if (c0 > 0) {
+        clay_grid_open_box(g->columnX[c0], 0, (Clay_Color){0});
+        Clay__CloseElement();
+    }
+    for (int32_t c = c0; c < c1; ++c) {
+        ClayGridColumn *col = &g->columns[c];
+        float w = g->columnX[c + 1] - g->columnX[c];
+        Clay_ElementDeclaration cell = (Clay_ElementDeclaration){0};
+        cell.layout = CLAY_LAYOUT_DEFAULT;
+        cell.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { w, w } }, .type = CLAY__SIZING_TYPE_FIXED };
+        cell.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { height, height } }, .type = CLAY__SIZING_TYPE_FIXED };
+        cell.layout.padding.left = cell.layout.padding.right = g->cellPadding;
+        cell.layout.childAlignment.x = col->align;
+        cell.layout.childAlignment.y = CLAY_ALIGN_Y_CENTER;
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, cell));
+
+        char buf[64];
+        int32_t len = 0;
+        const char *s = dataRow < 0 ? col->title : clay_grid_cell(col, dataRow, buf, sizeof(buf), &len);
+        if (dataRow < 0) len = col->titleLength;
+        if (len > 0) {
+            // copied: the column pool may move if Lua writes cells before the frame is rendered
+            Clay_String str = clay_frame_string(s, len);
+            if (str.chars) CLAY_TEXT(str, cfg);
+        }
+        Clay__CloseElement();
+    }
+    Clay__CloseElement();
+}
+
+static void clay_grid_emit(ClayDataGrid *g, Clay_ElementId id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    g->id = id;
+    clay_grid_sort_if_needed(g);
+    clay_grid_layout_columns(g);
+
+    Clay_ElementId headerId = Clay__HashNumber(0, id.id);
+    Clay_ElementId bodyId = Clay__HashNumber(1, id.id);
+    float totalW = g->columnX[g->columnCount];
+    float totalH = (float)g->rowCount * g->rowHeight;
+
+    // Window from the previous frame; before the first layout assume the whole screen.
+    float scrollX = 0, scrollY = 0;
+    float viewW = ctx->layoutDimensions.width, viewH = ctx->layoutDimensions.height;
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(bodyId.id);
+    if (sd) {
+        scrollX = -sd->scrollPosition.x;
+        scrollY = -sd->scrollPosition.y;
+        if (sd->boundingBox.width > 0) viewW = sd->boundingBox.width;
+        if (sd->boundingBox.height > 0) viewH = sd->boundingBox.height;
+    }
+
+    int32_t first = (int32_t)(scrollY / g->rowHeight);
+    int32_t last = (int32_t)ceilf((scrollY + viewH) / g->rowHeight) + 1;
+    if (first < 0) first = 0;
+    if (first > g->rowCount) first = g->rowCount;
+    if (last > g->rowCount) last = g->rowCount;
+    if (last < first) last = first;
+
+    int32_t c0 = 0, c1 = g->columnCount;
+    while (c0 < g->columnCount && g->columnX[c0 + 1] <= scrollX) c0++;
+    while (c1 > c0 && g->columnX[c1 - 1] >= scrollX + viewW) c1--;
+
+    Clay_TextElementConfig *cellCfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+    Clay_TextElementConfig *headerCfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+    *cellCfg = g->text;
+    *headerCfg = g->headerText;
+    cellCfg->wrapMode = headerCfg->wrapMode = CLAY_TEXT_WRAP_NONE;
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    // Header: clipped horizontally and shifted with the body so the columns stay aligned.
+    if (g->headerHeight > 0) {
+        Clay_ElementDeclaration hd = (Clay_ElementDeclaration){0};
+        hd.layout = CLAY_LAYOUT_DEFAULT;
+        hd.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+        hd.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { g->headerHeight, g->headerHeight } }, .type = CLAY__SIZING_TYPE_FIXED };
+        hd.backgroundColor = g->headerColor;
+        hd.clip.horizontal = true;
+        hd.clip.childOffset.x = -scrollX;
+        Clay__OpenElementWithId(headerId);
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, hd));
+        clay_grid_emit_row(g, -1, c0, c1, g->headerHeight, (Clay_Color){0}, headerCfg);
+        Clay__CloseElement();
+    }
+
+    Clay_ElementDeclaration bd = (Clay_ElementDeclaration){0};
+    bd.layout = CLAY_LAYOUT_DEFAULT;
+    bd.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    bd.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    bd.clip.horizontal = true;
+    bd.clip.vertical = true;
+    bd.clip.childOffset = sd ? sd->scrollPosition : (Clay_Vector2){0, 0};
+    Clay__OpenElementWithId(bodyId);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, bd));
+
+    // Content has the full size so Clay's scrolling sees every row.
+    Clay_ElementDeclaration content = (Clay_ElementDeclaration){0};
+    content.layout = CLAY_LAYOUT_DEFAULT;
+    content.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    content.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { totalW, totalW } }, .type = CLAY__SIZING_TYPE_FIXED };
+    content.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { totalH, totalH } }, .type = CLAY__SIZING_TYPE_FIXED };
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, content));
+    if (first > 0) {
+        clay_grid_open_box(0, (float)first * g->rowHeight, (Clay_Color){0});
+        Clay__CloseElement();
+    }
+    for (int32_t r = first; r < last; ++r) {
+        int32_t dataRow = g->order[r];
+        Clay_Color bg = dataRow == g->selectedRow ? g->selectedColor : (r & 1) ? g->altRowColor : g->rowColor;
+        clay_grid_emit_row(g, dataRow, c0, c1, g->rowHeight, bg, cellCfg);
+    }
+    Clay__CloseElement();
+
+    Clay__CloseElement();
+    Clay__CloseElement();
+}
+
+// grid:emit(name [, index [, isLocal]]) | grid:emit(idTable)
+static int l_Grid_emit(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "grid:emit() must be called during a layout pass");
+    }
+    if (!g->columnX) return luaL_error(L, "grid:emit(): call setColumns() first");
+    clay_grid_emit(g, clay_element_id_from_args(L, 2));
+    return 0;
+}
+
+// grid:hitTest(x, y) -> dataRow, col   (dataRow 0 for the header; nothing when outside)
+// Uses the bounds and scroll position of the last finished layout.
+static int l_Grid_hitTest(lua_State *L) {
+    ClayDataGrid *g = check_data_grid(L, 1);
+    float x = (float)luaL_checknumber(L, 2);
+    float y = (float)luaL_checknumber(L, 3);
+    if (!g->id.id || !g->columnX) return 0;
+
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(Clay__HashNumber(1, g->id.id).id);
+    float scrollX = sd ? -sd->scrollPosition.x : 0, scrollY = sd ? -sd->scrollPosition.y : 0;
+    Clay_ElementData header = Clay_GetElementData(Clay__HashNumber(0, g->id.id));
+    Clay_ElementData body = Clay_GetElementData(Clay__HashNumber(1, g->id.id));
+
+    Clay_BoundingBox box;
+    int32_t row;
+    if (header.found && y >= header.boundingBox.y && y < header.boundingBox.y + header.boundingBox.height) {
+        box = header.boundingBox;
+        row = 0;
+    } else if (body.found && y >= body.boundingBox.y && y < body.boundingBox.y + body.boundingBox.height) {
+        box = body.boundingBox;
+        int32_t display = (int32_t)((y - box.y + scrollY) / g->rowHeight);
+        if (display < 0 || display >= g->rowCount) return 0;
+        clay_grid_sort_if_needed(g);
+        row = g->order[display] + 1;
+    } else {
+        return 0;
+    }
+    if (x < box.x || x >= box.x + box.width) return 0;
+
+    float cx = x - box.x + scrollX;
+    for (int32_t c = 0; c < g->columnCount; ++c) {
+        if (cx >= g->columnX[c] && cx < g->columnX[c + 1]) {
+            lua_pushinteger(L, row);
+            lua_pushinteger(L, c + 1);
+            return 2;
+        }
+    }
+    return 0;
+}
+
+static int l_Grid_gc(lua_State *L) {
+    clay_grid_free(check_data_grid(L, 1));
+    return 0;
+}
+
+static void Clay_CreateDataGridMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayDataGrid")) {
+        lua_pushcfunction(L, l_Grid_setColumns); lua_setfield(L, -2, "setColumns");
+        lua_pushcfunction(L, l_Grid_setRowCount); lua_setfield(L, -2, "setRowCount");
+        lua_pushcfunction(L, l_Grid_rowCount); lua_setfield(L, -2, "rowCount");
+        lua_pushcfunction(L, l_Grid_setNumbers); lua_setfield(L, -2, "setNumbers");
+        lua_pushcfunction(L, l_Grid_setStrings); lua_setfield(L, -2, "setStrings");
+        lua_pushcfunction(L, l_Grid_set); lua_setfield(L, -2, "set");
+        lua_pushcfunction(L, l_Grid_get); lua_setfield(L, -2, "get");
+        lua_pushcfunction(L, l_Grid_sort); lua_setfield(L, -2, "sort");
+        lua_pushcfunction(L, l_Grid_rowAt); lua_setfield(L, -2, "rowAt");
+        lua_pushcfunction(L, l_Grid_select); lua_setfield(L, -2, "select");
+        lua_pushcfunction(L, l_Grid_setStyle); lua_setfield(L, -2, "setStyle");
+        lua_pushcfunction(L, l_Grid_emit); lua_setfield(L, -2, "emit");
+        lua_pushcfunction(L, l_Grid_hitTest); lua_setfield(L, -2, "hitTest");
+        lua_pushcfunction(L, l_Grid_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Log view
+//
+// clay.logView(capacity) keeps the newest `capacity` lines in a C ring buffer. Each
+// line stores how many wrapped rows it takes and the absolute row it starts at, so
+// the row index is a running prefix sum: appending or dropping a line is O(1) and
+// finding the first visible line is a binary search. Lines are wrapped when they are
+// appended and again only when the width or the style changes; emit reads the stored
+// row breaks. Only visible lines are emitted.
+// -----------------------------------------------------------------------------
+
+#define CLAY_LOG_LEVELS 8
+
+typedef struct {
+    char *chars;
+    int32_t length;
+    int32_t rows;           // wrapped rows at the current wrap width (>= 1)
+    ClayParagraphLine *breaks;  // the rows when rows > 1; a single row is the whole line
+    int32_t breakCapacity;
+    uint64_t top;           // absolute row of the line's first row
+    uint8_t level;          // palette index
+} ClayLogLine;
+
+typedef struct {
+    ClayLogLine *lines;
+    int32_t capacity;
+    int32_t head;           // ring index of the oldest line
+    int32_t count;
+    uint64_t endRow;        // absolute row after the newest line
+    uint64_t droppedRows;   // rows dropped from the front since the last emit
+    float wrapWidth;        // width the rows were computed for; <= 0: not known yet
+    float lastContentHeight;
+    int wrap;
+    int follow;
+    Clay_TextElementConfig text;
+    Clay_Color palette[CLAY_LOG_LEVELS];
+    ClayParagraphEntry scratch;     // reused wrap output
+} ClayLogView;
+
+static inline ClayLogLine* clay_log_at(ClayLogView *v, int32_t i) {
+    return &v->lines[(v->head + i) % v->capacity];
+}
+
+static inline uint64_t clay_log_start_row(ClayLogView *v) {
+    return v->count > 0 ? v->lines[v->head].top : v->endRow;
+}
+
+// Wrap one line into v->scratch; returns the number of rows.
+static int32_t clay_log_wrap(ClayLogView *v, const char *chars, int32_t length, float width) {
+    ClayParagraphEntry *e = &v->scratch;
+    e->text = (char*)chars;     // only read by the wrapper
+    e->textLength = length;
+    if (!v->wrap || width <= 0 || length == 0) {
+        e->lineCount = 0;
+        clay_paragraph_push_line(e, 0, length);
+    } else {
+        clay_paragraph_wrap(e, &v->text, width);
+    }
+    return e->lineCount > 0 ? e->lineCount : 1;
+}
+
+// Wrap a stored line and keep its row breaks for emit.
+static void clay_log_wrap_line(ClayLogView *v, ClayLogLine *ln, float width) {
+    int32_t rows = clay_log_wrap(v, ln->chars, ln->length, width);
+    if (rows > 1 && rows > v->scratch.lineCount) rows = 1;
+    if (rows > 1 && rows > ln->breakCapacity) {
+        ClayParagraphLine *grown = (ClayParagraphLine*)realloc(ln->breaks, sizeof(ClayParagraphLine) * (size_t)rows);
+        if (!grown) rows = 1;   // fall back to one unwrapped row
+        else { ln->breaks = grown; ln->breakCapacity = rows; }
+    }
+    if (rows > 1) memcpy(ln->breaks, v->scratch.lines, sizeof(ClayParagraphLine) * (size_t)rows);
+    ln->rows = rows;
+}
+
+static void clay_log_push(ClayLogView *v, const char *chars, size_t len, uint8_t level) {
+    ClayLogLine *ln;
+    if (v->count == v->capacity) {
+        ln = &v->lines[v->head];        // overwrite the oldest line
+        v->droppedRows += (uint64_t)ln->rows;
+        v->head = (v->head + 1) % v->capacity;
+        v->count--;
+    } else {
+        ln = &v->lines[(v->head + v->count) % v->capacity];
+    }
+    char *copy = (char*)realloc(ln->chars, len ? len : 1);
+    if (!copy) { ln->length = 0; len = 0; } else { ln->chars = copy; memcpy(copy, chars, len); }
+    ln->length = (int32_t)len;
+    ln->level = level < CLAY_LOG_LEVELS ? level : 0;
+    clay_log_wrap_line(v, ln, v->wrapWidth);
+    ln->top = v->endRow;
+    v->endRow += (uint64_t)ln->rows;
+    v->count++;
+}
+
+// Split on '\n' so every ring entry is one logical line.
+static void clay_log_append(ClayLogView *v, const char *s, size_t len, uint8_t level) {
+    size_t start = 0;
+    for (size_t i = 0; i <= len; ++i) {
+        if (i == len || s[i] == '\n') {
+            size_t end = i;
+            if (end > start && s[end - 1] == '\r') end--;
+            if (i < len || end > start || start == 0) clay_log_push(v, s + start, end - start, level);
+            start = i + 1;
+        }
+    }
+}
+
+// Re-wrap everything for a new width, keeping absolute rows continuous.
+static void clay_log_rewrap(ClayLogView *v, float width) {
+    v->wrapWidth = width;
+    uint64_t row = clay_log_start_row(v);
+    for (int32_t i = 0; i < v->count; ++i) {
+        ClayLogLine *ln = clay_log_at(v, i);
+        clay_log_wrap_line(v, ln, width);
+        ln->top = row;
+        row += (uint64_t)ln->rows;
+    }
+    v->endRow = row;
+}
+
+// Logical index of the line containing absolute row `row`.
+static int32_t clay_log_find_row(ClayLogView *v, uint64_t row) {
+    int32_t lo = 0, hi = v->count - 1, found = 0;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) >> 1;
+        if (clay_log_at(v, mid)->top <= row) { found = mid; lo = mid + 1; } else hi = mid - 1;
+    }
+    return found;
+}
+
+static ClayLogView* check_log_view(lua_State *L, int idx) {
+    return (ClayLogView*)luaL_checkudata(L, idx, "ClayLogView");
+}
+
+// clay.logView([capacity = 100000]) -> log
+static int l_Clay_LogView_New(lua_State *L) {
+    lua_Integer cap = luaL_optinteger(L, 1, 100000);
+    luaL_argcheck(L, cap >= 1 && cap <= INT32_MAX / (lua_Integer)sizeof(ClayLogLine), 1, "capacity out of range");
+    ClayLogView *v = (ClayLogView*)lua_newuserdata(L, sizeof(ClayLogView));
+    memset(v, 0, sizeof(*v));
+    v->lines = (ClayLogLine*)calloc((size_t)cap, sizeof(ClayLogLine));
+    if (!v->lines) return luaL_error(L, "logView: out of memory");
+    v->capacity = (int32_t)cap;
+    v->wrap = 1;
+    v->follow = 1;
+    v->text = (Clay_TextElementConfig){ .textColor = {255,255,255,255}, .fontId = 1, .fontSize = 16,
+                                        .wrapMode = CLAY_TEXT_WRAP_WORDS };
+    for (int k = 0; k < CLAY_LOG_LEVELS; ++k) v->palette[k] = v->text.textColor;
+    luaL_setmetatable(L, "ClayLogView");
+    return 1;
+}
+
+// log:append(str [, level])
+static int l_Log_append(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    size_t len = 0;
+    const char *s = luaL_checklstring(L, 2, &len);
+    clay_log_append(v, s, len, (uint8_t)luaL_optinteger(L, 3, 0));
+    lua_settop(L, 1);
+    return 1;
+}
+
+// log:appendMany({ str, ... } [, level])
+static int l_Log_appendMany(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    uint8_t level = (uint8_t)luaL_optinteger(L, 3, 0);
+    int32_t n = (int32_t)clay_rawlen(L, 2);
+    for (int32_t i = 1; i <= n; ++i) {
+        lua_rawgeti(L, 2, i);
+        size_t len = 0;
+        const char *s = lua_tolstring(L, -1, &len);
+        if (s) clay_log_append(v, s, len, level);
+        lua_pop(L, 1);
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Log_clear(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    v->droppedRows += v->endRow - clay_log_start_row(v);
+    v->head = 0;
+    v->count = 0;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Log_count(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    lua_pushinteger(L, v->count);
+    return 1;
+}
+
+// log:line(i) -> str, level   (1 = oldest kept line)
+static int l_Log_line(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    if (i < 1 || i > v->count) return 0;
+    ClayLogLine *ln = clay_log_at(v, (int32_t)i - 1);
+    lua_pushlstring(L, ln->chars ? ln->chars : "", (size_t)ln->length);
+    lua_pushinteger(L, ln->level);
+    return 2;
+}
+
+// log:follow(enabled) -- stick to the newest line while scrolled to the bottom
+static int l_Log_follow(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    v->follow = lua_toboolean(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// log:setStyle({ fontId=, fontSize=, letterSpacing=, lineHeight=, textColor=, wrap=, colors={ {r,g,b,a}, ... } })
+static int l_Log_setStyle(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    v->text.fontId = (uint16_t)clay_opt_number_field(L, 2, "fontId", v->text.fontId);
+    v->text.fontSize = (uint16_t)clay_opt_number_field(L, 2, "fontSize", v->text.fontSize);
+    v->text.letterSpacing = (uint16_t)clay_opt_number_field(L, 2, "letterSpacing", v->text.letterSpacing);
+    v->text.lineHeight = (uint16_t)clay_opt_number_field(L, 2, "lineHeight", v->text.lineHeight);
+    clay_opt_color_field(L, 2, "textColor", &v->text.textColor);
+    v->palette[0] = v->text.textColor;
+    lua_getfield(L, 2, "wrap");
+    if (!lua_isnil(L, -1)) v->wrap = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    clay_opt_palette_field(L, 2, "colors", v->palette, CLAY_LOG_LEVELS);
+    v->wrapWidth = 0;   // style changed: re-wrap on the next emit
+    lua_settop(L, 1);
+    return 1;
+}
+
+static void clay_log_emit(ClayLogView *v, Clay_ElementId id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    float rowHeight = clay_text_row_height(&v->text);
+    if (rowHeight <= 0) rowHeight = 1;
+
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(id.id);
+    float viewW = sd && sd->boundingBox.width > 0 ? sd->boundingBox.width : ctx->layoutDimensions.width;
+    float viewH = sd && sd->boundingBox.height > 0 ? sd->boundingBox.height : ctx->layoutDimensions.height;
+
+    // Was the view at the bottom when it was last laid out?
+    float scrollTop = sd ? -sd->scrollPosition.y : 0;
+    int pinned = v->follow && (!sd || scrollTop >= v->lastContentHeight - viewH - rowHeight * 0.5f);
+
+    // Keep the same lines in view when older ones were dropped or everything re-wrapped.
+    uint64_t startRow = clay_log_start_row(v);
+    double anchorRow = (double)(startRow - v->droppedRows) + scrollTop / rowHeight;
+    if (v->wrap && (v->wrapWidth <= 0 || fabsf(v->wrapWidth - viewW) > 0.5f)) {
+        int32_t anchorLine = 0;
+        float within = 0;
+        if (v->count > 0 && anchorRow >= (double)startRow) {
+            anchorLine = clay_log_find_row(v, (uint64_t)anchorRow);
+            within = (float)(anchorRow - (double)clay_log_at(v, anchorLine)->top);
+            if (within > (float)clay_log_at(v, anchorLine)->rows) within = 0;
+        }
+        clay_log_rewrap(v, viewW);
+        anchorRow = v->count > 0 ? (double)clay_log_at(v, anchorLine)->top + within : (double)startRow;
+    } else if (!v->wrap && v->wrapWidth != -1.0f) {
+        clay_log_rewrap(v, -1.0f);      // one row per line
+        anchorRow = (double)startRow;
+    }
+    v->droppedRows = 0;
+    startRow = clay_log_start_row(v);
+
+    float contentH = (float)(v->endRow - startRow) * rowHeight;
+    if (pinned) {
+        scrollTop = contentH - viewH;
+    } else {
+        scrollTop = (float)((anchorRow - (double)startRow) * rowHeight);
+    }
+    if (scrollTop > contentH - viewH) scrollTop = contentH - viewH;
+    if (scrollTop < 0) scrollTop = 0;
+    if (sd) sd->scrollPosition.y = -scrollTop;
+    v->lastContentHeight = contentH;
+
+    int32_t first = 0, last = 0;
+    if (v->count > 0) {
+        first = clay_log_find_row(v, startRow + (uint64_t)(scrollTop / rowHeight));
+        last = clay_log_find_row(v, startRow + (uint64_t)((scrollTop + viewH) / rowHeight)) + 1;
+        if (last > v->count) last = v->count;
+    }
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    decl.clip.vertical = true;
+    decl.clip.horizontal = !v->wrap;
+    decl.clip.childOffset = (Clay_Vector2){ sd ? sd->scrollPosition.x : 0, -scrollTop };
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    Clay_ElementDeclaration content = (Clay_ElementDeclaration){0};
+    content.layout = CLAY_LAYOUT_DEFAULT;
+    content.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    content.layout.sizing.width.type = v->wrap ? CLAY__SIZING_TYPE_GROW : CLAY__SIZING_TYPE_FIT;
+    content.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { contentH, contentH } }, .type = CLAY__SIZING_TYPE_FIXED };
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, content));
+
+    if (v->count > 0) {
+        float spacer = (float)(clay_log_at(v, first)->top - startRow) * rowHeight;
+        if (spacer > 0) {
+            Clay_ElementDeclaration sp = (Clay_ElementDeclaration){0};
+            sp.layout = CLAY_LAYOUT_DEFAULT;
+            sp.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { spacer, spacer } }, .type = CLAY__SIZING_TYPE_FIXED };
+            Clay__OpenElement();
+            Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, sp));
+            Clay__CloseElement();
+        }
+    }
+
+    Clay_TextElementConfig *cfgs[CLAY_LOG_LEVELS] = {0};
+    for (int32_t i = first; i < last; ++i) {
+        ClayLogLine *ln = clay_log_at(v, i);
+        if (!cfgs[ln->level]) {
+            cfgs[ln->level] = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+            *cfgs[ln->level] = v->text;
+            cfgs[ln->level]->textColor = v->palette[ln->level];
+            cfgs[ln->level]->wrapMode = CLAY_TEXT_WRAP_NONE;
+        }
+
+        // A fixed-height box per line keeps rows exactly where the prefix sums put them.
+        float h = (float)ln->rows * rowHeight;
+        Clay_ElementDeclaration box = (Clay_ElementDeclaration){0};
+        box.layout = CLAY_LAYOUT_DEFAULT;
+        box.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+        box.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { h, h } }, .type = CLAY__SIZING_TYPE_FIXED };
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, box));
+
+        // Rows are copied: the ring may overwrite this line before the frame is rendered.
+        ClayParagraphLine whole = { 0, ln->length };
+        for (int32_t r = 0; r < ln->rows; ++r) {
+            const ClayParagraphLine *pl = ln->rows > 1 ? &ln->breaks[r] : &whole;
+            if (pl->length == 0) continue;
+            Clay_String s = clay_frame_string(ln->chars + pl->start, pl->length);
+            if (s.chars) CLAY_TEXT(s, cfgs[ln->level]);
+        }
+        Clay__CloseElement();
+    }
+
+    Clay__CloseElement();
+    Clay__CloseElement();
+}
+
+// log:emit(name [, index [, isLocal]]) | log:emit(idTable)
+static int l_Log_emit(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "log:emit() must be called during a layout pass");
+    }
+    clay_log_emit(v, clay_element_id_from_args(L, 2));
+    return 0;
+}
+
+static int l_Log_gc(lua_State *L) {
+    ClayLogView *v = check_log_view(L, 1);
+    if (v->lines) {
+        for (int32_t i = 0; i < v->capacity; ++i) {
+            free(v->lines[i].chars);
+            free(v->lines[i].breaks);
+        }
+        free(v->lines);
+        v->lines = NULL;
+    }
+    free(v->scratch.lines);
+    v->scratch = (ClayParagraphEntry){0};
+    v->count = 0;
+    return 0;
+}
+
+static void Clay_CreateLogViewMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayLogView")) {
+        lua_pushcfunction(L, l_Log_append); lua_setfield(L, -2, "append");
+        lua_pushcfunction(L, l_Log_appendMany); lua_setfield(L, -2, "appendMany");
+        lua_pushcfunction(L, l_Log_clear); lua_setfield(L, -2, "clear");
+        lua_pushcfunction(L, l_Log_count); lua_setfield(L, -2, "count");
+        lua_pushcfunction(L, l_Log_line); lua_setfield(L, -2, "line");
+        lua_pushcfunction(L, l_Log_follow); lua_setfield(L, -2, "follow");
+        lua_pushcfunction(L, l_Log_setStyle); lua_setfield(L, -2, "setStyle");
+        lua_pushcfunction(L, l_Log_emit); lua_setfield(L, -2, "emit");
+        lua_pushcfunction(L, l_Log_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Tree view
+//
+// clay.treeView() keeps the hierarchy in one C node array (parent / first child /
+// next sibling links plus an expanded flag) and a flattened list of the rows that are
+// currently shown. Expanding or collapsing splices that node's visible subtree into
+// or out of the list; only adding nodes or expandAll() rebuild it. Each
+// node caches how many rows its subtree shows, so a splice knows its size up front.
+// -----------------------------------------------------------------------------
+
+#define CLAY_TREE_GLYPH_MAX 8
+
+typedef struct {
+    int32_t parent;         // -1: top level
+    int32_t firstChild;
+    int32_t lastChild;
+    int32_t nextSibling;
+    int32_t visibleDesc;    // rows shown below this node when it is expanded
+    int32_t row;            // index into rows; only trusted if rows[row] == this node
+    uint32_t labelOffset;
+    int32_t labelLength;
+    uint16_t depth;
+    uint8_t expanded;
+} ClayTreeNode;
+
+typedef struct {
+    ClayTreeNode *nodes;
+    int32_t nodeCount;
+    int32_t nodeCapacity;
+    int32_t rootFirst;
+    int32_t rootLast;
+    int32_t *rows;          // flattened visible nodes, in display order
+    int32_t rowCount;
+    int32_t rowCapacity;
+    int32_t rowsValidUpTo;  // nodes[rows[i]].row is correct for i < this
+    int rowsDirty;          // rows must be rebuilt from scratch
+    char *labels;
+    size_t labelsUsed;
+    size_t labelsCapacity;
+    size_t labelsLive;      // bytes still referenced by a node
+    int32_t selected;       // -1: none
+    float rowHeight;
+    float indent;
+    Clay_TextElementConfig text;
+    Clay_Color selectedColor;
+    char expandedGlyph[CLAY_TREE_GLYPH_MAX];
+    char collapsedGlyph[CLAY_TREE_GLYPH_MAX];
+    Clay_ElementId id;      // last emitted id, for hitTest()
+} ClayTreeView;
+
+static int clay_tree_reserve_rows(ClayTreeView *t, int32_t rows) {
+    if (rows <= t->rowCapacity) return 1;
+    int32_t cap = t->rowCapacity ? t->rowCapacity : 256;
+    while (cap < rows) cap *= 2;
+    int32_t *grown = (int32_t*)realloc(t->rows, sizeof(int32_t) * (size_t)cap);
+    if (!grown) return 0;
+    t->rows = grown;
+    t->rowCapacity = cap;
+    return 1;
+}
+
+static void clay_tree_rebuild_rows(ClayTreeView *t) {
+    int32_t shown = 0;
+    for (int32_t n = t->rootFirst; n >= 0; n = t->nodes[n].nextSibling) {
+        shown += 1 + (t->nodes[n].expanded ? t->nodes[n].visibleDesc : 0);
+    }
+    t->rowCount = 0;
+    t->rowsValidUpTo = 0;
+    if (!clay_tree_reserve_rows(t, shown)) return;
+
+    // Pre-order walk over expanded nodes, without a stack: descend, else climb to a sibling.
+    int32_t n = t->rootFirst;
+    while (n >= 0) {
+        ClayTreeNode *node = &t->nodes[n];
+        node->row = t->rowCount;
+        t->rows[t->rowCount++] = n;
+        if (node->expanded && node->firstChild >= 0) { n = node->firstChild; continue; }
+        while (n >= 0 && t->nodes[n].nextSibling < 0) n = t->nodes[n].parent;
+        if (n >= 0) n = t->nodes[n].nextSibling;
+    }
+    t->rowsValidUpTo = t->rowCount;
+    t->rowsDirty = 0;
+}
+
+static void clay_tree_ensure_rows(ClayTreeView *t) {
+    if (t->rowsDirty) clay_tree_rebuild_rows(t);
+}
+
+// Row currently showing node n, or -1 if one of its ancestors is collapsed.
+static int32_t clay_tree_row_of(ClayTreeView *t, int32_t n) {
+    clay_tree_ensure_rows(t);
+    int32_t r = t->nodes[n].row;
+    if (r >= 0 && r < t->rowsValidUpTo && t->rows[r] == n) return r;
+    if (t->rowsValidUpTo < t->rowCount) {
+        for (int32_t i = t->rowsValidUpTo; i < t->rowCount; ++i) t->nodes[t->rows[i]].row = i;
+        t->rowsValidUpTo = t->rowCount;
+        r = t->nodes[n].row;
+        if (r >= 0 && r < t->rowCount && t->rows[r] == n) return r;
+    }
+    return -1;
+}
+
+// Add `delta` shown rows below node p and every expanded ancestor that shows them.
+static void clay_tree_propagate(ClayTreeView *t, int32_t p, int32_t delta) {
+    while (p >= 0) {
+        t->nodes[p].visibleDesc += delta;
+        if (!t->nodes[p].expanded) break;
+        p = t->nodes[p].parent;
+    }
+}
+
+static void clay_tree_set_expanded(ClayTreeView *t, int32_t n, int expanded) {
+    ClayTreeNode *node = &t->nodes[n];
+    if ((int)node->expanded == expanded) return;
+    int32_t row = t->rowsDirty ? -1 : clay_tree_row_of(t, n);
+    node->expanded = (uint8_t)expanded;
+    int32_t delta = node->visibleDesc;
+    clay_tree_propagate(t, node->parent, expanded ? delta : -delta);
+    if (row < 0 || delta == 0) return;
+
+    int32_t at = row + 1;
+    if (!expanded) {
+        memmove(t->rows + at, t->rows + at + delta, sizeof(int32_t) * (size_t)(t->rowCount - at - delta));
+        t->rowCount -= delta;
+    } else {
+        if (!clay_tree_reserve_rows(t, t->rowCount + delta)) { t->rowsDirty = 1; return; }
+        memmove(t->rows + at + delta, t->rows + at, sizeof(int32_t) * (size_t)(t->rowCount - at));
+        t->rowCount += delta;
+        // Write n's shown subtree into the gap (same walk as the rebuild, bounded by n).
+        int32_t k = at, c = node->firstChild;
+        while (c >= 0 && c != n) {
+            t->rows[k++] = c;
+            if (t->nodes[c].expanded && t->nodes[c].firstChild >= 0) { c = t->nodes[c].firstChild; continue; }
+            while (c != n && t->nodes[c].nextSibling < 0) c = t->nodes[c].parent;
+            if (c != n) c = t->nodes[c].nextSibling;
+        }
+    }
+    if (t->rowsValidUpTo > at) t->rowsValidUpTo = at;
+}
+
+static int32_t clay_tree_add(ClayTreeView *t, int32_t parent, const char *label, size_t len, int expanded) {
+    if (t->nodeCount == t->nodeCapacity) {
+        int32_t cap = t->nodeCapacity ? t->nodeCapacity * 2 : 256;
+        ClayTreeNode *grown = (ClayTreeNode*)realloc(t->nodes, sizeof(ClayTreeNode) * (size_t)cap);
+        if (!grown) return -1;
+        t->nodes = grown;
+        t->nodeCapacity = cap;
+    }
+    if (t->labelsUsed + len > UINT32_MAX) return -1;
+    if (t->labelsUsed + len > t->labelsCapacity) {
+        size_t cap = t->labelsCapacity ? t->labelsCapacity : 4096;
+        while (cap < t->labelsUsed + len) cap *= 2;
+        char *grown = (char*)realloc(t->labels, cap);
+        if (!grown) return -1;
+        t->labels = grown;
+        t->labelsCapacity = cap;
+    }
+    int32_t n = t->nodeCount++;
+    ClayTreeNode *node = &t->nodes[n];
+    *node = (ClayTreeNode){ .parent = parent, .firstChild = -1, .lastChild = -1, .nextSibling = -1,
+                            .row = -1, .labelOffset = (uint32_t)t->labelsUsed, .labelLength = (int32_t)len,
+                            .expanded = (uint8_t)(expanded != 0) };
+    memcpy(t->labels + t->labelsUsed, label, len);
+    t->labelsUsed += len;
+    t->labelsLive += len;
+
+    if (parent < 0) {
+        if (t->rootLast >= 0) t->nodes[t->rootLast].nextSibling = n; else t->rootFirst = n;
+        t->rootLast = n;
+    } else {
+        ClayTreeNode *p = &t->nodes[parent];
+        node->depth = (uint16_t)(p->depth < UINT16_MAX ? p->depth + 1 : p->depth);
+        if (p->lastChild >= 0) t->nodes[p->lastChild].nextSibling = n; else p->firstChild = n;
+        p->lastChild = n;
+        clay_tree_propagate(t, parent, 1);
+    }
+    t->rowsDirty = 1;
+    return n;
+}
+
+// Recompute every visibleDesc after bulk flag changes. Children always have larger
+// indices than their parent, so one reverse pass sees each subtree before its root.
+static void clay_tree_recount(ClayTreeView *t) {
+    for (int32_t n = 0; n < t->nodeCount; ++n) t->nodes[n].visibleDesc = 0;
+    for (int32_t n = t->nodeCount - 1; n >= 0; --n) {
+        ClayTreeNode *node = &t->nodes[n];
+        if (node->parent >= 0) t->nodes[node->parent].visibleDesc += 1 + (node->expanded ? node->visibleDesc : 0);
+    }
+    t->rowsDirty = 1;
+}
+
+static ClayTreeView* check_tree_view(lua_State *L, int idx) {
+    return (ClayTreeView*)luaL_checkudata(L, idx, "ClayTreeView");
+}
+
+// Lua node ids are 1-based; 0 (or nil) is the invisible root where allowed.
+static int32_t check_tree_node(lua_State *L, ClayTreeView *t, int idx, int allowRoot) {
+    lua_Integer n = allowRoot ? luaL_optinteger(L, idx, 0) : luaL_checkinteger(L, idx);
+    luaL_argcheck(L, (allowRoot && n == 0) || (n >= 1 && n <= t->nodeCount), idx, "invalid tree node");
+    return (int32_t)n - 1;
+}
+
+// clay.treeView() -> tree
+static int l_Clay_TreeView_New(lua_State *L) {
+    ClayTreeView *t = (ClayTreeView*)lua_newuserdata(L, sizeof(ClayTreeView));
+    memset(t, 0, sizeof(*t));
+    t->rootFirst = t->rootLast = -1;
+    t->selected = -1;
+    t->rowHeight = 22;
+    t->indent = 16;
+    t->text = (Clay_TextElementConfig){ .textColor = {255,255,255,255}, .fontId = 1, .fontSize = 16,
+                                        .wrapMode = CLAY_TEXT_WRAP_NONE };
+    t->selectedColor = (Clay_Color){60,110,200,255};
+    strcpy(t->expandedGlyph, "\xE2\x96\xBE");     // ▾
+    strcpy(t->collapsedGlyph, "\xE2\x96\xB8");    // ▸
+    luaL_setmetatable(L, "ClayTreeView");
+    return 1;
+}
+
+// tree:add(parent, label [, expanded]) -> node   (parent 0 = top level)
+static int l_Tree_add(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    int32_t parent = check_tree_node(L, t, 2, 1);
+    size_t len = 0;
+    const char *label = luaL_checklstring(L, 3, &len);
+    int32_t n = clay_tree_add(t, parent, label, len, lua_toboolean(L, 4));
+    if (n < 0) return luaL_error(L, "tree:add: out of memory");
+    lua_pushinteger(L, n + 1);
+    return 1;
+}
+
+// tree:addMany({ parent, ... }, { label, ... }) -> firstNode
+// Parents may refer to nodes added earlier in the same call.
+static int l_Tree_addMany(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    int32_t count = (int32_t)clay_rawlen(L, 3);
+    int32_t first = t->nodeCount + 1;
+    for (int32_t i = 1; i <= count; ++i) {
+        lua_rawgeti(L, 2, i);
+        lua_Integer parent = lua_tointeger(L, -1);
+        lua_rawgeti(L, 3, i);
+        size_t len = 0;
+        const char *label = lua_tolstring(L, -1, &len);
+        if (parent < 0 || parent > t->nodeCount) return luaL_error(L, "tree:addMany: invalid parent at %d", (int)i);
+        if (clay_tree_add(t, (int32_t)parent - 1, label ? label : "", label ? len : 0, 0) < 0) {
+            return luaL_error(L, "tree:addMany: out of memory");
+        }
+        lua_pop(L, 2);
+    }
+    lua_pushinteger(L, first);
+    return 1;
+}
+
+static int l_Tree_clear(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    t->nodeCount = 0;
+    t->rowCount = 0;
+    t->rowsValidUpTo = 0;
+    t->rowsDirty = 0;
+    t->labelsUsed = t->labelsLive = 0;
+    t->rootFirst = t->rootLast = -1;
+    t->selected = -1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// Rewrite the label pool with only the current labels once more than half of it is
+// garbage. Emitted labels are copied into the frame arena, so nothing else points into it.
+static void clay_tree_labels_compact(ClayTreeView *t) {
+    if (t->labelsUsed < 4096 || t->labelsLive * 2 > t->labelsUsed) return;
+    size_t cap = t->labelsLive + 256;
+    char *pool = (char*)malloc(cap);
+    if (!pool) return;
+    size_t used = 0;
+    for (int32_t i = 0; i < t->nodeCount; ++i) {
+        ClayTreeNode *node = &t->nodes[i];
+        if (node->labelLength == 0) continue;
+        memcpy(pool + used, t->labels + node->labelOffset, (size_t)node->labelLength);
+        node->labelOffset = (uint32_t)used;
+        used += (size_t)node->labelLength;
+    }
+    free(t->labels);
+    t->labels = pool;
+    t->labelsUsed = used;
+    t->labelsCapacity = cap;
+}
+
+// tree:setLabel(node, label)   (rewritten in place when the new label fits)
+static int l_Tree_setLabel(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    int32_t n = check_tree_node(L, t, 2, 0);
+    size_t len = 0;
+    const char *label = luaL_checklstring(L, 3, &len);
+    ClayTreeNode *node = &t->nodes[n];
+    if ((size_t)node->labelLength < len) {
+        if (t->labelsUsed + len > UINT32_MAX) return luaL_error(L, "tree:setLabel: label storage full");
+        if (t->labelsUsed + len > t->labelsCapacity) {
+            size_t cap = t->labelsCapacity ? t->labelsCapacity : 4096;
+            while (cap < t->labelsUsed + len) cap *= 2;
+            char *grown = (char*)realloc(t->labels, cap);
+            if (!grown) return luaL_error(L, "tree:setLabel: out of memory");
+            t->labels = grown;
+            t->labelsCapacity = cap;
+        }
+        node->labelOffset = (uint32_t)t->labelsUsed;
+        t->labelsUsed += len;
+    }
+    memcpy(t->labels + node->labelOffset, label, len);
+    t->labelsLive = t->labelsLive + len - (size_t)node->labelLength;
+    node->labelLength = (int32_t)len;
+    clay_tree_labels_compact(t);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// tree:expand(node [, expanded = true]) / tree:collapse(node) / tree:toggle(node)
+static int l_Tree_expand(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    int32_t n = check_tree_node(L, t, 2, 0);
+    clay_tree_set_expanded(t, n, lua_isnoneornil(L, 3) ? 1 : lua_toboolean(L, 3));
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Tree_collapse(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    clay_tree_set_expanded(t, check_tree_node(L, t, 2, 0), 0);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Tree_toggle(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    int32_t n = check_tree_node(L, t, 2, 0);
+    clay_tree_set_expanded(t, n, !t->nodes[n].expanded);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// tree:expandAll([expanded = true])
+static int l_Tree_expandAll(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    uint8_t e = (uint8_t)(lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2));
+    for (int32_t n = 0; n < t->nodeCount; ++n) t->nodes[n].expanded = e;
+    clay_tree_recount(t);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Tree_isExpanded(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    lua_pushboolean(L, t->nodes[check_tree_node(L, t, 2, 0)].expanded);
+    return 1;
+}
+
+// tree:info(node) -> label, parent, depth, hasChildren
+static int l_Tree_info(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    ClayTreeNode *node = &t->nodes[check_tree_node(L, t, 2, 0)];
+    lua_pushlstring(L, t->labels + node->labelOffset, (size_t)node->labelLength);
+    lua_pushinteger(L, node->parent + 1);
+    lua_pushinteger(L, node->depth);
+    lua_pushboolean(L, node->firstChild >= 0);
+    return 4;
+}
+
+static int l_Tree_rowCount(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    clay_tree_ensure_rows(t);
+    lua_pushinteger(L, t->rowCount);
+    return 1;
+}
+
+// tree:nodeAt(row) -> node
+static int l_Tree_nodeAt(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    lua_Integer r = luaL_checkinteger(L, 2);
+    clay_tree_ensure_rows(t);
+    if (r < 1 || r > t->rowCount) return 0;
+    lua_pushinteger(L, t->rows[r - 1] + 1);
+    return 1;
+}
+
+// tree:rowOf(node) -> row | nil when hidden under a collapsed ancestor
+static int l_Tree_rowOf(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    int32_t r = clay_tree_row_of(t, check_tree_node(L, t, 2, 0));
+    if (r < 0) return 0;
+    lua_pushinteger(L, r + 1);
+    return 1;
+}
+
+// tree:select(node | nil)
+static int l_Tree_select(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    t->selected = lua_isnoneornil(L, 2) ? -1 : check_tree_node(L, t, 2, 0);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Tree_selected(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    if (t->selected < 0) return 0;
+    lua_pushinteger(L, t->selected + 1);
+    return 1;
+}
+
+static void clay_tree_opt_glyph(lua_State *L, int tbl, const char *name, char *out) {
+    lua_getfield(L, tbl, name);
+    if (lua_isstring(L, -1)) {
+        size_t len = 0;
+        const char *s = lua_tolstring(L, -1, &len);
+        luaL_argcheck(L, len < CLAY_TREE_GLYPH_MAX, 2, "glyph too long");
+        memcpy(out, s, len);
+        out[len] = '\0';
+    }
+    lua_pop(L, 1);
+}
+
+// tree:setStyle({ rowHeight=, indent=, fontId=, fontSize=, textColor=, selectedColor=,
+//                 expandedGlyph=, collapsedGlyph= })
+static int l_Tree_setStyle(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    t->rowHeight = clay_opt_number_field(L, 2, "rowHeight", t->rowHeight);
+    t->indent = clay_opt_number_field(L, 2, "indent", t->indent);
+    luaL_argcheck(L, t->rowHeight > 0, 2, "rowHeight must be positive");
+    t->text.fontId = (uint16_t)clay_opt_number_field(L, 2, "fontId", t->text.fontId);
+    t->text.fontSize = (uint16_t)clay_opt_number_field(L, 2, "fontSize", t->text.fontSize);
+    clay_opt_color_field(L, 2, "textColor", &t->text.textColor);
+    clay_opt_color_field(L, 2, "selectedColor", &t->selectedColor);
+    clay_tree_opt_glyph(L, 2, "expandedGlyph", t->expandedGlyph);
+    clay_tree_opt_glyph(L, 2, "collapsedGlyph", t->collapsedGlyph);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static void clay_tree_emit(ClayTreeView *t, Clay_ElementId id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    clay_tree_ensure_rows(t);
+    t->id = id;
+
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(id.id);
+    float scrollTop = sd ? -sd->scrollPosition.y : 0;
+    float viewH = sd && sd->boundingBox.height > 0 ? sd->boundingBox.height : ctx->layoutDimensions.height;
+    float contentH = (float)t->rowCount * t->rowHeight;
+
+    int32_t first = (int32_t)(scrollTop / t->rowHeight);
+    int32_t last = (int32_t)ceilf((scrollTop + viewH) / t->rowHeight) + 1;
+    if (first < 0) first = 0;
+    if (first > t->rowCount) first = t->rowCount;
+    if (last > t->rowCount) last = t->rowCount;
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    decl.clip.vertical = true;
+    decl.clip.childOffset = sd ? sd->scrollPosition : (Clay_Vector2){0, 0};
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    Clay_ElementDeclaration content = (Clay_ElementDeclaration){0};
+    content.layout = CLAY_LAYOUT_DEFAULT;
+    content.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    content.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    content.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { contentH, contentH } }, .type = CLAY__SIZING_TYPE_FIXED };
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, content));
+
+    if (first > 0) {
+        float spacer = (float)first * t->rowHeight;
+        Clay_ElementDeclaration sp = (Clay_ElementDeclaration){0};
+        sp.layout = CLAY_LAYOUT_DEFAULT;
+        sp.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { spacer, spacer } }, .type = CLAY__SIZING_TYPE_FIXED };
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, sp));
+        Clay__CloseElement();
+    }
+
+    Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+    *cfg = t->text;
+    cfg->wrapMode = CLAY_TEXT_WRAP_NONE;
+    // Glyphs live in the userdata, which may be collected before the frame is rendered.
+    Clay_String expanded = clay_frame_string(t->expandedGlyph, (int32_t)strlen(t->expandedGlyph));
+    Clay_String collapsed = clay_frame_string(t->collapsedGlyph, (int32_t)strlen(t->collapsedGlyph));
+
+    for (int32_t r = first; r < last; ++r) {
+        int32_t n = t->rows[r];
+        ClayTreeNode *node = &t->nodes[n];
+
+        Clay_ElementDeclaration row = (Clay_ElementDeclaration){0};
+        row.layout = CLAY_LAYOUT_DEFAULT;
+        row.layout.layoutDirection = CLAY_LEFT_TO_RIGHT;
+        row.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+        row.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { t->rowHeight, t->rowHeight } }, .type = CLAY__SIZING_TYPE_FIXED };
+        row.layout.padding.left = (uint16_t)((float)node->depth * t->indent);
+        row.layout.childAlignment.y = CLAY_ALIGN_Y_CENTER;
+        if (n == t->selected) row.backgroundColor = t->selectedColor;
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, row));
+
+        Clay_ElementDeclaration disclosure = (Clay_ElementDeclaration){0};
+        disclosure.layout = CLAY_LAYOUT_DEFAULT;
+        disclosure.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { t->indent, t->indent } }, .type = CLAY__SIZING_TYPE_FIXED };
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, disclosure));
+        if (node->firstChild >= 0) {
+            Clay_String glyph = node->expanded ? expanded : collapsed;
+            if (glyph.length > 0 && glyph.chars) CLAY_TEXT(glyph, cfg);
+        }
+        Clay__CloseElement();
+
+        if (node->labelLength > 0) {
+            Clay_String label = clay_frame_string(t->labels + node->labelOffset, node->labelLength);
+            if (label.chars) CLAY_TEXT(label, cfg);
+        }
+        Clay__CloseElement();
+    }
+
+    Clay__CloseElement();
+    Clay__CloseElement();
+}
+
+// tree:emit(name [, index [, isLocal]]) | tree:emit(idTable)
+static int l_Tree_emit(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "tree:emit() must be called during a layout pass");
+    }
+    clay_tree_emit(t, clay_element_id_from_args(L, 2));
+    return 0;
+}
+
+// tree:hitTest(x, y) -> node, onDisclosure
+static int l_Tree_hitTest(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    float x = (float)luaL_checknumber(L, 2);
+    float y = (float)luaL_checknumber(L, 3);
+    if (!t->id.id) return 0;
+    Clay_ElementData data = Clay_GetElementData(t->id);
+    if (!data.found) return 0;
+    Clay_BoundingBox b = data.boundingBox;
+    if (x < b.x || x >= b.x + b.width || y < b.y || y >= b.y + b.height) return 0;
+
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(t->id.id);
+    float scrollTop = sd ? -sd->scrollPosition.y : 0;
+    clay_tree_ensure_rows(t);
+    int32_t r = (int32_t)((y - b.y + scrollTop) / t->rowHeight);
+    if (r < 0 || r >= t->rowCount) return 0;
+    int32_t n = t->rows[r];
+    float dx = x - b.x - (float)t->nodes[n].depth * t->indent;
+    lua_pushinteger(L, n + 1);
+    lua_pushboolean(L, t->nodes[n].firstChild >= 0 && dx >= 0 && dx < t->indent);
+    return 2;
+}
+
+static int l_Tree_gc(lua_State *L) {
+    ClayTreeView *t = check_tree_view(L, 1);
+    free(t->nodes);
+    free(t->rows);
+    free(t->labels);
+    t->nodes = NULL;
+    t->rows = NULL;
+    t->labels = NULL;
+    t->nodeCount = t->rowCount = 0;
+    return 0;
+}
+
+static void Clay_CreateTreeViewMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayTreeView")) {
+        lua_pushcfunction(L, l_Tree_add); lua_setfield(L, -2, "add");
+        lua_pushcfunction(L, l_Tree_addMany); lua_setfield(L, -2, "addMany");
+        lua_pushcfunction(L, l_Tree_clear); lua_setfield(L, -2, "clear");
+        lua_pushcfunction(L, l_Tree_setLabel); lua_setfield(L, -2, "setLabel");
+        lua_pushcfunction(L, l_Tree_expand); lua_setfield(L, -2, "expand");
+        lua_pushcfunction(L, l_Tree_collapse); lua_setfield(L, -2, "collapse");
+        lua_pushcfunction(L, l_Tree_toggle); lua_setfield(L, -2, "toggle");
+        lua_pushcfunction(L, l_Tree_expandAll); lua_setfield(L, -2, "expandAll");
+        lua_pushcfunction(L, l_Tree_isExpanded); lua_setfield(L, -2, "isExpanded");
+        lua_pushcfunction(L, l_Tree_info); lua_setfield(L, -2, "info");
+        lua_pushcfunction(L, l_Tree_rowCount); lua_setfield(L, -2, "rowCount");
+        lua_pushcfunction(L, l_Tree_nodeAt); lua_setfield(L, -2, "nodeAt");
+        lua_pushcfunction(L, l_Tree_rowOf); lua_setfield(L, -2, "rowOf");
+        lua_pushcfunction(L, l_Tree_select); lua_setfield(L, -2, "select");
+        lua_pushcfunction(L, l_Tree_selected); lua_setfield(L, -2, "selected");
+        lua_pushcfunction(L, l_Tree_setStyle); lua_setfield(L, -2, "setStyle");
+        lua_pushcfunction(L, l_Tree_emit); lua_setfield(L, -2, "emit");
+        lua_pushcfunction(L, l_Tree_hitTest); lua_setfield(L, -2, "hitTest");
+        lua_pushcfunction(L, l_Tree_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Syntax highlighting
+//
+// clay.syntax{ rules=, keywords=, colors=, states= } compiles a lexer table: ordered
+// rules, each a Lua-style pattern (classes, sets and the * + - ? quantifiers, no
+// captures) tried at the current position within one lexer state. A keyword table
+// restyles matches of rules flagged `keywords`. The state a line ends in is carried to
+// the next line, so block comments and long strings span lines. Each rule keeps the
+// set of bytes its match can start with, so most rules are skipped with a bit test.
+// -----------------------------------------------------------------------------
+
+#define CLAY_SYNTAX_STYLE_MAX 32
+
+typedef struct {
+    uint32_t first[8];          // bytes a match can start with
+    int32_t patternOffset;      // into pool, without the leading '^'
+    int32_t patternLength;
+    int16_t next;               // state after a match, -1 to stay
+    uint8_t state;
+    uint8_t style;
+    uint8_t anchored;           // '^': only at the start of a line
+    uint8_t keywords;
+} ClaySyntaxRule;
+
+typedef struct {
+    uint32_t hash;
+    int32_t offset;             // into pool
+    int32_t length;
+    uint8_t style;
+} ClaySyntaxKeyword;
+
+typedef struct {
+    ClaySyntaxRule *rules;
+    int32_t ruleCount;
+    ClaySyntaxKeyword *keywords;   // sorted by hash
+    int32_t keywordCount;
+    char *pool;
+    int32_t poolUsed;
+    int32_t poolCapacity;
+    uint8_t stateStyle[256];        // style of text no rule matches, per state
+    Clay_Color colors[CLAY_SYNTAX_STYLE_MAX];
+    uint32_t colorSet;              // bit k: colors[k] was given
+} ClaySyntax;
+
+typedef struct {
+    int32_t start;              // byte offset in the line; a span runs to the next one
+    uint8_t style;
+} ClaySyntaxSpan;
+
+static int clay_pattern_class(uint8_t c, uint8_t cl) {
+    int res;
+    switch (tolower(cl)) {
+        case 'a': res = isalpha(c); break;
+        case 'c': res = iscntrl(c); break;
+        case 'd': res = isdigit(c); break;
+        case 'g': res = isgraph(c); break;
+        case 'l': res = islower(c); break;
+        case 'p': res = ispunct(c); break;
+        case 's': res = isspace(c); break;
+        case 'u': res = isupper(c); break;
+        case 'w': res = isalnum(c); break;
+        case 'x': res = isxdigit(c); break;
+        default: return cl == c;
+    }
+    return isupper(cl) ? !res : res != 0;
+}
+
+// p points at '[', ec at the matching ']'.
+static int clay_pattern_bracket(uint8_t c, const char *p, const char *ec) {
+    int sig = 1;
+    if (p[1] == '^') {
+        sig = 0;
+        p++;
+    }
+    while (++p < ec) {
+        if (*p == '%') {
+            p++;
+            if (clay_pattern_class(c, (uint8_t)*p)) return sig;
+        } else if (p[1] == '-' && p + 2 < ec) {
+            if ((uint8_t)p[0] <= c && c <= (uint8_t)p[2]) return sig;
+            p += 2;
+        } else if ((uint8_t)*p == c) {
+            return sig;
+        }
+    }
+    return !sig;
+}
+
+// End of the single-character item at p, or NULL when the pattern is malformed.
+static const char* clay_pattern_item_end(const char *p, const char *pe) {
+    if (*p == '%') return p + 1 < pe ? p + 2 : NULL;
+    if (*p != '[') return p + 1;
+    const char *q = p + 1;
+    if (q < pe && *q == '^') q++;
+    do {                            // a ']' right after '[' or '[^' is a literal
+        if (q >= pe) return NULL;
+        if (*q++ == '%') {
+            if (q >= pe) return NULL;
+            q++;
+        }
+    } while (q < pe && *q != ']');
+    return q < pe ? q + 1 : NULL;
+}
+
+static int clay_pattern_single(uint8_t c, const char *p, const char *ep) {
+    switch (*p) {
+        case '.': return 1;
+        case '%': return clay_pattern_class(c, (uint8_t)p[1]);
+        case '[': return clay_pattern_bracket(c, p, ep - 1);
+        default: return (uint8_t)*p == c;
+    }
+}
+
+// Match [p, pe) at s[i]; returns the end of the match, or -1.
+static int32_t clay_pattern_match(const char *s, int32_t i, int32_t len, const char *p, const char *pe) {
+    while (p < pe) {
+        if (*p == '$' && p + 1 == pe) return i == len ? i : -1;
+        const char *ep = clay_pattern_item_end(p, pe);
+        char q = ep < pe ? *ep : '\0';
+        int m = i < len && clay_pattern_single((uint8_t)s[i], p, ep);
+        if (q == '?') {
+            if (m) {
+                int32_t r = clay_pattern_match(s, i + 1, len, ep + 1, pe);
+                if (r >= 0) return r;
+            }
+            p = ep + 1;
+        } else if (q == '*' || q == '+') {
+            int32_t n = 0;
+            while (i + n < len && clay_pattern_single((uint8_t)s[i + n], p, ep)) n++;
+            for (; n >= (q == '+' ? 1 : 0); --n) {
+                int32_t r = clay_pattern_match(s, i + n, len, ep + 1, pe);
+                if (r >= 0) return r;
+            }
+            return -1;
+        } else if (q == '-') {
+            for (;;) {
+                int32_t r = clay_pattern_match(s, i, len, ep + 1, pe);
+                if (r >= 0) return r;
+                if (i < len && clay_pattern_single((uint8_t)s[i], p, ep)) i++;
+                else return -1;
+            }
+        } else {
+            if (!m) return -1;
+            i++;
+            p = ep;
+        }
+    }
+    return i;
+}
+
+static int clay_pattern_valid(const char *p, const char *pe) {
+    while (p < pe) {
+        const char *ep = clay_pattern_item_end(p, pe);
+        if (!ep) return 0;
+        p = ep < pe && (*ep == '?' || *ep == '*' || *ep == '+' || *ep == '-') ? ep + 1 : ep;
+    }
+    return 1;
+}
+
+static void clay_pattern_first_set(const char *p, const char *pe, uint32_t set[8]) {
+    const char *ep = clay_pattern_item_end(p, pe);
+    char q = ep < pe ? *ep : '\0';
+    if (q == '?' || q == '*' || q == '-' || (*p == '$' && p + 1 == pe)) {
+        memset(set, 0xFF, sizeof(uint32_t) * 8);
+        return;
+    }
+    memset(set, 0, sizeof(uint32_t) * 8);
+    for (int c = 0; c < 256; ++c) {
+        if (clay_pattern_single((uint8_t)c, p, ep)) set[c >> 5] |= 1u << (c & 31);
+    }
+}
+
+// Keyword style of s, or -1.
+static int clay_syntax_keyword(const ClaySyntax *sx, const char *s, int32_t len) {
+    uint32_t h = clay_hash_bytes(s, (size_t)len, 0);
+    int32_t lo = 0, hi = sx->keywordCount;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (sx->keywords[mid].hash < h) lo = mid + 1; else hi = mid;
+    }
+    for (; lo < sx->keywordCount && sx->keywords[lo].hash == h; ++lo) {
+        const ClaySyntaxKeyword *k = &sx->keywords[lo];
+        if (k->length == len && memcmp(sx->pool + k->offset, s, (size_t)len) == 0) return k->style;
+    }
+    return -1;
+}
+
+// Lex one line starting in `state` into spans (adjacent spans of one style are merged).
+// Returns the state the line ends in, or -1 when out of memory.
+static int clay_syntax_lex(const ClaySyntax *sx, const char *s, int32_t len, uint8_t state,
+                           ClaySyntaxSpan **spans, int32_t *count, int32_t *capacity) {
+    *count = 0;
+    int32_t i = 0;
+    while (i < len) {
+        uint8_t c = (uint8_t)s[i];
+        uint8_t style = sx->stateStyle[state];
+        int32_t end = -1;
+        for (int32_t r = 0; r < sx->ruleCount; ++r) {
+            const ClaySyntaxRule *rule = &sx->rules[r];
+            if (rule->state != state || !(rule->first[c >> 5] & (1u << (c & 31)))) continue;
+            if (rule->anchored && i > 0) continue;
+            const char *p = sx->pool + rule->patternOffset;
+            end = clay_pattern_match(s, i, len, p, p + rule->patternLength);
+            if (end <= i) {
+                end = -1;           // empty matches would never advance
+                continue;
+            }
+            style = rule->style;
+            if (rule->keywords) {
+                int k = clay_syntax_keyword(sx, s + i, end - i);
+                if (k >= 0) style = (uint8_t)k;
+            }
+            if (rule->next >= 0) state = (uint8_t)rule->next;
+            break;
+        }
+        if (end < 0) {
+            end = i + 1;
+            while (end < len && ((uint8_t)s[end] & 0xC0) == 0x80) end++;
+        }
+        if (*count == 0 || (*spans)[*count - 1].style != style) {
+            if (*count == *capacity) {
+                int32_t cap = *capacity ? *capacity * 2 : 8;
+                ClaySyntaxSpan *grown = (ClaySyntaxSpan*)realloc(*spans, sizeof(ClaySyntaxSpan) * (size_t)cap);
+                if (!grown) return -1;
+                *spans = grown;
+                *capacity = cap;
+            }
+            (*spans)[(*count)++] = (ClaySyntaxSpan){ i, style };
+        }
+        i = end;
+    }
+    return state;
+}
+
+static ClaySyntax* check_syntax(lua_State *L, int idx) {
+    return (ClaySyntax*)luaL_checkudata(L, idx, "ClaySyntax");
+}
+
+static int32_t clay_syntax_intern(lua_State *L, ClaySyntax *sx, const char *s, size_t len) {
+    if (len > (size_t)(INT32_MAX / 2) || (size_t)sx->poolUsed + len > (size_t)(INT32_MAX / 2)) {
+        return luaL_error(L, "clay.syntax: table too large");
+    }
+    if (sx->poolUsed + (int32_t)len > sx->poolCapacity) {
+        int32_t cap = sx->poolCapacity ? sx->poolCapacity : 1024;
+        while (cap < sx->poolUsed + (int32_t)len) cap *= 2;
+        char *grown = (char*)realloc(sx->pool, (size_t)cap);
+        if (!grown) return luaL_error(L, "clay.syntax: out of memory");
+        sx->pool = grown;
+        sx->poolCapacity = cap;
+    }
+    memcpy(sx->pool + sx->poolUsed, s, len);
+    sx->poolUsed += (int32_t)len;
+    return sx->poolUsed - (int32_t)len;
+}
+
+static int clay_syntax_keyword_cmp(const void *a, const void *b) {
+    uint32_t ha = ((const ClaySyntaxKeyword*)a)->hash, hb = ((const ClaySyntaxKeyword*)b)->hash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+static int clay_syntax_style_arg(lua_State *L, int idx) {
+    lua_Integer style = lua_tointeger(L, idx);
+    if (style < 0 || style >= CLAY_SYNTAX_STYLE_MAX) return luaL_error(L, "clay.syntax: style must be 0..%d", CLAY_SYNTAX_STYLE_MAX - 1);
+    return (int)style;
+}
+
+// clay.syntax{
+//   rules = { { pattern, style [, state=0] [, next=state] [, keywords=true] }, ... },
+//   keywords = { word = style, ... },
+//   colors = { [style] = {r, g, b [, a]}, ... },    -- style 0 is the editor's textColor
+//   states = { [state] = style, ... },              -- style of unmatched text per state
+// } -> syntax
+static int l_Clay_Syntax_New(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    ClaySyntax *sx = (ClaySyntax*)lua_newuserdata(L, sizeof(ClaySyntax));
+    memset(sx, 0, sizeof(*sx));
+    luaL_setmetatable(L, "ClaySyntax");
+    int self = lua_gettop(L);
+
+    lua_getfield(L, 1, "rules");
+    if (lua_istable(L, -1)) {
+        int t = lua_gettop(L);
+        int32_t count = (int32_t)clay_rawlen(L, t);
+        sx->rules = (ClaySyntaxRule*)calloc(count > 0 ? (size_t)count : 1, sizeof(ClaySyntaxRule));
+        if (!sx->rules) return luaL_error(L, "clay.syntax: out of memory");
+        for (int32_t i = 1; i <= count; ++i) {
+            lua_rawgeti(L, t, i);
+            if (!lua_istable(L, -1)) return luaL_error(L, "clay.syntax: rule %d is not a table", (int)i);
+            int r = lua_gettop(L);
+            ClaySyntaxRule *rule = &sx->rules[sx->ruleCount];
+            size_t len = 0;
+            lua_rawgeti(L, r, 1);
+            const char *pat = lua_tolstring(L, -1, &len);
+            if (!pat) return luaL_error(L, "clay.syntax: rule %d has no pattern", (int)i);
+            if (len > 0 && pat[0] == '^') {
+                rule->anchored = 1;
+                pat++;
+                len--;
+            }
+            if (len == 0 || !clay_pattern_valid(pat, pat + len)) {
+                return luaL_error(L, "clay.syntax: malformed pattern in rule %d", (int)i);
+            }
+            clay_pattern_first_set(pat, pat + len, rule->first);
+            rule->patternOffset = clay_syntax_intern(L, sx, pat, len);
+            rule->patternLength = (int32_t)len;
+            lua_pop(L, 1);
+            lua_rawgeti(L, r, 2);
+            rule->style = (uint8_t)clay_syntax_style_arg(L, -1);
+            lua_pop(L, 1);
+            float state = clay_opt_number_field(L, r, "state", 0);
+            float next = clay_opt_number_field(L, r, "next", -1);
+            luaL_argcheck(L, state >= 0 && state < 256 && next >= -1 && next < 256, 1, "lexer states are 0..255");
+            rule->state = (uint8_t)state;
+            rule->next = (int16_t)next;
+            lua_getfield(L, r, "keywords");
+            rule->keywords = (uint8_t)lua_toboolean(L, -1);
+            lua_pop(L, 2);
+            sx->ruleCount++;
+        }
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "keywords");
+    if (lua_istable(L, -1)) {
+        int t = lua_gettop(L);
+        int32_t capacity = 0;
+        lua_pushnil(L);
+        while (lua_next(L, t)) {
+            if (lua_type(L, -2) == LUA_TSTRING) {
+                if (sx->keywordCount == capacity) {
+                    capacity = capacity ? capacity * 2 : 32;
+                    ClaySyntaxKeyword *grown = (ClaySyntaxKeyword*)realloc(sx->keywords, sizeof(ClaySyntaxKeyword) * (size_t)capacity);
+                    if (!grown) return luaL_error(L, "clay.syntax: out of memory");
+                    sx->keywords = grown;
+                }
+                size_t len = 0;
+                const char *word = lua_tolstring(L, -2, &len);
+                ClaySyntaxKeyword *k = &sx->keywords[sx->keywordCount++];
+                k->style = (uint8_t)clay_syntax_style_arg(L, -1);
+                k->hash = clay_hash_bytes(word, len, 0);
+                k->length = (int32_t)len;
+                k->offset = clay_syntax_intern(L, sx, word, len);
+            }
+            lua_pop(L, 1);
+        }
+        if (sx->keywordCount > 1) qsort(sx->keywords, (size_t)sx->keywordCount, sizeof(ClaySyntaxKeyword), clay_syntax_keyword_cmp);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "states");
+    if (lua_istable(L, -1)) {
+        for (int s = 0; s < 256; ++s) {
+            lua_rawgeti(L, -1, s);
+            if (lua_isnumber(L, -1)) sx->stateStyle[s] = (uint8_t)clay_syntax_style_arg(L, -1);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    sx->colorSet = clay_opt_palette_field(L, 1, "colors", sx->colors, CLAY_SYNTAX_STYLE_MAX);
+    lua_settop(L, self);
+    return 1;
+}
+
+static int l_Syntax_gc(lua_State *L) {
+    ClaySyntax *sx = check_syntax(L, 1);
+    free(sx->rules);
+    free(sx->keywords);
+    free(sx->pool);
+    memset(sx, 0, sizeof(*sx));
+    return 0;
+}
+
+static void Clay_CreateSyntaxMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClaySyntax")) {
+        lua_pushcfunction(L, l_Syntax_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Text editor
+//
+// clay.textEditor() keeps its content in a C gap buffer, so typing at the caret only
+// moves the bytes between the previous and the new edit point. The text is split into
+// paragraphs at '\n'. Each paragraph caches its wrapped rows and the x offset of each of
+// its bytes, taken from the native font metrics when the font has them and from the
+// measure function otherwise. Caret placement, selection rectangles and click-to-caret
+// all read those offsets. An edit only invalidates the paragraphs it touched.
+// -----------------------------------------------------------------------------
+
+enum {
+    CLAY_CARET_LEFT,
+    CLAY_CARET_RIGHT,
+    CLAY_CARET_UP,
+    CLAY_CARET_DOWN,
+    CLAY_CARET_WORD_LEFT,
+    CLAY_CARET_WORD_RIGHT,
+    CLAY_CARET_LINE_START,
+    CLAY_CARET_LINE_END,
+    CLAY_CARET_DOC_START,
+    CLAY_CARET_DOC_END,
+};
+
+typedef struct {
+    int32_t start;              // byte offset of the paragraph in the text
+    int32_t length;             // bytes, not counting the '\n'
+    ClayParagraphLine *rows;    // relative to start; rowCount == 0 means "wrap again"
+    int32_t rowCount;
+    int32_t rowCapacity;
+    float *x;                   // x of byte offsets [0, length] from the paragraph start; NULL until needed
+    ClaySyntaxSpan *spans;      // spanCount < 0: lex again
+    int32_t spanCount;
+    int32_t spanCapacity;
+    uint8_t lexIn;              // lexer state at the start / end of the paragraph
+    uint8_t lexOut;
+} ClayEditorPara;
+
+typedef struct {
+    char *buf;
+    int32_t capacity;
+    int32_t gapStart;           // [gapStart, gapEnd) of buf is unused
+    int32_t gapEnd;
+    ClayEditorPara *paras;
+    int32_t paraCount;
+    int32_t paraCapacity;
+    int32_t *rowStart;          // first row of each paragraph (paraCount + 1 entries)
+    int32_t rowStartCapacity;
+    int rowStartValid;
+    int32_t caret;              // byte offsets; the selection is [min, max) of the two
+    int32_t anchor;
+    float preferredX;           // column kept across vertical moves, < 0 when unset
+    int revealCaret;
+    int focused;
+    int caretVisible;
+    float blinkPeriod;          // seconds per on/off cycle; 0: caretVisible is used as is
+    double caretMovedAt;        // clock time of the last caret move; blinking restarts there
+    int multiline;
+    int wrap;
+    float wrapWidth;            // width the cached rows were wrapped for
+    float rowHeight;            // from the last emit
+    float caretWidth;
+    Clay_TextElementConfig text;
+    Clay_Color caretColor;
+    Clay_Color selectionColor;
+    char *scratch;              // contiguous copy of a range that straddles the gap
+    int32_t scratchCapacity;
+    ClayParagraphEntry wrapper; // reused wrap output
+    ClaySyntax *syntax;         // kept alive by syntaxRef
+    int syntaxRef;
+    int32_t lexFrom;            // paragraphs before this one have up-to-date spans
+    Clay_ElementId id;
+} ClayTextEditor;
+
+static inline int32_t clay_editor_length(const ClayTextEditor *e) {
+    return e->capacity - (e->gapEnd - e->gapStart);
+}
+
+static inline uint8_t clay_editor_byte(const ClayTextEditor *e, int32_t pos) {
+    return (uint8_t)e->buf[pos < e->gapStart ? pos : pos + (e->gapEnd - e->gapStart)];
+}
+
+static void clay_editor_move_gap(ClayTextEditor *e, int32_t pos) {
+    if (pos < e->gapStart) {
+        int32_t n = e->gapStart - pos;
+        memmove(e->buf + e->gapEnd - n, e->buf + pos, (size_t)n);
+        e->gapStart -= n;
+        e->gapEnd -= n;
+    } else if (pos > e->gapStart) {
+        int32_t n = pos - e->gapStart;
+        memmove(e->buf + e->gapStart, e->buf + e->gapEnd, (size_t)n);
+        e->gapStart += n;
+        e->gapEnd += n;
+    }
+}
+
+// Make the gap at least `need` bytes wide; returns 0 when out of memory.
+static int clay_editor_reserve(ClayTextEditor *e, int32_t need) {
+    int32_t gap = e->gapEnd - e->gapStart;
+    if (gap >= need) return 1;
+    int64_t used = e->capacity - gap;
+    int64_t cap = e->capacity ? e->capacity : 256;
+    while (cap - used < need) cap *= 2;
+    if (cap > INT32_MAX) return 0;
+    char *grown = (char*)realloc(e->buf, (size_t)cap);
+    if (!grown) return 0;
+    int32_t tail = e->capacity - e->gapEnd;
+    memmove(grown + cap - tail, grown + e->gapEnd, (size_t)tail);
+    e->buf = grown;
+    e->gapEnd = (int32_t)cap - tail;
+    e->capacity = (int32_t)cap;
+    return 1;
+}
+
+// Bytes [start, start + len) as one pointer. Valid until the next edit or range call.
+static const char* clay_editor_range(ClayTextEditor *e, int32_t start, int32_t len) {
+    int32_t gap = e->gapEnd - e->gapStart;
+    if (start + len <= e->gapStart) return e->buf + start;
+    if (start >= e->gapStart) return e->buf + start + gap;
+    if (len > e->scratchCapacity) {
+        int32_t cap = e->scratchCapacity ? e->scratchCapacity : 256;
+        while (cap < len) cap *= 2;
+        char *grown = (char*)realloc(e->scratch, (size_t)cap);
+        if (!grown) return NULL;
+        e->scratch = grown;
+        e->scratchCapacity = cap;
+    }
+    int32_t head = e->gapStart - start;
+    memcpy(e->scratch, e->buf + start, (size_t)head);
+    memcpy(e->scratch + head, e->buf + e->gapEnd, (size_t)(len - head));
+    return e->scratch;
+}
+
+static void clay_editor_para_invalidate(ClayEditorPara *p) {
+    p->rowCount = 0;
+    free(p->x);
+    p->x = NULL;
+}
+
+// Index of the paragraph containing byte offset pos.
+static int32_t clay_editor_para_at(const ClayTextEditor *e, int32_t pos) {
+    int32_t lo = 0, hi = e->paraCount - 1;
+    while (lo < hi) {
+        int32_t mid = (lo + hi + 1) / 2;
+        if (e->paras[mid].start <= pos) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Replace bytes [from, to) with s. Only the paragraphs the range touches are re-created;
+// the ones after it just move. Returns 0 when out of memory (nothing is changed).
+static int clay_editor_replace(ClayTextEditor *e, int32_t from, int32_t to, const char *s, int32_t len) {
+    if (!clay_editor_reserve(e, len)) return 0;
+    int32_t added = 1;
+    for (const char *nl = s; (nl = (const char*)memchr(nl, '\n', (size_t)(s + len - nl))) != NULL; ++nl) added++;
+    int32_t pa = clay_editor_para_at(e, from);
+    int32_t pb = clay_editor_para_at(e, to);
+    int32_t count = e->paraCount - (pb - pa + 1) + added;
+    if (count > e->paraCapacity) {
+        int32_t cap = e->paraCapacity ? e->paraCapacity : 64;
+        while (cap < count) cap *= 2;
+        ClayEditorPara *grown = (ClayEditorPara*)realloc(e->paras, sizeof(ClayEditorPara) * (size_t)cap);
+        if (!grown) return 0;
+        e->paras = grown;
+        e->paraCapacity = cap;
+    }
+
+    int32_t start = e->paras[pa].start;
+    for (int32_t p = pa; p <= pb; ++p) {
+        clay_editor_para_invalidate(&e->paras[p]);
+        free(e->paras[p].rows);
+        free(e->paras[p].spans);
+    }
+    memmove(e->paras + pa + added, e->paras + pb + 1, sizeof(ClayEditorPara) * (size_t)(e->paraCount - pb - 1));
+    e->paraCount = count;
+    int32_t delta = len - (to - from);
+    for (int32_t p = pa + added; p < count; ++p) e->paras[p].start += delta;
+
+    clay_editor_move_gap(e, from);
+    e->gapEnd += to - from;
+    memcpy(e->buf + e->gapStart, s, (size_t)len);
+    e->gapStart += len;
+
+    int32_t i = 0;
+    for (int32_t k = 0; k < added; ++k) {
+        ClayEditorPara *p = &e->paras[pa + k];
+        memset(p, 0, sizeof(*p));
+        p->spanCount = -1;
+        p->start = start;
+        while (i < len && s[i] != '\n') i++;
+        if (k + 1 < added) {
+            start = from + i + 1;
+            p->length = start - 1 - p->start;
+            i++;
+        } else {
+            int32_t end = pa + added < count ? e->paras[pa + added].start - 1 : clay_editor_length(e);
+            p->length = end - p->start;
+        }
+    }
+    e->rowStartValid = 0;
+    if (pa < e->lexFrom) e->lexFrom = pa;
+    return 1;
+}
+
+static void clay_editor_invalidate_all(ClayTextEditor *e) {
+    for (int32_t p = 0; p < e->paraCount; ++p) clay_editor_para_invalidate(&e->paras[p]);
+    e->rowStartValid = 0;
+}
+
+static int32_t clay_editor_next(const ClayTextEditor *e, int32_t pos) {
+    int32_t len = clay_editor_length(e);
+    if (pos >= len) return len;
+    pos++;
+    while (pos < len && (clay_editor_byte(e, pos) & 0xC0) == 0x80) pos++;
+    return pos;
+}
+
+static int32_t clay_editor_prev(const ClayTextEditor *e, int32_t pos) {
+    if (pos <= 0) return 0;
+    pos--;
+    while (pos > 0 && (clay_editor_byte(e, pos) & 0xC0) == 0x80) pos--;
+    return pos;
+}
+
+// Clamp pos into the text and back onto a codepoint boundary.
+static int32_t clay_editor_clamp(const ClayTextEditor *e, lua_Integer pos) {
+    int32_t len = clay_editor_length(e);
+    if (pos <= 0) return 0;
+    if (pos >= len) return len;
+    int32_t p = (int32_t)pos;
+    while (p > 0 && (clay_editor_byte(e, p) & 0xC0) == 0x80) p--;
+    return p;
+}
+
+static int clay_editor_wrap_para(ClayTextEditor *e, ClayEditorPara *p) {
+    ClayParagraphEntry *w = &e->wrapper;
+    const char *chars = p->length > 0 ? clay_editor_range(e, p->start, p->length) : "";
+    w->lineCount = 0;
+    if (chars && e->wrap && e->wrapWidth > 0 && p->length > 0) {
+        Clay_TextElementConfig cfg = e->text;
+        cfg.wrapMode = CLAY_TEXT_WRAP_WORDS;
+        w->text = (char*)chars;     // only read by the wrapper
+        w->textLength = p->length;
+        clay_paragraph_wrap(w, &cfg, e->wrapWidth);
+    }
+    if (w->lineCount == 0) clay_paragraph_push_line(w, 0, p->length);
+    if (w->lineCount == 0) return 0;
+    // The wrapper drops leading spaces; an editor has to show (and place the caret in) them.
+    w->lines[0].length += w->lines[0].start;
+    w->lines[0].start = 0;
+
+    if (w->lineCount > p->rowCapacity) {
+        ClayParagraphLine *grown = (ClayParagraphLine*)realloc(p->rows, sizeof(ClayParagraphLine) * (size_t)w->lineCount);
+        if (!grown) return 0;
+        p->rows = grown;
+        p->rowCapacity = w->lineCount;
+    }
+    memcpy(p->rows, w->lines, sizeof(ClayParagraphLine) * (size_t)w->lineCount);
+    p->rowCount = w->lineCount;
+    return 1;
+}
+
+// Wrap every paragraph that needs it and rebuild the row prefix. Only edited paragraphs
+// need wrapping unless the width changed. Returns 0 when out of memory.
+static int clay_editor_layout(ClayTextEditor *e, float width) {
+    if (!e->wrap) width = 0;
+    if (fabsf(width - e->wrapWidth) > 0.5f) {
+        e->wrapWidth = width;
+        clay_editor_invalidate_all(e);
+    }
+    if (e->paraCount + 1 > e->rowStartCapacity) {
+        int32_t cap = e->rowStartCapacity ? e->rowStartCapacity : 64;
+        while (cap < e->paraCount + 1) cap *= 2;
+        int32_t *grown = (int32_t*)realloc(e->rowStart, sizeof(int32_t) * (size_t)cap);
+        if (!grown) return 0;
+        e->rowStart = grown;
+        e->rowStartCapacity = cap;
+        e->rowStartValid = 0;
+    }
+    if (e->rowStartValid) return 1;
+    int32_t row = 0;
+    for (int32_t i = 0; i < e->paraCount; ++i) {
+        ClayEditorPara *p = &e->paras[i];
+        if (p->rowCount == 0 && !clay_editor_wrap_para(e, p)) return 0;
+        e->rowStart[i] = row;
+        row += p->rowCount;
+    }
+    e->rowStart[e->paraCount] = row;
+    e->rowStartValid = 1;
+    return 1;
+}
+
+static inline int32_t clay_editor_total_rows(const ClayTextEditor *e) {
+    return e->rowStartValid ? e->rowStart[e->paraCount] : 0;
+}
+
+// Paragraph holding global row `row` (requires a valid row prefix).
+static int32_t clay_editor_para_of_row(const ClayTextEditor *e, int32_t row) {
+    int32_t lo = 0, hi = e->paraCount - 1;
+    while (lo < hi) {
+        int32_t mid = (lo + hi + 1) / 2;
+        if (e->rowStart[mid] <= row) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Per-byte x offsets of a paragraph, measured once per edit.
+static const float* clay_editor_para_x(ClayTextEditor *e, ClayEditorPara *p) {
+    if (p->x) return p->x;
+    float *x = (float*)malloc(sizeof(float) * (size_t)(p->length + 1));
+    if (!x) return NULL;
+    const char *chars = p->length > 0 ? clay_editor_range(e, p->start, p->length) : "";
+    if (!chars) { free(x); return NULL; }
+    ClayFontMetrics *fm = clay_font_metrics(e->text.fontId);
+    float fontSize = (float)e->text.fontSize;
+    float letterSpacing = (float)e->text.letterSpacing;
+    float pen = 0;
+    int32_t i = 0;
+    while (i < p->length) {
+        int32_t at = i;
+        uint32_t cp = (uint8_t)chars[i] < 0x80 ? (uint8_t)chars[i++] : clay_utf8_next(chars, p->length, &i);
+        for (int32_t k = at; k < i; ++k) x[k] = pen;
+        pen += (fm ? clay_font_scaled_advance(fm, cp, fontSize) : clay_measure_slice(chars + at, i - at, &e->text)) + letterSpacing;
+    }
+    x[p->length] = pen;
+    p->x = x;
+    return x;
+}
+
+// Bring the spans of paragraphs [0, upTo) up to date. Lexing restarts at the first edited
+// paragraph. A paragraph that was not edited and starts in the same state as before keeps
+// its spans and end state, so the following ones are skipped for as long as each of them
+// was lexed from its predecessor's current end state. Paragraphs past an earlier upTo may
+// still hold spans from an older state chain; the check stops there and lexes them again.
+static void clay_editor_lex_to(ClayTextEditor *e, int32_t upTo) {
+    if (!e->syntax) return;
+    int32_t p = e->lexFrom;
+    if (upTo > e->paraCount) upTo = e->paraCount;
+    while (p < upTo) {
+        ClayEditorPara *para = &e->paras[p];
+        uint8_t in = p > 0 ? e->paras[p - 1].lexOut : 0;
+        if (para->spanCount >= 0 && para->lexIn == in) {
+            p++;
+            while (p < e->paraCount && e->paras[p].spanCount >= 0 && e->paras[p].lexIn == e->paras[p - 1].lexOut) p++;
+            continue;
+        }
+        const char *chars = para->length > 0 ? clay_editor_range(e, para->start, para->length) : "";
+        int out = chars ? clay_syntax_lex(e->syntax, chars, para->length, in, &para->spans, &para->spanCount, &para->spanCapacity) : -1;
+        if (out < 0) {
+            para->spanCount = -1;
+            break;
+        }
+        para->lexIn = in;
+        para->lexOut = (uint8_t)out;
+        p++;
+    }
+    e->lexFrom = p;
+}
+
+// Row within paragraph p that shows local offset o (a wrap point belongs to the next row).
+static int32_t clay_editor_row_in_para(const ClayEditorPara *p, int32_t o) {
+    int32_t r = 0;
+    while (r + 1 < p->rowCount && p->rows[r + 1].start <= o) r++;
+    return r;
+}
+
+// Global row and x (relative to the row start) of byte offset pos.
+static int clay_editor_locate(ClayTextEditor *e, int32_t pos, int32_t *row, float *x) {
+    if (!clay_editor_layout(e, e->wrapWidth)) return 0;
+    int32_t pi = clay_editor_para_at(e, pos);
+    ClayEditorPara *p = &e->paras[pi];
+    const float *xs = clay_editor_para_x(e, p);
+    if (!xs) return 0;
+    int32_t o = pos - p->start;
+    int32_t r = clay_editor_row_in_para(p, o);
+    *row = e->rowStart[pi] + r;
+    *x = xs[o] - xs[p->rows[r].start];
+    return 1;
+}
+
+// Byte offset on global row `row` nearest to x (relative to the row start).
+static int32_t clay_editor_offset_at(ClayTextEditor *e, int32_t row, float x) {
+    if (!clay_editor_layout(e, e->wrapWidth)) return e->caret;
+    if (row < 0) return 0;
+    if (row >= clay_editor_total_rows(e)) return clay_editor_length(e);
+    int32_t pi = clay_editor_para_of_row(e, row);
+    ClayEditorPara *p = &e->paras[pi];
+    int32_t r = row - e->rowStart[pi];
+    const float *xs = clay_editor_para_x(e, p);
+    if (!xs) return p->start;
+    int32_t rs = p->rows[r].start;
+    int lastRow = r + 1 == p->rowCount;
+    int32_t re = lastRow ? p->length : p->rows[r + 1].start;
+    float target = xs[rs] + x;
+    int32_t o = rs;
+    while (o < re) {
+        int32_t next = o + 1;
+        while (next < re && xs[next] == xs[o]) next++;      // skip continuation bytes
+        if (!lastRow && next == re) break;      // past a wrap: stay before the last codepoint
+        if (target < (xs[o] + xs[next]) * 0.5f) break;
+        o = next;
+    }
+    return clay_editor_clamp(e, p->start + o);
+}
+
+static int clay_editor_is_word(uint8_t c) {
+    return c >= 0x80 || c == '_' || (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+static int32_t clay_editor_move(ClayTextEditor *e, int32_t pos, int dir) {
+    int32_t len = clay_editor_length(e);
+    switch (dir) {
+        case CLAY_CARET_LEFT: return clay_editor_prev(e, pos);
+        case CLAY_CARET_RIGHT: return clay_editor_next(e, pos);
+        case CLAY_CARET_WORD_LEFT:
+            while (pos > 0 && !clay_editor_is_word(clay_editor_byte(e, pos - 1))) pos--;
+            while (pos > 0 && clay_editor_is_word(clay_editor_byte(e, pos - 1))) pos--;
+            return clay_editor_clamp(e, pos);
+        case CLAY_CARET_WORD_RIGHT:
+            while (pos < len && !clay_editor_is_word(clay_editor_byte(e, pos))) pos++;
+            while (pos < len && clay_editor_is_word(clay_editor_byte(e, pos))) pos++;
+            return clay_editor_clamp(e, pos);
+        case CLAY_CARET_DOC_START: return 0;
+        case CLAY_CARET_DOC_END: return len;
+        default: break;
+    }
+    int32_t row = 0;
+    float x = 0;
+    if (!clay_editor_locate(e, pos, &row, &x)) return pos;
+    switch (dir) {
+        case CLAY_CARET_UP:
+        case CLAY_CARET_DOWN:
+            if (e->preferredX < 0) e->preferredX = x;
+            row += dir == CLAY_CARET_UP ? -1 : 1;
+            if (row < 0) return 0;
+            if (row >= clay_editor_total_rows(e)) return len;
+            return clay_editor_offset_at(e, row, e->preferredX);
+        case CLAY_CARET_LINE_START:
+            return clay_editor_offset_at(e, row, 0);
+        case CLAY_CARET_LINE_END: {
+            ClayEditorPara *p = &e->paras[clay_editor_para_at(e, pos)];
+            int32_t r = clay_editor_row_in_para(p, pos - p->start);
+            return p->start + (r + 1 == p->rowCount ? p->length : p->rows[r].start + p->rows[r].length);
+        }
+        default:
+            return pos;
+    }
+}
+
+static void clay_editor_set_caret(ClayTextEditor *e, int32_t pos, int extend) {
+    e->caret = pos;
+    if (!extend) e->anchor = pos;
+    e->revealCaret = 1;
+    e->caretMovedAt = g_Now;
+}
+
+// Replace the selection (or insert at the caret) and put the caret after the new text.
+static int clay_editor_insert(ClayTextEditor *e, const char *s, int32_t len) {
+    int32_t from = e->caret < e->anchor ? e->caret : e->anchor;
+    int32_t to = e->caret < e->anchor ? e->anchor : e->caret;
+    if (!clay_editor_replace(e, from, to, s, len)) return 0;
+    clay_editor_set_caret(e, from + len, 0);
+    e->preferredX = -1;
+    return 1;
+}
+
+static ClayTextEditor* check_text_editor(lua_State *L, int idx) {
+    return (ClayTextEditor*)luaL_checkudata(L, idx, "ClayTextEditor");
+}
+
+// Strip newlines from single-line input; returns s itself when there are none.
+static const char* clay_editor_filter(lua_State *L, ClayTextEditor *e, const char *s, size_t *len) {
+    if (e->multiline || !memchr(s, '\n', *len)) return s;
+    char *out = (char*)lua_newuserdata(L, *len);
+    size_t n = 0;
+    for (size_t i = 0; i < *len; ++i) {
+        if (s[i] != '\n' && s[i] != '\r') out[n++] = s[i];
+    }
+    *len = n;
+    return out;
+}
+
+// clay.textEditor([text]) -> editor
+static int l_Clay_TextEditor_New(lua_State *L) {
+    size_t len = 0;
+    const char *s = luaL_optlstring(L, 1, "", &len);
+    ClayTextEditor *e = (ClayTextEditor*)lua_newuserdata(L, sizeof(ClayTextEditor));
+    memset(e, 0, sizeof(*e));
+    e->multiline = 1;
+    e->wrap = 1;
+    e->preferredX = -1;
+    e->caretVisible = 1;
+    e->caretWidth = 2;
+    e->text = (Clay_TextElementConfig){ .textColor = {255,255,255,255}, .fontId = 1, .fontSize = 16,
+                                        .wrapMode = CLAY_TEXT_WRAP_NONE };
+    e->caretColor = (Clay_Color){255,255,255,255};
+    e->selectionColor = (Clay_Color){80,140,255,90};
+    e->syntaxRef = LUA_NOREF;
+    luaL_setmetatable(L, "ClayTextEditor");
+    e->paras = (ClayEditorPara*)calloc(64, sizeof(ClayEditorPara));
+    if (!e->paras) return luaL_error(L, "clay.textEditor: out of memory");
+    e->paraCapacity = 64;
+    e->paraCount = 1;
+    if (len > INT32_MAX / 2 || !clay_editor_replace(e, 0, 0, s, (int32_t)len)) {
+        return luaL_error(L, "clay.textEditor: out of memory");
+    }
+    return 1;
+}
+
+// editor:setText(text) -- also clears the selection and moves the caret to the end
+static int l_Editor_setText(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    size_t len = 0;
+    const char *s = luaL_checklstring(L, 2, &len);
+    s = clay_editor_filter(L, e, s, &len);
+    if (len > INT32_MAX / 2 || !clay_editor_replace(e, 0, clay_editor_length(e), s, (int32_t)len)) {
+        return luaL_error(L, "editor:setText: out of memory");
+    }
+    clay_editor_set_caret(e, (int32_t)len, 0);
+    e->preferredX = -1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:getText([from [, to]]) -> string   (byte offsets, 0 .. length)
+static int l_Editor_getText(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    int32_t len = clay_editor_length(e);
+    int32_t from = clay_editor_clamp(e, luaL_optinteger(L, 2, 0));
+    int32_t to = clay_editor_clamp(e, luaL_optinteger(L, 3, len));
+    if (to <= from) {
+        lua_pushlstring(L, "", 0);
+        return 1;
+    }
+    const char *chars = clay_editor_range(e, from, to - from);
+    if (!chars) return luaL_error(L, "editor:getText: out of memory");
+    lua_pushlstring(L, chars, (size_t)(to - from));
+    return 1;
+}
+
+static int l_Editor_length(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    lua_pushinteger(L, clay_editor_length(e));
+    return 1;
+}
+
+static int l_Editor_lineCount(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    lua_pushinteger(L, e->paraCount);
+    return 1;
+}
+
+// editor:insert(text) -- replaces the selection
+static int l_Editor_insert(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    size_t len = 0;
+    const char *s = luaL_checklstring(L, 2, &len);
+    s = clay_editor_filter(L, e, s, &len);
+    if (len > INT32_MAX / 2 || !clay_editor_insert(e, s, (int32_t)len)) {
+        return luaL_error(L, "editor:insert: out of memory");
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:backspace() / editor:delete() -- remove the selection, or one codepoint
+static int clay_editor_erase(lua_State *L, int forward) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    if (e->caret == e->anchor) {
+        e->anchor = forward ? clay_editor_next(e, e->caret) : clay_editor_prev(e, e->caret);
+    }
+    if (!clay_editor_insert(e, "", 0)) return luaL_error(L, "editor: out of memory");
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Editor_backspace(lua_State *L) { return clay_editor_erase(L, 0); }
+static int l_Editor_delete(lua_State *L) { return clay_editor_erase(L, 1); }
+
+// editor:setCaret(offset [, extendSelection])
+static int l_Editor_setCaret(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    clay_editor_set_caret(e, clay_editor_clamp(e, luaL_checkinteger(L, 2)), lua_toboolean(L, 3));
+    e->preferredX = -1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:caret() -> caret, anchor
+static int l_Editor_caret(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    lua_pushinteger(L, e->caret);
+    lua_pushinteger(L, e->anchor);
+    return 2;
+}
+
+// editor:select(from, to) -- anchor at from, caret at to
+static int l_Editor_select(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    e->anchor = clay_editor_clamp(e, luaL_checkinteger(L, 2));
+    clay_editor_set_caret(e, clay_editor_clamp(e, luaL_checkinteger(L, 3)), 1);
+    e->preferredX = -1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Editor_selectAll(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    e->anchor = 0;
+    clay_editor_set_caret(e, clay_editor_length(e), 1);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:selection() -> from, to   (equal when nothing is selected)
+static int l_Editor_selection(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    lua_pushinteger(L, e->caret < e->anchor ? e->caret : e->anchor);
+    lua_pushinteger(L, e->caret < e->anchor ? e->anchor : e->caret);
+    return 2;
+}
+
+static int l_Editor_selectedText(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    int32_t from = e->caret < e->anchor ? e->caret : e->anchor;
+    int32_t to = e->caret < e->anchor ? e->anchor : e->caret;
+    const char *chars = to > from ? clay_editor_range(e, from, to - from) : "";
+    if (!chars) return luaL_error(L, "editor:selectedText: out of memory");
+    lua_pushlstring(L, chars, (size_t)(to - from));
+    return 1;
+}
+
+// editor:move(clay.CARET_*, [extendSelection])
+static int l_Editor_move(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    int dir = (int)luaL_checkinteger(L, 2);
+    int extend = lua_toboolean(L, 3);
+    luaL_argcheck(L, dir >= CLAY_CARET_LEFT && dir <= CLAY_CARET_DOC_END, 2, "invalid caret movement");
+    int32_t from = e->caret < e->anchor ? e->caret : e->anchor;
+    int32_t to = e->caret < e->anchor ? e->anchor : e->caret;
+    int32_t pos;
+    if (!extend && from != to && (dir == CLAY_CARET_LEFT || dir == CLAY_CARET_RIGHT)) {
+        pos = dir == CLAY_CARET_LEFT ? from : to;     // collapse the selection
+    } else {
+        pos = clay_editor_move(e, e->caret, dir);
+    }
+    if (dir != CLAY_CARET_UP && dir != CLAY_CARET_DOWN) e->preferredX = -1;
+    clay_editor_set_caret(e, pos, extend);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:setFocused(focused [, caretVisible = focused]) -- blink by toggling caretVisible
+static int l_Editor_setFocused(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    int focused = lua_toboolean(L, 2);
+    if (focused && !e->focused) e->caretMovedAt = g_Now;
+    e->focused = focused;
+    e->caretVisible = lua_isnoneornil(L, 3) ? e->focused : lua_toboolean(L, 3);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:setBlink(period)   (seconds per on/off cycle, driven by the binding clock; 0 stops blinking)
+static int l_Editor_setBlink(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    double period = luaL_checknumber(L, 2);
+    e->blinkPeriod = period > 0 ? (float)period : 0.0f;
+    e->caretMovedAt = g_Now;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:setSyntax(syntax | nil) -- highlight with a table from clay.syntax{}
+static int l_Editor_setSyntax(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    ClaySyntax *sx = lua_isnoneornil(L, 2) ? NULL : check_syntax(L, 2);
+    luaL_unref(L, LUA_REGISTRYINDEX, e->syntaxRef);
+    e->syntaxRef = LUA_NOREF;
+    if (sx) {
+        lua_pushvalue(L, 2);
+        e->syntaxRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    e->syntax = sx;
+    for (int32_t p = 0; p < e->paraCount; ++p) e->paras[p].spanCount = -1;
+    e->lexFrom = 0;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// editor:setStyle({ fontId=, fontSize=, letterSpacing=, lineHeight=, textColor=, caretColor=,
+//                   selectionColor=, caretWidth=, wrap=, multiline= })
+static int l_Editor_setStyle(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    e->text.fontId = (uint16_t)clay_opt_number_field(L, 2, "fontId", e->text.fontId);
+    e->text.fontSize = (uint16_t)clay_opt_number_field(L, 2, "fontSize", e->text.fontSize);
+    e->text.letterSpacing = (uint16_t)clay_opt_number_field(L, 2, "letterSpacing", e->text.letterSpacing);
+    e->text.lineHeight = (uint16_t)clay_opt_number_field(L, 2, "lineHeight", e->text.lineHeight);
+    e->caretWidth = clay_opt_number_field(L, 2, "caretWidth", e->caretWidth);
+    clay_opt_color_field(L, 2, "textColor", &e->text.textColor);
+    clay_opt_color_field(L, 2, "caretColor", &e->caretColor);
+    clay_opt_color_field(L, 2, "selectionColor", &e->selectionColor);
+    lua_getfield(L, 2, "wrap");
+    if (!lua_isnil(L, -1)) e->wrap = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "multiline");
+    if (!lua_isnil(L, -1)) e->multiline = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    clay_editor_invalidate_all(e);     // metrics may have changed
+    lua_settop(L, 1);
+    return 1;
+}
+
+// Declare one text element per highlighted span of a row.
+static void clay_editor_emit_spans(ClayTextEditor *e, const ClayEditorPara *p, ClayParagraphLine line,
+                                   Clay_String row, Clay_TextElementConfig **styleCfg) {
+    int32_t lineEnd = line.start + line.length;
+    int32_t lo = 0, hi = p->spanCount - 1;
+    while (lo < hi) {                   // last span starting at or before the row
+        int32_t mid = (lo + hi + 1) / 2;
+        if (p->spans[mid].start <= line.start) lo = mid; else hi = mid - 1;
+    }
+    for (int32_t k = lo; k < p->spanCount && p->spans[k].start < lineEnd; ++k) {
+        int32_t s0 = p->spans[k].start > line.start ? p->spans[k].start : line.start;
+        int32_t s1 = k + 1 < p->spanCount && p->spans[k + 1].start < lineEnd ? p->spans[k + 1].start : lineEnd;
+        if (s1 <= s0) continue;
+        uint8_t style = p->spans[k].style;
+        if (!styleCfg[style]) {
+            Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+            *cfg = e->text;
+            cfg->wrapMode = CLAY_TEXT_WRAP_NONE;
+            if (style > 0 && (e->syntax->colorSet & (1u << style))) cfg->textColor = e->syntax->colors[style];
+            styleCfg[style] = cfg;
+        }
+        Clay_String piece = { .length = s1 - s0, .chars = row.chars + (s0 - line.start) };
+        CLAY_TEXT(piece, styleCfg[style]);
+    }
+}
+
+static void clay_editor_rect(float x, float y, float w, float h, Clay_Color color) {
+    Clay_ElementDeclaration r = (Clay_ElementDeclaration){0};
+    r.layout = CLAY_LAYOUT_DEFAULT;
+    r.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { w, w } }, .type = CLAY__SIZING_TYPE_FIXED };
+    r.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { h, h } }, .type = CLAY__SIZING_TYPE_FIXED };
+    r.backgroundColor = color;
+    r.floating.attachTo = CLAY_ATTACH_TO_PARENT;
+    r.floating.offset = (Clay_Vector2){ x, y };
+    r.floating.pointerCaptureMode = CLAY_POINTER_CAPTURE_MODE_PASSTHROUGH;
+    r.floating.clipTo = CLAY_CLIP_TO_ATTACHED_PARENT;
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, r));
+    Clay__CloseElement();
+}
+
+// Inside clay.measureSubtree the scratch context knows nothing of the editor's view: rows
+// stay wrapped at the width of the last real emit, and the caret reveal, the hit-test id
+// and the blink wake-up are left for the real emit.
+static void clay_editor_emit(ClayTextEditor *e, Clay_ElementId id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    int measuring = g_MeasureDepth != 0;
+    float rowHeight = clay_text_row_height(&e->text);
+    if (rowHeight <= 0) rowHeight = 1;
+    e->rowHeight = rowHeight;
+    if (!measuring) e->id = id;
+
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(id.id);
+    float viewW = sd && sd->boundingBox.width > 0 ? sd->boundingBox.width : ctx->layoutDimensions.width;
+    float viewH = sd && sd->boundingBox.height > 0 ? sd->boundingBox.height : ctx->layoutDimensions.height;
+    if (measuring && e->wrapWidth > 0) viewW = e->wrapWidth;
+    clay_editor_layout(e, viewW);
+    int32_t totalRows = clay_editor_total_rows(e);
+    float contentH = (float)totalRows * rowHeight;
+
+    float scrollTop = sd ? -sd->scrollPosition.y : 0;
+    float scrollLeft = sd && !e->wrap ? -sd->scrollPosition.x : 0;
+    int32_t caretRow = 0;
+    float caretX = 0;
+    int caretKnown = clay_editor_locate(e, e->caret, &caretRow, &caretX);
+    if (e->revealCaret && caretKnown && !measuring) {
+        float y = (float)caretRow * rowHeight;
+        if (y < scrollTop) scrollTop = y;
+        if (y + rowHeight > scrollTop + viewH) scrollTop = y + rowHeight - viewH;
+        if (!e->wrap) {
+            if (caretX < scrollLeft) scrollLeft = caretX;
+            if (caretX + e->caretWidth > scrollLeft + viewW) scrollLeft = caretX + e->caretWidth - viewW;
+        }
+    }
+    if (!measuring) e->revealCaret = 0;
+    if (scrollTop > contentH - viewH) scrollTop = contentH - viewH;
+    if (scrollTop < 0) scrollTop = 0;
+    if (scrollLeft < 0) scrollLeft = 0;
+    if (sd) sd->scrollPosition = (Clay_Vector2){ -scrollLeft, -scrollTop };
+
+    int32_t first = (int32_t)(scrollTop / rowHeight);
+    int32_t last = (int32_t)ceilf((scrollTop + viewH) / rowHeight) + 1;
+    if (first > totalRows) first = totalRows;
+    if (last > totalRows) last = totalRows;
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    decl.clip.vertical = true;
+    decl.clip.horizontal = !e->wrap;
+    decl.clip.childOffset = (Clay_Vector2){ -scrollLeft, -scrollTop };
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    Clay_ElementDeclaration content = (Clay_ElementDeclaration){0};
+    content.layout = CLAY_LAYOUT_DEFAULT;
+    content.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    content.layout.sizing.width.type = e->wrap ? CLAY__SIZING_TYPE_GROW : CLAY__SIZING_TYPE_FIT;
+    content.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { contentH, contentH } }, .type = CLAY__SIZING_TYPE_FIXED };
+    Clay__OpenElementWithId(Clay__HashNumber(0, id.id));
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, content));
+
+    if (first > 0) {
+        float spacer = (float)first * rowHeight;
+        Clay_ElementDeclaration sp = (Clay_ElementDeclaration){0};
+        sp.layout = CLAY_LAYOUT_DEFAULT;
+        sp.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { spacer, spacer } }, .type = CLAY__SIZING_TYPE_FIXED };
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, sp));
+        Clay__CloseElement();
+    }
+
+    Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+    *cfg = e->text;
+    cfg->wrapMode = CLAY_TEXT_WRAP_NONE;
+
+    Clay_TextElementConfig *styleCfg[CLAY_SYNTAX_STYLE_MAX] = {0};
+    if (e->syntax && last > first) clay_editor_lex_to(e, clay_editor_para_of_row(e, last - 1) + 1);
+
+    int32_t selFrom = e->caret < e->anchor ? e->caret : e->anchor;
+    int32_t selTo = e->caret < e->anchor ? e->anchor : e->caret;
+    int32_t pi = first < totalRows ? clay_editor_para_of_row(e, first) : e->paraCount;
+    int32_t r = pi < e->paraCount ? first - e->rowStart[pi] : 0;
+    for (int32_t g = first; g < last; ++g) {
+        ClayEditorPara *p = &e->paras[pi];
+        ClayParagraphLine line = p->rows[r];
+
+        Clay_ElementDeclaration row = (Clay_ElementDeclaration){0};
+        row.layout = CLAY_LAYOUT_DEFAULT;
+        row.layout.sizing.width.type = e->wrap ? CLAY__SIZING_TYPE_GROW : CLAY__SIZING_TYPE_FIT;
+        row.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { rowHeight, rowHeight } }, .type = CLAY__SIZING_TYPE_FIXED };
+        row.layout.childAlignment.y = CLAY_ALIGN_Y_CENTER;
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, row));
+        if (line.length > 0) {
+            const char *chars = clay_editor_range(e, p->start + line.start, line.length);
+            Clay_String str = chars ? clay_frame_string(chars, line.length) : (Clay_String){0};
+            if (str.chars && e->syntax && p->spanCount > 0) clay_editor_emit_spans(e, p, line, str, styleCfg);
+            else if (str.chars) CLAY_TEXT(str, cfg);
+        }
+        Clay__CloseElement();
+
+        // Selection highlight for the part of this row inside [selFrom, selTo).
+        int lastRow = r + 1 == p->rowCount;
+        int32_t spanStart = p->start + line.start;
+        int32_t spanEnd = p->start + (lastRow ? p->length : p->rows[r + 1].start);
+        if (selFrom < selTo && selFrom <= spanEnd && selTo > spanStart) {
+            const float *xs = clay_editor_para_x(e, p);
+            if (xs) {
+                int32_t lo = selFrom > spanStart ? selFrom : spanStart;
+                int32_t hi = selTo < spanEnd ? selTo : spanEnd;
+                float x0 = xs[lo - p->start] - xs[line.start];
+                float x1 = xs[hi - p->start] - xs[line.start];
+                if (lastRow && selTo > spanEnd) x1 += rowHeight * 0.3f;    // the newline is selected too
+                if (x1 > x0) clay_editor_rect(x0, (float)g * rowHeight, x1 - x0, rowHeight, e->selectionColor);
+            }
+        }
+
+        if (++r == p->rowCount) {
+            r = 0;
+            pi++;
+        }
+    }
+
+    int caretOn = e->focused && e->caretVisible;
+    if (caretOn && e->blinkPeriod > 0) {
+        // Visible for the first half of each period after the caret last moved.
+        double half = e->blinkPeriod * 0.5;
+        double phase = floor((g_Now - e->caretMovedAt) / half);
+        if (phase < 0) phase = 0;
+        caretOn = fmod(phase, 2.0) == 0;
+        double toggle = e->caretMovedAt + (phase + 1) * half;
+        if (toggle < g_NextWake && !measuring) g_NextWake = toggle;
+    }
+    if (caretOn && caretKnown && caretRow >= first && caretRow < last) {
+        clay_editor_rect(caretX, (float)caretRow * rowHeight, e->caretWidth, rowHeight, e->caretColor);
+    }
+
+    Clay__CloseElement();
+    Clay__CloseElement();
+}
+
+// editor:emit(name [, index [, isLocal]]) | editor:emit(idTable)
+static int l_Editor_emit(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "editor:emit() must be called during a layout pass");
+    }
+    clay_editor_emit(e, clay_element_id_from_args(L, 2));
+    return 0;
+}
+
+// Content-space position of screen point (x, y), from the last layout.
+static int clay_editor_content_point(ClayTextEditor *e, float x, float y, float *cx, float *cy, int *inside) {
+    if (!e->id.id) return 0;
+    Clay_ElementData data = Clay_GetElementData(e->id);
+    if (!data.found) return 0;
+    Clay_BoundingBox b = data.boundingBox;
+    Clay__ScrollContainerDataInternal *sd = clay_scroll_data_find(e->id.id);
+    *cx = x - b.x - (sd ? sd->scrollPosition.x : 0);
+    *cy = y - b.y - (sd ? sd->scrollPosition.y : 0);
+    *inside = x >= b.x && x < b.x + b.width && y >= b.y && y < b.y + b.height;
+    return 1;
+}
+
+// editor:hitTest(x, y) -> offset, inside   (points outside clamp to the nearest row)
+static int l_Editor_hitTest(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    float cx = 0, cy = 0;
+    int inside = 0;
+    if (!clay_editor_content_point(e, (float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3), &cx, &cy, &inside)) return 0;
+    int32_t row = (int32_t)floorf(cy / (e->rowHeight > 0 ? e->rowHeight : 1));
+    lua_pushinteger(L, clay_editor_offset_at(e, row, cx));
+    lua_pushboolean(L, inside);
+    return 2;
+}
+
+// editor:click(x, y [, extendSelection]) -> offset   (moves the caret; drag with extend = true)
+static int l_Editor_click(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    float cx = 0, cy = 0;
+    int inside = 0;
+    if (!clay_editor_content_point(e, (float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3), &cx, &cy, &inside)) return 0;
+    int32_t row = (int32_t)floorf(cy / (e->rowHeight > 0 ? e->rowHeight : 1));
+    clay_editor_set_caret(e, clay_editor_offset_at(e, row, cx), lua_toboolean(L, 4));
+    e->preferredX = -1;
+    lua_pushinteger(L, e->caret);
+    return 1;
+}
+
+// editor:caretRect() -> x, y, width, height   (screen space; e.g. to place an IME window)
+static int l_Editor_caretRect(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    float ox = 0, oy = 0, cx = 0;
+    int inside = 0;
+    int32_t row = 0;
+    if (!clay_editor_content_point(e, 0, 0, &ox, &oy, &inside)) return 0;
+    if (!clay_editor_locate(e, e->caret, &row, &cx)) return 0;
+    lua_pushnumber(L, cx - ox);
+    lua_pushnumber(L, (float)row * e->rowHeight - oy);
+    lua_pushnumber(L, e->caretWidth);
+    lua_pushnumber(L, e->rowHeight);
+    return 4;
+}
+
+static int l_Editor_gc(lua_State *L) {
+    ClayTextEditor *e = check_text_editor(L, 1);
+    for (int32_t p = 0; p < e->paraCount; ++p) {
+        free(e->paras[p].rows);
+        free(e->paras[p].x);
+        free(e->paras[p].spans);
+    }
+    free(e->paras);
+    free(e->buf);
+    free(e->rowStart);
+    free(e->scratch);
+    free(e->wrapper.lines);
+    luaL_unref(L, LUA_REGISTRYINDEX, e->syntaxRef);
+    memset(e, 0, sizeof(*e));
+    e->syntaxRef = LUA_NOREF;
+    return 0;
+}
+
+static void Clay_CreateTextEditorMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayTextEditor")) {
+        lua_pushcfunction(L, l_Editor_setText); lua_setfield(L, -2, "setText");
+        lua_pushcfunction(L, l_Editor_getText); lua_setfield(L, -2, "getText");
+        lua_pushcfunction(L, l_Editor_length); lua_setfield(L, -2, "length");
+        lua_pushcfunction(L, l_Editor_lineCount); lua_setfield(L, -2, "lineCount");
+        lua_pushcfunction(L, l_Editor_insert); lua_setfield(L, -2, "insert");
+        lua_pushcfunction(L, l_Editor_backspace); lua_setfield(L, -2, "backspace");
+        lua_pushcfunction(L, l_Editor_delete); lua_setfield(L, -2, "delete");
+        lua_pushcfunction(L, l_Editor_setCaret); lua_setfield(L, -2, "setCaret");
+        lua_pushcfunction(L, l_Editor_caret); lua_setfield(L, -2, "caret");
+        lua_pushcfunction(L, l_Editor_select); lua_setfield(L, -2, "select");
+        lua_pushcfunction(L, l_Editor_selectAll); lua_setfield(L, -2, "selectAll");
+        lua_pushcfunction(L, l_Editor_selection); lua_setfield(L, -2, "selection");
+        lua_pushcfunction(L, l_Editor_selectedText); lua_setfield(L, -2, "selectedText");
+        lua_pushcfunction(L, l_Editor_move); lua_setfield(L, -2, "move");
+        lua_pushcfunction(L, l_Editor_setFocused); lua_setfield(L, -2, "setFocused");
+        lua_pushcfunction(L, l_Editor_setBlink); lua_setfield(L, -2, "setBlink");
+        lua_pushcfunction(L, l_Editor_setSyntax); lua_setfield(L, -2, "setSyntax");
+        lua_pushcfunction(L, l_Editor_setStyle); lua_setfield(L, -2, "setStyle");
+        lua_pushcfunction(L, l_Editor_emit); lua_setfield(L, -2, "emit");
+        lua_pushcfunction(L, l_Editor_hitTest); lua_setfield(L, -2, "hitTest");
+        lua_pushcfunction(L, l_Editor_click); lua_setfield(L, -2, "click");
+        lua_pushcfunction(L, l_Editor_caretRect); lua_setfield(L, -2, "caretRect");
+        lua_pushcfunction(L, l_Editor_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Markdown
+//
+// clay.markdown(id, source [, theme]) parses a CommonMark subset in C and declares the
+// elements directly. The subset covers ATX and setext headings, paragraphs, emphasis,
+// code spans, fenced and indented code blocks, lists, links and thematic breaks. Parses
+// are cached by the source together with the width and theme they are laid out for, and
+// shared by every view showing that text the same way. A parse replaced within a frame is
+// freed by the next beginLayout, since the frame's text commands point into its pool.
+// -----------------------------------------------------------------------------
+
+#define CLAY_MARKDOWN_MAX_IDLE_FRAMES 120u
+#define CLAY_MD_LIST_DEPTH_MAX 8
+#define CLAY_MD_THEME_KEY_WORDS 42
+
+enum { CLAY_MD_PARAGRAPH, CLAY_MD_HEADING, CLAY_MD_CODE, CLAY_MD_ITEM, CLAY_MD_RULE };
+enum { CLAY_MD_STRONG = 1, CLAY_MD_EMPHASIS = 2, CLAY_MD_CODE_SPAN = 4, CLAY_MD_LINK = 8, CLAY_MD_STYLES = 16 };
+
+typedef struct {
+    uint8_t type;
+    uint8_t level;          // heading level, or list nesting depth
+    uint8_t ordered;
+    int32_t number;         // ordered list item number
+    int32_t runStart;       // code blocks have one run per line
+    int32_t runCount;
+    int32_t lineStart;      // laid out lines (not used by rules)
+    int32_t lineCount;
+} ClayMdBlock;
+
+typedef struct {
+    int32_t offset;         // text in pool
+    int32_t length;
+    int32_t link;           // index into links, -1 if none
+    uint8_t flags;
+} ClayMdRun;
+
+typedef struct {
+    int32_t offset;         // in pool
+    int32_t length;
+} ClayMdSlice;
+
+typedef struct {
+    int32_t run;
+    int32_t offset;         // in pool
+    int32_t length;
+} ClayMdPiece;
+
+typedef struct {
+    Clay_TextElementConfig text;    // body text
+    uint16_t boldFontId;
+    uint16_t italicFontId;
+    uint16_t boldItalicFontId;
+    uint16_t codeFontId;
+    uint16_t headingFontId;
+    uint16_t headingSizes[6];
+    Clay_Color headingColor;
+    Clay_Color codeColor;
+    Clay_Color codeBackground;
+    Clay_Color linkColor;
+    Clay_Color ruleColor;
+    float blockGap;
+    float listIndent;
+    float codePadding;
+} ClayMdTheme;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t lastFrame;
+    char *source;               // kept to tell hash collisions apart
+    int32_t sourceLength;
+    char *pool;                 // text of all runs and link targets
+    int32_t poolUsed, poolCapacity;
+    ClayMdBlock *blocks;
+    int32_t blockCount, blockCapacity;
+    ClayMdRun *runs;
+    int32_t runCount, runCapacity;
+    ClayMdSlice *links;
+    int32_t linkCount, linkCapacity;
+    int retired;                // replaced this frame; freed by the next sweep
+    float width;                // layout below is for this width and theme, < 0: lay out again
+    uint32_t themeKey[CLAY_MD_THEME_KEY_WORDS];
+    ClayMdSlice *lines;         // pieces of each line: offset = first piece, length = count
+    int32_t lineCount, lineCapacity;
+    ClayMdPiece *pieces;
+    int32_t pieceCount, pieceCapacity;
+} ClayMarkdownDoc;
+
+typedef struct {
+    uint32_t elementId;
+    Clay_String url;
+} ClayMdLinkHit;
+
+static ClayMarkdownDoc *g_Markdown = NULL;
+static int32_t g_MarkdownCount = 0;
+static int32_t g_MarkdownCapacity = 0;
+static ClayU32Map g_MarkdownIndex = {0};
+static ClayMdLinkHit *g_MarkdownLinks = NULL;     // link pieces declared this frame
+static int32_t g_MarkdownLinkCount = 0;
+static int32_t g_MarkdownLinkCapacity = 0;
+
+static void clay_md_doc_free(ClayMarkdownDoc *d) {
+    free(d->source);
+    free(d->pool);
+    free(d->blocks);
+    free(d->runs);
+    free(d->links);
+    free(d->lines);
+    free(d->pieces);
+    memset(d, 0, sizeof(*d));
+}
+
+static void clay_markdown_clear(void) {
+    for (int32_t i = 0; i < g_MarkdownCount; ++i) clay_md_doc_free(&g_Markdown[i]);
+    free(g_Markdown);
+    g_Markdown = NULL;
+    g_MarkdownCount = g_MarkdownCapacity = 0;
+    clay_u32map_free(&g_MarkdownIndex);
+    free(g_MarkdownLinks);
+    g_MarkdownLinks = NULL;
+    g_MarkdownLinkCount = g_MarkdownLinkCapacity = 0;
+}
+
+// Measurements changed: lay every parse out again on its next emit.
+static void clay_markdown_relayout(void) {
+    for (int32_t i = 0; i < g_MarkdownCount; ++i) g_Markdown[i].width = -1;
+}
+
+static void clay_markdown_sweep(void) {
+    g_MarkdownLinkCount = 0;
+    int32_t kept = 0;
+    for (int32_t i = 0; i < g_MarkdownCount; ++i) {
+        ClayMarkdownDoc *d = &g_Markdown[i];
+        if (d->retired || g_FrameIndex - d->lastFrame > CLAY_MARKDOWN_MAX_IDLE_FRAMES) {
+            clay_md_doc_free(d);
+            continue;
+        }
+        if (kept != i) g_Markdown[kept] = *d;
+        kept++;
+    }
+    if (kept == g_MarkdownCount) return;
+    g_MarkdownCount = kept;
+    clay_u32map_clear(&g_MarkdownIndex);
+    for (int32_t i = 0; i < g_MarkdownCount; ++i) clay_u32map_put(&g_MarkdownIndex, g_Markdown[i].hash, i);
+}
+
+static int32_t clay_md_intern(ClayMarkdownDoc *d, const char *s, int32_t n) {
+    if (!clay_array_reserve((void**)&d->pool, &d->poolCapacity, d->poolUsed + n, 1)) return -1;
+    memcpy(d->pool + d->poolUsed, s, (size_t)n);
+    d->poolUsed += n;
+    return d->poolUsed - n;
+}
+
+// Append text to the current block, extending its last run when the style matches.
+static int clay_md_put(ClayMarkdownDoc *d, int32_t blockRunStart, uint8_t flags, int32_t link, const char *s, int32_t n, int merge) {
+    ClayMdRun *last = d->runCount > blockRunStart ? &d->runs[d->runCount - 1] : NULL;
+    int32_t at = clay_md_intern(d, s, n);
+    if (at < 0) return 0;
+    if (merge && last && last->flags == flags && last->link == link && last->offset + last->length == at) {
+        last->length += n;
+        return 1;
+    }
+    if (!clay_array_reserve((void**)&d->runs, &d->runCapacity, d->runCount + 1, sizeof(ClayMdRun))) return 0;
+    d->runs[d->runCount++] = (ClayMdRun){ at, n, link, flags };
+    return 1;
+}
+
+// Is there a delimiter run of c (at least `need` long) after `from` that can close?
+static int clay_md_has_closer(const char *s, int32_t from, int32_t len, char c, int32_t need) {
+    for (int32_t i = from; i < len; ++i) {
+        if (s[i] == '\\') { i++; continue; }
+        if (s[i] != c) continue;
+        int32_t n = 1;
+        while (i + n < len && s[i + n] == c) n++;
+        int prevSpace = isspace((uint8_t)s[i - 1]);
+        int nextWord = i + n < len && isalnum((uint8_t)s[i + n]);
+        if (n >= need && !prevSpace && (c != '_' || !nextWord)) return 1;
+        i += n - 1;
+    }
+    return 0;
+}
+
+// "[text](url)" starting at s[i]: returns the index of the ']' and sets the target and
+// the index just past ')', or returns -1.
+static int32_t clay_md_link_end(const char *s, int32_t i, int32_t len, int32_t *url, int32_t *urlLength, int32_t *resume) {
+    int32_t depth = 0, close = -1;
+    for (int32_t j = i + 1; j < len; ++j) {
+        if (s[j] == '\\') { j++; continue; }
+        if (s[j] == '[') depth++;
+        else if (s[j] == ']' && depth-- == 0) { close = j; break; }
+    }
+    if (close < 0 || close + 1 >= len || s[close + 1] != '(') return -1;
+    int32_t j = close + 2, parens = 0;
+    while (j < len && s[j] == ' ') j++;
+    int32_t start = j;
+    for (; j < len; ++j) {
+        if (s[j] == '(') parens++;
+        else if (s[j] == ')' && parens-- == 0) break;
+    }
+    if (j >= len) return -1;
+    int32_t end = start;
+    while (end < j && s[end] != ' ') end++;      // drop an optional "title"
+    if (end - start >= 2 && s[start] == '<' && s[end - 1] == '>') { start++; end--; }
+    *url = start;
+    *urlLength = end - start;
+    *resume = j + 1;
+    return close;
+}
+
+// Inline syntax of one block's text into runs.
+static int clay_md_inline(ClayMarkdownDoc *d, ClayMdBlock *b, const char *s, int32_t len) {
+    b->runStart = d->runCount;
+    uint8_t flags = 0;
+    char strongChar = 0, emChar = 0;
+    int32_t link = -1, linkEnd = -1, linkResume = -1;
+    int32_t i = 0;
+    while (i < len) {
+        char c = s[i];
+        if (link >= 0 && i == linkEnd) {
+            link = -1;
+            flags &= (uint8_t)~CLAY_MD_LINK;
+            i = linkResume;
+            continue;
+        }
+        if (c == '\\' && i + 1 < len && ispunct((uint8_t)s[i + 1])) {
+            if (!clay_md_put(d, b->runStart, flags, link, s + i + 1, 1, 1)) return 0;
+            i += 2;
+            continue;
+        }
+        if (c == '`') {
+            int32_t n = 1;
+            while (i + n < len && s[i + n] == '`') n++;
+            int32_t j = i + n, close = -1;
+            while (j < len) {
+                if (s[j] != '`') { j++; continue; }
+                int32_t m = 1;
+                while (j + m < len && s[j + m] == '`') m++;
+                if (m == n) { close = j; break; }
+                j += m;
+            }
+            if (close < 0) {
+                if (!clay_md_put(d, b->runStart, flags, link, s + i, n, 1)) return 0;
+                i += n;
+                continue;
+            }
+            int32_t from = i + n, to = close;
+            if (to - from >= 2 && s[from] == ' ' && s[to - 1] == ' ') { from++; to--; }
+            if (to > from && !clay_md_put(d, b->runStart, flags | CLAY_MD_CODE_SPAN, link, s + from, to - from, 1)) return 0;
+            i = close + n;
+            continue;
+        }
+        if (c == '*' || c == '_') {
+            int32_t n = 1;
+            while (i + n < len && s[i + n] == c) n++;
+            uint8_t prev = i > 0 ? (uint8_t)s[i - 1] : ' ';
+            uint8_t next = i + n < len ? (uint8_t)s[i + n] : ' ';
+            int canOpen = !isspace(next), canClose = !isspace(prev);
+            if (c == '_') {
+                canOpen = canOpen && !isalnum(prev);
+                canClose = canClose && !isalnum(next);
+            }
+            int32_t k = n;
+            while (k > 0) {
+                if (k >= 2 && (flags & CLAY_MD_STRONG) && canClose && strongChar == c) {
+                    flags &= (uint8_t)~CLAY_MD_STRONG;
+                    k -= 2;
+                } else if ((flags & CLAY_MD_EMPHASIS) && canClose && emChar == c) {
+                    flags &= (uint8_t)~CLAY_MD_EMPHASIS;
+                    k -= 1;
+                } else if (canOpen && k >= 2 && !(flags & CLAY_MD_STRONG) && clay_md_has_closer(s, i + n, len, c, 2)) {
+                    flags |= CLAY_MD_STRONG;
+                    strongChar = c;
+                    k -= 2;
+                } else if (canOpen && !(flags & CLAY_MD_EMPHASIS) && clay_md_has_closer(s, i + n, len, c, 1)) {
+                    flags |= CLAY_MD_EMPHASIS;
+                    emChar = c;
+                    k -= 1;
+                } else {
+                    break;
+                }
+            }
+            if (k > 0 && !clay_md_put(d, b->runStart, flags, link, s + i, k, 1)) return 0;
+            i += n;
+            continue;
+        }
+        if (c == '[' && link < 0) {
+            int32_t url = 0, urlLength = 0, resume = 0;
+            int32_t close = clay_md_link_end(s, i, len, &url, &urlLength, &resume);
+            if (close > i) {
+                int32_t at = clay_md_intern(d, s + url, urlLength);
+                if (at < 0 || !clay_array_reserve((void**)&d->links, &d->linkCapacity, d->linkCount + 1, sizeof(ClayMdSlice))) return 0;
+                d->links[d->linkCount] = (ClayMdSlice){ at, urlLength };
+                link = d->linkCount++;
+                flags |= CLAY_MD_LINK;
+                linkEnd = close;
+                linkResume = resume;
+                i++;
+                continue;
+            }
+        }
+        int32_t j = i + 1;
+        while (j < len && j != linkEnd && !strchr("\\`*_[", s[j])) j++;
+        if (!clay_md_put(d, b->runStart, flags, link, s + i, j - i, 1)) return 0;
+        i = j;
+    }
+    b->runCount = d->runCount - b->runStart;
+    return 1;
+}
+
+static int clay_md_push_block(ClayMarkdownDoc *d, const ClayMdBlock *b) {
+    if (!clay_array_reserve((void**)&d->blocks, &d->blockCapacity, d->blockCount + 1, sizeof(ClayMdBlock))) return 0;
+    d->blocks[d->blockCount++] = *b;
+    return 1;
+}
+
+static int clay_md_is_rule(const char *s, int32_t len) {
+    char c = 0;
+    int32_t n = 0;
+    for (int32_t i = 0; i < len; ++i) {
+        if (s[i] == ' ' || s[i] == '\t') continue;
+        if (s[i] != '-' && s[i] != '*' && s[i] != '_') return 0;
+        if (c && s[i] != c) return 0;
+        c = s[i];
+        n++;
+    }
+    return n >= 3;
+}
+
+// List marker at s: returns the marker length (including the space after it), or 0.
+static int32_t clay_md_list_marker(const char *s, int32_t len, int *ordered, int32_t *number) {
+    if (len >= 1 && (s[0] == '-' || s[0] == '*' || s[0] == '+') && (len == 1 || s[1] == ' ')) {
+        *ordered = 0;
+        return len == 1 ? 1 : 2;
+    }
+    int32_t i = 0, value = 0;
+    while (i < len && i < 9 && isdigit((uint8_t)s[i])) value = value * 10 + (s[i++] - '0');
+    if (i == 0 || i >= len || (s[i] != '.' && s[i] != ')')) return 0;
+    if (i + 1 < len && s[i + 1] != ' ') return 0;
+    *ordered = 1;
+    *number = value;
+    return i + 1 < len ? i + 2 : i + 1;
+}
+
+static int clay_md_parse(ClayMarkdownDoc *d, const char *src, int32_t len) {
+    char *acc = NULL;                   // inline text of the open paragraph / heading / item
+    int32_t accLength = 0, accCapacity = 0;
+    int open = 0, hardBreak = 0;
+    ClayMdBlock block = {0};
+    int32_t listIndent[CLAY_MD_LIST_DEPTH_MAX];
+    int32_t listDepth = 0;
+    int fence = 0;                      // inside a fenced code block
+    char fenceChar = 0;
+    int32_t fenceLength = 0;
+    int ok = 1;
+
+#define CLAY_MD_FLUSH() do { \
+        if (open) { \
+            ok = ok && clay_md_inline(d, &block, acc ? acc : "", accLength) && clay_md_push_block(d, &block); \
+            open = 0; \
+            accLength = 0; \
+        } \
+    } while (0)
+
+    for (int32_t pos = 0; pos < len && ok; ) {
+        const char *nl = (const char*)memchr(src + pos, '\n', (size_t)(len - pos));
+        int32_t end = nl ? (int32_t)(nl - src) : len;
+        const char *line = src + pos;
+        int32_t lineLength = end - pos;
+        pos = end + 1;
+        if (lineLength > 0 && line[lineLength - 1] == '\r') lineLength--;
+
+        int32_t indent = 0, skip = 0;
+        while (skip < lineLength && (line[skip] == ' ' || line[skip] == '\t')) {
+            indent += line[skip] == '\t' ? 4 - indent % 4 : 1;
+            skip++;
+        }
+        const char *text = line + skip;
+        int32_t textLength = lineLength - skip;
+
+        if (fence) {
+            int32_t n = 0;
+            while (n < textLength && text[n] == fenceChar) n++;
+            if (indent < 4 && n >= fenceLength && n == textLength) {
+                fence = 0;
+                ok = clay_md_push_block(d, &block);
+            } else {
+                ok = clay_md_put(d, block.runStart, 0, -1, line, lineLength, 0);
+                block.runCount++;
+            }
+            continue;
+        }
+        if (textLength == 0) {
+            CLAY_MD_FLUSH();
+            continue;
+        }
+
+        // Indented code, unless it continues a paragraph or nests a list.
+        int lastIsItem = d->blockCount > 0 && d->blocks[d->blockCount - 1].type == CLAY_MD_ITEM;
+        int ordered = 0;
+        int32_t number = 1;
+        int32_t marker = clay_md_list_marker(text, textLength, &ordered, &number);
+        if (indent >= 4 && !open && !(marker && (lastIsItem || listDepth > 0))) {
+            ClayMdBlock *prev = d->blockCount > 0 ? &d->blocks[d->blockCount - 1] : NULL;
+            int32_t cut = 0, col = 0;
+            while (cut < lineLength && col < 4) { col += line[cut] == '\t' ? 4 - col % 4 : 1; cut++; }
+            if (!(prev && prev->type == CLAY_MD_CODE && prev->level == 1 && prev->runStart + prev->runCount == d->runCount)) {
+                ClayMdBlock code = { .type = CLAY_MD_CODE, .level = 1, .runStart = d->runCount };
+                ok = clay_md_push_block(d, &code);
+                prev = &d->blocks[d->blockCount - 1];
+            }
+            ok = ok && clay_md_put(d, prev->runStart, 0, -1, line + cut, lineLength - cut, 0);
+            if (ok) prev->runCount++;
+            listDepth = 0;
+            continue;
+        }
+
+        if (indent < 4 && textLength >= 3 && (text[0] == '`' || text[0] == '~')) {
+            int32_t n = 0;
+            while (n < textLength && text[n] == text[0]) n++;
+            if (n >= 3) {
+                CLAY_MD_FLUSH();
+                fence = 1;
+                fenceChar = text[0];
+                fenceLength = n;
+                block = (ClayMdBlock){ .type = CLAY_MD_CODE, .runStart = d->runCount };
+                listDepth = 0;
+                continue;
+            }
+        }
+
+        if (open && block.type == CLAY_MD_PARAGRAPH && indent < 4) {
+            int32_t n = 0;
+            while (n < textLength && text[n] == text[0]) n++;
+            while (n < textLength && text[n] == ' ') n++;
+            if ((text[0] == '=' || text[0] == '-') && n == textLength) {
+                block.type = CLAY_MD_HEADING;       // setext heading underline
+                block.level = text[0] == '=' ? 1 : 2;
+                CLAY_MD_FLUSH();
+                continue;
+            }
+        }
+
+        if (indent < 4 && text[0] == '#') {
+            int32_t level = 0;
+            while (level < textLength && text[level] == '#') level++;
+            if (level <= 6 && (level == textLength || text[level] == ' ')) {
+                CLAY_MD_FLUSH();
+                int32_t from = level, to = textLength;
+                while (from < to && text[from] == ' ') from++;
+                while (to > from && text[to - 1] == ' ') to--;
+                int32_t hashes = to;
+                while (hashes > from && text[hashes - 1] == '#') hashes--;
+                if (hashes == from || text[hashes - 1] == ' ') to = hashes;
+                while (to > from && text[to - 1] == ' ') to--;
+                block = (ClayMdBlock){ .type = CLAY_MD_HEADING, .level = (uint8_t)level };
+                ok = clay_md_inline(d, &block, text + from, to - from) && clay_md_push_block(d, &block);
+                listDepth = 0;
+                continue;
+            }
+        }
+
+        if (indent < 4 && clay_md_is_rule(text, textLength)) {
+            CLAY_MD_FLUSH();
+            block = (ClayMdBlock){ .type = CLAY_MD_RULE };
+            ok = clay_md_push_block(d, &block);
+            listDepth = 0;
+            continue;
+        }
+
+        if (marker) {
+            CLAY_MD_FLUSH();
+            while (listDepth > 0 && listIndent[listDepth - 1] >= indent) listDepth--;
+            block = (ClayMdBlock){ .type = CLAY_MD_ITEM, .level = (uint8_t)listDepth, .ordered = (uint8_t)ordered, .number = number };
+            if (listDepth < CLAY_MD_LIST_DEPTH_MAX) listIndent[listDepth++] = indent;
+            open = 1;
+            text += marker;
+            textLength -= marker;
+            while (textLength > 0 && *text == ' ') { text++; textLength--; }
+            hardBreak = 0;
+        } else if (!open) {
+            block = (ClayMdBlock){ .type = CLAY_MD_PARAGRAPH };
+            open = 1;
+            hardBreak = 0;
+            if (!lastIsItem || indent == 0) listDepth = 0;
+        }
+
+        // Join the line to the open block; a line ending in two spaces or '\' breaks the line.
+        int32_t trimmed = textLength;
+        while (trimmed > 0 && text[trimmed - 1] == ' ') trimmed--;
+        int nextBreak = textLength - trimmed >= 2;
+        if (trimmed > 0 && text[trimmed - 1] == '\\') { trimmed--; nextBreak = 1; }
+        if (!clay_array_reserve((void**)&acc, &accCapacity, accLength + trimmed + 1, 1)) { ok = 0; break; }
+        if (accLength > 0) acc[accLength++] = hardBreak ? '\n' : ' ';
+        memcpy(acc + accLength, text, (size_t)trimmed);
+        accLength += trimmed;
+        hardBreak = nextBreak;
+    }
+    if (fence && ok) ok = clay_md_push_block(d, &block);     // unterminated fence runs to the end
+    CLAY_MD_FLUSH();
+#undef CLAY_MD_FLUSH
+    free(acc);
+    return ok;
+}
+
+static inline uint32_t clay_md_f32(float f) {
+    uint32_t u;
+    f += 0.0f;      // -0 keys like 0
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+// The theme's fields as words, so themes are hashed and compared without struct padding.
+static void clay_md_theme_key(const ClayMdTheme *t, uint32_t *k) {
+    const Clay_Color *colors[6] = { &t->text.textColor, &t->headingColor, &t->codeColor,
+                                    &t->codeBackground, &t->linkColor, &t->ruleColor };
+    int n = 0;
+    for (int i = 0; i < 6; ++i) {
+        k[n++] = clay_md_f32(colors[i]->r);
+        k[n++] = clay_md_f32(colors[i]->g);
+        k[n++] = clay_md_f32(colors[i]->b);
+        k[n++] = clay_md_f32(colors[i]->a);
+    }
+    k[n++] = t->text.fontId;
+    k[n++] = t->text.fontSize;
+    k[n++] = t->text.letterSpacing;
+    k[n++] = t->text.lineHeight;
+    k[n++] = t->boldFontId;
+    k[n++] = t->italicFontId;
+    k[n++] = t->boldItalicFontId;
+    k[n++] = t->codeFontId;
+    k[n++] = t->headingFontId;
+    for (int i = 0; i < 6; ++i) k[n++] = t->headingSizes[i];
+    k[n++] = clay_md_f32(t->blockGap);
+    k[n++] = clay_md_f32(t->listIndent);
+    k[n++] = clay_md_f32(t->codePadding);
+}
+
+// The parse of `source`, from the cache or parsed now; NULL when out of memory.
+static ClayMarkdownDoc* clay_markdown_get(const char *source, int32_t length) {
+    uint32_t hash = clay_hash_bytes(source, (size_t)length, 0x4D44u);
+    int32_t idx = clay_u32map_get(&g_MarkdownIndex, hash);
+    if (idx >= 0) {
+        ClayMarkdownDoc *d = &g_Markdown[idx];
+        if (d->sourceLength == length && memcmp(d->source, source, (size_t)length) == 0) {
+            d->lastFrame = g_FrameIndex;
+            return d;
+        }
+        // Hash collision: the newer text takes the key. The old parse may already have been
+        // emitted this frame, so it stays allocated until the next sweep.
+        d->retired = 1;
+    }
+    if (!clay_array_reserve((void**)&g_Markdown, &g_MarkdownCapacity, g_MarkdownCount + 1, sizeof(ClayMarkdownDoc))) return NULL;
+    idx = g_MarkdownCount++;
+    ClayMarkdownDoc *d = &g_Markdown[idx];
+    memset(d, 0, sizeof(*d));
+    clay_u32map_put(&g_MarkdownIndex, hash, idx);
+    d->hash = hash;
+    d->lastFrame = g_FrameIndex;
+    d->width = -1;
+    d->source = (char*)malloc((size_t)length + 1);
+    if (d->source) {
+        memcpy(d->source, source, (size_t)length);
+        d->sourceLength = length;
+    }
+    if (!d->source || !clay_md_parse(d, source, length)) {
+        clay_md_doc_free(d);
+        d->hash = hash;
+        d->sourceLength = -1;   // never matches; parsed again next time
+        return NULL;
+    }
+    return d;
+}
+
+static void clay_md_theme(lua_State *L, int idx, ClayMdTheme *t) {
+    memset(t, 0, sizeof(*t));
+    t->text = (Clay_TextElementConfig){ .textColor = {255,255,255,255}, .fontId = 1, .fontSize = 16,
+                                        .wrapMode = CLAY_TEXT_WRAP_NONE };
+    t->linkColor = (Clay_Color){90,160,255,255};
+    t->codeBackground = (Clay_Color){255,255,255,24};
+    t->ruleColor = (Clay_Color){128,128,128,255};
+    if (lua_istable(L, idx)) {
+        t->text.fontId = (uint16_t)clay_opt_number_field(L, idx, "fontId", t->text.fontId);
+        t->text.fontSize = (uint16_t)clay_opt_number_field(L, idx, "fontSize", t->text.fontSize);
+        t->text.lineHeight = (uint16_t)clay_opt_number_field(L, idx, "lineHeight", 0);
+        clay_opt_color_field(L, idx, "textColor", &t->text.textColor);
+    }
+    float size = (float)t->text.fontSize;
+    static const float headingScale[6] = { 2.0f, 1.6f, 1.35f, 1.15f, 1.0f, 0.9f };
+    for (int i = 0; i < 6; ++i) t->headingSizes[i] = (uint16_t)(size * headingScale[i] + 0.5f);
+    t->headingColor = t->codeColor = t->text.textColor;
+    t->blockGap = size * 0.75f;
+    t->listIndent = size * 1.5f;
+    t->codePadding = size * 0.5f;
+    if (!lua_istable(L, idx)) {
+        t->boldFontId = t->italicFontId = t->boldItalicFontId = t->codeFontId = t->headingFontId = t->text.fontId;
+        return;
+    }
+    t->boldFontId = (uint16_t)clay_opt_number_field(L, idx, "boldFontId", t->text.fontId);
+    t->italicFontId = (uint16_t)clay_opt_number_field(L, idx, "italicFontId", t->text.fontId);
+    t->boldItalicFontId = (uint16_t)clay_opt_number_field(L, idx, "boldItalicFontId", t->boldFontId);
+    t->codeFontId = (uint16_t)clay_opt_number_field(L, idx, "codeFontId", t->text.fontId);
+    t->headingFontId = (uint16_t)clay_opt_number_field(L, idx, "headingFontId", t->boldFontId);
+    lua_getfield(L, idx, "headingSizes");
+    if (lua_istable(L, -1)) {
+        for (int i = 0; i < 6; ++i) {
+            lua_rawgeti(L, -1, i + 1);
+            if (lua_isnumber(L, -1)) t->headingSizes[i] = (uint16_t)lua_tonumber(L, -1);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    clay_opt_color_field(L, idx, "headingColor", &t->headingColor);
+    clay_opt_color_field(L, idx, "codeColor", &t->codeColor);
+    clay_opt_color_field(L, idx, "codeBackground", &t->codeBackground);
+    clay_opt_color_field(L, idx, "linkColor", &t->linkColor);
+    clay_opt_color_field(L, idx, "ruleColor", &t->ruleColor);
+    t->blockGap = clay_opt_number_field(L, idx, "blockGap", t->blockGap);
+    t->listIndent = clay_opt_number_field(L, idx, "listIndent", t->listIndent);
+    t->codePadding = clay_opt_number_field(L, idx, "codePadding", t->codePadding);
+}
+
+static void clay_md_style(const ClayMdTheme *t, const ClayMdBlock *b, uint8_t flags, Clay_TextElementConfig *out) {
+    *out = t->text;
+    out->wrapMode = CLAY_TEXT_WRAP_NONE;
+    if (b->type == CLAY_MD_HEADING) {
+        out->fontId = t->headingFontId;
+        out->fontSize = t->headingSizes[b->level >= 1 && b->level <= 6 ? b->level - 1 : 0];
+        out->lineHeight = 0;
+        out->textColor = t->headingColor;
+    }
+    if (b->type == CLAY_MD_CODE || (flags & CLAY_MD_CODE_SPAN)) {
+        out->fontId = t->codeFontId;
+        out->textColor = t->codeColor;
+    } else if ((flags & (CLAY_MD_STRONG | CLAY_MD_EMPHASIS)) == (CLAY_MD_STRONG | CLAY_MD_EMPHASIS)) {
+        out->fontId = t->boldItalicFontId;
+    } else if (flags & CLAY_MD_STRONG) {
+        out->fontId = b->type == CLAY_MD_HEADING ? t->headingFontId : t->boldFontId;
+    } else if (flags & CLAY_MD_EMPHASIS) {
+        out->fontId = t->italicFontId;
+    }
+    if (flags & CLAY_MD_LINK) out->textColor = t->linkColor;
+}
+
+static int clay_md_push_piece(ClayMarkdownDoc *d, int32_t run, int32_t offset, int32_t length) {
+    ClayMdSlice *line = &d->lines[d->lineCount - 1];
+    if (line->length > 0) {
+        ClayMdPiece *last = &d->pieces[d->pieceCount - 1];
+        if (last->run == run && last->offset + last->length == offset) {
+            last->length += length;
+            return 1;
+        }
+    }
+    if (!clay_array_reserve((void**)&d->pieces, &d->pieceCapacity, d->pieceCount + 1, sizeof(ClayMdPiece))) return 0;
+    d->pieces[d->pieceCount++] = (ClayMdPiece){ run, offset, length };
+    line->length++;
+    return 1;
+}
+
+static int clay_md_push_line(ClayMarkdownDoc *d) {
+    if (!clay_array_reserve((void**)&d->lines, &d->lineCapacity, d->lineCount + 1, sizeof(ClayMdSlice))) return 0;
+    d->lines[d->lineCount++] = (ClayMdSlice){ d->pieceCount, 0 };
+    return 1;
+}
+
+// Greedy line breaking of one block's runs at spaces. Text glued to the previous word
+// across a style change ("**bold**,") never starts a line.
+static int clay_md_layout_block(ClayMarkdownDoc *d, ClayMdBlock *b, const ClayMdTheme *t, float maxWidth) {
+    float spaceWidth[CLAY_MD_STYLES];
+    for (int i = 0; i < CLAY_MD_STYLES; ++i) spaceWidth[i] = -1;
+    b->lineStart = d->lineCount;
+    if (!clay_md_push_line(d)) return 0;
+    float x = 0;
+    int32_t spaceRun = -1, spaceAt = 0, spaces = 0;
+    for (int32_t r = b->runStart; r < b->runStart + b->runCount; ++r) {
+        const ClayMdRun *run = &d->runs[r];
+        Clay_TextElementConfig cfg;
+        clay_md_style(t, b, run->flags, &cfg);
+        const char *s = d->pool + run->offset;
+        int32_t i = 0;
+        while (i < run->length) {
+            if (s[i] == '\n') {
+                if (!clay_md_push_line(d)) return 0;
+                x = 0;
+                spaces = 0;
+                i++;
+                continue;
+            }
+            if (s[i] == ' ') {
+                if (spaces == 0) { spaceRun = r; spaceAt = run->offset + i; }
+                spaces++;
+                i++;
+                continue;
+            }
+            int32_t j = i;
+            while (j < run->length && s[j] != ' ' && s[j] != '\n') j++;
+            float w = clay_measure_slice(s + i, j - i, &cfg);
+            int lineEmpty = d->lines[d->lineCount - 1].length == 0;
+            if (spaces > 0 && !lineEmpty) {
+                uint8_t sf = d->runs[spaceRun].flags & (CLAY_MD_STYLES - 1);
+                if (spaceWidth[sf] < 0) {
+                    Clay_TextElementConfig scfg;
+                    clay_md_style(t, b, sf, &scfg);
+                    spaceWidth[sf] = clay_measure_slice(" ", 1, &scfg);
+                }
+                float gap = spaceWidth[sf] * (float)spaces;
+                if (x + gap + w > maxWidth) {
+                    if (!clay_md_push_line(d)) return 0;
+                    x = 0;
+                } else {
+                    if (!clay_md_push_piece(d, spaceRun, spaceAt, spaces)) return 0;
+                    x += gap;
+                }
+            }
+            spaces = 0;
+            if (!clay_md_push_piece(d, r, run->offset + i, j - i)) return 0;
+            x += w;
+            i = j;
+        }
+    }
+    b->lineCount = d->lineCount - b->lineStart;
+    return 1;
+}
+
+static int clay_md_layout(ClayMarkdownDoc *d, const ClayMdTheme *t, const uint32_t *themeKey, float width) {
+    d->lineCount = 0;
+    d->pieceCount = 0;
+    for (int32_t i = 0; i < d->blockCount; ++i) {
+        ClayMdBlock *b = &d->blocks[i];
+        b->lineStart = d->lineCount;
+        b->lineCount = 0;
+        if (b->type == CLAY_MD_RULE) continue;
+        if (b->type == CLAY_MD_CODE) {
+            for (int32_t r = b->runStart; r < b->runStart + b->runCount; ++r) {
+                if (!clay_md_push_line(d)) return 0;
+                if (d->runs[r].length > 0 && !clay_md_push_piece(d, r, d->runs[r].offset, d->runs[r].length)) return 0;
+            }
+            b->lineCount = d->lineCount - b->lineStart;
+            continue;
+        }
+        float maxWidth = width;
+        if (b->type == CLAY_MD_ITEM) maxWidth -= (float)(b->level + 1) * t->listIndent;
+        if (!clay_md_layout_block(d, b, t, maxWidth)) return 0;
+    }
+    d->width = width;
+    memcpy(d->themeKey, themeKey, sizeof(d->themeKey));
+    return 1;
+}
+
+static void clay_md_open(Clay_ElementDeclaration *decl) {
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, (*decl)));
+}
+
+// A text element whose minimum width doesn't keep its parent from shrinking; the narrower
+// width is picked up (and laid out again) on the next frame.
+static void clay_md_text(Clay_String s, Clay_TextElementConfig *cfg) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    CLAY_TEXT(s, cfg);
+    Clay_LayoutElement *te = Clay_LayoutElementArray_Get(&ctx->layoutElements, ctx->layoutElements.length - 1);
+    te->minDimensions.width = 0;
+}
+
+static void clay_md_emit_lines(ClayMarkdownDoc *d, const ClayMdBlock *b, const ClayMdTheme *t, Clay_ElementId id) {
+    Clay_TextElementConfig *styleCfg[CLAY_MD_STYLES] = {0};
+    uint32_t linkBase = Clay__HashNumber(2, id.id).id;
+    for (int32_t l = b->lineStart; l < b->lineStart + b->lineCount; ++l) {
+        ClayMdSlice line = d->lines[l];
+        Clay_ElementDeclaration row = (Clay_ElementDeclaration){0};
+        row.layout = CLAY_LAYOUT_DEFAULT;
+        row.layout.childAlignment.y = CLAY_ALIGN_Y_CENTER;
+        clay_md_open(&row);
+        if (line.length == 0) {
+            // keep the height of blank lines
+            Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+            clay_md_style(t, b, 0, cfg);
+            CLAY_TEXT(((Clay_String){ .isStaticallyAllocated = true, .length = 1, .chars = " " }), cfg);
+        }
+        for (int32_t p = line.offset; p < line.offset + line.length; ++p) {
+            const ClayMdPiece *piece = &d->pieces[p];
+            const ClayMdRun *run = &d->runs[piece->run];
+            uint8_t flags = run->flags & (CLAY_MD_STYLES - 1);
+            if (!styleCfg[flags]) {
+                styleCfg[flags] = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+                clay_md_style(t, b, flags, styleCfg[flags]);
+            }
+            Clay_String s = { .isStaticallyAllocated = false, .length = piece->length, .chars = d->pool + piece->offset };
+            int wrapped = (flags & (CLAY_MD_CODE_SPAN | CLAY_MD_LINK)) != 0;
+            if (wrapped) {
+                Clay_ElementDeclaration box = (Clay_ElementDeclaration){0};
+                box.layout = CLAY_LAYOUT_DEFAULT;
+                if (flags & CLAY_MD_CODE_SPAN) box.backgroundColor = t->codeBackground;
+                if (flags & CLAY_MD_LINK) {
+                    Clay_ElementId eid = Clay__HashNumber((uint32_t)g_MarkdownLinkCount, linkBase);
+                    if (clay_array_reserve((void**)&g_MarkdownLinks, &g_MarkdownLinkCapacity, g_MarkdownLinkCount + 1, sizeof(ClayMdLinkHit))) {
+                        ClayMdSlice url = d->links[run->link];
+                        g_MarkdownLinks[g_MarkdownLinkCount++] = (ClayMdLinkHit){ eid.id,
+                            (Clay_String){ .isStaticallyAllocated = false, .length = url.length, .chars = d->pool + url.offset } };
+                    }
+                    Clay__OpenElementWithId(eid);
+                    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, box));
+                } else {
+                    clay_md_open(&box);
+                }
+            }
+            clay_md_text(s, styleCfg[flags]);
+            if (wrapped) Clay__CloseElement();
+        }
+        Clay__CloseElement();
+    }
+}
+
+// Width to break lines at: the column's width in the previous frame.
+static float clay_markdown_width(Clay_ElementId id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    Clay_ElementData prev = Clay_GetElementData(id);
+    float width = prev.found ? prev.boundingBox.width : 0;
+    if (width <= 0) {
+        // Not laid out yet: start from the parent's inner width.
+        Clay_LayoutElement *parent = Clay__GetOpenLayoutElement();
+        Clay_ElementData pd = Clay_GetElementData((Clay_ElementId){ .id = parent->id });
+        width = pd.found ? pd.boundingBox.width - parent->layoutConfig->padding.left - parent->layoutConfig->padding.right
+                         : ctx->layoutDimensions.width;
+    }
+    return width;
+}
+
+static void clay_markdown_declare(ClayMarkdownDoc *d, const ClayMdTheme *t, Clay_ElementId id) {
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.childGap = (uint16_t)t->blockGap;
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    for (int32_t i = 0; i < d->blockCount; ++i) {
+        const ClayMdBlock *b = &d->blocks[i];
+        Clay_ElementDeclaration box = (Clay_ElementDeclaration){0};
+        box.layout = CLAY_LAYOUT_DEFAULT;
+        box.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+        box.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+        switch (b->type) {
+            case CLAY_MD_RULE:
+                box.layout.sizing.height = (Clay_SizingAxis){ .size = { .minMax = { 1, 1 } }, .type = CLAY__SIZING_TYPE_FIXED };
+                box.backgroundColor = t->ruleColor;
+                clay_md_open(&box);
+                Clay__CloseElement();
+                break;
+            case CLAY_MD_CODE:
+                box.layout.padding = (Clay_Padding){ (uint16_t)t->codePadding, (uint16_t)t->codePadding,
+                                                     (uint16_t)t->codePadding, (uint16_t)t->codePadding };
+                box.backgroundColor = t->codeBackground;
+                box.clip.horizontal = true;
+                clay_md_open(&box);
+                clay_md_emit_lines(d, b, t, id);
+                Clay__CloseElement();
+                break;
+            case CLAY_MD_ITEM: {
+                box.layout.layoutDirection = CLAY_LEFT_TO_RIGHT;
+                box.layout.padding.left = (uint16_t)((float)b->level * t->listIndent);
+                clay_md_open(&box);
+                Clay_ElementDeclaration mark = (Clay_ElementDeclaration){0};
+                mark.layout = CLAY_LAYOUT_DEFAULT;
+                mark.layout.sizing.width = (Clay_SizingAxis){ .size = { .minMax = { t->listIndent, t->listIndent } }, .type = CLAY__SIZING_TYPE_FIXED };
+                clay_md_open(&mark);
+                Clay_TextElementConfig *cfg = CLAY_TEXT_CONFIG((Clay_TextElementConfig){0});
+                clay_md_style(t, b, 0, cfg);
+                if (b->ordered) {
+                    char num[16];
+                    int n = snprintf(num, sizeof(num), "%d.", (int)b->number);
+                    Clay_String s = clay_frame_string(num, n);
+                    if (s.chars) CLAY_TEXT(s, cfg);
+                } else {
+                    CLAY_TEXT(((Clay_String){ .isStaticallyAllocated = true, .length = 3, .chars = "\xE2\x80\xA2" }), cfg);   // •
+                }
+                Clay__CloseElement();
+                Clay_ElementDeclaration body = (Clay_ElementDeclaration){0};
+                body.layout = CLAY_LAYOUT_DEFAULT;
+                body.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+                body.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+                clay_md_open(&body);
+                clay_md_emit_lines(d, b, t, id);
+                Clay__CloseElement();
+                Clay__CloseElement();
+                break;
+            }
+            default:
+                clay_md_open(&box);
+                clay_md_emit_lines(d, b, t, id);
+                Clay__CloseElement();
+                break;
+        }
+    }
+    Clay__CloseElement();
+}
+
+// Lays the parse out again when the width or theme changed; 0 when out of memory, with the
+// layout marked stale so the next emit retries. Inside clay.measureSubtree a changed layout
+// goes into a copy, so the cached one stays at the width the real frame uses.
+static int clay_markdown_emit(ClayMarkdownDoc *d, const ClayMdTheme *t, const uint32_t *themeKey, float width, Clay_ElementId id) {
+    if (d->width == width && memcmp(d->themeKey, themeKey, sizeof(d->themeKey)) == 0) {
+        clay_markdown_declare(d, t, id);
+        return 1;
+    }
+    if (!g_MeasureDepth) {
+        if (!clay_md_layout(d, t, themeKey, width)) {
+            d->width = -1;
+            return 0;
+        }
+        clay_markdown_declare(d, t, id);
+        return 1;
+    }
+    ClayMarkdownDoc copy = *d;
+    copy.lines = NULL;
+    copy.pieces = NULL;
+    copy.lineCount = copy.lineCapacity = copy.pieceCount = copy.pieceCapacity = 0;
+    copy.blocks = (ClayMdBlock*)malloc(sizeof(ClayMdBlock) * (size_t)(d->blockCount > 0 ? d->blockCount : 1));
+    int ok = copy.blocks != NULL;
+    if (ok) {
+        memcpy(copy.blocks, d->blocks, sizeof(ClayMdBlock) * (size_t)d->blockCount);
+        ok = clay_md_layout(&copy, t, themeKey, width);
+    }
+    if (ok) clay_markdown_declare(&copy, t, id);
+    free(copy.blocks);
+    free(copy.lines);
+    free(copy.pieces);
+    return ok;
+}
+
+// clay.markdown(id, source [, theme])   (id: string or id table)
+// theme = { fontId=, fontSize=, lineHeight=, textColor=, boldFontId=, italicFontId=,
+//           boldItalicFontId=, codeFontId=, headingFontId=, headingSizes={h1..h6},
+//           headingColor=, codeColor=, codeBackground=, linkColor=, ruleColor=,
+//           blockGap=, listIndent=, codePadding= }
+static int l_Clay_Markdown(lua_State *L) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "clay.markdown() must be called during a layout pass");
+    }
+    luaL_argcheck(L, lua_type(L, 1) == LUA_TSTRING || lua_type(L, 1) == LUA_TTABLE, 1, "string or id table expected");
+    Clay_ElementId id = lua_type(L, 1) == LUA_TTABLE ? clay_check_element_id(L, 1)
+                                                     : Clay__HashString(Clay_BorrowLuaString(L, 1), 0);
+    size_t len = 0;
+    const char *source = luaL_checklstring(L, 2, &len);
+    luaL_argcheck(L, len <= (size_t)(INT32_MAX / 2), 2, "source too long");
+    ClayMdTheme theme;
+    clay_md_theme(L, 3, &theme);
+    uint32_t themeKey[CLAY_MD_THEME_KEY_WORDS];
+    clay_md_theme_key(&theme, themeKey);
+
+    float width = clay_markdown_width(id);
+    ClayMarkdownDoc *d = clay_markdown_get(source, (int32_t)len);
+    if (!d || !clay_markdown_emit(d, &theme, themeKey, width, id)) return luaL_error(L, "clay.markdown: out of memory");
+    return 0;
+}
+
+// clay.markdownLinkAt(x, y) -> url | nil   (links declared by clay.markdown in the last layout)
+static int l_Clay_MarkdownLinkAt(lua_State *L) {
+    float x = (float)luaL_checknumber(L, 1);
+    float y = (float)luaL_checknumber(L, 2);
+    for (int32_t i = 0; i < g_MarkdownLinkCount; ++i) {
+        Clay_ElementData data = Clay_GetElementData((Clay_ElementId){ .id = g_MarkdownLinks[i].elementId });
+        if (!data.found) continue;
+        Clay_BoundingBox b = data.boundingBox;
+        if (x >= b.x && x < b.x + b.width && y >= b.y && y < b.y + b.height) {
+            lua_pushlstring(L, g_MarkdownLinks[i].url.chars, (size_t)g_MarkdownLinks[i].url.length);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Chart series
+//
+// clay.series() holds a numeric series in C: its own float copy or a host buffer. The
+// series' emit() declares a CUSTOM element. Once the layout is final, the series is
+// decimated to one min/max pair per pixel column of that element's bounding box, and
+// the render command carries the result as a polyline (or column list) in screen space.
+// -----------------------------------------------------------------------------
+
+enum { CLAY_CHART_LINE, CLAY_CHART_COLUMNS };
+
+typedef struct {
+    float *values;          // owned, or the host buffer when external
+    int32_t count;
+    int32_t capacity;       // 0 for an external buffer
+    int external;
+    int mode;
+    Clay_Color color;
+    int autoRange;          // y range from the visible samples
+    float yMin, yMax;
+    float baseline;         // columns start here; NaN = yMin
+    int32_t viewFirst;      // visible sample range [viewFirst, viewFirst + viewCount); viewCount < 0 = to the end
+    int32_t viewCount;
+} ClaySeries;
+
+// One chart declared this frame; customData of its CUSTOM command points here.
+typedef struct {
+    uint32_t elementId;
+    const ClaySeries *series;   // frame-anchored until the next layout
+    float *points;              // x, y pairs in screen space, filled after layout
+    int32_t pointCount;
+} ClayChartPlot;
+
+static ClayChartPlot **g_Charts = NULL;
+static int32_t g_ChartCount = 0;
+static int32_t g_ChartCapacity = 0;
+static ClayU32Map g_ChartIndex = {0};
+
+static ClaySeries* check_series(lua_State *L, int idx) {
+    return (ClaySeries*)luaL_checkudata(L, idx, "ClaySeries");
+}
+
+static void clay_chart_frame_reset(void) {
+    g_ChartCount = 0;
+    clay_u32map_clear(&g_ChartIndex);
+}
+
+static void clay_chart_clear(void) {
+    free(g_Charts);
+    g_Charts = NULL;
+    g_ChartCount = g_ChartCapacity = 0;
+    clay_u32map_free(&g_ChartIndex);
+}
+
+// Min and max of v[0..n), skipping NaNs; *lo > *hi when there was no number.
+static void clay_chart_minmax(const float *v, int32_t n, float *lo, float *hi) {
+    float mn = INFINITY, mx = -INFINITY;
+    int32_t i = 0;
+#if defined(CLAY_LUA_SSE2)
+    if (n >= 8) {
+        // minps/maxps return the second operand when either is NaN, so NaN samples drop out.
+        __m128 mn0 = _mm_set1_ps(INFINITY), mn1 = mn0;
+        __m128 mx0 = _mm_set1_ps(-INFINITY), mx1 = mx0;
+        for (; i + 8 <= n; i += 8) {
+            __m128 a = _mm_loadu_ps(v + i), b = _mm_loadu_ps(v + i + 4);
+            mn0 = _mm_min_ps(a, mn0); mx0 = _mm_max_ps(a, mx0);
+            mn1 = _mm_min_ps(b, mn1); mx1 = _mm_max_ps(b, mx1);
+        }
+        float l[4], h[4];
+        _mm_storeu_ps(l, _mm_min_ps(mn0, mn1));
+        _mm_storeu_ps(h, _mm_max_ps(mx0, mx1));
+        for (int k = 0; k < 4; ++k) {
+            if (l[k] < mn) mn = l[k];
+            if (h[k] > mx) mx = h[k];
+        }
+    }
+#elif defined(CLAY_LUA_NEON)
+    if (n >= 8) {
+        float32x4_t mn0 = vdupq_n_f32(INFINITY), mn1 = mn0;
+        float32x4_t mx0 = vdupq_n_f32(-INFINITY), mx1 = mx0;
+        for (; i + 8 <= n; i += 8) {
+            float32x4_t a = vld1q_f32(v + i), b = vld1q_f32(v + i + 4);
+            mn0 = vminnmq_f32(mn0, a); mx0 = vmaxnmq_f32(mx0, a);
+            mn1 = vminnmq_f32(mn1, b); mx1 = vmaxnmq_f32(mx1, b);
+        }
+        mn = vminnmvq_f32(vminnmq_f32(mn0, mn1));
+        mx = vmaxnmvq_f32(vmaxnmq_f32(mx0, mx1));
+    }
+#endif
+    for (; i < n; ++i) {
+        if (v[i] < mn) mn = v[i];
+        if (v[i] > mx) mx = v[i];
+    }
+    *lo = mn;
+    *hi = mx;
+}
+
+// Decimate one plot to its element's bounding box.
+static void clay_chart_plot(ClayChartPlot *p, Clay_BoundingBox box) {
+    const ClaySeries *s = p->series;
+    p->points = NULL;
+    p->pointCount = 0;
+    int32_t first = s->viewFirst < s->count ? s->viewFirst : s->count;
+    int32_t n = s->viewCount < 0 || s->viewCount > s->count - first ? s->count - first : s->viewCount;
+    int32_t columns = (int32_t)box.width;
+    if (n <= 0 || columns <= 0 || !s->values) return;
+
+    // One min/max per column; when there are few samples, the samples themselves.
+    int decimate = n > 2 * columns || s->mode == CLAY_CHART_COLUMNS;
+    int32_t slots = decimate ? columns : n;
+    float *lo = (float*)clay_frame_alloc(sizeof(float) * 2 * (size_t)slots);
+    float *out = (float*)clay_frame_alloc(sizeof(float) * 4 * (size_t)slots);
+    if (!lo || !out) return;
+    float *hi = lo + slots;
+    const float *v = s->values + first;
+    float rangeLo = INFINITY, rangeHi = -INFINITY;
+    for (int32_t c = 0; c < slots; ++c) {
+        if (decimate) {
+            int32_t a = (int32_t)((int64_t)c * n / columns);
+            int32_t b = (int32_t)((int64_t)(c + 1) * n / columns);
+            if (b <= a) b = a + 1;  // fewer samples than columns: a sample spans several columns
+            clay_chart_minmax(v + a, b - a, &lo[c], &hi[c]);
+        } else {
+            lo[c] = v[c] == v[c] ? v[c] : INFINITY;
+            hi[c] = v[c] == v[c] ? v[c] : -INFINITY;
+        }
+        if (lo[c] < rangeLo) rangeLo = lo[c];
+        if (hi[c] > rangeHi) rangeHi = hi[c];
+    }
+    float yMin = s->autoRange ? rangeLo : s->yMin;
+    float yMax = s->autoRange ? rangeHi : s->yMax;
+    if (!(yMin <= yMax)) return;    // nothing but NaNs
+    float scale = yMax > yMin ? box.height / (yMax - yMin) : 0;
+    float bottom = box.y + box.height;
+    float mid = yMax > yMin ? 0 : box.height * 0.5f;
+#define CLAY_CHART_Y(value) (bottom - mid - ((value) - yMin) * scale)
+
+    int32_t k = 0;
+    float prevY = NAN;
+    float base = s->baseline == s->baseline ? s->baseline : yMin;
+    for (int32_t c = 0; c < slots; ++c) {
+        if (lo[c] > hi[c]) continue;
+        float x = decimate ? box.x + (float)c + 0.5f
+                           : box.x + (n > 1 ? (float)c * box.width / (float)(n - 1) : box.width * 0.5f);
+        if (s->mode == CLAY_CHART_COLUMNS) {
+            float top = hi[c] > base ? hi[c] : base;
+            float low = lo[c] < base ? lo[c] : base;
+            out[k++] = x; out[k++] = CLAY_CHART_Y(top);
+            out[k++] = x; out[k++] = CLAY_CHART_Y(low);
+            continue;
+        }
+        float yLo = CLAY_CHART_Y(lo[c]), yHi = CLAY_CHART_Y(hi[c]);
+        if (!decimate || lo[c] == hi[c]) {
+            out[k++] = x; out[k++] = yLo;
+            prevY = yLo;
+            continue;
+        }
+        // Enter the column at the extreme nearest to where the line comes from.
+        int hiFirst = prevY == prevY && fabsf(prevY - yHi) < fabsf(prevY - yLo);
+        out[k++] = x; out[k++] = hiFirst ? yHi : yLo;
+        out[k++] = x; out[k++] = hiFirst ? yLo : yHi;
+        prevY = hiFirst ? yLo : yHi;
+    }
+#undef CLAY_CHART_Y
+    p->points = out;
+    p->pointCount = k / 2;
+}
+
+// Fill in every chart declared this frame, now that the layout is final.
+static void clay_chart_apply(Clay_RenderCommandArray *arr) {
+    if (g_ChartCount == 0) return;
+    for (int32_t i = 0; i < arr->length; ++i) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_CUSTOM) continue;
+        int32_t idx = clay_u32map_get(&g_ChartIndex, cmd->id);
+        if (idx < 0 || cmd->renderData.custom.customData != g_Charts[idx]) continue;
+        clay_chart_plot(g_Charts[idx], cmd->boundingBox);
+    }
+}
+
+// The plot carried by a render command, or NULL.
+static ClayChartPlot* clay_chart_of_command(Clay_RenderCommand *cmd) {
+    if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_CUSTOM) return NULL;
+    int32_t idx = clay_u32map_get(&g_ChartIndex, cmd->id);
+    return idx >= 0 && cmd->renderData.custom.customData == g_Charts[idx] ? g_Charts[idx] : NULL;
+}
+
+// A bounds transition moved the chart's command: move its plot, which was computed in
+// screen space from the unmoved box, the same way.
+static void clay_chart_flip_offset(Clay_RenderCommand *cmd, const ClayFlipOffset *o) {
+    ClayChartPlot *plot = clay_chart_of_command(cmd);
+    if (!plot) return;
+    for (int32_t p = 0; p < plot->pointCount; ++p) {
+        float *pt = &plot->points[2 * p];
+        pt[0] = o->origin.x + (pt[0] - o->origin.x) * o->sx + o->dx;
+        pt[1] = o->origin.y + (pt[1] - o->origin.y) * o->sy + o->dy;
+    }
+}
+
+static int l_Clay_Series_New(lua_State *L) {
+    ClaySeries *s = (ClaySeries*)lua_newuserdata(L, sizeof(ClaySeries));
+    memset(s, 0, sizeof(*s));
+    s->color = (Clay_Color){90,160,255,255};
+    s->autoRange = 1;
+    s->baseline = NAN;
+    s->viewCount = -1;
+    luaL_setmetatable(L, "ClaySeries");
+    return 1;
+}
+
+static void clay_series_release(ClaySeries *s) {
+    if (!s->external) free(s->values);
+    s->values = NULL;
+    s->count = s->capacity = 0;
+    s->external = 0;
+}
+
+static int clay_series_reserve(ClaySeries *s, int32_t need) {
+    if (s->external) clay_series_release(s);
+    return clay_array_reserve((void**)&s->values, &s->capacity, need, sizeof(float));
+}
+
+// series:set(values)   (Lua array of numbers; copied)
+static int l_Series_set(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int32_t n = (int32_t)clay_rawlen(L, 2);
+    if (s->external) clay_series_release(s);
+    s->count = 0;
+    if (!clay_series_reserve(s, n)) return luaL_error(L, "series:set: out of memory");
+    for (int32_t i = 0; i < n; ++i) {
+        lua_rawgeti(L, 2, i + 1);
+        s->values[i] = lua_isnumber(L, -1) ? (float)lua_tonumber(L, -1) : NAN;
+        lua_pop(L, 1);
+    }
+    s->count = n;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// series:append(value | values)
+static int l_Series_append(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    if (s->external) return luaL_error(L, "series:append: the series uses an external buffer");
+    if (lua_istable(L, 2)) {
+        int32_t n = (int32_t)clay_rawlen(L, 2);
+        if (!clay_series_reserve(s, s->count + n)) return luaL_error(L, "series:append: out of memory");
+        for (int32_t i = 0; i < n; ++i) {
+            lua_rawgeti(L, 2, i + 1);
+            s->values[s->count++] = lua_isnumber(L, -1) ? (float)lua_tonumber(L, -1) : NAN;
+            lua_pop(L, 1);
+        }
+    } else {
+        float value = (float)luaL_checknumber(L, 2);
+        if (!clay_series_reserve(s, s->count + 1)) return luaL_error(L, "series:append: out of memory");
+        s->values[s->count++] = value;
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+// series:setBuffer(ptr, count)   (ptr: lightuserdata or integer address of `count` 32-bit floats)
+// The buffer is read when the frame's layout ends, and must stay valid until then.
+static int l_Series_setBuffer(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    void *ptr = NULL;
+    if (lua_islightuserdata(L, 2)) ptr = lua_touserdata(L, 2);
+    else ptr = (void*)(uintptr_t)luaL_checkinteger(L, 2);
+    lua_Integer count = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, count >= 0 && count <= INT32_MAX, 3, "count out of range");
+    luaL_argcheck(L, ptr != NULL || count == 0, 2, "null buffer");
+    clay_series_release(s);
+    s->values = (float*)ptr;
+    s->count = (int32_t)count;
+    s->external = 1;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Series_count(lua_State *L) {
+    lua_pushinteger(L, check_series(L, 1)->count);
+    return 1;
+}
+
+// series:get(i) -> value   (1-based)
+static int l_Series_get(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    if (i < 1 || i > s->count) return 0;
+    lua_pushnumber(L, s->values[i - 1]);
+    return 1;
+}
+
+// series:range() -> min, max   (over the visible samples; nil if there are none)
+static int l_Series_range(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    int32_t first = s->viewFirst < s->count ? s->viewFirst : s->count;
+    int32_t n = s->viewCount < 0 || s->viewCount > s->count - first ? s->count - first : s->viewCount;
+    float lo = 0, hi = -1;
+    if (n > 0) clay_chart_minmax(s->values + first, n, &lo, &hi);
+    if (!(lo <= hi)) return 0;
+    lua_pushnumber(L, lo);
+    lua_pushnumber(L, hi);
+    return 2;
+}
+
+// series:setView([first [, last]])   (1-based, inclusive; no arguments shows everything)
+static int l_Series_setView(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    lua_Integer first = luaL_optinteger(L, 2, 1);
+    luaL_argcheck(L, first >= 1 && first <= INT32_MAX, 2, "first out of range");
+    s->viewFirst = (int32_t)(first - 1);
+    s->viewCount = -1;
+    if (!lua_isnoneornil(L, 3)) {
+        lua_Integer last = luaL_checkinteger(L, 3);
+        s->viewCount = last < first ? 0 : (int32_t)(last - first + 1 > INT32_MAX ? INT32_MAX : last - first + 1);
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+// series:setStyle{ mode=clay.CHART_LINE|CHART_COLUMNS, color=, yMin=, yMax=, baseline= }
+// Setting yMin or yMax fixes the y range; `false` (for both) returns to the automatic range.
+static int l_Series_setStyle(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    s->mode = (int)clay_opt_number_field(L, 2, "mode", (float)s->mode);
+    luaL_argcheck(L, s->mode == CLAY_CHART_LINE || s->mode == CLAY_CHART_COLUMNS, 2, "unknown chart mode");
+    clay_opt_color_field(L, 2, "color", &s->color);
+    lua_getfield(L, 2, "yMin");
+    lua_getfield(L, 2, "yMax");
+    if (lua_isnumber(L, -2) || lua_isnumber(L, -1)) {
+        if (s->autoRange) { s->yMin = 0; s->yMax = 1; }
+        s->autoRange = 0;
+        if (lua_isnumber(L, -2)) s->yMin = (float)lua_tonumber(L, -2);
+        if (lua_isnumber(L, -1)) s->yMax = (float)lua_tonumber(L, -1);
+    } else if (lua_type(L, -2) == LUA_TBOOLEAN || lua_type(L, -1) == LUA_TBOOLEAN) {
+        s->autoRange = 1;
+    }
+    lua_pop(L, 2);
+    lua_getfield(L, 2, "baseline");
+    if (lua_isnumber(L, -1)) s->baseline = (float)lua_tonumber(L, -1);
+    else if (lua_type(L, -1) == LUA_TBOOLEAN) s->baseline = NAN;
+    lua_pop(L, 1);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// series:emit(id...)   (GROW x GROW custom element; id as for clay.id)
+static int l_Series_emit(lua_State *L) {
+    ClaySeries *s = check_series(L, 1);
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "series:emit() must be called during a layout pass");
+    }
+    Clay_ElementId id = clay_element_id_from_args(L, 2);
+    ClayChartPlot *p = (ClayChartPlot*)clay_frame_alloc(sizeof(ClayChartPlot));
+    if (!p || !clay_array_reserve((void**)&g_Charts, &g_ChartCapacity, g_ChartCount + 1, sizeof(ClayChartPlot*))) {
+        return luaL_error(L, "series:emit: out of memory");
+    }
+    *p = (ClayChartPlot){ id.id, s, NULL, 0 };
+
+    if (!g_MeasureDepth) {
+        clay_frame_anchor(L, 1);     // read again when the layout ends
+        clay_u32map_put(&g_ChartIndex, id.id, g_ChartCount);
+        g_Charts[g_ChartCount++] = p;
+    }
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    decl.backgroundColor = s->color;
+    decl.custom.customData = p;
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+    Clay__CloseElement();
+    return 0;
+}
+
+static int l_Series_gc(lua_State *L) {
+    clay_series_release(check_series(L, 1));
+    return 0;
+}
+
+static void Clay_CreateSeriesMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClaySeries")) {
+        lua_pushcfunction(L, l_Series_set); lua_setfield(L, -2, "set");
+        lua_pushcfunction(L, l_Series_append); lua_setfield(L, -2, "append");
+        lua_pushcfunction(L, l_Series_setBuffer); lua_setfield(L, -2, "setBuffer");
+        lua_pushcfunction(L, l_Series_count); lua_setfield(L, -2, "count");
+        lua_pushcfunction(L, l_Series_get); lua_setfield(L, -2, "get");
+        lua_pushcfunction(L, l_Series_range); lua_setfield(L, -2, "range");
+        lua_pushcfunction(L, l_Series_setView); lua_setfield(L, -2, "setView");
+        lua_pushcfunction(L, l_Series_setStyle); lua_setfield(L, -2, "setStyle");
+        lua_pushcfunction(L, l_Series_emit); lua_setfield(L, -2, "emit");
+        lua_pushcfunction(L, l_Series_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Canvas
+//
+// clay.canvas([cellSize]) holds user items (rectangles, images, labels) in C with
+// world-space bounds, indexed by a uniform grid of cellSize x cellSize cells. The
+// canvas' emit() declares one clipped element. Only the items that fall inside the
+// element's previous-frame bounds at the current pan and zoom are selected. Once the
+// layout is final, they are spliced into the render commands as plain RECTANGLE / IMAGE
+// / TEXT commands inside the element's scissor. The items are not declared as floating
+// elements: Clay sorts floating roots pairwise, which is too slow with thousands of them.
+// -----------------------------------------------------------------------------
+
+#define CLAY_CANVAS_MAX_ITEM_CELLS 1024    // larger items go to a list checked by every query
+
+typedef struct {
+    float x, y, w, h;           // world space
+    Clay_Color color;
+    float cornerRadius;         // world units
+    uint32_t labelOffset;
+    int32_t labelLength;
+    int imageRef;               // LUA_NOREF: no image
+    uint32_t seq;               // add() order, which is the drawing order; slots are reused
+    uint32_t stamp;             // last query that visited the item
+    uint8_t alive;
+    uint8_t oversized;          // in `oversized` rather than in grid cells
+} ClayCanvasItem;
+
+typedef struct {
+    int32_t *items;
+    int32_t count;
+    int32_t capacity;
+} ClayCanvasCell;
+
+typedef struct {
+    ClayCanvasItem *items;
+    int32_t itemCount, itemCapacity;
+    int32_t liveCount;
+    int32_t *freeItems;         // removed slots, reused by add()
+    int32_t freeCount, freeCapacity;
+    char *labels;
+    uint32_t labelUsed, labelCapacity;
+    uint32_t labelLive;         // bytes still referenced by an item
+    uint32_t nextSeq;
+    ClayCanvasCell *cells;
+    int32_t cellCount, cellCapacity;
+    ClayU32Map cellIndex;       // cell key -> cells index
+    ClayCanvasCell oversized;
+    float cellSize;
+    float panX, panY;           // world point at the element's top-left corner
+    float zoom;                 // screen pixels per world unit
+    uint32_t stamp;
+    int32_t *found;             // result of the last query, ascending
+    int32_t foundCount, foundCapacity;
+    Clay_TextElementConfig text;
+    float minLabelSize;         // labels scaled below this font size are hidden
+    Clay_ElementId id;
+} ClayCanvas;
+
+// One canvas declared this frame: the items to splice in once its bounds are final.
+typedef struct {
+    uint32_t elementId;
+    ClayCanvas *canvas;         // frame-anchored
+    int32_t *items;
+    void **images;              // imageData of each item (the item's own ref, lent to the command)
+    Clay_String *labels;
+    Clay_Dimensions *labelSizes;
+    Clay_TextElementConfig text;
+    int32_t count;
+    int32_t commandCount;
+} ClayCanvasFrame;
+
+static ClayCanvasFrame *g_CanvasFrames = NULL;
+static int32_t g_CanvasFrameCount = 0;
+static int32_t g_CanvasFrameCapacity = 0;
+// Item image refs lent to this frame's commands; cmd:imageData() reads them without
+// releasing. A lent ref that its item drops is released at the next beginLayout.
+static ClayU32Map g_CanvasLentRefs = {0};
+static int *g_CanvasRetiredRefs = NULL;
+static int32_t g_CanvasRetiredCount = 0;
+static int32_t g_CanvasRetiredCapacity = 0;
+
+static int clay_canvas_ref_lent(int ref) {
+    return ref > 0 && clay_u32map_get(&g_CanvasLentRefs, (uint32_t)ref) >= 0;
+}
+
+static void clay_canvas_release_ref(lua_State *L, int ref) {
+    if (clay_canvas_ref_lent(ref) &&
+        clay_array_reserve((void**)&g_CanvasRetiredRefs, &g_CanvasRetiredCapacity, g_CanvasRetiredCount + 1, sizeof(int))) {
+        g_CanvasRetiredRefs[g_CanvasRetiredCount++] = ref;
+        return;
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+}
+
+static void clay_canvas_frame_reset(lua_State *L) {
+    g_CanvasFrameCount = 0;
+    clay_u32map_clear(&g_CanvasLentRefs);
+    for (int32_t i = 0; i < g_CanvasRetiredCount; ++i) luaL_unref(L, LUA_REGISTRYINDEX, g_CanvasRetiredRefs[i]);
+    g_CanvasRetiredCount = 0;
+}
+
+static void clay_canvas_frames_free(lua_State *L) {
+    clay_canvas_frame_reset(L);
+    free(g_CanvasFrames);
+    free(g_CanvasRetiredRefs);
+    g_CanvasFrames = NULL;
+    g_CanvasRetiredRefs = NULL;
+    g_CanvasFrameCapacity = g_CanvasRetiredCapacity = 0;
+    clay_u32map_free(&g_CanvasLentRefs);
+}
+
+static ClayCanvas* check_canvas(lua_State *L, int idx) {
+    return (ClayCanvas*)luaL_checkudata(L, idx, "ClayCanvas");
+}
+
+static uint32_t clay_canvas_cell_key(int32_t cx, int32_t cy) {
+    uint32_t k = clay_hash_u32(clay_hash_u32(2166136261u, (uint32_t)cx), (uint32_t)cy);
+    return k ? k : 1;
+}
+
+static int clay_canvas_cell_push(ClayCanvasCell *cell, int32_t item) {
+    if (!clay_array_reserve((void**)&cell->items, &cell->capacity, cell->count + 1, sizeof(int32_t))) return 0;
+    cell->items[cell->count++] = item;
+    return 1;
+}
+
+static void clay_canvas_cell_remove(ClayCanvasCell *cell, int32_t item) {
+    for (int32_t i = 0; i < cell->count; ++i) {
+        if (cell->items[i] == item) {
+            cell->items[i] = cell->items[--cell->count];
+            return;
+        }
+    }
+}
+
+// Cell range covered by a world rectangle; returns the number of cells.
+static int64_t clay_canvas_cells_of(const ClayCanvas *c, float x0, float y0, float x1, float y1,
+                                    int32_t *cx0, int32_t *cy0, int32_t *cx1, int32_t *cy1) {
+    const float lim = 1e9f;
+    *cx0 = (int32_t)fmaxf(-lim, fminf(lim, floorf(x0 / c->cellSize)));
+    *cy0 = (int32_t)fmaxf(-lim, fminf(lim, floorf(y0 / c->cellSize)));
+    *cx1 = (int32_t)fmaxf(-lim, fminf(lim, floorf(x1 / c->cellSize)));
+    *cy1 = (int32_t)fmaxf(-lim, fminf(lim, floorf(y1 / c->cellSize)));
+    return (int64_t)(*cx1 - *cx0 + 1) * (int64_t)(*cy1 - *cy0 + 1);
+}
+
+static int clay_canvas_index(ClayCanvas *c, int32_t n) {
+    ClayCanvasItem *it = &c->items[n];
+    int32_t cx0, cy0, cx1, cy1;
+    int64_t cells = clay_canvas_cells_of(c, it->x, it->y, it->x + it->w, it->y + it->h, &cx0, &cy0, &cx1, &cy1);
+    it->oversized = cells > CLAY_CANVAS_MAX_ITEM_CELLS;
+    if (it->oversized) return clay_canvas_cell_push(&c->oversized, n);
+    for (int32_t cy = cy0; cy <= cy1; ++cy) {
+        for (int32_t cx = cx0; cx <= cx1; ++cx) {
+            uint32_t key = clay_canvas_cell_key(cx, cy);
+            int32_t idx = clay_u32map_get(&c->cellIndex, key);
+            if (idx < 0) {
+                if (!clay_array_reserve((void**)&c->cells, &c->cellCapacity, c->cellCount + 1, sizeof(ClayCanvasCell))) return 0;
+                idx = c->cellCount++;
+                c->cells[idx] = (ClayCanvasCell){0};
+                clay_u32map_put(&c->cellIndex, key, idx);
+            }
+            if (!clay_canvas_cell_push(&c->cells[idx], n)) return 0;
+        }
+    }
+    return 1;
+}
+
+static void clay_canvas_unindex(ClayCanvas *c, int32_t n) {
+    ClayCanvasItem *it = &c->items[n];
+    if (it->oversized) {
+        clay_canvas_cell_remove(&c->oversized, n);
+        return;
+    }
+    int32_t cx0, cy0, cx1, cy1;
+    clay_canvas_cells_of(c, it->x, it->y, it->x + it->w, it->y + it->h, &cx0, &cy0, &cx1, &cy1);
+    for (int32_t cy = cy0; cy <= cy1; ++cy) {
+        for (int32_t cx = cx0; cx <= cx1; ++cx) {
+            int32_t idx = clay_u32map_get(&c->cellIndex, clay_canvas_cell_key(cx, cy));
+            if (idx >= 0) clay_canvas_cell_remove(&c->cells[idx], n);
+        }
+    }
+}
+
+static const ClayCanvasItem *g_CanvasSortItems = NULL;
+
+static int clay_canvas_cmp_seq(const void *a, const void *b) {
+    uint32_t x = g_CanvasSortItems[*(const int32_t*)a].seq, y = g_CanvasSortItems[*(const int32_t*)b].seq;
+    return x < y ? -1 : x > y;
+}
+
+static void clay_canvas_visit(ClayCanvas *c, const ClayCanvasCell *cell, float x0, float y0, float x1, float y1) {
+    for (int32_t i = 0; i < cell->count; ++i) {
+        int32_t n = cell->items[i];
+        ClayCanvasItem *it = &c->items[n];
+        if (it->stamp == c->stamp) continue;
+        it->stamp = c->stamp;
+        if (it->x > x1 || it->y > y1 || it->x + it->w < x0 || it->y + it->h < y0) continue;
+        if (!clay_array_reserve((void**)&c->found, &c->foundCapacity, c->foundCount + 1, sizeof(int32_t))) return;
+        c->found[c->foundCount++] = n;
+    }
+}
+
+// Items overlapping a world rectangle into c->found, in insertion (drawing) order.
+static void clay_canvas_query(ClayCanvas *c, float x0, float y0, float x1, float y1) {
+    c->foundCount = 0;
+    if (++c->stamp == 0) {
+        for (int32_t i = 0; i < c->itemCount; ++i) c->items[i].stamp = 0;
+        c->stamp = 1;
+    }
+    int32_t cx0, cy0, cx1, cy1;
+    int64_t cells = clay_canvas_cells_of(c, x0, y0, x1, y1, &cx0, &cy0, &cx1, &cy1);
+    if (cells > c->cellCount) {
+        // Zoomed out past the populated cells: walking them all is cheaper.
+        for (int32_t i = 0; i < c->cellCount; ++i) clay_canvas_visit(c, &c->cells[i], x0, y0, x1, y1);
+    } else {
+        for (int32_t cy = cy0; cy <= cy1; ++cy) {
+            for (int32_t cx = cx0; cx <= cx1; ++cx) {
+                int32_t idx = clay_u32map_get(&c->cellIndex, clay_canvas_cell_key(cx, cy));
+                if (idx >= 0) clay_canvas_visit(c, &c->cells[idx], x0, y0, x1, y1);
+            }
+        }
+    }
+    clay_canvas_visit(c, &c->oversized, x0, y0, x1, y1);
+    g_CanvasSortItems = c->items;
+    qsort(c->found, (size_t)c->foundCount, sizeof(int32_t), clay_canvas_cmp_seq);
+    g_CanvasSortItems = NULL;
+}
+
+static void clay_canvas_clear_items(lua_State *L, ClayCanvas *c) {
+    for (int32_t i = 0; i < c->itemCount; ++i) {
+        if (c->items[i].alive) clay_canvas_release_ref(L, c->items[i].imageRef);
+    }
+    for (int32_t i = 0; i < c->cellCount; ++i) free(c->cells[i].items);
+    c->itemCount = c->liveCount = c->freeCount = c->cellCount = c->foundCount = 0;
+    c->labelUsed = c->labelLive = 0;
+    c->nextSeq = 0;
+    c->oversized.count = 0;
+    clay_u32map_clear(&c->cellIndex);
+}
+
+static int l_Clay_Canvas_New(lua_State *L) {
+    float cellSize = (float)luaL_optnumber(L, 1, 256);
+    luaL_argcheck(L, cellSize > 0, 1, "cell size must be positive");
+    ClayCanvas *c = (ClayCanvas*)lua_newuserdata(L, sizeof(ClayCanvas));
+    memset(c, 0, sizeof(*c));
+    c->cellSize = cellSize;
+    c->zoom = 1;
+    c->text = (Clay_TextElementConfig){ .textColor = {255,255,255,255}, .fontId = 1, .fontSize = 14,
+                                        .wrapMode = CLAY_TEXT_WRAP_NONE };
+    c->minLabelSize = 6;
+    luaL_setmetatable(L, "ClayCanvas");
+    return 1;
+}
+
+static int32_t check_canvas_item(lua_State *L, ClayCanvas *c, int idx) {
+    lua_Integer n = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, n >= 1 && n <= c->itemCount && c->items[n - 1].alive, idx, "no such item");
+    return (int32_t)(n - 1);
+}
+
+// Apply the fields of the item table at `tbl` (absent fields keep their value).
+static int clay_canvas_read_item(lua_State *L, ClayCanvas *c, int tbl, ClayCanvasItem *it) {
+    it->x = clay_opt_number_field(L, tbl, "x", it->x);
+    it->y = clay_opt_number_field(L, tbl, "y", it->y);
+    it->w = clay_opt_number_field(L, tbl, "w", it->w);
+    it->h = clay_opt_number_field(L, tbl, "h", it->h);
+    if (it->w < 0) it->w = 0;
+    if (it->h < 0) it->h = 0;
+    it->cornerRadius = clay_opt_number_field(L, tbl, "radius", it->cornerRadius);
+    clay_opt_color_field(L, tbl, "color", &it->color);
+    lua_getfield(L, tbl, "label");
+    if (lua_type(L, -1) == LUA_TSTRING || lua_type(L, -1) == LUA_TBOOLEAN) {
+        size_t len = 0;
+        const char *label = lua_type(L, -1) == LUA_TSTRING ? lua_tolstring(L, -1, &len) : "";
+        if ((size_t)it->labelLength >= len) {
+            memcpy(c->labels + it->labelOffset, label, len);    // shrink in place
+        } else {
+            if (len > 0x7fffffffu - c->labelUsed) { lua_pop(L, 1); return 0; }
+            if (c->labelUsed + len > c->labelCapacity) {
+                uint32_t cap = c->labelCapacity ? c->labelCapacity : 256;
+                while (cap < c->labelUsed + len) cap *= 2;
+                char *grown = (char*)realloc(c->labels, cap);
+                if (!grown) { lua_pop(L, 1); return 0; }
+                c->labels = grown;
+                c->labelCapacity = cap;
+            }
+            memcpy(c->labels + c->labelUsed, label, len);
+            it->labelOffset = c->labelUsed;
+            c->labelUsed += (uint32_t)len;
+        }
+        c->labelLive += (uint32_t)len - (uint32_t)it->labelLength;
+        it->labelLength = (int32_t)len;
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, tbl, "image");          // false removes the image
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+    } else {
+        clay_canvas_release_ref(L, it->imageRef);
+        it->imageRef = LUA_NOREF;
+        if (lua_type(L, -1) == LUA_TBOOLEAN) lua_pop(L, 1);
+        else it->imageRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    return 1;
+}
+
+// Rewrite the label pool with only the live labels once more than half of it is garbage.
+// Emitted labels are copied into the frame arena, so nothing else points into the pool.
+static void clay_canvas_labels_compact(ClayCanvas *c) {
+    if (c->labelUsed < 4096 || c->labelLive * 2 > c->labelUsed) return;
+    uint32_t cap = c->labelLive + 256;
+    char *pool = (char*)malloc(cap);
+    if (!pool) return;
+    uint32_t used = 0;
+    for (int32_t i = 0; i < c->itemCount; ++i) {
+        ClayCanvasItem *it = &c->items[i];
+        if (!it->alive || it->labelLength == 0) continue;
+        memcpy(pool + used, c->labels + it->labelOffset, (size_t)it->labelLength);
+        it->labelOffset = used;
+        used += (uint32_t)it->labelLength;
+    }
+    free(c->labels);
+    c->labels = pool;
+    c->labelUsed = used;
+    c->labelCapacity = cap;
+}
+
+// canvas:add{ x=, y=, w=, h=, color=, radius=, label=, image= } -> item
+static int l_Canvas_add(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int32_t n;
+    if (c->freeCount > 0) {
+        n = c->freeItems[--c->freeCount];
+    } else {
+        if (!clay_array_reserve((void**)&c->items, &c->itemCapacity, c->itemCount + 1, sizeof(ClayCanvasItem))) {
+            return luaL_error(L, "canvas:add: out of memory");
+        }
+        n = c->itemCount++;
+    }
+    ClayCanvasItem *it = &c->items[n];
+    memset(it, 0, sizeof(*it));
+    it->color = (Clay_Color){255,255,255,255};
+    it->imageRef = LUA_NOREF;
+    it->seq = c->nextSeq++;
+    it->alive = 1;
+    c->liveCount++;
+    if (!clay_canvas_read_item(L, c, 2, it) || !clay_canvas_index(c, n)) {
+        return luaL_error(L, "canvas:add: out of memory");
+    }
+    lua_pushinteger(L, n + 1);
+    return 1;
+}
+
+// canvas:update(item, { fields to change })
+static int l_Canvas_update(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    int32_t n = check_canvas_item(L, c, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    clay_canvas_unindex(c, n);
+    int ok = clay_canvas_read_item(L, c, 3, &c->items[n]);
+    if (!clay_canvas_index(c, n) || !ok) return luaL_error(L, "canvas:update: out of memory");
+    clay_canvas_labels_compact(c);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Canvas_remove(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    int32_t n = check_canvas_item(L, c, 2);
+    clay_canvas_unindex(c, n);
+    clay_canvas_release_ref(L, c->items[n].imageRef);
+    c->items[n].imageRef = LUA_NOREF;
+    c->items[n].alive = 0;
+    c->liveCount--;
+    c->labelLive -= (uint32_t)c->items[n].labelLength;
+    c->items[n].labelLength = 0;
+    clay_canvas_labels_compact(c);
+    if (clay_array_reserve((void**)&c->freeItems, &c->freeCapacity, c->freeCount + 1, sizeof(int32_t))) {
+        c->freeItems[c->freeCount++] = n;
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Canvas_clear(lua_State *L) {
+    clay_canvas_clear_items(L, check_canvas(L, 1));
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Canvas_count(lua_State *L) {
+    lua_pushinteger(L, check_canvas(L, 1)->liveCount);
+    return 1;
+}
+
+// canvas:bounds(item) -> x, y, w, h   (world space)
+static int l_Canvas_bounds(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    ClayCanvasItem *it = &c->items[check_canvas_item(L, c, 2)];
+    lua_pushnumber(L, it->x);
+    lua_pushnumber(L, it->y);
+    lua_pushnumber(L, it->w);
+    lua_pushnumber(L, it->h);
+    return 4;
+}
+
+// canvas:query(x0, y0, x1, y1) -> { item, ... }   (world rectangle, drawing order)
+static int l_Canvas_query(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    float x0 = (float)luaL_checknumber(L, 2), y0 = (float)luaL_checknumber(L, 3);
+    float x1 = (float)luaL_checknumber(L, 4), y1 = (float)luaL_checknumber(L, 5);
+    clay_canvas_query(c, fminf(x0, x1), fminf(y0, y1), fmaxf(x0, x1), fmaxf(y0, y1));
+    lua_createtable(L, c->foundCount, 0);
+    for (int32_t i = 0; i < c->foundCount; ++i) {
+        lua_pushinteger(L, c->found[i] + 1);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// canvas:setView(panX, panY [, zoom])   (pan: world point shown at the element's top-left)
+static int l_Canvas_setView(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    c->panX = (float)luaL_checknumber(L, 2);
+    c->panY = (float)luaL_checknumber(L, 3);
+    float zoom = (float)luaL_optnumber(L, 4, c->zoom);
+    luaL_argcheck(L, zoom > 0, 4, "zoom must be positive");
+    c->zoom = zoom;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Canvas_view(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    lua_pushnumber(L, c->panX);
+    lua_pushnumber(L, c->panY);
+    lua_pushnumber(L, c->zoom);
+    return 3;
+}
+
+// canvas:pan(dx, dy)   (screen pixels; dragging the content right moves the view left)
+static int l_Canvas_pan(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    c->panX -= (float)luaL_checknumber(L, 2) / c->zoom;
+    c->panY -= (float)luaL_checknumber(L, 3) / c->zoom;
+    lua_settop(L, 1);
+    return 1;
+}
+
+// The element's top-left corner on screen, from the last layout.
+static Clay_Vector2 clay_canvas_origin(ClayCanvas *c) {
+    if (!c->id.id) return (Clay_Vector2){0, 0};
+    Clay_ElementData data = Clay_GetElementData(c->id);
+    return data.found ? (Clay_Vector2){ data.boundingBox.x, data.boundingBox.y } : (Clay_Vector2){0, 0};
+}
+
+// canvas:zoomAt(x, y, factor)   (keeps the world point under screen point x, y in place)
+static int l_Canvas_zoomAt(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    float x = (float)luaL_checknumber(L, 2), y = (float)luaL_checknumber(L, 3);
+    float factor = (float)luaL_checknumber(L, 4);
+    luaL_argcheck(L, factor > 0, 4, "factor must be positive");
+    Clay_Vector2 o = clay_canvas_origin(c);
+    float wx = c->panX + (x - o.x) / c->zoom, wy = c->panY + (y - o.y) / c->zoom;
+    c->zoom *= factor;
+    c->panX = wx - (x - o.x) / c->zoom;
+    c->panY = wy - (y - o.y) / c->zoom;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Canvas_toWorld(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    Clay_Vector2 o = clay_canvas_origin(c);
+    lua_pushnumber(L, c->panX + ((float)luaL_checknumber(L, 2) - o.x) / c->zoom);
+    lua_pushnumber(L, c->panY + ((float)luaL_checknumber(L, 3) - o.y) / c->zoom);
+    return 2;
+}
+
+static int l_Canvas_toScreen(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    Clay_Vector2 o = clay_canvas_origin(c);
+    lua_pushnumber(L, o.x + ((float)luaL_checknumber(L, 2) - c->panX) * c->zoom);
+    lua_pushnumber(L, o.y + ((float)luaL_checknumber(L, 3) - c->panY) * c->zoom);
+    return 2;
+}
+
+// canvas:hitTest(x, y) -> item | nil   (screen point; the topmost item under it)
+static int l_Canvas_hitTest(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    float x = (float)luaL_checknumber(L, 2), y = (float)luaL_checknumber(L, 3);
+    if (!c->id.id) return 0;
+    Clay_ElementData data = Clay_GetElementData(c->id);
+    if (!data.found) return 0;
+    Clay_BoundingBox b = data.boundingBox;
+    if (x < b.x || x >= b.x + b.width || y < b.y || y >= b.y + b.height) return 0;
+    float wx = c->panX + (x - b.x) / c->zoom, wy = c->panY + (y - b.y) / c->zoom;
+    clay_canvas_query(c, wx, wy, wx, wy);
+    if (c->foundCount == 0) return 0;
+    lua_pushinteger(L, c->found[c->foundCount - 1] + 1);
+    return 1;
+}
+
+// canvas:setStyle{ fontId, fontSize, textColor, minLabelSize }   (label size is scaled by zoom)
+static int l_Canvas_setStyle(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    c->text.fontId = (uint16_t)clay_opt_number_field(L, 2, "fontId", c->text.fontId);
+    c->text.fontSize = (uint16_t)clay_opt_number_field(L, 2, "fontSize", c->text.fontSize);
+    clay_opt_color_field(L, 2, "textColor", &c->text.textColor);
+    c->minLabelSize = clay_opt_number_field(L, 2, "minLabelSize", c->minLabelSize);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static void clay_canvas_emit(lua_State *L, ClayCanvas *c, Clay_ElementId id) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    c->id = id;
+    Clay_ElementData prev = Clay_GetElementData(id);
+    float viewW = prev.found ? prev.boundingBox.width : ctx->layoutDimensions.width;
+    float viewH = prev.found ? prev.boundingBox.height : ctx->layoutDimensions.height;
+
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.sizing.width.type = CLAY__SIZING_TYPE_GROW;
+    decl.layout.sizing.height.type = CLAY__SIZING_TYPE_GROW;
+    decl.clip.horizontal = true;
+    decl.clip.vertical = true;
+    Clay__OpenElementWithId(id);
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+    Clay__CloseElement();
+    if (g_MeasureDepth) return;
+
+    clay_canvas_query(c, c->panX, c->panY, c->panX + viewW / c->zoom, c->panY + viewH / c->zoom);
+    if (c->foundCount == 0) return;
+    if (!clay_array_reserve((void**)&g_CanvasFrames, &g_CanvasFrameCapacity, g_CanvasFrameCount + 1, sizeof(ClayCanvasFrame))) return;
+    ClayCanvasFrame *f = &g_CanvasFrames[g_CanvasFrameCount];
+    memset(f, 0, sizeof(*f));
+    f->elementId = id.id;
+    f->canvas = c;
+    f->count = c->foundCount;
+    f->items = (int32_t*)clay_frame_alloc(sizeof(int32_t) * (size_t)f->count);
+    f->images = (void**)clay_frame_alloc(sizeof(void*) * (size_t)f->count);
+    f->labels = (Clay_String*)clay_frame_alloc(sizeof(Clay_String) * (size_t)f->count);
+    f->labelSizes = (Clay_Dimensions*)clay_frame_alloc(sizeof(Clay_Dimensions) * (size_t)f->count);
+    if (!f->items || !f->images || !f->labels || !f->labelSizes) return;
+    memcpy(f->items, c->found, sizeof(int32_t) * (size_t)f->count);
+
+    f->text = c->text;
+    f->text.fontSize = (uint16_t)fminf(65535.0f, (float)c->text.fontSize * c->zoom + 0.5f);
+    int labels = (float)f->text.fontSize >= c->minLabelSize;
+    float labelHeight = labels ? clay_text_row_height(&f->text) : 0;
+    for (int32_t i = 0; i < f->count; ++i) {
+        ClayCanvasItem *it = &c->items[f->items[i]];
+        f->images[i] = NULL;
+        f->labels[i] = (Clay_String){0};
+        f->commandCount++;                              // rectangle or image
+        if (it->imageRef != LUA_NOREF) {
+            // Lightuserdata (atlas handles, texture pointers) pass through as is; other values
+            // lend the item's own ref, which cmd:imageData() reads without releasing.
+            lua_rawgeti(L, LUA_REGISTRYINDEX, it->imageRef);
+            if (lua_islightuserdata(L, -1)) {
+                f->images[i] = lua_touserdata(L, -1);
+            } else {
+                f->images[i] = clay_tag_from_ref(it->imageRef);
+                clay_u32map_put(&g_CanvasLentRefs, (uint32_t)it->imageRef, 1);
+            }
+            lua_pop(L, 1);
+        }
+        if (labels && it->labelLength > 0) {
+            f->labels[i] = clay_frame_string(c->labels + it->labelOffset, it->labelLength);
+            if (!f->labels[i].chars) continue;
+            f->labelSizes[i] = (Clay_Dimensions){ clay_measure_slice(f->labels[i].chars, f->labels[i].length, &f->text), labelHeight };
+            f->commandCount++;
+        }
+    }
+    clay_frame_anchor(L, 1);
+    g_CanvasFrameCount++;
+}
+
+// Splice the items of every canvas declared this frame into the render commands, just
+// before each canvas' SCISSOR_END. The new array lives in the frame arena. A canvas that
+// Clay culled has no scissor, and its items are left out with it.
+static void clay_canvas_apply(Clay_RenderCommandArray *arr) {
+    if (g_CanvasFrameCount == 0) return;
+    int64_t extra = 0;
+    for (int32_t i = 0; i < g_CanvasFrameCount; ++i) extra += g_CanvasFrames[i].commandCount;
+    if (extra == 0 || arr->length + extra > INT32_MAX) return;
+    int32_t total = arr->length + (int32_t)extra;
+    Clay_RenderCommand *out = (Clay_RenderCommand*)clay_frame_alloc(sizeof(Clay_RenderCommand) * (size_t)total);
+    if (!out) return;
+
+    int32_t k = 0;
+    for (int32_t i = 0; i < arr->length; ++i) {
+        Clay_RenderCommand *cmd = &arr->internalArray[i];
+        if (cmd->commandType == CLAY_RENDER_COMMAND_TYPE_SCISSOR_END) {
+            for (int32_t fi = 0; fi < g_CanvasFrameCount; ++fi) {
+                ClayCanvasFrame *f = &g_CanvasFrames[fi];
+                if (f->elementId != cmd->id || f->commandCount == 0) continue;
+                ClayCanvas *c = f->canvas;
+                Clay_LayoutElementHashMapItem *item = Clay__GetHashMapItem(f->elementId);
+                Clay_BoundingBox box = item->boundingBox;
+                float z = c->zoom;
+                for (int32_t j = 0; j < f->count; ++j) {
+                    ClayCanvasItem *it = &c->items[f->items[j]];
+                    Clay_BoundingBox r = { box.x + (it->x - c->panX) * z, box.y + (it->y - c->panY) * z, it->w * z, it->h * z };
+                    float radius = it->cornerRadius * z;
+                    Clay_CornerRadius corners = { radius, radius, radius, radius };
+                    Clay_RenderCommand rc = { .boundingBox = r, .id = Clay__HashNumber((uint32_t)f->items[j], f->elementId).id,
+                                              .zIndex = cmd->zIndex };
+                    if (f->images[j]) {
+                        rc.commandType = CLAY_RENDER_COMMAND_TYPE_IMAGE;
+                        rc.renderData.image = (Clay_ImageRenderData){ it->color, corners, f->images[j] };
+                    } else {
+                        rc.commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE;
+                        rc.renderData.rectangle = (Clay_RectangleRenderData){ it->color, corners };
+                    }
+                    out[k++] = rc;
+                    if (!f->labels[j].chars) continue;
+                    Clay_Dimensions d = f->labelSizes[j];
+                    Clay_RenderCommand tc = rc;
+                    tc.commandType = CLAY_RENDER_COMMAND_TYPE_TEXT;
+                    tc.boundingBox = (Clay_BoundingBox){ r.x + (r.width - d.width) * 0.5f, r.y + (r.height - d.height) * 0.5f, d.width, d.height };
+                    tc.renderData.text = (Clay_TextRenderData){
+                        .stringContents = { f->labels[j].length, f->labels[j].chars, f->labels[j].chars },
+                        .textColor = f->text.textColor, .fontId = f->text.fontId, .fontSize = f->text.fontSize,
+                        .letterSpacing = f->text.letterSpacing, .lineHeight = f->text.lineHeight,
+                    };
+                    out[k++] = tc;
+                }
+                f->commandCount = 0;
+            }
+        }
+        out[k++] = *cmd;
+    }
+    arr->internalArray = out;
+    arr->length = k;
+    arr->capacity = total;
+}
+
+// A bounds transition moves an ancestor of the canvas: its spliced items move with it.
+static void clay_canvas_flip_offset(uint32_t elementId, float dx, float dy) {
+    for (int32_t fi = 0; fi < g_CanvasFrameCount; ++fi) {
+        const ClayCanvasFrame *f = &g_CanvasFrames[fi];
+        if (f->elementId != elementId || !f->items) continue;
+        for (int32_t j = 0; j < f->count; ++j) {
+            ClayFlipOffset *o = clay_flip_offset_for(Clay__HashNumber((uint32_t)f->items[j], elementId).id);
+            if (o) { o->dx += dx; o->dy += dy; }
+        }
+    }
+}
+
+// canvas:emit(id...)   (GROW x GROW clipped element; id as for clay.id)
+static int l_Canvas_emit(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || ctx->openLayoutElementStack.length < 1) {
+        return luaL_error(L, "canvas:emit() must be called during a layout pass");
+    }
+    clay_canvas_emit(L, c, clay_element_id_from_args(L, 2));
+    return 0;
+}
+
+static int l_Canvas_gc(lua_State *L) {
+    ClayCanvas *c = check_canvas(L, 1);
+    clay_canvas_clear_items(L, c);
+    free(c->items);
+    free(c->freeItems);
+    free(c->labels);
+    free(c->cells);
+    free(c->oversized.items);
+    free(c->found);
+    clay_u32map_free(&c->cellIndex);
+    memset(c, 0, sizeof(*c));
+    return 0;
+}
+
+static void Clay_CreateCanvasMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayCanvas")) {
+        lua_pushcfunction(L, l_Canvas_add); lua_setfield(L, -2, "add");
+        lua_pushcfunction(L, l_Canvas_update); lua_setfield(L, -2, "update");
+        lua_pushcfunction(L, l_Canvas_remove); lua_setfield(L, -2, "remove");
+        lua_pushcfunction(L, l_Canvas_clear); lua_setfield(L, -2, "clear");
+        lua_pushcfunction(L, l_Canvas_count); lua_setfield(L, -2, "count");
+        lua_pushcfunction(L, l_Canvas_bounds); lua_setfield(L, -2, "bounds");
+        lua_pushcfunction(L, l_Canvas_query); lua_setfield(L, -2, "query");
+        lua_pushcfunction(L, l_Canvas_setView); lua_setfield(L, -2, "setView");
+        lua_pushcfunction(L, l_Canvas_view); lua_setfield(L, -2, "view");
+        lua_pushcfunction(L, l_Canvas_pan); lua_setfield(L, -2, "pan");
+        lua_pushcfunction(L, l_Canvas_zoomAt); lua_setfield(L, -2, "zoomAt");
+        lua_pushcfunction(L, l_Canvas_toWorld); lua_setfield(L, -2, "toWorld");
+        lua_pushcfunction(L, l_Canvas_toScreen); lua_setfield(L, -2, "toScreen");
+        lua_pushcfunction(L, l_Canvas_hitTest); lua_setfield(L, -2, "hitTest");
+        lua_pushcfunction(L, l_Canvas_setStyle); lua_setfield(L, -2, "setStyle");
+        lua_pushcfunction(L, l_Canvas_emit); lua_setfield(L, -2, "emit");
+        lua_pushcfunction(L, l_Canvas_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Texture atlas
+//
+// clay.atlas(pageWidth, pageHeight [, padding]) packs image rectangles into pages with a
+// skyline bottom-left packer. atlas:add(w, h) returns a handle to use as an element's
+// imageData. Handles are lightuserdata tagged with bit 1, next to the bit-0 registry-ref
+// tag, so render commands that draw atlased images can be recognised without touching
+// Lua. cmd:atlas() returns their page and UV rectangle. Placements of a cleared or
+// collected atlas are recycled; a handle carries its slot's generation, so old handles
+// stop resolving once their slot is reused.
+// -----------------------------------------------------------------------------
+
+#define CLAY_ATLAS_SLOT_BITS 24                 // handle = generation << 24 | slot (1-based)
+#define CLAY_ATLAS_SLOT_MASK ((1u << CLAY_ATLAS_SLOT_BITS) - 1u)
+#define CLAY_ATLAS_GENERATION_MASK 63u          // what is left of 30 bits after the tag
+
+typedef struct {
+    int32_t x, y, width;
+} ClaySkylineNode;
+
+typedef struct {
+    ClaySkylineNode *nodes;
+    int32_t count, capacity;
+} ClayAtlasPage;
+
+typedef struct ClayAtlas {
+    int32_t pageWidth, pageHeight;
+    int32_t padding;
+    ClayAtlasPage *pages;
+    int32_t pageCount, pageCapacity;
+    int32_t *handles;           // slots of the placements owned by this atlas
+    int32_t handleCount, handleCapacity;
+} ClayAtlas;
+
+typedef struct {
+    ClayAtlas *atlas;           // NULL once released
+    int32_t page;               // 0-based
+    int32_t x, y, w, h;
+    uint32_t generation;        // bumped on release
+} ClayAtlasPlacement;
+
+static ClayAtlasPlacement *g_AtlasPlacements = NULL;   // slot n is g_AtlasPlacements[n - 1]
+static int32_t g_AtlasPlacementCount = 0;
+static int32_t g_AtlasPlacementCapacity = 0;
+static int32_t *g_AtlasFreeSlots = NULL;                // released slots, reused by add
+static int32_t g_AtlasFreeCount = 0;
+static int32_t g_AtlasFreeCapacity = 0;
+
+static inline int clay_is_atlas_tag(const void *p) {
+    return ((uintptr_t)p & (uintptr_t)3u) == 2u;
+}
+
+static inline void* clay_tag_from_atlas(int32_t handle) {
+    return (void*)(((uintptr_t)(uint32_t)handle << 2) | 2u);
+}
+
+static const ClayAtlasPlacement* clay_atlas_placement(const void *p) {
+    if (!clay_is_atlas_tag(p)) return NULL;
+    uintptr_t h = (uintptr_t)p >> 2;
+    uintptr_t n = h & CLAY_ATLAS_SLOT_MASK;
+    if (n < 1 || n > (uintptr_t)g_AtlasPlacementCount) return NULL;
+    const ClayAtlasPlacement *pl = &g_AtlasPlacements[n - 1];
+    return pl->atlas && pl->generation == ((h >> CLAY_ATLAS_SLOT_BITS) & CLAY_ATLAS_GENERATION_MASK) ? pl : NULL;
+}
+
+static ClayAtlas* check_atlas(lua_State *L, int idx) {
+    return (ClayAtlas*)luaL_checkudata(L, idx, "ClayAtlas");
+}
+
+static int clay_atlas_new_page(ClayAtlas *a) {
+    if (!clay_array_reserve((void**)&a->pages, &a->pageCapacity, a->pageCount + 1, sizeof(ClayAtlasPage))) return 0;
+    ClayAtlasPage *pg = &a->pages[a->pageCount];
+    *pg = (ClayAtlasPage){0};
+    if (!clay_array_reserve((void**)&pg->nodes, &pg->capacity, 1, sizeof(ClaySkylineNode))) return 0;
+    pg->nodes[0] = (ClaySkylineNode){ 0, 0, a->pageWidth };
+    pg->count = 1;
+    a->pageCount++;
+    return 1;
+}
+
+// Lowest y at which a w x h rectangle fits with its left edge at node i; -1 if it doesn't.
+static int32_t clay_skyline_fit(const ClayAtlas *a, const ClayAtlasPage *pg, int32_t i, int32_t w, int32_t h) {
+    int32_t x = pg->nodes[i].x;
+    if (x + w > a->pageWidth) return -1;
+    int32_t y = 0, left = w;
+    for (int32_t j = i; left > 0; ++j) {
+        if (j >= pg->count) return -1;
+        if (pg->nodes[j].y > y) y = pg->nodes[j].y;
+        if (y + h > a->pageHeight) return -1;
+        left -= pg->nodes[j].width;
+    }
+    return y;
+}
+
+// Place w x h on the page, bottom-left rule; returns 0 if it doesn't fit.
+static int clay_skyline_insert(const ClayAtlas *a, ClayAtlasPage *pg, int32_t w, int32_t h, int32_t *outX, int32_t *outY) {
+    int32_t best = -1, bestY = INT32_MAX, bestWidth = INT32_MAX;
+    for (int32_t i = 0; i < pg->count; ++i) {
+        int32_t y = clay_skyline_fit(a, pg, i, w, h);
+        if (y < 0) continue;
+        if (y + h < bestY || (y + h == bestY && pg->nodes[i].width < bestWidth)) {
+            best = i;
+            bestY = y + h;
+            bestWidth = pg->nodes[i].width;
+        }
+    }
+    if (best < 0) return 0;
+    if (!clay_array_reserve((void**)&pg->nodes, &pg->capacity, pg->count + 1, sizeof(ClaySkylineNode))) return 0;
+    int32_t x = pg->nodes[best].x;
+    *outX = x;
+    *outY = bestY - h;
+
+    memmove(&pg->nodes[best + 1], &pg->nodes[best], sizeof(ClaySkylineNode) * (size_t)(pg->count - best));
+    pg->nodes[best] = (ClaySkylineNode){ x, bestY, w };
+    pg->count++;
+    // Trim the nodes now covered by the new one.
+    for (int32_t i = best + 1; i < pg->count; ) {
+        ClaySkylineNode *n = &pg->nodes[i];
+        int32_t covered = x + w - n->x;
+        if (covered <= 0) break;
+        if (covered < n->width) {
+            n->x += covered;
+            n->width -= covered;
+            break;
+        }
+        memmove(n, n + 1, sizeof(ClaySkylineNode) * (size_t)(pg->count - i - 1));
+        pg->count--;
+    }
+    // Merge neighbours at the same height.
+    for (int32_t i = 0; i + 1 < pg->count; ) {
+        if (pg->nodes[i].y == pg->nodes[i + 1].y) {
+            pg->nodes[i].width += pg->nodes[i + 1].width;
+            memmove(&pg->nodes[i + 1], &pg->nodes[i + 2], sizeof(ClaySkylineNode) * (size_t)(pg->count - i - 2));
+            pg->count--;
+        } else {
+            i++;
+        }
+    }
+    return 1;
+}
+
+// Pack one image; returns its handle, 0 if it can never fit, -1 when out of memory.
+static int32_t clay_atlas_add(ClayAtlas *a, int32_t w, int32_t h) {
+    int32_t pw = w + a->padding, ph = h + a->padding;
+    if (pw > a->pageWidth || ph > a->pageHeight) return 0;
+    int32_t page = -1, x = 0, y = 0;
+    for (int32_t p = 0; p < a->pageCount && page < 0; ++p) {
+        if (clay_skyline_insert(a, &a->pages[p], pw, ph, &x, &y)) page = p;
+    }
+    if (page < 0) {
+        if (!clay_atlas_new_page(a) || !clay_skyline_insert(a, &a->pages[a->pageCount - 1], pw, ph, &x, &y)) return -1;
+        page = a->pageCount - 1;
+    }
+    if (!clay_array_reserve((void**)&a->handles, &a->handleCapacity, a->handleCount + 1, sizeof(int32_t))) return -1;
+    int32_t n;
+    if (g_AtlasFreeCount > 0) {
+        n = g_AtlasFreeSlots[--g_AtlasFreeCount];
+    } else {
+        if ((uint32_t)g_AtlasPlacementCount >= CLAY_ATLAS_SLOT_MASK ||
+            !clay_array_reserve((void**)&g_AtlasPlacements, &g_AtlasPlacementCapacity, g_AtlasPlacementCount + 1, sizeof(ClayAtlasPlacement))) {
+            return -1;
+        }
+        g_AtlasPlacements[g_AtlasPlacementCount] = (ClayAtlasPlacement){0};
+        n = ++g_AtlasPlacementCount;
+    }
+    ClayAtlasPlacement *pl = &g_AtlasPlacements[n - 1];
+    *pl = (ClayAtlasPlacement){ a, page, x, y, w, h, pl->generation };
+    a->handles[a->handleCount++] = n;
+    return (int32_t)(pl->generation << CLAY_ATLAS_SLOT_BITS | (uint32_t)n);
+}
+
+static void clay_atlas_release(ClayAtlas *a) {
+    for (int32_t i = 0; i < a->handleCount; ++i) {
+        int32_t n = a->handles[i];
+        ClayAtlasPlacement *pl = &g_AtlasPlacements[n - 1];
+        pl->atlas = NULL;
+        pl->generation = (pl->generation + 1) & CLAY_ATLAS_GENERATION_MASK;
+        // a slot that can't be listed as free is simply never reused
+        if (clay_array_reserve((void**)&g_AtlasFreeSlots, &g_AtlasFreeCapacity, g_AtlasFreeCount + 1, sizeof(int32_t))) {
+            g_AtlasFreeSlots[g_AtlasFreeCount++] = n;
+        }
+    }
+    a->handleCount = 0;
+    for (int32_t p = 0; p < a->pageCount; ++p) free(a->pages[p].nodes);
+    a->pageCount = 0;
+}
+
+// clay.atlas(pageWidth, pageHeight [, padding])
+static int l_Clay_Atlas_New(lua_State *L) {
+    lua_Integer w = luaL_checkinteger(L, 1), h = luaL_checkinteger(L, 2);
+    lua_Integer padding = luaL_optinteger(L, 3, 1);
+    luaL_argcheck(L, w > 0 && w <= 65536, 1, "page width out of range");
+    luaL_argcheck(L, h > 0 && h <= 65536, 2, "page height out of range");
+    luaL_argcheck(L, padding >= 0 && padding < 256, 3, "padding out of range");
+    ClayAtlas *a = (ClayAtlas*)lua_newuserdata(L, sizeof(ClayAtlas));
+    memset(a, 0, sizeof(*a));
+    a->pageWidth = (int32_t)w;
+    a->pageHeight = (int32_t)h;
+    a->padding = (int32_t)padding;
+    luaL_setmetatable(L, "ClayAtlas");
+    return 1;
+}
+
+// atlas:add(w, h) -> handle, page, x, y   (nil if the image is larger than a page)
+static int l_Atlas_add(lua_State *L) {
+    ClayAtlas *a = check_atlas(L, 1);
+    lua_Integer w = luaL_checkinteger(L, 2), h = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, w > 0 && w <= 65536, 2, "width out of range");
+    luaL_argcheck(L, h > 0 && h <= 65536, 3, "height out of range");
+    int32_t n = clay_atlas_add(a, (int32_t)w, (int32_t)h);
+    if (n < 0) return luaL_error(L, "atlas:add: out of memory");
+    if (n == 0) return 0;
+    const ClayAtlasPlacement *pl = clay_atlas_placement(clay_tag_from_atlas(n));
+    lua_pushlightuserdata(L, clay_tag_from_atlas(n));
+    lua_pushinteger(L, pl->page + 1);
+    lua_pushinteger(L, pl->x);
+    lua_pushinteger(L, pl->y);
+    return 4;
+}
+
+static int clay_cmp_atlas_order(const void *pa, const void *pb) {
+    const int32_t *a = (const int32_t*)pa, *b = (const int32_t*)pb;   // { index, w, h }
+    if (a[2] != b[2]) return a[2] > b[2] ? -1 : 1;
+    if (a[1] != b[1]) return a[1] > b[1] ? -1 : 1;
+    return a[0] < b[0] ? -1 : a[0] > b[0];
+}
+
+// atlas:addMany({ w1, h1, w2, h2, ... }) -> { handle | false, ... }
+// Packs tallest first, which fills pages better than arrival order.
+static int l_Atlas_addMany(lua_State *L) {
+    ClayAtlas *a = check_atlas(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int32_t count = (int32_t)(clay_rawlen(L, 2) / 2);
+    int32_t *order = (int32_t*)malloc(sizeof(int32_t) * 3 * (size_t)(count > 0 ? count : 1));
+    if (!order) return luaL_error(L, "atlas:addMany: out of memory");
+    for (int32_t i = 0; i < count; ++i) {
+        lua_rawgeti(L, 2, 2 * i + 1);
+        lua_rawgeti(L, 2, 2 * i + 2);
+        order[3 * i] = i;
+        order[3 * i + 1] = (int32_t)lua_tointeger(L, -2);
+        order[3 * i + 2] = (int32_t)lua_tointeger(L, -1);
+        lua_pop(L, 2);
+    }
+    qsort(order, (size_t)count, sizeof(int32_t) * 3, clay_cmp_atlas_order);
+    lua_createtable(L, count, 0);
+    for (int32_t i = 0; i < count; ++i) {
+        int32_t w = order[3 * i + 1], h = order[3 * i + 2];
+        int32_t n = w > 0 && h > 0 && w <= 65536 && h <= 65536 ? clay_atlas_add(a, w, h) : 0;
+        if (n < 0) {
+            free(order);
+            return luaL_error(L, "atlas:addMany: out of memory");
+        }
+        if (n > 0) lua_pushlightuserdata(L, clay_tag_from_atlas(n));
+        else lua_pushboolean(L, 0);
+        lua_rawseti(L, -2, order[3 * i] + 1);
+    }
+    free(order);
+    return 1;
+}
+
+// atlas:placement(handle) -> page, x, y, w, h   (nil for handles of other or cleared atlases)
+static int l_Atlas_placement(lua_State *L) {
+    ClayAtlas *a = check_atlas(L, 1);
+    const ClayAtlasPlacement *pl = clay_atlas_placement(lua_touserdata(L, 2));
+    if (!pl || pl->atlas != a) return 0;
+    lua_pushinteger(L, pl->page + 1);
+    lua_pushinteger(L, pl->x);
+    lua_pushinteger(L, pl->y);
+    lua_pushinteger(L, pl->w);
+    lua_pushinteger(L, pl->h);
+    return 5;
+}
+
+static int l_Atlas_pageCount(lua_State *L) {
+    lua_pushinteger(L, check_atlas(L, 1)->pageCount);
+    return 1;
+}
+
+// atlas:clear()   (empties every page; existing handles stop resolving)
+static int l_Atlas_clear(lua_State *L) {
+    clay_atlas_release(check_atlas(L, 1));
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int l_Atlas_gc(lua_State *L) {
+    ClayAtlas *a = check_atlas(L, 1);
+    clay_atlas_release(a);
+    free(a->pages);
+    free(a->handles);
+    memset(a, 0, sizeof(*a));
+    return 0;
+}
+
+static void Clay_CreateAtlasMetatable(lua_State *L) {
+    if (luaL_newmetatable(L, "ClayAtlas")) {
+        lua_pushcfunction(L, l_Atlas_add); lua_setfield(L, -2, "add");
+        lua_pushcfunction(L, l_Atlas_addMany); lua_setfield(L, -2, "addMany");
+        lua_pushcfunction(L, l_Atlas_placement); lua_setfield(L, -2, "placement");
+        lua_pushcfunction(L, l_Atlas_pageCount); lua_setfield(L, -2, "pageCount");
+        lua_pushcfunction(L, l_Atlas_clear); lua_setfield(L, -2, "clear");
+        lua_pushcfunction(L, l_Atlas_gc); lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Kinetic scrolling
+//
+// clay.setScrollPhysics(id, opts) hands a scroll container to a C controller. The
+// controller handles drag, momentum with friction, rubber-band overscroll that springs
+// back, and snap points. clay.scrollTo(id, target, duration) eases a container to bring
+// an element (or a content offset) into view. The controller runs inside
+// clay.updateScrollContainers(). It writes the same internal scroll position that
+// clay.setScrollOffset() does, and undoes Clay's own drag and momentum for the
+// containers it owns.
+// -----------------------------------------------------------------------------
+
+#define CLAY_SCROLL_SETTLE_DISTANCE 0.5f
+#define CLAY_SCROLL_SETTLE_SPEED 10.0f
+#define CLAY_SCROLL_WHEEL_IDLE 0.15f     // seconds after the last wheel step before snapping
+
+typedef struct {
+    float pos, vel;
+    float target;               // spring target while hasTarget
+    uint8_t hasTarget;
+} ClayScrollAxis;
+
+typedef struct {
+    uint32_t elementId;
+    float friction;             // velocity decay rate, 1/s
+    float stiffness;            // spring constant for spring-back and snapping, 1/s^2
+    float snapInterval;         // > 0: snap to multiples of this
+    uint8_t snapChildren;       // snap so a child lines up where the first child rests
+    uint8_t overscroll;         // rubber-band past the ends
+    uint8_t dragging;
+    uint8_t tweening;
+    uint8_t tweenOnly;          // created by scrollTo() alone: dropped when the tween ends
+    ClayScrollAxis axis[2];
+    Clay_Vector2 dragPointer;
+    float dragStart[2];
+    float idle;                 // seconds since the last wheel or drag input
+    float tweenFrom[2], tweenTo[2];
+    float tweenElapsed, tweenDuration;
+    Clay_Vector2 written;       // position the controller last wrote
+    Clay_Vector2 layoutPosition;    // scroll position the last layout used
+    float *childOffsets;        // x, y pairs relative to the first child, from the last layout
+    int32_t childCount, childCapacity;
+} ClayScrollController;
+
+static ClayScrollController *g_ScrollControllers = NULL;
+static int32_t g_ScrollControllerCount = 0;
+static int32_t g_ScrollControllerCapacity = 0;
+
+static ClayScrollController* clay_scroll_controller_find(uint32_t id) {
+    for (int32_t i = 0; i < g_ScrollControllerCount; ++i) {
+        if (g_ScrollControllers[i].elementId == id) return &g_ScrollControllers[i];
+    }
+    return NULL;
+}
+
+static ClayScrollController* clay_scroll_controller_get(uint32_t id) {
+    ClayScrollController *c = clay_scroll_controller_find(id);
+    if (c) return c;
+    if (!clay_array_reserve((void**)&g_ScrollControllers, &g_ScrollControllerCapacity, g_ScrollControllerCount + 1, sizeof(ClayScrollController))) return NULL;
+    c = &g_ScrollControllers[g_ScrollControllerCount++];
+    memset(c, 0, sizeof(*c));
+    c->elementId = id;
+    c->friction = 2.0f;
+    c->stiffness = 180.0f;
+    c->overscroll = 1;
+    Clay__ScrollContainerDataInternal *d = clay_scroll_data_find(id);
+    if (d) {
+        c->axis[0].pos = d->scrollPosition.x;
+        c->axis[1].pos = d->scrollPosition.y;
+        c->written = c->layoutPosition = d->scrollPosition;
+    }
+    return c;
+}
+
+static void clay_scroll_controller_remove(uint32_t id) {
+    ClayScrollController *c = clay_scroll_controller_find(id);
+    if (!c) return;
+    free(c->childOffsets);
+    *c = g_ScrollControllers[--g_ScrollControllerCount];
+}
+
+static void clay_scroll_controllers_clear(void) {
+    for (int32_t i = 0; i < g_ScrollControllerCount; ++i) free(g_ScrollControllers[i].childOffsets);
+    free(g_ScrollControllers);
+    g_ScrollControllers = NULL;
+    g_ScrollControllerCount = g_ScrollControllerCapacity = 0;
+}
+
+static int clay_scroll_controller_active(const ClayScrollController *c) {
+    return c->dragging || c->tweening || c->axis[0].vel != 0 || c->axis[1].vel != 0 ||
+           c->axis[0].hasTarget || c->axis[1].hasTarget;
+}
+
+// Rubber band: the further past the end, the less the content follows the finger.
+static float clay_scroll_rubber(float over, float dimension) {
+    if (dimension <= 0) return 0;
+    float sign = over < 0 ? -1.0f : 1.0f;
+    float x = fabsf(over);
+    return sign * (1.0f - 1.0f / (x * 0.55f / dimension + 1.0f)) * dimension;
+}
+
+// Nearest snap position to `p` on axis a, within [lo, hi]; p itself when nothing snaps.
+static float clay_scroll_snap(const ClayScrollController *c, int a, float p, float lo, float hi) {
+    float best = p;
+    if (c->snapInterval > 0) {
+        best = roundf(p / c->snapInterval) * c->snapInterval;
+    } else if (c->snapChildren && c->childCount > 0) {
+        float bestDist = INFINITY;
+        for (int32_t i = 0; i < c->childCount; ++i) {
+            float s = -c->childOffsets[2 * i + a];
+            if (fabsf(s - p) < bestDist) { bestDist = fabsf(s - p); best = s; }
+        }
+    } else {
+        return p;
+    }
+    return best < lo ? lo : best > hi ? hi : best;
+}
+
+static int clay_scroll_has_snap(const ClayScrollController *c) {
+    return c->snapInterval > 0 || (c->snapChildren && c->childCount > 0);
+}
+
+// Innermost controlled container under the pointer, from the last layout's hit test.
+static ClayScrollController* clay_scroll_controller_hovered(Clay_Context *ctx) {
+    for (int32_t i = ctx->pointerOverIds.length - 1; i >= 0; --i) {
+        ClayScrollController *c = clay_scroll_controller_find(ctx->pointerOverIds.internalArray[i].id);
+        if (c) return c;
+    }
+    return NULL;
+}
+
+static void clay_scroll_controller_step(ClayScrollController *c, Clay__ScrollContainerDataInternal *d,
+                                        const Clay_PointerData *pointer, int hovered, int enableDrag,
+                                        Clay_Vector2 wheel, float dt) {
+    float viewport[2] = { d->boundingBox.width, d->boundingBox.height };
+    float lo[2] = { fminf(0, d->boundingBox.width - d->contentSize.width), fminf(0, d->boundingBox.height - d->contentSize.height) };
+    float wheelDelta[2] = { wheel.x, wheel.y };
+    float pointerPos[2] = { pointer->position.x, pointer->position.y };
+    float dragOrigin[2] = { c->dragPointer.x, c->dragPointer.y };
+
+    if (enableDrag && hovered && pointer->state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
+        c->dragging = 1;
+        c->tweening = 0;
+        c->dragPointer = pointer->position;
+        for (int a = 0; a < 2; ++a) {
+            c->dragStart[a] = c->axis[a].pos;
+            c->axis[a].vel = 0;
+            c->axis[a].hasTarget = 0;
+            dragOrigin[a] = pointerPos[a];
+        }
+    } else if (c->dragging && (!enableDrag || pointer->state == CLAY_POINTER_DATA_RELEASED_THIS_FRAME ||
+                               pointer->state == CLAY_POINTER_DATA_RELEASED)) {
+        c->dragging = 0;
+        c->idle = 0;
+        for (int a = 0; a < 2; ++a) {
+            ClayScrollAxis *ax = &c->axis[a];
+            if (!clay_scroll_has_snap(c) || lo[a] >= 0) continue;
+            // Snap to the point nearest to where momentum alone would come to rest.
+            float rest = ax->pos + (c->friction > 0 ? ax->vel / c->friction : 0);
+            ax->target = clay_scroll_snap(c, a, rest, lo[a], 0);
+            ax->hasTarget = 1;
+        }
+    }
+
+    int wheeled = !c->dragging && hovered && (wheelDelta[0] != 0 || wheelDelta[1] != 0);
+    if (c->dragging || wheeled) c->idle = 0;
+    else c->idle += dt;
+
+    if (c->tweening && (c->dragging || wheeled)) c->tweening = 0;
+    if (c->tweening) {
+        c->tweenElapsed += dt;
+        float t = c->tweenDuration > 0 ? c->tweenElapsed / c->tweenDuration : 1.0f;
+        float e = t >= 1.0f ? 1.0f : clay_ease(CLAY_EASE_IN_OUT, t < 0 ? 0 : t);
+        for (int a = 0; a < 2; ++a) c->axis[a].pos = c->tweenFrom[a] + (c->tweenTo[a] - c->tweenFrom[a]) * e;
+        if (t >= 1.0f) c->tweening = 0;
+        return;
+    }
+
+    for (int a = 0; a < 2; ++a) {
+        ClayScrollAxis *ax = &c->axis[a];
+        if (lo[a] >= 0) {                   // nothing to scroll on this axis
+            ax->pos = 0;
+            ax->vel = 0;
+            ax->hasTarget = 0;
+            continue;
+        }
+        if (c->dragging) {
+            float raw = c->dragStart[a] + (pointerPos[a] - dragOrigin[a]);
+            float p = raw;
+            if (raw > 0) p = c->overscroll ? clay_scroll_rubber(raw, viewport[a]) : 0;
+            else if (raw < lo[a]) p = c->overscroll ? lo[a] + clay_scroll_rubber(raw - lo[a], viewport[a]) : lo[a];
+            if (dt > 0) ax->vel = ax->vel * 0.5f + (p - ax->pos) / dt * 0.5f;
+            ax->pos = p;
+            continue;
+        }
+        if (wheeled) {
+            float p = ax->pos + wheelDelta[a] * 10.0f;      // same scale as Clay's wheel handling
+            ax->pos = p < lo[a] ? lo[a] : p > 0 ? 0 : p;
+            ax->vel = 0;
+            ax->hasTarget = 0;
+            continue;
+        }
+        if (!ax->hasTarget && ax->vel == 0 && clay_scroll_has_snap(c) && c->idle >= CLAY_SCROLL_WHEEL_IDLE && lo[a] < 0) {
+            float s = clay_scroll_snap(c, a, ax->pos, lo[a], 0);
+            if (fabsf(s - ax->pos) > CLAY_SCROLL_SETTLE_DISTANCE) {
+                ax->target = s;
+                ax->hasTarget = 1;
+            }
+        }
+        // Past an end with no snap target: spring back to it.
+        int outside = ax->pos > 0 || ax->pos < lo[a];
+        if (!ax->hasTarget && outside) {
+            float bound = ax->pos > 0 ? 0 : lo[a];
+            if ((ax->pos - bound) * ax->vel >= 0 || fabsf(ax->vel) < CLAY_SCROLL_SETTLE_SPEED) {
+                ax->target = bound;
+                ax->hasTarget = 1;
+            }
+        }
+        // Fixed substeps keep the spring stable when frames are long.
+        float left = dt;
+        while (left > 0) {
+            float h = left > 1.0f / 120.0f ? 1.0f / 120.0f : left;
+            left -= h;
+            if (ax->hasTarget) {
+                float acc = c->stiffness * (ax->target - ax->pos) - 2.0f * sqrtf(c->stiffness) * ax->vel;
+                ax->vel += acc * h;
+                ax->pos += ax->vel * h;
+            } else {
+                ax->pos += ax->vel * h;
+                ax->vel *= expf(-c->friction * h);
+                if (!c->overscroll) {
+                    if (ax->pos > 0) { ax->pos = 0; ax->vel = 0; }
+                    if (ax->pos < lo[a]) { ax->pos = lo[a]; ax->vel = 0; }
+                }
+            }
+        }
+        if (ax->hasTarget) {
+            if (fabsf(ax->target - ax->pos) < CLAY_SCROLL_SETTLE_DISTANCE && fabsf(ax->vel) < CLAY_SCROLL_SETTLE_SPEED) {
+                ax->pos = ax->target;
+                ax->vel = 0;
+                ax->hasTarget = 0;
+            }
+        } else if (fabsf(ax->vel) < CLAY_SCROLL_SETTLE_SPEED) {
+            ax->vel = 0;
+        }
+    }
+}
+
+// Called by clay.updateScrollContainers() around Clay_UpdateScrollContainers.
+static void clay_scroll_controllers_update(int enableDrag, Clay_Vector2 wheel, float dt) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || g_ScrollControllerCount == 0) return;
+    ClayScrollController *hovered = clay_scroll_controller_hovered(ctx);
+    uint32_t hoveredId = hovered ? hovered->elementId : 0;     // removal below moves controllers
+    for (int32_t i = 0; i < g_ScrollControllerCount; ++i) {
+        ClayScrollController *c = &g_ScrollControllers[i];
+        Clay__ScrollContainerDataInternal *d = clay_scroll_data_find(c->elementId);
+        if (!d) {
+            if (c->tweenOnly) { clay_scroll_controller_remove(c->elementId); i--; }
+            continue;
+        }
+        int isHovered = c->elementId == hoveredId;
+        if (c->tweenOnly) {
+            // Hand the container back to Clay once the tween is over or the user takes over;
+            // Clay's own drag and wheel handling of this update is kept.
+            int interrupted = isHovered && ((enableDrag && ctx->pointerInfo.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) ||
+                                            wheel.x != 0 || wheel.y != 0);
+            if (!c->tweening || interrupted) {
+                clay_scroll_controller_remove(c->elementId);
+                i--;
+                continue;
+            }
+        }
+        d->scrollMomentum = (Clay_Vector2){0, 0};
+        d->pointerScrollActive = false;
+        clay_scroll_controller_step(c, d, &ctx->pointerInfo, isHovered, enableDrag, wheel, dt);
+        d->scrollPosition = (Clay_Vector2){ c->axis[0].pos, c->axis[1].pos };
+        c->written = d->scrollPosition;
+    }
+}
+
+// Snapshot of each controlled container before Clay_UpdateScrollContainers, so Clay's own
+// drag and momentum can be undone; positions set from Lua since the last update are adopted.
+static void clay_scroll_controllers_sync(void) {
+    for (int32_t i = 0; i < g_ScrollControllerCount; ++i) {
+        ClayScrollController *c = &g_ScrollControllers[i];
+        Clay__ScrollContainerDataInternal *d = clay_scroll_data_find(c->elementId);
+        if (!d) continue;
+        if (d->scrollPosition.x != c->written.x || d->scrollPosition.y != c->written.y) {
+            c->axis[0] = (ClayScrollAxis){ d->scrollPosition.x, 0, 0, 0 };
+            c->axis[1] = (ClayScrollAxis){ d->scrollPosition.y, 0, 0, 0 };
+            c->tweening = 0;
+            c->written = d->scrollPosition;
+        }
+    }
+}
+
+// After layout: remember the position the layout used and the child snap offsets.
+static void clay_scroll_controllers_post_layout(void) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx) return;
+    for (int32_t i = 0; i < g_ScrollControllerCount; ++i) {
+        ClayScrollController *c = &g_ScrollControllers[i];
+        Clay__ScrollContainerDataInternal *d = clay_scroll_data_find(c->elementId);
+        if (!d || !d->layoutElement) continue;
+        c->layoutPosition = d->scrollPosition;
+        if (!c->snapChildren) continue;
+        Clay__LayoutElementChildren ch = d->layoutElement->childrenOrTextContent.children;
+        c->childCount = 0;
+        if (ch.length == 0 || !clay_array_reserve((void**)&c->childOffsets, &c->childCapacity, 2 * ch.length, sizeof(float))) continue;
+        Clay_BoundingBox first = {0};
+        for (int32_t k = 0; k < ch.length; ++k) {
+            Clay_LayoutElement *el = Clay_LayoutElementArray_Get(&ctx->layoutElements, ch.elements[k]);
+            Clay_BoundingBox box = Clay__GetHashMapItem(el->id)->boundingBox;
+            if (k == 0) first = box;
+            c->childOffsets[2 * c->childCount] = box.x - first.x;
+            c->childOffsets[2 * c->childCount + 1] = box.y - first.y;
+            c->childCount++;
+        }
+    }
+}
+
+static int clay_scroll_controllers_active(void) {
+    for (int32_t i = 0; i < g_ScrollControllerCount; ++i) {
+        if (clay_scroll_controller_active(&g_ScrollControllers[i])) return 1;
+    }
+    return 0;
+}
+
+// clay.setScrollPhysics(id, { friction=2, stiffness=180, overscroll=true, snap=nil|interval|"children" } | nil)
+static int l_Clay_SetScrollPhysics(lua_State *L) {
+    Clay_ElementId id = clay_check_element_id(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        clay_scroll_controller_remove(id.id);
+        return 0;
+    }
+    luaL_checktype(L, 2, LUA_TTABLE);
+    ClayScrollController *c = clay_scroll_controller_get(id.id);
+    if (!c) return luaL_error(L, "setScrollPhysics: out of memory");
+    c->tweenOnly = 0;
+    c->friction = (float)clay_opt_number_field(L, 2, "friction", 2.0);
+    c->stiffness = (float)clay_opt_number_field(L, 2, "stiffness", 180.0);
+    if (c->friction < 0) c->friction = 0;
+    if (c->stiffness < 1) c->stiffness = 1;
+    lua_getfield(L, 2, "overscroll");
+    c->overscroll = lua_isnil(L, -1) ? 1 : (uint8_t)lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "snap");
+    c->snapInterval = 0;
+    c->snapChildren = 0;
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        c->snapInterval = (float)lua_tonumber(L, -1);
+    } else if (lua_type(L, -1) == LUA_TSTRING) {
+        luaL_argcheck(L, strcmp(lua_tostring(L, -1), "children") == 0, 2, "snap must be a number or \"children\"");
+        c->snapChildren = 1;
+    }
+    lua_pop(L, 1);
+    return 0;
+}
+
+// clay.scrollTo(id, targetId | offsetY [, duration = 0.3])
+static int l_Clay_ScrollTo(lua_State *L) {
+    Clay_ElementId id = clay_check_element_id(L, 1);
+    float duration = (float)luaL_optnumber(L, 3, 0.3);
+    Clay__ScrollContainerDataInternal *d = clay_scroll_data_find(id.id);
+    if (!d) return 0;
+    int created = clay_scroll_controller_find(id.id) == NULL;
+    ClayScrollController *c = clay_scroll_controller_get(id.id);
+    if (!c) return luaL_error(L, "scrollTo: out of memory");
+    if (created) c->tweenOnly = 1;
+    float lo[2] = { fminf(0, d->boundingBox.width - d->contentSize.width), fminf(0, d->boundingBox.height - d->contentSize.height) };
+    float to[2] = { c->axis[0].pos, c->axis[1].pos };
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        to[1] = -(float)lua_tonumber(L, 2);
+    } else {
+        Clay_ElementId target = clay_check_element_id(L, 2);
+        Clay_LayoutElementHashMapItem *item = Clay__GetHashMapItem(target.id);
+        if (!item || item->elementId.id != target.id) return 0;
+        Clay_BoundingBox b = item->boundingBox;
+        // Target extent in content space, then the smallest move that shows all of it.
+        float start[2] = { b.x - d->boundingBox.x - c->layoutPosition.x, b.y - d->boundingBox.y - c->layoutPosition.y };
+        float size[2] = { b.width, b.height };
+        float view[2] = { d->boundingBox.width, d->boundingBox.height };
+        for (int a = 0; a < 2; ++a) {
+            if (start[a] < -to[a]) to[a] = -start[a];
+            else if (start[a] + size[a] > -to[a] + view[a]) to[a] = -(start[a] + size[a] - view[a]);
+        }
+    }
+    for (int a = 0; a < 2; ++a) {
+        to[a] = to[a] < lo[a] ? lo[a] : to[a] > 0 ? 0 : to[a];
+        c->tweenFrom[a] = c->axis[a].pos;
+        c->tweenTo[a] = to[a];
+        c->axis[a].vel = 0;
+        c->axis[a].hasTarget = 0;
+    }
+    c->dragging = 0;
+    c->tweenElapsed = 0;
+    c->tweenDuration = duration > 0 ? duration : 0;
+    c->tweening = 1;
+    if (c->tweenDuration == 0) {
+        c->axis[0].pos = to[0];
+        c->axis[1].pos = to[1];
+        c->tweening = 0;
+        d->scrollPosition = (Clay_Vector2){ to[0], to[1] };
+        c->written = d->scrollPosition;
+        if (c->tweenOnly) clay_scroll_controller_remove(id.id);
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Pointer event queue
+//
+// clay.pushPointerEvent(x, y, down [, time [, pointer]]) queues pointer samples between
+// frames, so a click shorter than a frame is not lost. The queue is resolved when the next layout
+// begins, against the layout that was on screen when the events happened. Events pushed
+// during a layout pass are resolved when it ends and stay readable through the next pass.
+// Each event runs through Clay's own hit
+// test, and the ids under the pointer are recorded. Clay's pointer state ends up as the
+// last event's, the same as if clay.setPointerState() had been called with it. Events
+// from other pointers (a nonzero pointer id, such as a second touch) are not hit-tested.
+// Only the gesture recognizers below use them.
+// -----------------------------------------------------------------------------
+
+enum { CLAY_POINTER_MOVE, CLAY_POINTER_PRESS, CLAY_POINTER_RELEASE };
+
+typedef struct {
+    float x, y;
+    double time;
+    double clockOffset;             // binding clock minus `time` when the event was pushed
+    uint8_t down;
+    uint8_t kind;
+    int32_t pointer;                // 0 for the primary pointer
+    int32_t hitStart, hitCount;     // range of g_PointerHits
+    int32_t pressStart, pressCount; // releases: ids that were under the pointer at the press
+} ClayPointerEvent;
+
+static ClayPointerEvent *g_PointerQueue = NULL;      // pushed, not yet resolved
+static int32_t g_PointerQueueCount = 0;
+static int32_t g_PointerQueueCapacity = 0;
+static ClayPointerEvent *g_PointerEvents = NULL;     // resolved this frame
+static int32_t g_PointerEventCount = 0;
+static int32_t g_PointerEventCapacity = 0;
+static uint32_t *g_PointerHits = NULL;
+static int32_t g_PointerHitCount = 0;
+static int32_t g_PointerHitCapacity = 0;
+static uint32_t *g_PressHits = NULL;                 // ids under the pointer at the last press
+static int32_t g_PressHitCount = 0;
+static int32_t g_PressHitCapacity = 0;
+static int g_PointerWasDown = 0;
+static int32_t g_SecondPointer = 0;                  // id of the other pointer that is down, if any
+static int32_t g_PointerEventsSeen = 0;              // events resolved before the last pass began
+
+static void clay_gesture_feed(const ClayPointerEvent *ev, const uint32_t *hits);
+
+static int clay_id_list_has(const uint32_t *ids, int32_t count, uint32_t id) {
+    for (int32_t i = 0; i < count; ++i) if (ids[i] == id) return 1;
+    return 0;
+}
+
+// Hit-test the queued events against Clay's current layout tree.
+static void clay_pointer_queue_resolve(void) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!ctx || g_PointerQueueCount == 0) return;
+    for (int32_t i = 0; i < g_PointerQueueCount; ++i) {
+        ClayPointerEvent ev = g_PointerQueue[i];
+        if (ev.pointer != 0) {
+            if (g_SecondPointer != 0 && ev.pointer != g_SecondPointer) continue;   // a third pointer
+            ev.kind = ev.down && g_SecondPointer == 0 ? CLAY_POINTER_PRESS
+                    : !ev.down && g_SecondPointer != 0 ? CLAY_POINTER_RELEASE : CLAY_POINTER_MOVE;
+            if (ev.kind == CLAY_POINTER_MOVE && !ev.down) continue;                 // hover of an idle pointer
+            g_SecondPointer = ev.down ? ev.pointer : 0;
+            ev.hitStart = ev.pressStart = g_PointerHitCount;
+            ev.hitCount = ev.pressCount = 0;
+            if (!clay_array_reserve((void**)&g_PointerEvents, &g_PointerEventCapacity, g_PointerEventCount + 1, sizeof(ClayPointerEvent))) break;
+            g_PointerEvents[g_PointerEventCount++] = ev;
+            clay_gesture_feed(&ev, NULL);
+            continue;
+        }
+        Clay_SetPointerState((Clay_Vector2){ ev.x, ev.y }, ev.down);
+        ev.kind = ev.down && !g_PointerWasDown ? CLAY_POINTER_PRESS
+                : !ev.down && g_PointerWasDown ? CLAY_POINTER_RELEASE : CLAY_POINTER_MOVE;
+        g_PointerWasDown = ev.down;
+        int32_t n = ctx->pointerOverIds.length;
+        int32_t extra = ev.kind == CLAY_POINTER_RELEASE ? g_PressHitCount : 0;
+        if (!clay_array_reserve((void**)&g_PointerEvents, &g_PointerEventCapacity, g_PointerEventCount + 1, sizeof(ClayPointerEvent)) ||
+            !clay_array_reserve((void**)&g_PointerHits, &g_PointerHitCapacity, g_PointerHitCount + n + extra, sizeof(uint32_t))) {
+            break;
+        }
+        ev.hitStart = g_PointerHitCount;
+        ev.hitCount = n;
+        for (int32_t k = 0; k < n; ++k) g_PointerHits[g_PointerHitCount++] = ctx->pointerOverIds.internalArray[k].id;
+        ev.pressStart = g_PointerHitCount;
+        ev.pressCount = extra;
+        if (extra > 0) {
+            memcpy(g_PointerHits + g_PointerHitCount, g_PressHits, sizeof(uint32_t) * (size_t)extra);
+            g_PointerHitCount += extra;
+        }
+        if (ev.kind == CLAY_POINTER_PRESS &&
+            clay_array_reserve((void**)&g_PressHits, &g_PressHitCapacity, n > 0 ? n : 1, sizeof(uint32_t))) {
+            memcpy(g_PressHits, g_PointerHits + ev.hitStart, sizeof(uint32_t) * (size_t)n);
+            g_PressHitCount = n;
+        }
+        g_PointerEvents[g_PointerEventCount++] = ev;
+        clay_gesture_feed(&ev, g_PointerHits + ev.hitStart);
+    }
+    g_PointerQueueCount = 0;
+}
+
+// Drop the events the last pass could read. Those resolved when it ended are kept for the
+// next one, with their hit ranges moved to the front.
+static void clay_pointer_frame_reset(void) {
+    int32_t seen = g_PointerEventsSeen;
+    g_PointerEventsSeen = 0;
+    if (seen >= g_PointerEventCount) {
+        g_PointerEventCount = 0;
+        g_PointerHitCount = 0;
+        return;
+    }
+    int32_t base = g_PointerEvents[seen].hitStart;
+    g_PointerEventCount -= seen;
+    memmove(g_PointerEvents, g_PointerEvents + seen, sizeof(ClayPointerEvent) * (size_t)g_PointerEventCount);
+    for (int32_t i = 0; i < g_PointerEventCount; ++i) {
+        g_PointerEvents[i].hitStart -= base;
+        g_PointerEvents[i].pressStart -= base;
+    }
+    g_PointerHitCount -= base;
+    memmove(g_PointerHits, g_PointerHits + base, sizeof(uint32_t) * (size_t)g_PointerHitCount);
+}
+
+static void clay_pointer_queue_clear(void) {
+    free(g_PointerQueue);
+    free(g_PointerEvents);
+    free(g_PointerHits);
+    free(g_PressHits);
+    g_PointerQueue = g_PointerEvents = NULL;
+    g_PointerHits = g_PressHits = NULL;
+    g_PointerQueueCount = g_PointerQueueCapacity = 0;
+    g_PointerEventCount = g_PointerEventCapacity = 0;
+    g_PointerHitCount = g_PointerHitCapacity = 0;
+    g_PressHitCount = g_PressHitCapacity = 0;
+    g_PointerWasDown = 0;
+    g_SecondPointer = 0;
+    g_PointerEventsSeen = 0;
+}
+
+// clay.pushPointerEvent(x, y, down [, time = clock [, pointer = 0]])
+static int l_Clay_PushPointerEvent(lua_State *L) {
+    ClayPointerEvent ev = {0};
+    ev.x = (float)luaL_checknumber(L, 1);
+    ev.y = (float)luaL_checknumber(L, 2);
+    ev.down = (uint8_t)lua_toboolean(L, 3);
+    ev.time = luaL_optnumber(L, 4, g_Now + g_PendingDt);
+    ev.clockOffset = g_Now + g_PendingDt - ev.time;     // host timestamps may use another clock
+    ev.pointer = (int32_t)luaL_optinteger(L, 5, 0);
+    if (!clay_array_reserve((void**)&g_PointerQueue, &g_PointerQueueCapacity, g_PointerQueueCount + 1, sizeof(ClayPointerEvent))) {
+        return luaL_error(L, "pushPointerEvent: out of memory");
+    }
+    g_PointerQueue[g_PointerQueueCount++] = ev;
+    return 0;
+}
+
+// clay.pointerEventCount() -> n   (events resolved for this frame)
+static int l_Clay_PointerEventCount(lua_State *L) {
+    lua_pushinteger(L, g_PointerEventCount);
+    return 1;
+}
+
+// clay.pointerEvent(i) -> x, y, down, time, kind, pointer
+static int l_Clay_PointerEvent(lua_State *L) {
+    lua_Integer i = luaL_checkinteger(L, 1);
+    if (i < 1 || i > g_PointerEventCount) return 0;
+    const ClayPointerEvent *ev = &g_PointerEvents[i - 1];
+    lua_pushnumber(L, ev->x);
+    lua_pushnumber(L, ev->y);
+    lua_pushboolean(L, ev->down);
+    lua_pushnumber(L, ev->time);
+    lua_pushinteger(L, ev->kind);
+    lua_pushinteger(L, ev->pointer);
+    return 6;
+}
+
+// clay.pointerEventOver(i, id) -> boolean
+static int l_Clay_PointerEventOver(lua_State *L) {
+    lua_Integer i = luaL_checkinteger(L, 1);
+    Clay_ElementId id = clay_check_element_id(L, 2);
+    int over = 0;
+    if (i >= 1 && i <= g_PointerEventCount) {
+        const ClayPointerEvent *ev = &g_PointerEvents[i - 1];
+        over = clay_id_list_has(g_PointerHits + ev->hitStart, ev->hitCount, id.id);
+    }
+    lua_pushboolean(L, over);
+    return 1;
+}
+
+// clay.clicked(id) -> boolean   (a release this frame over id, whose press was over id too)
+static int l_Clay_Clicked(lua_State *L) {
+    Clay_ElementId id = clay_check_element_id(L, 1);
+    int clicked = 0;
+    for (int32_t i = 0; i < g_PointerEventCount && !clicked; ++i) {
+        const ClayPointerEvent *ev = &g_PointerEvents[i];
+        clicked = ev->kind == CLAY_POINTER_RELEASE &&
+                  clay_id_list_has(g_PointerHits + ev->hitStart, ev->hitCount, id.id) &&
+                  clay_id_list_has(g_PointerHits + ev->pressStart, ev->pressCount, id.id);
+    }
+    lua_pushboolean(L, clicked);
+    return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Gesture recognizers
+//
+// Elements built with :gestures() are gesture targets. The resolved pointer events run
+// through one set of state machines. These recognize tap and double-tap, long-press,
+// drag past a threshold, and two-pointer pinch/rotate. The results are a short event
+// list per frame, read with clay.gestureCount() / clay.gesture(i) or clay.gestureOn(id).
+// Drag and pinch updates within one frame are merged into a single event.
+// -----------------------------------------------------------------------------
+
+enum {
+    CLAY_GESTURE_TAP = 1,
+    CLAY_GESTURE_DOUBLE_TAP,
+    CLAY_GESTURE_LONG_PRESS,
+    CLAY_GESTURE_DRAG_START,
+    CLAY_GESTURE_DRAG,
+    CLAY_GESTURE_DRAG_END,
+    CLAY_GESTURE_PINCH_START,
+    CLAY_GESTURE_PINCH,
+    CLAY_GESTURE_PINCH_END
+};
+
+enum { CLAY_GESTURE_IDLE, CLAY_GESTURE_PENDING, CLAY_GESTURE_DRAGGING, CLAY_GESTURE_HELD, CLAY_GESTURE_PINCHING, CLAY_GESTURE_DONE };
+
+typedef struct {
+    uint8_t kind;
+    uint32_t elementId;         // target; 0 when the press hit no :gestures() element
+    float x, y;                 // pointer, or pinch center
+    float a, b;                 // drag: total dx, dy; pinch: scale, rotation (radians)
+    double time;
+} ClayGestureEvent;
+
+static ClayGestureEvent *g_Gestures = NULL;          // this frame
+static int32_t g_GestureCount = 0;
+static int32_t g_GestureCapacity = 0;
+static int32_t g_GesturesSeen = 0;                   // recognized before the last pass began
+static ClayU32Map g_GestureTargets[2] = {{0}};       // [g_GestureDeclare]: filled by this frame's declarations
+static int g_GestureDeclare = 0;
+
+static struct {
+    float dragThreshold;
+    float doubleTapTime;
+    float longPressTime;
+    int state;
+    uint32_t target;
+    float pressX, pressY, x, y;
+    double pressTime;           // event clock
+    double pressClockOffset;    // binding clock minus event clock at the press
+    uint32_t lastTapTarget;     // for double-tap
+    float lastTapX, lastTapY;
+    double lastTapTime;
+    float secondX, secondY;
+    float pinchDistance, pinchAngle;
+} g_Gesture = { 4.0f, 0.3f, 0.5f, CLAY_GESTURE_IDLE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1.0, 0, 0, 0, 0 };
+
+static void clay_gesture_register(uint32_t elementId) {
+    clay_u32map_put(&g_GestureTargets[g_GestureDeclare], elementId, 1);
+}
+
+// Deepest gesture target among the ids under the pointer.
+static uint32_t clay_gesture_target(const uint32_t *hits, int32_t count) {
+    for (int32_t i = count - 1; i >= 0; --i) {
+        if (clay_u32map_get(&g_GestureTargets[g_GestureDeclare], hits[i]) >= 0) return hits[i];
+    }
+    return 0;
+}
+
+static void clay_gesture_emit(uint8_t kind, float x, float y, float a, float b, double time) {
+    // Coalesce continuous updates within a frame.
+    if ((kind == CLAY_GESTURE_DRAG || kind == CLAY_GESTURE_PINCH) && g_GestureCount > g_GesturesSeen) {
+        ClayGestureEvent *last = &g_Gestures[g_GestureCount - 1];
+        if (last->kind == kind && last->elementId == g_Gesture.target) {
+            *last = (ClayGestureEvent){ kind, g_Gesture.target, x, y, a, b, time };
+            return;
+        }
+    }
+    if (!clay_array_reserve((void**)&g_Gestures, &g_GestureCapacity, g_GestureCount + 1, sizeof(ClayGestureEvent))) return;
+    g_Gestures[g_GestureCount++] = (ClayGestureEvent){ kind, g_Gesture.target, x, y, a, b, time };
+}
+
+static void clay_gesture_pinch_metrics(float *distance, float *angle, float *cx, float *cy) {
+    float dx = g_Gesture.secondX - g_Gesture.x, dy = g_Gesture.secondY - g_Gesture.y;
+    *distance = sqrtf(dx * dx + dy * dy);
+    *angle = atan2f(dy, dx);
+    *cx = (g_Gesture.x + g_Gesture.secondX) * 0.5f;
+    *cy = (g_Gesture.y + g_Gesture.secondY) * 0.5f;
+}
+
+// `now` is on the event clock.
+static void clay_gesture_long_press(double now) {
+    if (g_Gesture.state == CLAY_GESTURE_PENDING && now >= g_Gesture.pressTime + g_Gesture.longPressTime) {
+        g_Gesture.state = CLAY_GESTURE_HELD;
+        clay_gesture_emit(CLAY_GESTURE_LONG_PRESS, g_Gesture.x, g_Gesture.y, 0, 0, g_Gesture.pressTime + g_Gesture.longPressTime);
+    }
+}
+
+static void clay_gesture_feed(const ClayPointerEvent *ev, const uint32_t *hits) {
+    float dist, angle, cx, cy;
+    if (ev->pointer != 0) {
+        // The second pointer is only used for pinch.
+        g_Gesture.secondX = ev->x;
+        g_Gesture.secondY = ev->y;
+        if (ev->kind == CLAY_POINTER_PRESS) {
+            if (g_Gesture.state != CLAY_GESTURE_PENDING && g_Gesture.state != CLAY_GESTURE_DRAGGING && g_Gesture.state != CLAY_GESTURE_HELD) return;
+            if (g_Gesture.state == CLAY_GESTURE_DRAGGING) {
+                clay_gesture_emit(CLAY_GESTURE_DRAG_END, g_Gesture.x, g_Gesture.y, g_Gesture.x - g_Gesture.pressX, g_Gesture.y - g_Gesture.pressY, ev->time);
+            }
+            clay_gesture_pinch_metrics(&g_Gesture.pinchDistance, &g_Gesture.pinchAngle, &cx, &cy);
+            g_Gesture.state = CLAY_GESTURE_PINCHING;
+            clay_gesture_emit(CLAY_GESTURE_PINCH_START, cx, cy, 1.0f, 0.0f, ev->time);
+        } else if (g_Gesture.state == CLAY_GESTURE_PINCHING) {
+            clay_gesture_pinch_metrics(&dist, &angle, &cx, &cy);
+            float scale = g_Gesture.pinchDistance > 0 ? dist / g_Gesture.pinchDistance : 1.0f;
+            if (ev->kind == CLAY_POINTER_RELEASE) {
+                clay_gesture_emit(CLAY_GESTURE_PINCH_END, cx, cy, scale, angle - g_Gesture.pinchAngle, ev->time);
+                g_Gesture.state = CLAY_GESTURE_DONE;
+            } else {
+                clay_gesture_emit(CLAY_GESTURE_PINCH, cx, cy, scale, angle - g_Gesture.pinchAngle, ev->time);
+            }
+        }
+        return;
+    }
+
+    clay_gesture_long_press(ev->time);
+    g_Gesture.x = ev->x;
+    g_Gesture.y = ev->y;
+    if (ev->kind == CLAY_POINTER_PRESS) {
+        g_Gesture.state = CLAY_GESTURE_PENDING;
+        g_Gesture.target = clay_gesture_target(hits, ev->hitCount);
+        g_Gesture.pressX = ev->x;
+        g_Gesture.pressY = ev->y;
+        g_Gesture.pressTime = ev->time;
+        g_Gesture.pressClockOffset = ev->clockOffset;
+        return;
+    }
+    float dx = ev->x - g_Gesture.pressX, dy = ev->y - g_Gesture.pressY;
+    switch (g_Gesture.state) {
+        case CLAY_GESTURE_PENDING:
+            if (ev->kind == CLAY_POINTER_RELEASE) {
+                float tx = ev->x - g_Gesture.lastTapX, ty = ev->y - g_Gesture.lastTapY;
+                int isDouble = g_Gesture.lastTapTime >= 0 && ev->time - g_Gesture.lastTapTime <= g_Gesture.doubleTapTime &&
+                               g_Gesture.lastTapTarget == g_Gesture.target &&
+                               tx * tx + ty * ty <= 4.0f * g_Gesture.dragThreshold * g_Gesture.dragThreshold;
+                clay_gesture_emit(isDouble ? CLAY_GESTURE_DOUBLE_TAP : CLAY_GESTURE_TAP, ev->x, ev->y, 0, 0, ev->time);
+                g_Gesture.lastTapTime = isDouble ? -1.0 : ev->time;     // a third tap starts over
+                g_Gesture.lastTapTarget = g_Gesture.target;
+                g_Gesture.lastTapX = ev->x;
+                g_Gesture.lastTapY = ev->y;
+                g_Gesture.state = CLAY_GESTURE_IDLE;
+            } else if (ev->down && dx * dx + dy * dy > g_Gesture.dragThreshold * g_Gesture.dragThreshold) {
+                g_Gesture.state = CLAY_GESTURE_DRAGGING;
+                clay_gesture_emit(CLAY_GESTURE_DRAG_START, g_Gesture.pressX, g_Gesture.pressY, 0, 0, ev->time);
+                clay_gesture_emit(CLAY_GESTURE_DRAG, ev->x, ev->y, dx, dy, ev->time);
+            }
+            break;
+        case CLAY_GESTURE_DRAGGING:
+            clay_gesture_emit(ev->down ? CLAY_GESTURE_DRAG : CLAY_GESTURE_DRAG_END, ev->x, ev->y, dx, dy, ev->time);
+            if (!ev->down) g_Gesture.state = CLAY_GESTURE_IDLE;
+            break;
+        case CLAY_GESTURE_PINCHING: {
+            clay_gesture_pinch_metrics(&dist, &angle, &cx, &cy);
+            float scale = g_Gesture.pinchDistance > 0 ? dist / g_Gesture.pinchDistance : 1.0f;
+            clay_gesture_emit(ev->down ? CLAY_GESTURE_PINCH : CLAY_GESTURE_PINCH_END, cx, cy, scale, angle - g_Gesture.pinchAngle, ev->time);
+            if (!ev->down) g_Gesture.state = CLAY_GESTURE_IDLE;
+            break;
+        }
+        default:                                // held after a long press, or a finished pinch
+            if (!ev->down) g_Gesture.state = CLAY_GESTURE_IDLE;
+            break;
+    }
+}
+
+// Fire a long press that came due without a pointer event, or schedule a wake-up for it.
+// `now` is on the binding clock; the press time is moved onto it with the offset the press
+// was pushed with.
+static void clay_gesture_tick(double now) {
+    clay_gesture_long_press(now - g_Gesture.pressClockOffset);
+    double due = g_Gesture.pressTime + g_Gesture.pressClockOffset + g_Gesture.longPressTime;
+    if (g_Gesture.state == CLAY_GESTURE_PENDING && due < g_NextWake) g_NextWake = due;
+}
+
+// Like pointer events, gestures recognized when a pass ended are kept for the next one.
+static void clay_gesture_frame_begin(void) {
+    int32_t seen = g_GesturesSeen < g_GestureCount ? g_GesturesSeen : g_GestureCount;
+    g_GestureCount -= seen;
+    if (seen > 0) memmove(g_Gestures, g_Gestures + seen, sizeof(ClayGestureEvent) * (size_t)g_GestureCount);
+    g_GesturesSeen = 0;
+}
+
+// After this frame's events are resolved: start collecting targets for the next one.
+static void clay_gesture_swap_targets(void) {
+    g_GestureDeclare ^= 1;
+    clay_u32map_clear(&g_GestureTargets[g_GestureDeclare]);
+}
+
+static void clay_gesture_clear(void) {
+    free(g_Gestures);
+    g_Gestures = NULL;
+    g_GestureCount = g_GestureCapacity = g_GesturesSeen = 0;
+    clay_u32map_free(&g_GestureTargets[0]);
+    clay_u32map_free(&g_GestureTargets[1]);
+    g_Gesture.state = CLAY_GESTURE_IDLE;
+    g_Gesture.lastTapTime = -1.0;
+}
+
+static int clay_push_gesture(lua_State *L, const ClayGestureEvent *g) {
+    lua_pushinteger(L, g->kind);
+    lua_pushinteger(L, (lua_Integer)g->elementId);
+    lua_pushnumber(L, g->x);
+    lua_pushnumber(L, g->y);
+    lua_pushnumber(L, g->a);
+    lua_pushnumber(L, g->b);
+    return 6;
+}
+
+// clay.gestureCount() -> n
+static int l_Clay_GestureCount(lua_State *L) {
+    lua_pushinteger(L, g_GestureCount);
+    return 1;
+}
+
+// clay.gesture(i) -> kind, elementId, x, y, a, b
+static int l_Clay_Gesture(lua_State *L) {
+    lua_Integer i = luaL_checkinteger(L, 1);
+    if (i < 1 || i > g_GestureCount) return 0;
+    return clay_push_gesture(L, &g_Gestures[i - 1]);
+}
+
+// clay.gestureOn(id [, kind]) -> kind, elementId, x, y, a, b   (the last matching gesture this frame)
+static int l_Clay_GestureOn(lua_State *L) {
+    Clay_ElementId id = clay_check_element_id(L, 1);
+    lua_Integer kind = luaL_optinteger(L, 2, 0);
+    for (int32_t i = g_GestureCount - 1; i >= 0; --i) {
+        if (g_Gestures[i].elementId == id.id && (kind == 0 || g_Gestures[i].kind == kind)) {
+            return clay_push_gesture(L, &g_Gestures[i]);
+        }
+    }
+    return 0;
+}
+
+// clay.setGestureOptions{ dragThreshold = 4, doubleTapTime = 0.3, longPressTime = 0.5 }
+static int l_Clay_SetGestureOptions(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    g_Gesture.dragThreshold = clay_opt_number_field(L, 1, "dragThreshold", g_Gesture.dragThreshold);
+    g_Gesture.doubleTapTime = clay_opt_number_field(L, 1, "doubleTapTime", g_Gesture.doubleTapTime);
+    g_Gesture.longPressTime = clay_opt_number_field(L, 1, "longPressTime", g_Gesture.longPressTime);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Directional focus
+//
+// Elements built with :focusable() can take focus, and clay.focusNext(dir) moves it to
+// the best candidate in a direction. Focusable bounds are copied from each final layout.
+// The first query after a layout indexes them in a uniform grid. A query then visits
+// cells outward from the focused element and stops once no unvisited cell can beat the
+// best score. A key press therefore costs a few cells, not a scan of every focusable.
+// -----------------------------------------------------------------------------
+
+enum { CLAY_FOCUS_LEFT, CLAY_FOCUS_RIGHT, CLAY_FOCUS_UP, CLAY_FOCUS_DOWN };
+static const char *const g_FocusDirNames[] = { "left", "right", "up", "down", NULL };
+
+#define CLAY_FOCUS_MAX_ITEM_CELLS 64       // larger items go to a list checked by every query
+
+typedef struct {
+    uint32_t elementId;
+    float lo[2], hi[2];         // final bounds
+    uint32_t stamp;             // last query that visited the item
+} ClayFocusItem;
+
+static uint32_t *g_FocusDeclared = NULL;           // this frame's :focusable() elements
+static int32_t g_FocusDeclaredCount = 0;
+static int32_t g_FocusDeclaredCapacity = 0;
+static ClayFocusItem *g_FocusItems = NULL;         // as of the last layout
+static int32_t g_FocusItemCount = 0;
+static int32_t g_FocusItemCapacity = 0;
+static uint32_t g_FocusId = 0;
+static uint32_t g_FocusStamp = 0;
+
+// Grid over g_FocusItems, rebuilt on demand: cell c holds g_FocusCellItems[start[c] .. start[c + 1]).
+static int g_FocusIndexed = 0;
+static float g_FocusCellSize = 1.0f;
+static int32_t g_FocusCellMin[2], g_FocusCellMax[2];
+static ClayU32Map g_FocusCellIndex = {0};
+static int32_t *g_FocusCellStart = NULL;
+static int32_t g_FocusCellCount = 0;
+static int32_t g_FocusCellCapacity = 0;
+static int32_t *g_FocusCellItems = NULL;
+static int32_t g_FocusCellItemCapacity = 0;
+static int32_t *g_FocusOversized = NULL;
+static int32_t g_FocusOversizedCount = 0;
+static int32_t g_FocusOversizedCapacity = 0;
+
+static void clay_focus_register(uint32_t elementId) {
+    if (!clay_array_reserve((void**)&g_FocusDeclared, &g_FocusDeclaredCapacity, g_FocusDeclaredCount + 1, sizeof(uint32_t))) return;
+    g_FocusDeclared[g_FocusDeclaredCount++] = elementId;
+}
+
+static void clay_focus_frame_reset(void) {
+    g_FocusDeclaredCount = 0;
+}
+
+// Copy the final bounds of this frame's focusables.
+static void clay_focus_post_layout(void) {
+    g_FocusItemCount = 0;
+    g_FocusIndexed = 0;
+    if (!clay_array_reserve((void**)&g_FocusItems, &g_FocusItemCapacity, g_FocusDeclaredCount, sizeof(ClayFocusItem))) return;
+    for (int32_t i = 0; i < g_FocusDeclaredCount; ++i) {
+        Clay_LayoutElementHashMapItem *item = Clay__GetHashMapItem(g_FocusDeclared[i]);
+        if (!item || item->elementId.id != g_FocusDeclared[i]) continue;
+        Clay_BoundingBox b = item->boundingBox;
+        g_FocusItems[g_FocusItemCount++] = (ClayFocusItem){ g_FocusDeclared[i], { b.x, b.y }, { b.x + b.width, b.y + b.height }, 0 };
+    }
+}
+
+static void clay_focus_clear(void) {
+    free(g_FocusDeclared);
+    free(g_FocusItems);
+    free(g_FocusCellStart);
+    free(g_FocusCellItems);
+    free(g_FocusOversized);
+    g_FocusDeclared = NULL;
+    g_FocusItems = NULL;
+    g_FocusCellStart = g_FocusCellItems = g_FocusOversized = NULL;
+    g_FocusDeclaredCount = g_FocusDeclaredCapacity = 0;
+    g_FocusItemCount = g_FocusItemCapacity = 0;
+    g_FocusCellCount = g_FocusCellCapacity = g_FocusCellItemCapacity = 0;
+    g_FocusOversizedCount = g_FocusOversizedCapacity = 0;
+    clay_u32map_free(&g_FocusCellIndex);
+    g_FocusIndexed = 0;
+    g_FocusId = 0;
+}
+
+static int32_t clay_focus_cell_of(float v) {
+    const float lim = 1e9f;
+    return (int32_t)fmaxf(-lim, fminf(lim, floorf(v / g_FocusCellSize)));
+}
+
+static int clay_focus_is_oversized(const ClayFocusItem *it) {
+    int64_t w = (int64_t)clay_focus_cell_of(it->hi[0]) - clay_focus_cell_of(it->lo[0]) + 1;
+    int64_t h = (int64_t)clay_focus_cell_of(it->hi[1]) - clay_focus_cell_of(it->lo[1]) + 1;
+    return w * h > CLAY_FOCUS_MAX_ITEM_CELLS;
+}
+
+// Two passes over the items: count per cell, then fill the flat cell lists.
+static int clay_focus_build_index(void) {
+    clay_u32map_clear(&g_FocusCellIndex);
+    g_FocusCellCount = 0;
+    g_FocusOversizedCount = 0;
+    if (g_FocusItemCount == 0) return g_FocusIndexed = 1;
+
+    // Cells about twice the typical focusable, so most items fall in one to four of them.
+    double sum = 0;
+    for (int32_t i = 0; i < g_FocusItemCount; ++i) {
+        sum += fmaxf(g_FocusItems[i].hi[0] - g_FocusItems[i].lo[0], g_FocusItems[i].hi[1] - g_FocusItems[i].lo[1]);
+    }
+    g_FocusCellSize = (float)fmax(1.0, 2.0 * sum / g_FocusItemCount);
+    g_FocusCellMin[0] = g_FocusCellMin[1] = INT32_MAX;
+    g_FocusCellMax[0] = g_FocusCellMax[1] = INT32_MIN;
+
+    int32_t entries = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int32_t i = 0; i < g_FocusItemCount; ++i) {
+            const ClayFocusItem *it = &g_FocusItems[i];
+            if (clay_focus_is_oversized(it)) {
+                if (pass == 1) continue;
+                if (!clay_array_reserve((void**)&g_FocusOversized, &g_FocusOversizedCapacity, g_FocusOversizedCount + 1, sizeof(int32_t))) return 0;
+                g_FocusOversized[g_FocusOversizedCount++] = i;
+                continue;
+            }
+            int32_t cx0 = clay_focus_cell_of(it->lo[0]), cx1 = clay_focus_cell_of(it->hi[0]);
+            int32_t cy0 = clay_focus_cell_of(it->lo[1]), cy1 = clay_focus_cell_of(it->hi[1]);
+            for (int32_t cy = cy0; cy <= cy1; ++cy) {
+                for (int32_t cx = cx0; cx <= cx1; ++cx) {
+                    uint32_t key = clay_canvas_cell_key(cx, cy);
+                    int32_t idx = clay_u32map_get(&g_FocusCellIndex, key);
+                    if (pass == 1) {
+                        g_FocusCellItems[g_FocusCellStart[idx + 1]++] = i;
+                        continue;
+                    }
+                    if (idx < 0) {
+                        if (!clay_array_reserve((void**)&g_FocusCellStart, &g_FocusCellCapacity, g_FocusCellCount + 2, sizeof(int32_t))) return 0;
+                        idx = g_FocusCellCount++;
+                        g_FocusCellStart[idx + 1] = 0;
+                        clay_u32map_put(&g_FocusCellIndex, key, idx);
+                    }
+                    g_FocusCellStart[idx + 1]++;
+                    entries++;
+                }
+            }
+            if (pass == 0) {
+                if (cx0 < g_FocusCellMin[0]) g_FocusCellMin[0] = cx0;
+                if (cy0 < g_FocusCellMin[1]) g_FocusCellMin[1] = cy0;
+                if (cx1 > g_FocusCellMax[0]) g_FocusCellMax[0] = cx1;
+                if (cy1 > g_FocusCellMax[1]) g_FocusCellMax[1] = cy1;
+            }
+        }
+        if (pass == 0) {
+            if (g_FocusCellCount == 0) break;
+            if (!clay_array_reserve((void**)&g_FocusCellItems, &g_FocusCellItemCapacity, entries, sizeof(int32_t))) return 0;
+            // Exclusive prefix sums, shifted by one: pass 1 advances start[c + 1] up to start[c + 2].
+            g_FocusCellStart[0] = 0;
+            int32_t run = 0;
+            for (int32_t c = 0; c < g_FocusCellCount; ++c) {
+                int32_t n = g_FocusCellStart[c + 1];
+                g_FocusCellStart[c + 1] = run;
+                run += n;
+            }
+        }
+    }
+    return g_FocusIndexed = 1;
+}
+
+typedef struct {
+    int axis;                   // 0: horizontal, 1: vertical
+    float sign;                 // +1 toward larger coordinates
+    float near, far, center;    // the focused element along the direction (sign applied)
+    float crossLo, crossHi, crossCenter;
+    int32_t from;               // focused item index
+    int32_t best;
+    float bestScore;
+} ClayFocusQuery;
+
+// Score a candidate: distance along the direction, plus twice the gap across it, plus a
+// small pull toward the focused element's center line. Lower is better.
+static void clay_focus_consider(ClayFocusQuery *q, int32_t i) {
+    ClayFocusItem *it = &g_FocusItems[i];
+    if (it->stamp == g_FocusStamp || i == q->from) return;
+    it->stamp = g_FocusStamp;
+    int a = q->axis, c = 1 - a;
+    float near = q->sign > 0 ? it->lo[a] : -it->hi[a];
+    float far = q->sign > 0 ? it->hi[a] : -it->lo[a];
+    if ((near + far) * 0.5f <= q->center || far <= q->far) return;     // not ahead
+    float major = fmaxf(0.0f, near - q->far);
+    float cross = fmaxf(0.0f, fmaxf(it->lo[c] - q->crossHi, q->crossLo - it->hi[c]));
+    float score = major + 2.0f * cross + 0.1f * fabsf((it->lo[c] + it->hi[c]) * 0.5f - q->crossCenter);
+    if (score < q->bestScore) {
+        q->bestScore = score;
+        q->best = i;
+    }
+}
+
+static void clay_focus_visit_cell(ClayFocusQuery *q, int32_t major, int32_t cross) {
+    int32_t cx = q->axis == 0 ? major : cross, cy = q->axis == 0 ? cross : major;
+    int32_t idx = clay_u32map_get(&g_FocusCellIndex, clay_canvas_cell_key(cx, cy));
+    if (idx < 0) return;
+    for (int32_t k = g_FocusCellStart[idx]; k < g_FocusCellStart[idx + 1]; ++k) clay_focus_consider(q, g_FocusCellItems[k]);
 }
 
-static void text_builder_detach_ptrs(LuaClayTextBuilder *t) {
-    t->cfg.userData = NULL;
+// Best item ahead of `from` in direction `dir`, or -1.
+static int32_t clay_focus_search(int32_t from, int dir) {
+    if (!g_FocusIndexed && !clay_focus_build_index()) return -1;
+    if (++g_FocusStamp == 0) {
+        for (int32_t i = 0; i < g_FocusItemCount; ++i) g_FocusItems[i].stamp = 0;
+        g_FocusStamp = 1;
+    }
+    const ClayFocusItem *f = &g_FocusItems[from];
+    ClayFocusQuery q;
+    q.axis = dir == CLAY_FOCUS_LEFT || dir == CLAY_FOCUS_RIGHT ? 0 : 1;
+    q.sign = dir == CLAY_FOCUS_RIGHT || dir == CLAY_FOCUS_DOWN ? 1.0f : -1.0f;
+    int a = q.axis, c = 1 - a;
+    q.near = q.sign > 0 ? f->lo[a] : -f->hi[a];
+    q.far = q.sign > 0 ? f->hi[a] : -f->lo[a];
+    q.center = (q.near + q.far) * 0.5f;
+    q.crossLo = f->lo[c];
+    q.crossHi = f->hi[c];
+    q.crossCenter = (f->lo[c] + f->hi[c]) * 0.5f;
+    q.from = from;
+    q.best = -1;
+    q.bestScore = INFINITY;
+
+    for (int32_t i = 0; i < g_FocusOversizedCount; ++i) clay_focus_consider(&q, g_FocusOversized[i]);
+    if (g_FocusCellCount == 0) return q.best;
+
+    float cs = g_FocusCellSize;
+    int32_t step = q.sign > 0 ? 1 : -1;
+    int32_t r0 = clay_focus_cell_of(q.crossLo), r1 = clay_focus_cell_of(q.crossHi);
+    int32_t rowMin = g_FocusCellMin[c], rowMax = g_FocusCellMax[c];
+    // Cells along the direction, starting with the one holding the focused element's center.
+    int32_t m = clay_focus_cell_of(q.sign * q.center);
+    if (step > 0 && m < g_FocusCellMin[a]) m = g_FocusCellMin[a];
+    if (step < 0 && m > g_FocusCellMax[a]) m = g_FocusCellMax[a];
+    for (; m >= g_FocusCellMin[a] && m <= g_FocusCellMax[a]; m += step) {
+        float cellNear = q.sign > 0 ? m * cs : -(m + 1) * cs;
+        float majorBound = fmaxf(0.0f, cellNear - q.far);
+        if (majorBound >= q.bestScore) break;
+        // Rows across it, outward from the focused element's own rows.
+        for (int32_t r = r0 > rowMin ? r0 : rowMin; r <= r1 && r <= rowMax; ++r) clay_focus_visit_cell(&q, m, r);
+        for (int32_t d = 1;; ++d) {
+            int32_t lo = r0 - d, hi = r1 + d;
+            int more = 0;
+            if (lo >= rowMin && majorBound + 2.0f * (q.crossLo - (lo + 1) * cs) < q.bestScore) {
+                clay_focus_visit_cell(&q, m, lo);
+                more = 1;
+            }
+            if (hi <= rowMax && majorBound + 2.0f * (hi * cs - q.crossHi) < q.bestScore) {
+                clay_focus_visit_cell(&q, m, hi);
+                more = 1;
+            }
+            if (!more) break;
+        }
+    }
+    return q.best;
 }
 
-static int l_Text_userData(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    clay_set_ptr_from_lua(L, 2, &t->cfg.userData);
-    lua_settop(L, 1);
+static int32_t clay_focus_find(uint32_t elementId) {
+    for (int32_t i = 0; elementId && i < g_FocusItemCount; ++i) {
+        if (g_FocusItems[i].elementId == elementId) return i;
+    }
+    return -1;
+}
+
+// clay.focusNext(dir) -> elementId | nil   (dir: "left", "right", "up" or "down")
+static int l_Clay_FocusNext(lua_State *L) {
+    int dir = luaL_checkoption(L, 1, NULL, g_FocusDirNames);
+    if (g_FocusItemCount == 0) return 0;
+    int32_t from = clay_focus_find(g_FocusId);
+    int32_t next = from < 0 ? 0 : clay_focus_search(from, dir);     // nothing focused: the first focusable
+    if (next < 0) return 0;
+    g_FocusId = g_FocusItems[next].elementId;
+    lua_pushinteger(L, (lua_Integer)g_FocusId);
     return 1;
 }
 
-static int l_Text_textColor(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.textColor.r = (float)luaL_checknumber(L, 2);
-    t->cfg.textColor.g = (float)luaL_checknumber(L, 3);
-    t->cfg.textColor.b = (float)luaL_checknumber(L, 4);
-    t->cfg.textColor.a = (float)luaL_optnumber(L, 5, 255.0);
-    lua_settop(L, 1);
-    return 1;
+// clay.setFocus(id | nil)
+static int l_Clay_SetFocus(lua_State *L) {
+    g_FocusId = lua_isnoneornil(L, 1) ? 0 : clay_check_element_id(L, 1).id;
+    return 0;
 }
 
-static int l_Text_fontId(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.fontId = (uint16_t)luaL_checkinteger(L, 2);
-    lua_settop(L, 1);
+// clay.focusedId() -> elementId | nil
+static int l_Clay_FocusedId(lua_State *L) {
+    if (!g_FocusId) return 0;
+    lua_pushinteger(L, (lua_Integer)g_FocusId);
     return 1;
 }
 
-static int l_Text_fontSize(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.fontSize = (uint16_t)luaL_checkinteger(L, 2);
-    lua_settop(L, 1);
+// clay.hasFocus(id) -> boolean
+static int l_Clay_HasFocus(lua_State *L) {
+    Clay_ElementId id = clay_check_element_id(L, 1);
+    lua_pushboolean(L, g_FocusId != 0 && g_FocusId == id.id);
     return 1;
 }
 
-static int l_Text_letterSpacing(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.letterSpacing = (uint16_t)luaL_checkinteger(L, 2);
-    lua_settop(L, 1);
-    return 1;
+// -----------------------------------------------------------------------------
+// Visibility and prefetch hints
+//
+// With clay.trackVisibility(horizon), each finished layout walks the element tree once.
+// Image and custom elements are clipped against the viewport and every clipping
+// ancestor. The result lists the elements that are visible, plus the ones that the
+// scroll velocity of their containers will bring into view within `horizon` seconds,
+// each with its time until visible. Container velocity is measured from the change in
+// scroll position between layouts, so it covers Clay's own scrolling, kinetic
+// controllers and clay.setScrollOffset alike. The frame in which each imageData value
+// was last visible is kept in a weak table for LRU eviction.
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    uint32_t elementId;
+    float position[2];
+    float velocity[2];          // pixels per second, smoothed
+    double time;
+    uint32_t lastFrame;
+} ClayScrollVelocity;
+
+typedef struct {
+    uint32_t elementId;
+    uint8_t isImage;
+    void *data;                 // imageData / customData as declared
+    int32_t anchor;             // frame anchor index of a Lua value, 0: none
+    int32_t order;              // tree order
+    float eta;                  // seconds until visible, 0: visible now
+} ClayVisibleElement;
+
+typedef struct {
+    int32_t element;
+    float clip[4];              // x0, y0, x1, y1
+    float velocity[2];
+} ClayVisibilityNode;
+
+static int g_VisibilityTracking = 0;
+static float g_VisibilityHorizon = 0;
+static ClayScrollVelocity *g_ScrollVelocities = NULL;
+static int32_t g_ScrollVelocityCount = 0;
+static int32_t g_ScrollVelocityCapacity = 0;
+static ClayU32Map g_ScrollVelocityIndex = {0};
+static ClayVisibleElement *g_VisibleElements = NULL;
+static int32_t g_VisibleCount = 0;
+static int32_t g_VisibleCapacity = 0;
+static ClayVisibilityNode *g_VisibilityStack = NULL;
+static int32_t g_VisibilityStackCapacity = 0;
+static int g_ImageSeenRef = LUA_NOREF;              // weak-keyed: imageData -> frame last visible
+
+// Measure every scroll container's velocity from its position change since the last layout.
+static void clay_scroll_velocity_update(Clay_Context *ctx) {
+    for (int32_t i = 0; i < ctx->scrollContainerDatas.length; ++i) {
+        Clay__ScrollContainerDataInternal *d = Clay__ScrollContainerDataInternalArray_Get(&ctx->scrollContainerDatas, i);
+        int32_t idx = clay_u32map_get(&g_ScrollVelocityIndex, d->elementId);
+        if (idx < 0) {
+            if (!clay_array_reserve((void**)&g_ScrollVelocities, &g_ScrollVelocityCapacity, g_ScrollVelocityCount + 1, sizeof(ClayScrollVelocity))) return;
+            idx = g_ScrollVelocityCount++;
+            g_ScrollVelocities[idx] = (ClayScrollVelocity){ d->elementId, { d->scrollPosition.x, d->scrollPosition.y }, { 0, 0 }, g_Now, g_FrameIndex };
+            clay_u32map_put(&g_ScrollVelocityIndex, d->elementId, idx);
+            continue;
+        }
+        ClayScrollVelocity *v = &g_ScrollVelocities[idx];
+        double dt = g_Now - v->time;
+        v->lastFrame = g_FrameIndex;
+        if (dt <= 1e-6) continue;       // clock not advanced: keep the last estimate
+        float p[2] = { d->scrollPosition.x, d->scrollPosition.y };
+        for (int a = 0; a < 2; ++a) {
+            v->velocity[a] = 0.5f * v->velocity[a] + 0.5f * (float)((p[a] - v->position[a]) / dt);
+            v->position[a] = p[a];
+        }
+        v->time = g_Now;
+    }
+
+    // Drop containers that are gone; the map has no delete, so rebuild it.
+    int32_t live = 0;
+    for (int32_t i = 0; i < g_ScrollVelocityCount; ++i) {
+        if (g_ScrollVelocities[i].lastFrame + 60 >= g_FrameIndex) g_ScrollVelocities[live++] = g_ScrollVelocities[i];
+    }
+    if (live != g_ScrollVelocityCount) {
+        g_ScrollVelocityCount = live;
+        clay_u32map_clear(&g_ScrollVelocityIndex);
+        for (int32_t i = 0; i < live; ++i) clay_u32map_put(&g_ScrollVelocityIndex, g_ScrollVelocities[i].elementId, i);
+    }
 }
 
-static int l_Text_lineHeight(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.lineHeight = (uint16_t)luaL_checkinteger(L, 2);
-    lua_settop(L, 1);
-    return 1;
+static void clay_scroll_velocity_of(uint32_t elementId, float out[2]) {
+    int32_t idx = clay_u32map_get(&g_ScrollVelocityIndex, elementId);
+    out[0] = idx >= 0 ? g_ScrollVelocities[idx].velocity[0] : 0;
+    out[1] = idx >= 0 ? g_ScrollVelocities[idx].velocity[1] : 0;
 }
 
-static int l_Text_wrapMode(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.wrapMode = (Clay_TextElementConfigWrapMode)luaL_checkinteger(L, 2);
-    lua_settop(L, 1);
-    return 1;
+static void clay_clip_intersect(float clip[4], Clay_BoundingBox b) {
+    clip[0] = fmaxf(clip[0], b.x);
+    clip[1] = fmaxf(clip[1], b.y);
+    clip[2] = fminf(clip[2], b.x + b.width);
+    clip[3] = fminf(clip[3], b.y + b.height);
 }
 
-static int l_Text_textAlignment(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return luaL_error(L, "text builder is not active (already done?)");
-    t->cfg.textAlignment = (Clay_TextAlignment)luaL_checkinteger(L, 2);
-    lua_settop(L, 1);
-    return 1;
+// Seconds until a box moving at `velocity` overlaps `clip`: 0 when it already does, and
+// a negative number when that will not happen within `horizon`.
+static float clay_visible_in(Clay_BoundingBox b, const float clip[4], const float velocity[2], float horizon) {
+    float box[4] = { b.x, b.y, b.x + b.width, b.y + b.height };
+    if (clip[0] >= clip[2] || clip[1] >= clip[3] || b.width <= 0 || b.height <= 0) return -1.0f;
+    float enter = 0, leave = INFINITY;
+    for (int a = 0; a < 2; ++a) {
+        float lo = box[a], hi = box[a + 2], v = velocity[a];
+        if (v == 0) {
+            if (lo >= clip[a + 2] || hi <= clip[a]) return -1.0f;
+            continue;
+        }
+        float t0 = (v > 0 ? clip[a] - hi : clip[a + 2] - lo) / v;      // starts overlapping
+        float t1 = (v > 0 ? clip[a + 2] - lo : clip[a] - hi) / v;      // stops overlapping
+        if (t0 > enter) enter = t0;
+        if (t1 < leave) leave = t1;
+    }
+    return enter < leave && enter <= horizon ? enter : -1.0f;
 }
 
-static int l_Text_close(lua_State *L) {
-    LuaClayTextBuilder *t = check_text_builder(L, 1);
-    if (!t->active) return 0;
+static int clay_visible_cmp(const void *a, const void *b) {
+    const ClayVisibleElement *x = (const ClayVisibleElement*)a, *y = (const ClayVisibleElement*)b;
+    if (x->eta != y->eta) return x->eta < y->eta ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
 
-    text_builder_emit(t);
-    return 0;
+static void clay_visibility_collect(Clay_Context *ctx) {
+    g_VisibleCount = 0;
+    for (int32_t r = 0; r < ctx->layoutElementTreeRoots.length; ++r) {
+        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&ctx->layoutElementTreeRoots, r);
+        int32_t top = 0;
+        if (!clay_array_reserve((void**)&g_VisibilityStack, &g_VisibilityStackCapacity, 1, sizeof(ClayVisibilityNode))) return;
+        ClayVisibilityNode node = { root->layoutElementIndex, { 0, 0, ctx->layoutDimensions.width, ctx->layoutDimensions.height }, { 0, 0 } };
+        if (root->clipElementId) {
+            clay_clip_intersect(node.clip, Clay__GetHashMapItem(root->clipElementId)->boundingBox);
+            clay_scroll_velocity_of(root->clipElementId, node.velocity);
+        }
+        g_VisibilityStack[top++] = node;
+        while (top > 0) {
+            node = g_VisibilityStack[--top];
+            Clay_LayoutElement *el = Clay_LayoutElementArray_Get(&ctx->layoutElements, node.element);
+            if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) continue;
+            Clay_BoundingBox box = Clay__GetHashMapItem(el->id)->boundingBox;
+            int isImage = Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_IMAGE);
+            if ((isImage || Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_CUSTOM)) && clay_u32map_get(&g_ChartIndex, el->id) < 0) {
+                float eta = clay_visible_in(box, node.clip, node.velocity, g_VisibilityHorizon);
+                if (eta >= 0 && clay_array_reserve((void**)&g_VisibleElements, &g_VisibleCapacity, g_VisibleCount + 1, sizeof(ClayVisibleElement))) {
+                    int32_t order = g_VisibleCount;
+                    void *data = isImage ? Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_IMAGE).imageElementConfig->imageData
+                                         : Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_CUSTOM).customElementConfig->customData;
+                    g_VisibleElements[order] = (ClayVisibleElement){ el->id, (uint8_t)isImage, data, 0, order, eta };
+                    g_VisibleCount++;
+                }
+            }
+            if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_CLIP)) {
+                float v[2];
+                clay_clip_intersect(node.clip, box);
+                clay_scroll_velocity_of(el->id, v);
+                node.velocity[0] += v[0];
+                node.velocity[1] += v[1];
+            }
+            Clay__LayoutElementChildren ch = el->childrenOrTextContent.children;
+            if (!clay_array_reserve((void**)&g_VisibilityStack, &g_VisibilityStackCapacity, top + ch.length, sizeof(ClayVisibilityNode))) return;
+            for (int32_t k = ch.length - 1; k >= 0; --k) {
+                node.element = ch.elements[k];
+                g_VisibilityStack[top++] = node;
+            }
+        }
+    }
+    // Visible first, then by time until visible.
+    qsort(g_VisibleElements, (size_t)g_VisibleCount, sizeof(ClayVisibleElement), clay_visible_cmp);
 }
 
-// Alias for older name (some people prefer :done())
-static int l_Text_done(lua_State *L) {
-    return l_Text_close(L);
+static void clay_push_declared_data(lua_State *L, void *p) {
+    if (clay_is_ref_tag(p)) lua_rawgeti(L, LUA_REGISTRYINDEX, clay_ref_from_tag(p));
+    else if (p) lua_pushlightuserdata(L, p);
+    else lua_pushnil(L);
 }
 
-static int l_Text_gc(lua_State *L) {
-    LuaClayTextBuilder *t = (LuaClayTextBuilder*)luaL_testudata(L, 1, "ClayTextBuilder");
-    if (!t) return 0;
-    if (t->active) {
-        // Builder never done -> prevent leaking tagged ref
-        clay_unref_tagged(L, &t->cfg.userData);
-        t->active = 0;
+// After the post-layout passes, while the declared Lua values are still referenced.
+static void clay_visibility_update(lua_State *L) {
+    Clay_Context *ctx = Clay_GetCurrentContext();
+    if (!g_VisibilityTracking || !ctx) return;
+    clay_scroll_velocity_update(ctx);
+    clay_visibility_collect(ctx);
+
+    if (g_ImageSeenRef == LUA_NOREF) {
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushstring(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        g_ImageSeenRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_ImageSeenRef);
+    for (int32_t i = 0; i < g_VisibleCount; ++i) {
+        ClayVisibleElement *e = &g_VisibleElements[i];
+        if (!e->data) continue;
+        clay_push_declared_data(L, e->data);
+        if (clay_is_ref_tag(e->data)) {
+            clay_frame_anchor(L, -1);       // command accessors may release the ref before it is read
+            e->anchor = g_FrameAnchorCount;
+        }
+        if (e->isImage && e->eta == 0) {
+            lua_pushinteger(L, (lua_Integer)g_FrameIndex);
+            lua_rawset(L, -3);
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+}
+
+static void clay_visibility_clear(lua_State *L) {
+    free(g_ScrollVelocities);
+    free(g_VisibleElements);
+    free(g_VisibilityStack);
+    g_ScrollVelocities = NULL;
+    g_VisibleElements = NULL;
+    g_VisibilityStack = NULL;
+    g_ScrollVelocityCount = g_ScrollVelocityCapacity = 0;
+    g_VisibleCount = g_VisibleCapacity = g_VisibilityStackCapacity = 0;
+    clay_u32map_free(&g_ScrollVelocityIndex);
+    luaL_unref(L, LUA_REGISTRYINDEX, g_ImageSeenRef);
+    g_ImageSeenRef = LUA_NOREF;
+    g_VisibilityTracking = 0;
+}
+
+// clay.trackVisibility(horizon | false)   (horizon in seconds; 0: visible elements only)
+static int l_Clay_TrackVisibility(lua_State *L) {
+    if (lua_isnoneornil(L, 1) || (lua_isboolean(L, 1) && !lua_toboolean(L, 1))) {
+        clay_visibility_clear(L);
+        return 0;
     }
+    float horizon = (float)luaL_checknumber(L, 1);
+    g_VisibilityHorizon = horizon > 0 ? horizon : 0;
+    g_VisibilityTracking = 1;
     return 0;
 }
 
-static void Clay_CreateElementBuilderMetatable(lua_State *L) {
-    if (luaL_newmetatable(L, "ClayElementBuilder")) {
-        lua_pushcfunction(L, l_Elem_layoutDirection); lua_setfield(L, -2, "layoutDirection");
-        lua_pushcfunction(L, l_Elem_childGap); lua_setfield(L, -2, "childGap");
-        lua_pushcfunction(L, l_Elem_childAlignment); lua_setfield(L, -2, "childAlignment");
-        lua_pushcfunction(L, l_Elem_padding); lua_setfield(L, -2, "padding");
-        lua_pushcfunction(L, l_Elem_width); lua_setfield(L, -2, "width");
-        lua_pushcfunction(L, l_Elem_height); lua_setfield(L, -2, "height");
-        lua_pushcfunction(L, l_Elem_backgroundColor); lua_setfield(L, -2, "backgroundColor");
-        lua_pushcfunction(L, l_Elem_cornerRadius); lua_setfield(L, -2, "cornerRadius");
-        lua_pushcfunction(L, l_Elem_borderColor); lua_setfield(L, -2, "borderColor");
-        lua_pushcfunction(L, l_Elem_borderWidth); lua_setfield(L, -2, "borderWidth");
-        lua_pushcfunction(L, l_Elem_clip); lua_setfield(L, -2, "clip");
-        lua_pushcfunction(L, l_Elem_clipHorizontal); lua_setfield(L, -2, "clipHorizontal");
-        lua_pushcfunction(L, l_Elem_clipVertical); lua_setfield(L, -2, "clipVertical");
-        lua_pushcfunction(L, l_Elem_childOffset); lua_setfield(L, -2, "childOffset");
-        lua_pushcfunction(L, l_Elem_aspectRatio); lua_setfield(L, -2, "aspectRatio");
-        lua_pushcfunction(L, l_Elem_imageData); lua_setfield(L, -2, "imageData");
-        lua_pushcfunction(L, l_Elem_customData); lua_setfield(L, -2, "customData");
-        lua_pushcfunction(L, l_Elem_userData); lua_setfield(L, -2, "userData");
+// clay.visibleCount() -> n   (as of the last layout; visible first, then predicted)
+static int l_Clay_VisibleCount(lua_State *L) {
+    lua_pushinteger(L, g_VisibleCount);
+    return 1;
+}
 
-        lua_pushcfunction(L, l_Elem_attachTo); lua_setfield(L, -2, "attachTo");
-        lua_pushcfunction(L, l_Elem_attachPoints); lua_setfield(L, -2, "attachPoints");
-        lua_pushcfunction(L, l_Elem_offset); lua_setfield(L, -2, "offset");
-        lua_pushcfunction(L, l_Elem_expand); lua_setfield(L, -2, "expand");
-        lua_pushcfunction(L, l_Elem_parentId); lua_setfield(L, -2, "parentId");
-        lua_pushcfunction(L, l_Elem_zIndex); lua_setfield(L, -2, "zIndex");
-        lua_pushcfunction(L, l_Elem_pointerCaptureMode); lua_setfield(L, -2, "pointerCaptureMode");
-        lua_pushcfunction(L, l_Elem_clipTo); lua_setfield(L, -2, "clipTo");
+// clay.visibleElement(i) -> elementId, data, eta, commandType
+static int l_Clay_VisibleElement(lua_State *L) {
+    lua_Integer i = luaL_checkinteger(L, 1);
+    if (i < 1 || i > g_VisibleCount) return 0;
+    const ClayVisibleElement *e = &g_VisibleElements[i - 1];
+    lua_pushinteger(L, (lua_Integer)e->elementId);
+    if (e->anchor > 0 && e->anchor <= g_FrameAnchorCount) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, g_FrameAnchorRef);
+        lua_rawgeti(L, -1, e->anchor);
+        lua_remove(L, -2);
+    } else if (e->anchor > 0 || clay_is_ref_tag(e->data)) {
+        lua_pushnil(L);                     // a new frame has begun
+    } else {
+        clay_push_declared_data(L, e->data);
+    }
+    lua_pushnumber(L, e->eta);
+    lua_pushinteger(L, e->isImage ? CLAY_RENDER_COMMAND_TYPE_IMAGE : CLAY_RENDER_COMMAND_TYPE_CUSTOM);
+    return 4;
+}
 
-        lua_pushcfunction(L, l_Elem_children); lua_setfield(L, -2, "children");
-        lua_pushcfunction(L, l_Elem_close); lua_setfield(L, -2, "close");
+// clay.imageAge(data) -> frames since last visible | nil
+static int l_Clay_ImageAge(lua_State *L) {
+    luaL_checkany(L, 1);
+    if (g_ImageSeenRef == LUA_NOREF || lua_isnil(L, 1)) return 0;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_ImageSeenRef);
+    lua_pushvalue(L, 1);
+    lua_rawget(L, -2);
+    if (lua_isnil(L, -1)) return 0;
+    lua_pushinteger(L, (lua_Integer)g_FrameIndex - lua_tointeger(L, -1));
+    return 1;
+}
 
-        lua_pushcfunction(L, l_Elem_gc); lua_setfield(L, -2, "__gc");
-        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+// clay.staleImages(minFrames) -> { data, ... }   (not visible for at least minFrames; forgotten once reported)
+static int l_Clay_StaleImages(lua_State *L) {
+    lua_Integer minFrames = luaL_checkinteger(L, 1);
+    lua_newtable(L);
+    if (g_ImageSeenRef == LUA_NOREF) return 1;
+    int out = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_ImageSeenRef);
+    int seen = lua_gettop(L);
+    int n = 0;
+    lua_pushnil(L);
+    while (lua_next(L, seen)) {
+        if ((lua_Integer)g_FrameIndex - lua_tointeger(L, -1) >= minFrames) {
+            lua_pushvalue(L, -2);
+            lua_rawseti(L, out, ++n);
+            lua_pushvalue(L, -2);
+            lua_pushnil(L);
+            lua_rawset(L, seen);            // clearing existing fields during traversal is allowed
+        }
+        lua_pop(L, 1);
     }
-    lua_pop(L, 1);
+    lua_settop(L, out);
+    return 1;
 }
 
-static void Clay_CreateTextBuilderMetatable(lua_State *L) {
-    if (luaL_newmetatable(L, "ClayTextBuilder")) {
-        lua_pushcfunction(L, l_Text_userData); lua_setfield(L, -2, "userData");
-        lua_pushcfunction(L, l_Text_textColor); lua_setfield(L, -2, "textColor");
-        lua_pushcfunction(L, l_Text_fontId); lua_setfield(L, -2, "fontId");
-        lua_pushcfunction(L, l_Text_fontSize); lua_setfield(L, -2, "fontSize");
-        lua_pushcfunction(L, l_Text_letterSpacing); lua_setfield(L, -2, "letterSpacing");
-        lua_pushcfunction(L, l_Text_lineHeight); lua_setfield(L, -2, "lineHeight");
-        lua_pushcfunction(L, l_Text_wrapMode); lua_setfield(L, -2, "wrapMode");
-        lua_pushcfunction(L, l_Text_textAlignment); lua_setfield(L, -2, "textAlignment");
-        lua_pushcfunction(L, l_Text_close); lua_setfield(L, -2, "close");
-        lua_pushcfunction(L, l_Text_done); lua_setfield(L, -2, "done");
-        lua_pushcfunction(L, l_Text_gc); lua_setfield(L, -2, "__gc");
-        lua_pushvalue(L, -1); lua_setfield(L, -2, "__index");
+// -----------------------------------------------------------------------------
+// Redraw scheduling
+//
+// clay.nextFrameDeadline() tells a host when it next has to lay out and draw.
+// - Right away: while scroll momentum, a kinetic scroll, an animation or a layout
+//   transition is in flight, or when the pointer changed since the last layout.
+// - Later: at the next scheduled change, such as a caret blink.
+// - Never (nil): when nothing will change until new input arrives.
+// -----------------------------------------------------------------------------
+
+static Clay_PointerData g_LayoutPointer;    // pointer as of the last clay.beginLayout()
+
+static int clay_pointer_down(Clay_PointerDataInteractionState s) {
+    return s == CLAY_POINTER_DATA_PRESSED_THIS_FRAME || s == CLAY_POINTER_DATA_PRESSED;
+}
+
+static int clay_frame_needed_now(Clay_Context *ctx) {
+    if (g_AnimRunning || g_PointerQueueCount > 0 || clay_scroll_controllers_active()) return 1;
+    if (!ctx) return 0;
+    const Clay_PointerData *p = &ctx->pointerInfo;
+    if (p->position.x != g_LayoutPointer.position.x || p->position.y != g_LayoutPointer.position.y) return 1;
+    if (clay_pointer_down(p->state) != clay_pointer_down(g_LayoutPointer.state)) return 1;
+    // A press or release seen by the last layout settles into its steady state next frame.
+    if (g_LayoutPointer.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME ||
+        g_LayoutPointer.state == CLAY_POINTER_DATA_RELEASED_THIS_FRAME) return 1;
+    for (int32_t i = 0; i < ctx->scrollContainerDatas.length; ++i) {
+        Clay__ScrollContainerDataInternal *d = Clay__ScrollContainerDataInternalArray_Get(&ctx->scrollContainerDatas, i);
+        if (fabsf(d->scrollMomentum.x) > 0.1f || fabsf(d->scrollMomentum.y) > 0.1f) return 1;
     }
-    lua_pop(L, 1);
+    return 0;
+}
+
+// clay.nextFrameDeadline() -> time, delay | nil   (binding clock seconds; delay is time - clock)
+static int l_Clay_NextFrameDeadline(lua_State *L) {
+    double at = clay_frame_needed_now(Clay_GetCurrentContext()) ? g_Now + g_PendingDt : g_NextWake;
+    if (isinf(at)) return 0;
+    double delay = at - (g_Now + g_PendingDt);
+    lua_pushnumber(L, at);
+    lua_pushnumber(L, delay > 0 ? delay : 0);
+    return 2;
 }
 
 // -----------------------------------------------------------------------------
@@ -1312,6 +10592,8 @@ static int l_Clay_CreateTextElement(lua_State *L) {
     cfg->textAlignment = CLAY_TEXT_ALIGN_LEFT;
     cfg->letterSpacing = 0;
     cfg->lineHeight = 0;
+    uint16_t ellipsisLines = 0;
+    uint8_t ellipsisMode = CLAY_ELLIPSIS_END;
 	
     if (lua_istable(L, 2)) {
         lua_getfield(L, 2, "fontId");
@@ -1346,9 +10628,21 @@ static int l_Clay_CreateTextElement(lua_State *L) {
         lua_getfield(L, 2, "wrapMode");
         if (lua_isnumber(L, -1)) cfg->wrapMode = (Clay_TextElementConfigWrapMode)lua_tointeger(L, -1);
         lua_pop(L, 1);
+
+        lua_getfield(L, 2, "ellipsis");
+        if (lua_isnumber(L, -1)) ellipsisLines = (uint16_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, 2, "ellipsisMode");
+        if (lua_isnumber(L, -1)) ellipsisMode = (uint8_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
     }
     
-	CLAY_TEXT(s, cfg);
+    if (ellipsisLines) {
+        clay_ellipsis_emit(s, cfg, ellipsisLines, ellipsisMode);
+    } else {
+        CLAY_TEXT(s, cfg);
+    }
 
     lua_pushboolean(L, 1);
     return 1;
@@ -1453,6 +10747,31 @@ static int l_Clay_GetElementIdWithIndex(lua_State *L) {
 
 
 static int l_Clay_BeginLayout(lua_State *L) {
+    g_FrameIndex++;
+    if (lua_type(L, 1) == LUA_TNUMBER) g_Now = lua_tonumber(L, 1);
+    else g_Now += g_PendingDt;
+    g_PendingDt = 0;
+    clay_frame_reset();
+    clay_paragraph_cache_sweep();
+    clay_text_runs_sweep();
+    clay_markdown_sweep();
+    clay_chart_frame_reset();
+    clay_canvas_frame_reset(L);
+    clay_nine_slice_frame_reset();
+    clay_payload_frame_reset();
+    clay_anim_sweep();
+    clay_flip_sweep();
+    g_NextWake = INFINITY;
+    clay_pointer_frame_reset();
+    clay_gesture_frame_begin();
+    clay_pointer_queue_resolve();   // against the layout on screen, before Clay resets it
+    g_PointerEventsSeen = g_PointerEventCount;
+    clay_gesture_tick(g_Now);
+    g_GesturesSeen = g_GestureCount;
+    clay_gesture_swap_targets();
+    clay_focus_frame_reset();
+    if (Clay_GetCurrentContext()) g_LayoutPointer = Clay_GetCurrentContext()->pointerInfo;
+    g_EllipsisCount = 0;
     Clay_BeginLayout();
     return 0;
 }
@@ -1464,10 +10783,15 @@ typedef struct {
 
 static int clay_iter_next(lua_State *L) {
     Clay_IteratorState* it = (Clay_IteratorState*)lua_touserdata(L, lua_upvalueindex(1));
-    if (!it || it->index >= it->array.length)
-        return 0;
+    if (!it) return 0;
 
-    Clay_RenderCommand* cmd = &it->array.internalArray[it->index++];
+    Clay_RenderCommand* cmd = NULL;
+    while (it->index < it->array.length) {
+        cmd = &it->array.internalArray[it->index++];
+        if (g_CustomHandlerCount == 0 || cmd->commandType != CLAY_RENDER_COMMAND_TYPE_CUSTOM || !clay_custom_dispatch(cmd)) break;
+        cmd = NULL;
+    }
+    if (!cmd) return 0;
 
     // Wrap pointer as userdata (not lightuserdata so metatable can attach)
     Clay_RenderCommand** udata = (Clay_RenderCommand**)lua_newuserdata(L, sizeof(Clay_RenderCommand*));
@@ -1477,11 +10801,26 @@ static int clay_iter_next(lua_State *L) {
     return 1;
 }
 
+// Binding-side passes over the finished layout, before commands are handed to Lua.
+static void clay_post_layout(Clay_RenderCommandArray *arr) {
+    clay_paragraph_apply(arr);
+    clay_ellipsis_apply(arr);
+    clay_chart_apply(arr);
+    clay_canvas_apply(arr);
+    clay_nine_slice_apply(arr);     // builds the image source table for the final array
+    clay_flip_apply(arr);           // moves boxes in place, after every pass that adds commands
+    clay_scroll_controllers_post_layout();
+    clay_focus_post_layout();
+}
+
 static int l_Clay_EndLayoutIter(lua_State *L) {
     Clay_IteratorState* it = (Clay_IteratorState*)lua_newuserdata(L, sizeof(Clay_IteratorState));
     *it = (Clay_IteratorState){0};
     it->array = Clay_EndLayout();
     it->index = 0;
+    clay_post_layout(&it->array);
+    clay_pointer_queue_resolve();   // events pushed during the pass
+    clay_visibility_update(L);
 
     lua_pushcclosure(L, clay_iter_next, 1);
     return 1;
@@ -1575,6 +10914,45 @@ static int l_ClayCmd_Text(lua_State *L) {
     return 5;
 }
 
+// cmd:textRuns() -> { {text=, fontId=, x=, width=}, ... }
+// Splits a text command by the font each codepoint resolves to in its fallback chain.
+// x is relative to the command's bounds. Without fallbacks there is a single run.
+static int l_ClayCmd_TextRuns(lua_State *L) {
+    Clay_RenderCommand* cmd = checkcmd(L);
+    if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_TEXT) return 0;
+    Clay_TextRenderData *t = &cmd->renderData.text;
+    const char *chars = t->stringContents.chars;
+    int32_t length = t->stringContents.length;
+
+    ClayFontMetrics *fm = clay_font_metrics(t->fontId);
+    ClayTextRunsEntry *runs = fm && fm->fallbackCount > 0 ? clay_text_runs(t->fontId, chars, length) : NULL;
+    int32_t count = runs ? runs->runCount : 1;
+
+    lua_createtable(L, count, 0);
+    float x = 0;
+    for (int32_t r = 0; r < count; ++r) {
+        ClayTextRun run = runs ? runs->runs[r] : (ClayTextRun){ 0, length, t->fontId };
+        float width = cmd->boundingBox.width;
+        if (fm) {
+            int32_t glyphs = 0;
+            width = clay_font_run_width(&g_FontMetrics[run.fontId], chars + run.start, run.length, (float)t->fontSize, &glyphs);
+            if (glyphs > 1) width += (float)t->letterSpacing * (float)(glyphs - 1);
+        }
+        lua_createtable(L, 0, 4);
+        lua_pushlstring(L, chars + run.start, (size_t)run.length);
+        lua_setfield(L, -2, "text");
+        lua_pushinteger(L, run.fontId);
+        lua_setfield(L, -2, "fontId");
+        lua_pushnumber(L, x);
+        lua_setfield(L, -2, "x");
+        lua_pushnumber(L, width);
+        lua_setfield(L, -2, "width");
+        lua_rawseti(L, -2, r + 1);
+        x += width + (float)t->letterSpacing;
+    }
+    return 1;
+}
+
 static int l_ClayCmd_CornerRadius(lua_State *L) {
     Clay_RenderCommand* cmd = checkcmd(L);
     if (cmd->commandType == CLAY_RENDER_COMMAND_TYPE_RECTANGLE) {
@@ -1628,7 +11006,15 @@ static int l_ClayCmd_ImageData(lua_State *L) {
         // It's a registry ref: restore the *original* Lua value
         int ref = clay_ref_from_tag(p);
         lua_rawgeti(L, LUA_REGISTRYINDEX, ref);   // pushes original value
-        
+        if (clay_canvas_ref_lent(ref)) return 1;  // a canvas item's; the item keeps it
+
+        // Slices of one nine-slice image share the ref; the last one read releases it.
+        ClayImageSource *src = clay_image_source(cmd);
+        if (src && src->refSlices && --*src->refSlices > 0) {
+            cmd->renderData.image.imageData = NULL;
+            return 1;
+        }
+
         // IMPORTANT: Calling cmd:imageData() is one-shot per frame per command, if will be null if called more than once
         luaL_unref(L, LUA_REGISTRYINDEX, ref);
         cmd->renderData.image.imageData = NULL;
@@ -1640,6 +11026,43 @@ static int l_ClayCmd_ImageData(lua_State *L) {
     }
 }
 
+// cmd:imageSource() -> x, y, w, h   (IMAGE commands drawing part of their image, in image pixels)
+static int l_ClayCmd_ImageSource(lua_State *L) {
+    Clay_RenderCommand* cmd = checkcmd(L);
+    if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_IMAGE) return 0;
+    ClayImageSource *src = clay_image_source(cmd);
+    if (!src || !src->hasRect) return 0;
+    lua_pushnumber(L, src->x);
+    lua_pushnumber(L, src->y);
+    lua_pushnumber(L, src->w);
+    lua_pushnumber(L, src->h);
+    return 4;
+}
+
+// cmd:atlas() -> page, u0, v0, u1, v1   (IMAGE commands whose imageData is an atlas handle)
+// The UV rectangle covers cmd:imageSource() when the command draws part of its image.
+static int l_ClayCmd_Atlas(lua_State *L) {
+    Clay_RenderCommand* cmd = checkcmd(L);
+    if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_IMAGE) return 0;
+    const ClayAtlasPlacement *pl = clay_atlas_placement(cmd->renderData.image.imageData);
+    if (!pl) return 0;
+    float x = (float)pl->x, y = (float)pl->y, w = (float)pl->w, h = (float)pl->h;
+    const ClayImageSource *src = clay_image_source(cmd);
+    if (src && src->hasRect) {
+        x += src->x;
+        y += src->y;
+        w = src->w;
+        h = src->h;
+    }
+    float pw = (float)pl->atlas->pageWidth, ph = (float)pl->atlas->pageHeight;
+    lua_pushinteger(L, pl->page + 1);
+    lua_pushnumber(L, x / pw);
+    lua_pushnumber(L, y / ph);
+    lua_pushnumber(L, (x + w) / pw);
+    lua_pushnumber(L, (y + h) / ph);
+    return 5;
+}
+
 static int l_ClayCmd_CustomData(lua_State *L) {
     Clay_RenderCommand* cmd = checkcmd(L);
     if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_CUSTOM)
@@ -1686,6 +11109,44 @@ static int l_ClayCmd_UserData(lua_State *L) {
     }
 }
 
+// cmd:payload() -> tag, v1, ..., vN   (CUSTOM commands of elements built with :payload)
+static int l_ClayCmd_Payload(lua_State *L) {
+    Clay_RenderCommand* cmd = checkcmd(L);
+    const ClayCustomPayload *p = clay_payload_of_command(cmd);
+    if (!p) return 0;
+    luaL_checkstack(L, p->count + 1, "payload");
+    lua_pushinteger(L, (lua_Integer)p->tag);
+    for (int32_t i = 0; i < p->count; ++i) lua_pushnumber(L, (lua_Number)p->values[i]);
+    return p->count + 1;
+}
+
+// cmd:chart([into]) -> points, count
+// The decimated series of a chart command as a flat { x1, y1, x2, y2, ... } array in screen
+// space; `into` is reused (and not shrunk) when given.
+static int l_ClayCmd_Chart(lua_State *L) {
+    Clay_RenderCommand* cmd = checkcmd(L);
+    ClayChartPlot *p = clay_chart_of_command(cmd);
+    if (!p) return 0;
+    if (lua_istable(L, 2)) lua_settop(L, 2);
+    else lua_createtable(L, p->pointCount * 2, 0);
+    for (int32_t i = 0; i < p->pointCount * 2; ++i) {
+        lua_pushnumber(L, p->points[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushinteger(L, p->pointCount);
+    return 2;
+}
+
+// cmd:chartBuffer() -> lightuserdata, count   (count x, y float pairs; valid until the next layout)
+static int l_ClayCmd_ChartBuffer(lua_State *L) {
+    Clay_RenderCommand* cmd = checkcmd(L);
+    ClayChartPlot *p = clay_chart_of_command(cmd);
+    if (!p) return 0;
+    lua_pushlightuserdata(L, p->points);
+    lua_pushinteger(L, p->pointCount);
+    return 2;
+}
+
 static int l_ClayCmd_Clip(lua_State *L) {
     Clay_RenderCommand* cmd = checkcmd(L);
     if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_SCISSOR_START &&
@@ -1712,6 +11173,9 @@ static void Clay_CreateCommandMetatable(lua_State *L) {
 
         lua_pushcfunction(L, l_ClayCmd_Text);
         lua_setfield(L, -2, "text");
+
+        lua_pushcfunction(L, l_ClayCmd_TextRuns);
+        lua_setfield(L, -2, "textRuns");
         
         lua_pushcfunction(L, l_ClayCmd_CornerRadius);
 		lua_setfield(L, -2, "cornerRadius");
@@ -1722,11 +11186,24 @@ static void Clay_CreateCommandMetatable(lua_State *L) {
 		lua_pushcfunction(L, l_ClayCmd_ImageData);
 		lua_setfield(L, -2, "imageData");
 
+		lua_pushcfunction(L, l_ClayCmd_ImageSource);
+		lua_setfield(L, -2, "imageSource");
+		lua_pushcfunction(L, l_ClayCmd_Atlas);
+		lua_setfield(L, -2, "atlas");
+
 		lua_pushcfunction(L, l_ClayCmd_CustomData);
 		lua_setfield(L, -2, "customData");
+		lua_pushcfunction(L, l_ClayCmd_Payload);
+		lua_setfield(L, -2, "payload");
 
 		lua_pushcfunction(L, l_ClayCmd_UserData);
 		lua_setfield(L, -2, "userData");
+
+		lua_pushcfunction(L, l_ClayCmd_Chart);
+		lua_setfield(L, -2, "chart");
+
+		lua_pushcfunction(L, l_ClayCmd_ChartBuffer);
+		lua_setfield(L, -2, "chartBuffer");
 				
 		lua_pushcfunction(L, l_ClayCmd_Clip);
 		lua_setfield(L, -2, "clip");
@@ -1761,7 +11238,10 @@ static int l_Clay_UpdateScrollContainers(lua_State *L) {
     double dx = luaL_checknumber(L, 2);
     double dy = luaL_checknumber(L, 3);
     double dt = luaL_checknumber(L, 4);
+    if (dt > 0) g_PendingDt += dt;
+    clay_scroll_controllers_sync();
     Clay_UpdateScrollContainers(enable, (Clay_Vector2){(float)dx, (float)dy}, (float)dt);
+    clay_scroll_controllers_update(enable, (Clay_Vector2){(float)dx, (float)dy}, dt > 0 ? (float)dt : 0.0f);
     return 0;
 }
 
@@ -1787,6 +11267,19 @@ static int l_Clay_GetElementData(lua_State *L) {
     return 1;
 }
 
+// clay.boundsDelta(id...) -> dx, dy, dw, dh   (change between the last two layouts of a tracked element)
+static int l_Clay_BoundsDelta(lua_State *L) {
+    Clay_ElementId id = clay_element_id_from_args(L, 1);
+    int32_t idx = clay_u32map_get(&g_FlipIndex, id.id);
+    if (idx < 0 || !g_Flips[idx].hasBox) return 0;
+    const ClayFlipState *f = &g_Flips[idx];
+    lua_pushnumber(L, f->current.x - f->previous.x);
+    lua_pushnumber(L, f->current.y - f->previous.y);
+    lua_pushnumber(L, f->current.width - f->previous.width);
+    lua_pushnumber(L, f->current.height - f->previous.height);
+    return 4;
+}
+
 static void ClayErrorPrinter(Clay_ErrorData err) {
     fprintf(stderr, "[Clay Error] %.*s\n", (int)err.errorText.length, err.errorText.chars);
     switch(err.errorType) {
@@ -1827,9 +11320,130 @@ static int l_Clay_Initialize(lua_State *L) {
     return 2;
 }
 
+// ---- clay.measureSubtree: lay out declarations in a scratch context ----
+static Clay_Context *g_MeasureContext = NULL;
+static void *g_MeasureArenaMem = NULL;
+static ClayU32Map g_MeasureRefs = {0};
+
+// Release a tagged ref once per measurement (g_MeasureRefs is cleared by the caller).
+static void clay_measure_release_ref(lua_State *L, void *p) {
+    if (!p || !clay_is_ref_tag(p)) return;
+    int ref = clay_ref_from_tag(p);
+    if (ref <= 0 || clay_u32map_get(&g_MeasureRefs, (uint32_t)ref) >= 0) return;
+    clay_u32map_put(&g_MeasureRefs, (uint32_t)ref, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+}
+
+// The scratch layout is never rendered, so release the Lua values its elements hold. The
+// configs are walked rather than the commands: an element without a background emits no
+// command but can still carry userData, and after an error in fn there are no commands.
+// One ref can sit on several configs.
+static void clay_measure_release_refs(lua_State *L, Clay_Context *ctx) {
+    clay_u32map_clear(&g_MeasureRefs);
+    for (int32_t i = 0; i < ctx->layoutElements.length; ++i) {
+        Clay_LayoutElement *el = Clay_LayoutElementArray_Get(&ctx->layoutElements, i);
+        if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_SHARED)) {
+            clay_measure_release_ref(L, Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_SHARED).sharedElementConfig->userData);
+        }
+        if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+            clay_measure_release_ref(L, Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_TEXT).textElementConfig->userData);
+        }
+        if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_IMAGE)) {
+            clay_measure_release_ref(L, Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_IMAGE).imageElementConfig->imageData);
+        }
+        if (Clay__ElementHasConfig(el, CLAY__ELEMENT_CONFIG_TYPE_CUSTOM)) {
+            clay_measure_release_ref(L, Clay__FindElementConfigWithType(el, CLAY__ELEMENT_CONFIG_TYPE_CUSTOM).customElementConfig->customData);
+        }
+    }
+}
+
+// clay.measureSubtree(fn [, maxW [, maxH]]) -> width, height
+// Runs fn's declarations inside a fit-sized, top-to-bottom container in a scratch Clay
+// context and returns the container's size. Nothing reaches the current frame.
+static int l_Clay_MeasureSubtree(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    float maxW = (float)luaL_optnumber(L, 2, 1e6);
+    float maxH = (float)luaL_optnumber(L, 3, 1e6);
+    luaL_argcheck(L, maxW >= 0, 2, "max width must not be negative");
+    luaL_argcheck(L, maxH >= 0, 3, "max height must not be negative");
+    Clay_Context *frameContext = Clay_GetCurrentContext();
+    if (!frameContext) return luaL_error(L, "measureSubtree: clay is not initialized");
+    if (g_MeasureDepth) return luaL_error(L, "measureSubtree: calls cannot be nested");
+
+    if (!g_MeasureContext) {
+        size_t capacity = Clay_MinMemorySize();        // sized for the main context's element limit
+        g_MeasureArenaMem = malloc(capacity);
+        if (!g_MeasureArenaMem) return luaL_error(L, "measureSubtree: out of memory");
+        g_MeasureContext = Clay_Initialize(Clay_CreateArenaWithCapacityAndMemory(capacity, g_MeasureArenaMem),
+                                           (Clay_Dimensions){ maxW, maxH }, (Clay_ErrorHandler){ ClayErrorPrinter, NULL });
+        Clay_SetCurrentContext(frameContext);
+        if (!g_MeasureContext) {
+            free(g_MeasureArenaMem);
+            g_MeasureArenaMem = NULL;
+            return luaL_error(L, "measureSubtree: could not create the scratch context");
+        }
+    }
+
+    Clay_SetCurrentContext(g_MeasureContext);
+    Clay_SetLayoutDimensions((Clay_Dimensions){ maxW, maxH });
+    Clay_BeginLayout();
+    Clay_ElementDeclaration decl = (Clay_ElementDeclaration){0};
+    decl.layout = CLAY_LAYOUT_DEFAULT;
+    decl.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    decl.layout.sizing.width = (Clay_SizingAxis){ .size.minMax = { 0, maxW }, .type = CLAY__SIZING_TYPE_FIT };
+    decl.layout.sizing.height = (Clay_SizingAxis){ .size.minMax = { 0, maxH }, .type = CLAY__SIZING_TYPE_FIT };
+    Clay__OpenElement();
+    Clay__ConfigureOpenElement(CLAY__CONFIG_WRAPPER(Clay_ElementDeclaration, decl));
+
+    g_MeasureDepth++;
+    lua_pushvalue(L, 1);
+    int status = lua_pcall(L, 0, 0, 0);
+    g_MeasureDepth--;
+    if (status != 0) {
+        // The scratch tree may be left unbalanced; the next call's BeginLayout resets it.
+        clay_measure_release_refs(L, g_MeasureContext);
+        Clay_SetCurrentContext(frameContext);
+        return lua_error(L);
+    }
+
+    Clay__CloseElement();
+    Clay_EndLayout();
+    Clay_Dimensions size = { 0, 0 };
+    if (g_MeasureContext->layoutElements.length > 1) {
+        size = Clay_LayoutElementArray_Get(&g_MeasureContext->layoutElements, 1)->dimensions;   // [0] is Clay's root
+    }
+    clay_measure_release_refs(L, g_MeasureContext);
+    Clay_SetCurrentContext(frameContext);
+
+    lua_pushnumber(L, size.width);
+    lua_pushnumber(L, size.height);
+    return 2;
+}
 
 static int l_Clay_Shutdown(lua_State* L) {
-    (void)L;
+    clay_paragraph_cache_free();
+    clay_u32map_free(&g_ParagraphRefLines);
+    clay_text_runs_clear();
+    clay_markdown_clear();
+    clay_chart_clear();
+    clay_nine_slice_clear();
+    clay_payload_clear();
+    clay_anim_clear();
+    clay_flip_clear();
+    clay_scroll_controllers_clear();
+    clay_pointer_queue_clear();
+    clay_gesture_clear();
+    clay_focus_clear();
+    clay_visibility_clear(L);
+    clay_canvas_frames_free(L);
+    luaL_unref(L, LUA_REGISTRYINDEX, g_FrameAnchorRef);
+    g_FrameAnchorRef = LUA_NOREF;
+    g_FrameAnchorCount = 0;
+    g_EllipsisCount = 0;
+    free(g_MeasureArenaMem);
+    g_MeasureArenaMem = NULL;
+    g_MeasureContext = NULL;
+    clay_u32map_free(&g_MeasureRefs);
     if (g_ClayArenaMem) {
         free(g_ClayArenaMem);
         g_ClayArenaMem = NULL;
@@ -2034,6 +11648,8 @@ static int l_Clay_SetMaxMeasureTextCacheWordCount(lua_State *L) {
 
 static int l_Clay_ResetMeasureTextCache(lua_State *L) {
     Clay_ResetMeasureTextCache();
+    clay_paragraph_cache_clear();
+    clay_markdown_relayout();
     return 0;
 }
 
@@ -2183,12 +11799,27 @@ int luaopen_clay(lua_State *L) {
     // Core layout
     lua_pushcfunction(L, l_Clay_BeginLayout); lua_setfield(L, -2, "beginLayout");
     lua_pushcfunction(L, l_Clay_EndLayoutIter); lua_setfield(L, -2, "endLayoutIter");
+    lua_pushcfunction(L, l_Clay_SetCustomHandler); lua_setfield(L, -2, "setCustomHandler");
+    lua_pushcfunction(L, l_Clay_IsAnimating); lua_setfield(L, -2, "isAnimating");
+    lua_pushcfunction(L, l_Clay_BoundsDelta); lua_setfield(L, -2, "boundsDelta");
+    lua_pushcfunction(L, l_Clay_MeasureSubtree); lua_setfield(L, -2, "measureSubtree");
+    lua_pushcfunction(L, l_Clay_NextFrameDeadline); lua_setfield(L, -2, "nextFrameDeadline");
     lua_pushcfunction(L, l_Clay_CreateElement); lua_setfield(L, -2, "createElement");
     lua_pushcfunction(L, l_Clay_CreateTextElement); lua_setfield(L, -2, "createTextElement");
 
     // Fluent builders (no table churn)
     lua_pushcfunction(L, l_Clay_ElementBuilder_New); lua_setfield(L, -2, "element");
     lua_pushcfunction(L, l_Clay_TextBuilder_New); lua_setfield(L, -2, "text");
+    lua_pushcfunction(L, l_Clay_DataGrid_New); lua_setfield(L, -2, "dataGrid");
+    lua_pushcfunction(L, l_Clay_LogView_New); lua_setfield(L, -2, "logView");
+    lua_pushcfunction(L, l_Clay_TreeView_New); lua_setfield(L, -2, "treeView");
+    lua_pushcfunction(L, l_Clay_TextEditor_New); lua_setfield(L, -2, "textEditor");
+    lua_pushcfunction(L, l_Clay_Syntax_New); lua_setfield(L, -2, "syntax");
+    lua_pushcfunction(L, l_Clay_Markdown); lua_setfield(L, -2, "markdown");
+    lua_pushcfunction(L, l_Clay_MarkdownLinkAt); lua_setfield(L, -2, "markdownLinkAt");
+    lua_pushcfunction(L, l_Clay_Series_New); lua_setfield(L, -2, "series");
+    lua_pushcfunction(L, l_Clay_Canvas_New); lua_setfield(L, -2, "canvas");
+    lua_pushcfunction(L, l_Clay_Atlas_New); lua_setfield(L, -2, "atlas");
     lua_pushcfunction(L, l_Clay_Id); lua_setfield(L, -2, "id");
     lua_pushcfunction(L, l_Clay_AutoId); lua_setfield(L, -2, "autoId");
     lua_pushcfunction(L, l_Clay_GetLastElementId); lua_setfield(L, -2, "getLastElementId");
@@ -2213,9 +11844,29 @@ int luaopen_clay(lua_State *L) {
     lua_pushcfunction(L, l_Clay_CreateArenaWithCapacityAndMemory); lua_setfield(L, -2, "createArenaWithCapacityAndMemory");
     lua_pushcfunction(L, l_Clay_Hovered); lua_setfield(L, -2, "hovered");
     lua_pushcfunction(L, l_Clay_PointerOver); lua_setfield(L, -2, "pointerOver");
+    lua_pushcfunction(L, l_Clay_PushPointerEvent); lua_setfield(L, -2, "pushPointerEvent");
+    lua_pushcfunction(L, l_Clay_PointerEventCount); lua_setfield(L, -2, "pointerEventCount");
+    lua_pushcfunction(L, l_Clay_PointerEvent); lua_setfield(L, -2, "pointerEvent");
+    lua_pushcfunction(L, l_Clay_PointerEventOver); lua_setfield(L, -2, "pointerEventOver");
+    lua_pushcfunction(L, l_Clay_Clicked); lua_setfield(L, -2, "clicked");
+    lua_pushcfunction(L, l_Clay_GestureCount); lua_setfield(L, -2, "gestureCount");
+    lua_pushcfunction(L, l_Clay_Gesture); lua_setfield(L, -2, "gesture");
+    lua_pushcfunction(L, l_Clay_GestureOn); lua_setfield(L, -2, "gestureOn");
+    lua_pushcfunction(L, l_Clay_SetGestureOptions); lua_setfield(L, -2, "setGestureOptions");
+    lua_pushcfunction(L, l_Clay_FocusNext); lua_setfield(L, -2, "focusNext");
+    lua_pushcfunction(L, l_Clay_SetFocus); lua_setfield(L, -2, "setFocus");
+    lua_pushcfunction(L, l_Clay_FocusedId); lua_setfield(L, -2, "focusedId");
+    lua_pushcfunction(L, l_Clay_HasFocus); lua_setfield(L, -2, "hasFocus");
+    lua_pushcfunction(L, l_Clay_TrackVisibility); lua_setfield(L, -2, "trackVisibility");
+    lua_pushcfunction(L, l_Clay_VisibleCount); lua_setfield(L, -2, "visibleCount");
+    lua_pushcfunction(L, l_Clay_VisibleElement); lua_setfield(L, -2, "visibleElement");
+    lua_pushcfunction(L, l_Clay_ImageAge); lua_setfield(L, -2, "imageAge");
+    lua_pushcfunction(L, l_Clay_StaleImages); lua_setfield(L, -2, "staleImages");
     lua_pushcfunction(L, l_Clay_GetScrollContainerData); lua_setfield(L, -2, "getScrollContainerData");
     lua_pushcfunction(L, l_Clay_SetScrollContainerPosition); lua_setfield(L, -2, "setScrollContainerPosition");
     lua_pushcfunction(L, l_Clay_SetScrollOffset); lua_setfield(L, -2, "setScrollOffset");
+    lua_pushcfunction(L, l_Clay_SetScrollPhysics); lua_setfield(L, -2, "setScrollPhysics");
+    lua_pushcfunction(L, l_Clay_ScrollTo); lua_setfield(L, -2, "scrollTo");
     lua_pushcfunction(L, l_Clay_SetDebugModeEnabled); lua_setfield(L, -2, "setDebugModeEnabled");
     lua_pushcfunction(L, l_Clay_IsDebugModeEnabled); lua_setfield(L, -2, "isDebugModeEnabled");
     lua_pushcfunction(L, l_Clay_SetCullingEnabled); lua_setfield(L, -2, "setCullingEnabled");
@@ -2225,9 +11876,12 @@ int luaopen_clay(lua_State *L) {
     lua_pushcfunction(L, l_Clay_GetMaxMeasureTextCacheWordCount); lua_setfield(L, -2, "getMaxMeasureTextCacheWordCount");
     lua_pushcfunction(L, l_Clay_SetMaxMeasureTextCacheWordCount); lua_setfield(L, -2, "setMaxMeasureTextCacheWordCount");
     lua_pushcfunction(L, l_Clay_ResetMeasureTextCache); lua_setfield(L, -2, "resetMeasureTextCache");
+    lua_pushcfunction(L, l_Clay_ClearParagraphCache); lua_setfield(L, -2, "clearParagraphCache");
 
     // Custom hooks
     lua_pushcfunction(L, l_Clay_SetMeasureTextFunction); lua_setfield(L, -2, "setMeasureTextFunction");
+    lua_pushcfunction(L, l_Clay_SetFontMetrics); lua_setfield(L, -2, "setFontMetrics");
+    lua_pushcfunction(L, l_Clay_SetFontFallback); lua_setfield(L, -2, "setFontFallback");
 
     // Helper functions for creating configs
     lua_pushcfunction(L, l_Clay_SizingFixed); lua_setfield(L, -2, "sizingFixed");
@@ -2283,6 +11937,43 @@ int luaopen_clay(lua_State *L) {
     lua_pushinteger(L, CLAY_TEXT_WRAP_WORDS); lua_setfield(L, -2, "WRAP_MODE_WORDS");
     lua_pushinteger(L, CLAY_TEXT_WRAP_NEWLINES); lua_setfield(L, -2, "WRAP_MODE_NEWLINES");
 
+    // Text truncation modes
+    lua_pushinteger(L, CLAY_ELLIPSIS_END); lua_setfield(L, -2, "ELLIPSIS_END");
+    lua_pushinteger(L, CLAY_ELLIPSIS_MIDDLE); lua_setfield(L, -2, "ELLIPSIS_MIDDLE");
+    lua_pushinteger(L, CLAY_ELLIPSIS_START); lua_setfield(L, -2, "ELLIPSIS_START");
+
+    // Data grid column types
+    lua_pushinteger(L, CLAY_GRID_NUMBER); lua_setfield(L, -2, "GRID_NUMBER");
+    lua_pushinteger(L, CLAY_GRID_STRING); lua_setfield(L, -2, "GRID_STRING");
+    lua_pushinteger(L, CLAY_CARET_LEFT); lua_setfield(L, -2, "CARET_LEFT");
+    lua_pushinteger(L, CLAY_CARET_RIGHT); lua_setfield(L, -2, "CARET_RIGHT");
+    lua_pushinteger(L, CLAY_CARET_UP); lua_setfield(L, -2, "CARET_UP");
+    lua_pushinteger(L, CLAY_CARET_DOWN); lua_setfield(L, -2, "CARET_DOWN");
+    lua_pushinteger(L, CLAY_CARET_WORD_LEFT); lua_setfield(L, -2, "CARET_WORD_LEFT");
+    lua_pushinteger(L, CLAY_CARET_WORD_RIGHT); lua_setfield(L, -2, "CARET_WORD_RIGHT");
+    lua_pushinteger(L, CLAY_CARET_LINE_START); lua_setfield(L, -2, "CARET_LINE_START");
+    lua_pushinteger(L, CLAY_CARET_LINE_END); lua_setfield(L, -2, "CARET_LINE_END");
+    lua_pushinteger(L, CLAY_CARET_DOC_START); lua_setfield(L, -2, "CARET_DOC_START");
+    lua_pushinteger(L, CLAY_CARET_DOC_END); lua_setfield(L, -2, "CARET_DOC_END");
+    lua_pushinteger(L, CLAY_CHART_LINE); lua_setfield(L, -2, "CHART_LINE");
+    lua_pushinteger(L, CLAY_CHART_COLUMNS); lua_setfield(L, -2, "CHART_COLUMNS");
+    lua_pushinteger(L, CLAY_EASE_LINEAR); lua_setfield(L, -2, "EASE_LINEAR");
+    lua_pushinteger(L, CLAY_EASE_IN); lua_setfield(L, -2, "EASE_IN");
+    lua_pushinteger(L, CLAY_EASE_OUT); lua_setfield(L, -2, "EASE_OUT");
+    lua_pushinteger(L, CLAY_EASE_IN_OUT); lua_setfield(L, -2, "EASE_IN_OUT");
+    lua_pushinteger(L, CLAY_POINTER_MOVE); lua_setfield(L, -2, "POINTER_MOVE");
+    lua_pushinteger(L, CLAY_POINTER_PRESS); lua_setfield(L, -2, "POINTER_PRESS");
+    lua_pushinteger(L, CLAY_POINTER_RELEASE); lua_setfield(L, -2, "POINTER_RELEASE");
+    lua_pushinteger(L, CLAY_GESTURE_TAP); lua_setfield(L, -2, "GESTURE_TAP");
+    lua_pushinteger(L, CLAY_GESTURE_DOUBLE_TAP); lua_setfield(L, -2, "GESTURE_DOUBLE_TAP");
+    lua_pushinteger(L, CLAY_GESTURE_LONG_PRESS); lua_setfield(L, -2, "GESTURE_LONG_PRESS");
+    lua_pushinteger(L, CLAY_GESTURE_DRAG_START); lua_setfield(L, -2, "GESTURE_DRAG_START");
+    lua_pushinteger(L, CLAY_GESTURE_DRAG); lua_setfield(L, -2, "GESTURE_DRAG");
+    lua_pushinteger(L, CLAY_GESTURE_DRAG_END); lua_setfield(L, -2, "GESTURE_DRAG_END");
+    lua_pushinteger(L, CLAY_GESTURE_PINCH_START); lua_setfield(L, -2, "GESTURE_PINCH_START");
+    lua_pushinteger(L, CLAY_GESTURE_PINCH); lua_setfield(L, -2, "GESTURE_PINCH");
+    lua_pushinteger(L, CLAY_GESTURE_PINCH_END); lua_setfield(L, -2, "GESTURE_PINCH_END");
+
     // Export layout direction constants
     lua_pushinteger(L, CLAY_LEFT_TO_RIGHT); lua_setfield(L, -2, "LEFT_TO_RIGHT");
     lua_pushinteger(L, CLAY_TOP_TO_BOTTOM); lua_setfield(L, -2, "TOP_TO_BOTTOM");
@@ -2319,5 +12010,15 @@ int luaopen_clay(lua_State *L) {
 	Clay_CreateElementBuilderMetatable(L);
 	Clay_CreateTextBuilderMetatable(L);
 
+	// Components
+	Clay_CreateDataGridMetatable(L);
+	Clay_CreateLogViewMetatable(L);
+	Clay_CreateTreeViewMetatable(L);
+	Clay_CreateSyntaxMetatable(L);
+	Clay_CreateTextEditorMetatable(L);
+	Clay_CreateSeriesMetatable(L);
+	Clay_CreateCanvasMetatable(L);
+	Clay_CreateAtlasMetatable(L);
+
     return 1;
 }